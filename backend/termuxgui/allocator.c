@@ -2,6 +2,7 @@
 #include <dlfcn.h>
 #include <malloc.h>
 #include <pthread.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include <drm_fourcc.h>
@@ -13,6 +14,26 @@
 static const struct wlr_buffer_impl buffer_impl;
 static const struct wlr_allocator_interface allocator_impl;
 
+static const struct {
+    uint32_t drm_format;
+    tgui_hardware_buffer_format tgui_format;
+} formats[] = {
+    {DRM_FORMAT_ABGR8888, TGUI_HARDWARE_BUFFER_FORMAT_RGBA8888},
+    {DRM_FORMAT_XBGR8888, TGUI_HARDWARE_BUFFER_FORMAT_RGBX8888},
+    {DRM_FORMAT_RGB565, TGUI_HARDWARE_BUFFER_FORMAT_RGB565},
+};
+
+static bool get_tgui_format(uint32_t drm_format,
+                            tgui_hardware_buffer_format *tgui_format) {
+    for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+        if (formats[i].drm_format == drm_format) {
+            *tgui_format = formats[i].tgui_format;
+            return true;
+        }
+    }
+    return false;
+}
+
 struct wlr_tgui_buffer *
 tgui_buffer_from_buffer(struct wlr_buffer *wlr_buffer) {
     assert(wlr_buffer->impl == &buffer_impl);
@@ -29,16 +50,159 @@ tgui_allocator_from_allocator(struct wlr_allocator *wlr_allocator) {
     return alloc;
 }
 
+/**
+ * Foreign buffer which doesn't share its memory with any of the buffers the
+ * allocator had when it was last checked.
+ */
+struct tgui_poisoned_buffer {
+    struct wlr_addon addon;
+    uint64_t buffers_generation;
+};
+
+static void poisoned_buffer_handle_destroy(struct wlr_addon *addon) {
+    struct tgui_poisoned_buffer *poisoned =
+        wl_container_of(addon, poisoned, addon);
+    wlr_addon_finish(addon);
+    free(poisoned);
+}
+
+static const struct wlr_addon_interface poisoned_buffer_addon_impl = {
+    .name = "wlr_tgui_poisoned_buffer",
+    .destroy = poisoned_buffer_handle_destroy,
+};
+
+static struct tgui_poisoned_buffer *
+find_poisoned_buffer(struct wlr_tgui_allocator *alloc,
+                     struct wlr_buffer *wlr_buffer) {
+    struct wlr_addon *addon = wlr_addon_find(&wlr_buffer->addons, alloc,
+                                             &poisoned_buffer_addon_impl);
+    if (addon == NULL) {
+        return NULL;
+    }
+    struct tgui_poisoned_buffer *poisoned =
+        wl_container_of(addon, poisoned, addon);
+    return poisoned;
+}
+
+/**
+ * Remember that a foreign buffer can't be imported, so that the next attempts
+ * don't pay for the lookup until the allocator creates new buffers.
+ */
+static void poison_buffer(struct wlr_tgui_allocator *alloc,
+                          struct wlr_buffer *wlr_buffer) {
+    struct tgui_poisoned_buffer *poisoned =
+        find_poisoned_buffer(alloc, wlr_buffer);
+    if (poisoned == NULL) {
+        poisoned = calloc(1, sizeof(*poisoned));
+        if (poisoned == NULL) {
+            wlr_log_errno(WLR_ERROR, "Allocation failed");
+            return;
+        }
+        wlr_addon_init(&poisoned->addon, &wlr_buffer->addons, alloc,
+                       &poisoned_buffer_addon_impl);
+    }
+    poisoned->buffers_generation = alloc->buffers_generation;
+}
+
+struct wlr_tgui_buffer *tgui_buffer_import(struct wlr_allocator *wlr_allocator,
+                                           struct wlr_buffer *wlr_buffer) {
+    if (wlr_buffer->impl == &buffer_impl) {
+        return tgui_buffer_from_buffer(wlr_buffer);
+    }
+    // Clients can't get hold of our hardware buffers, so theirs never share
+    // memory with them: don't look their dmabufs up on every frame
+    if (wlr_allocator == NULL || wlr_client_buffer_get(wlr_buffer) != NULL) {
+        return NULL;
+    }
+
+    // Scan-out is attempted on every frame of a fullscreen client, don't
+    // look up its buffers again when nothing changed
+    struct wlr_tgui_allocator *alloc =
+        tgui_allocator_from_allocator(wlr_allocator);
+    struct tgui_poisoned_buffer *poisoned =
+        find_poisoned_buffer(alloc, wlr_buffer);
+    if (poisoned != NULL &&
+        poisoned->buffers_generation == alloc->buffers_generation) {
+        return NULL;
+    }
+
+    // A foreign dmabuf can only be presented if it shares its memory with one
+    // of our hardware buffers, the surface view can't take anything else
+    struct wlr_dmabuf_attributes dmabuf;
+    if (!wlr_buffer_get_dmabuf(wlr_buffer, &dmabuf)) {
+        return NULL;
+    }
+    if (dmabuf.n_planes != 1 || dmabuf.offset[0] != 0 ||
+        (dmabuf.modifier != DRM_FORMAT_MOD_LINEAR &&
+         dmabuf.modifier != DRM_FORMAT_MOD_INVALID)) {
+        poison_buffer(alloc, wlr_buffer);
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(dmabuf.fd[0], &st) != 0) {
+        poison_buffer(alloc, wlr_buffer);
+        return NULL;
+    }
+
+    struct wlr_tgui_buffer *buffer;
+    wl_list_for_each(buffer, &alloc->buffers, allocator_link) {
+        if (buffer->dmabuf_dev == st.st_dev &&
+            buffer->dmabuf_ino == st.st_ino &&
+            buffer->format == dmabuf.format &&
+            buffer->dmabuf.stride[0] == dmabuf.stride[0] &&
+            buffer->wlr_buffer.width == wlr_buffer->width &&
+            buffer->wlr_buffer.height == wlr_buffer->height) {
+            return buffer;
+        }
+    }
+    poison_buffer(alloc, wlr_buffer);
+    return NULL;
+}
+
+static void pool_recycle(struct wlr_tgui_allocator *alloc,
+                         struct wlr_tgui_pool_buffer *pool_buffer);
+
 static void buffer_destroy(struct wlr_buffer *wlr_buffer) {
     struct wlr_tgui_buffer *buffer = tgui_buffer_from_buffer(wlr_buffer);
+    wl_list_remove(&buffer->allocator_link);
+
+    struct wlr_tgui_allocator *alloc = buffer->allocator;
+    if (alloc == NULL) {
+        wlr_dmabuf_attributes_finish(&buffer->dmabuf);
+        tgui_hardware_buffer_destroy(buffer->conn, &buffer->buffer);
+        free(buffer);
+        return;
+    }
+
     if (buffer->data) {
-        buffer->allocator->AHardwareBuffer_unlock(buffer->buffer.buffer,
-                                                  NULL);
+        alloc->AHardwareBuffer_unlock(buffer->buffer.buffer, NULL);
     }
 
-    wlr_dmabuf_attributes_finish(&buffer->dmabuf);
-    tgui_hardware_buffer_destroy(buffer->conn, &buffer->buffer);
+    struct wlr_tgui_pool_buffer *pool_buffer =
+        calloc(1, sizeof(*pool_buffer));
+    if (pool_buffer == NULL) {
+        pthread_mutex_lock(&alloc->pool_mutex);
+        alloc->resident_bytes -= (size_t) buffer->desc.stride *
+                                 buffer->desc.height *
+                                 buffer->bytes_per_pixel;
+        pthread_mutex_unlock(&alloc->pool_mutex);
+        wlr_dmabuf_attributes_finish(&buffer->dmabuf);
+        tgui_hardware_buffer_destroy(buffer->conn, &buffer->buffer);
+        free(buffer);
+        return;
+    }
+    pool_buffer->width = buffer->wlr_buffer.width;
+    pool_buffer->height = buffer->wlr_buffer.height;
+    pool_buffer->format = buffer->format;
+    pool_buffer->buffer = buffer->buffer;
+    pool_buffer->desc = buffer->desc;
+    pool_buffer->dmabuf_fd = buffer->dmabuf.fd[0];
+    pool_buffer->dmabuf_dev = buffer->dmabuf_dev;
+    pool_buffer->dmabuf_ino = buffer->dmabuf_ino;
     free(buffer);
+
+    pool_recycle(alloc, pool_buffer);
 }
 
 static bool buffer_get_dmabuf(struct wlr_buffer *wlr_buffer,
@@ -54,6 +218,9 @@ static bool begin_data_ptr_access(struct wlr_buffer *wlr_buffer,
                                   uint32_t *format,
                                   size_t *stride) {
     struct wlr_tgui_buffer *buffer = tgui_buffer_from_buffer(wlr_buffer);
+    if (buffer->allocator == NULL) {
+        return false;
+    }
 
     if (buffer->data == NULL) {
         buffer->allocator->AHardwareBuffer_lock(
@@ -69,7 +236,7 @@ static bool begin_data_ptr_access(struct wlr_buffer *wlr_buffer,
 
     *data = buffer->data;
     *format = buffer->format;
-    *stride = buffer->desc.stride * 4;
+    *stride = buffer->desc.stride * buffer->bytes_per_pixel;
     return true;
 }
 
@@ -90,60 +257,66 @@ static const struct wlr_buffer_impl buffer_impl = {
     .end_data_ptr_access = end_data_ptr_access,
 };
 
-static struct wlr_buffer *
-allocator_create_buffer(struct wlr_allocator *wlr_allocator,
-                        int width,
-                        int height,
-                        const struct wlr_drm_format *format) {
-    struct wlr_tgui_allocator *alloc =
-        tgui_allocator_from_allocator(wlr_allocator);
+static size_t pool_buffer_size(struct wlr_tgui_pool_buffer *pool_buffer) {
+    const struct wlr_pixel_format_info *info =
+        drm_get_pixel_format_info(pool_buffer->format);
+    return (size_t) pool_buffer->desc.stride * pool_buffer->desc.height *
+           (info != NULL ? info->bpp / 8 : 4);
+}
 
-    if (!wlr_drm_format_has(format, DRM_FORMAT_MOD_INVALID) &&
-        !wlr_drm_format_has(format, DRM_FORMAT_MOD_LINEAR)) {
-        wlr_log(WLR_ERROR, "TGUI allocator only supports INVALID and "
-                           "LINEAR modifiers");
-        return NULL;
-    }
+/**
+ * Hand a buffer to the pool thread for destruction. pool_mutex must be
+ * locked.
+ */
+static void pool_discard(struct wlr_tgui_allocator *alloc,
+                         struct wlr_tgui_pool_buffer *pool_buffer) {
+    alloc->resident_bytes -= pool_buffer_size(pool_buffer);
+    wl_list_insert(&alloc->trash, &pool_buffer->link);
+    pthread_cond_signal(&alloc->pool_cond);
+}
 
+/**
+ * Create a hardware buffer and find its dmabuf. Safe to call from the pool
+ * thread.
+ */
+static bool pool_buffer_create(struct wlr_tgui_allocator *alloc,
+                               struct wlr_tgui_pool_buffer *pool_buffer,
+                               int width,
+                               int height,
+                               uint32_t format) {
     const struct wlr_pixel_format_info *info =
-        drm_get_pixel_format_info(format->format);
-    if (info == NULL) {
-        wlr_log(WLR_ERROR, "Unsupported pixel format 0x%" PRIX32,
-                format->format);
-        return NULL;
-    }
-
-    struct wlr_tgui_buffer *buffer = calloc(1, sizeof(*buffer));
-    if (buffer == NULL) {
-        return NULL;
+        drm_get_pixel_format_info(format);
+    tgui_hardware_buffer_format tgui_format;
+    if (info == NULL || !get_tgui_format(format, &tgui_format)) {
+        wlr_log(WLR_ERROR, "Unsupported pixel format 0x%" PRIX32, format);
+        return false;
     }
-    buffer->allocator = alloc;
-    buffer->format = format->format;
-    buffer->conn = alloc->conn;
 
-    wlr_buffer_init(&buffer->wlr_buffer, &buffer_impl, width, height);
+    pool_buffer->width = width;
+    pool_buffer->height = height;
+    pool_buffer->format = format;
 
     tgui_err ret = tgui_hardware_buffer_create(
-        alloc->conn, &buffer->buffer, TGUI_HARDWARE_BUFFER_FORMAT_RGBA8888,
-        width, height, TGUI_HARDWARE_BUFFER_CPU_OFTEN,
-        TGUI_HARDWARE_BUFFER_CPU_OFTEN);
+        alloc->conn, &pool_buffer->buffer, tgui_format, width, height,
+        TGUI_HARDWARE_BUFFER_CPU_OFTEN, TGUI_HARDWARE_BUFFER_CPU_OFTEN);
     if (ret > 0) {
         wlr_log(WLR_ERROR, "Failed to create tgui_hardware_buffer");
-        free(buffer);
-        return NULL;
+        return false;
     } else {
         wlr_log(WLR_INFO, "Create tgui_hardware_buffer width: %d height: %d",
                 width, height);
     }
-    alloc->AHardwareBuffer_describe(buffer->buffer.buffer, &buffer->desc);
+    alloc->AHardwareBuffer_describe(pool_buffer->buffer.buffer,
+                                    &pool_buffer->desc);
 
     const native_handle_t *handle =
-        alloc->AHardwareBuffer_getNativeHandle(buffer->buffer.buffer);
+        alloc->AHardwareBuffer_getNativeHandle(pool_buffer->buffer.buffer);
 
     int fd = -1;
     for (int i = 0; i < handle->numFds; i++) {
         size_t size = lseek(handle->data[i], 0, SEEK_END);
-        if (size < (buffer->desc.stride * buffer->desc.height * 4))
+        if (size < (pool_buffer->desc.stride * pool_buffer->desc.height *
+                    (info->bpp / 8)))
             continue;
 
         fd = dup(handle->data[i]);
@@ -152,11 +325,284 @@ allocator_create_buffer(struct wlr_allocator *wlr_allocator,
 
     if (fd < 0) {
         wlr_log(WLR_ERROR, "Failed to get dmabuf");
-        tgui_hardware_buffer_destroy(alloc->conn, &buffer->buffer);
-        free(buffer);
+        tgui_hardware_buffer_destroy(alloc->conn, &pool_buffer->buffer);
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == 0) {
+        pool_buffer->dmabuf_dev = st.st_dev;
+        pool_buffer->dmabuf_ino = st.st_ino;
+    }
+    pool_buffer->dmabuf_fd = fd;
+
+    pthread_mutex_lock(&alloc->pool_mutex);
+    alloc->resident_bytes += pool_buffer_size(pool_buffer);
+    pthread_mutex_unlock(&alloc->pool_mutex);
+    return true;
+}
+
+static void pool_buffer_destroy(struct wlr_tgui_allocator *alloc,
+                                struct wlr_tgui_pool_buffer *pool_buffer) {
+    close(pool_buffer->dmabuf_fd);
+    tgui_hardware_buffer_destroy(alloc->conn, &pool_buffer->buffer);
+    free(pool_buffer);
+}
+
+static struct wlr_tgui_pool_hint *
+pool_find_hint(struct wlr_tgui_allocator *alloc,
+               int width,
+               int height,
+               uint32_t format) {
+    for (size_t i = 0; i < alloc->hints_len; i++) {
+        struct wlr_tgui_pool_hint *hint = &alloc->hints[i];
+        if (hint->width == width && hint->height == height &&
+            hint->format == format) {
+            return hint;
+        }
+    }
+    return NULL;
+}
+
+static void pool_recycle(struct wlr_tgui_allocator *alloc,
+                         struct wlr_tgui_pool_buffer *pool_buffer) {
+    pthread_mutex_lock(&alloc->pool_mutex);
+    // Before the first prediction, assume the next buffers have the same size
+    bool wanted = !alloc->predicted ||
+                  pool_find_hint(alloc, pool_buffer->width,
+                                 pool_buffer->height,
+                                 pool_buffer->format) != NULL;
+    if (wanted && alloc->pool_len < TGUI_POOL_CAP) {
+        wl_list_insert(&alloc->pool, &pool_buffer->link);
+        alloc->pool_len++;
+    } else {
+        pool_discard(alloc, pool_buffer);
+    }
+    pthread_mutex_unlock(&alloc->pool_mutex);
+}
+
+static struct wlr_tgui_pool_buffer *
+pool_take(struct wlr_tgui_allocator *alloc,
+          int width,
+          int height,
+          uint32_t format) {
+    pthread_mutex_lock(&alloc->pool_mutex);
+    struct wlr_tgui_pool_buffer *pool_buffer, *found = NULL;
+    wl_list_for_each(pool_buffer, &alloc->pool, link) {
+        if (pool_buffer->width == width && pool_buffer->height == height &&
+            pool_buffer->format == format) {
+            found = pool_buffer;
+            break;
+        }
+    }
+    if (found != NULL) {
+        wl_list_remove(&found->link);
+        alloc->pool_len--;
+    }
+    pthread_mutex_unlock(&alloc->pool_mutex);
+    return found;
+}
+
+static void *pool_thread(void *data) {
+    struct wlr_tgui_allocator *alloc = data;
+
+    pthread_mutex_lock(&alloc->pool_mutex);
+    while (alloc->pool_thread_run) {
+        if (!wl_list_empty(&alloc->trash)) {
+            struct wlr_tgui_pool_buffer *pool_buffer =
+                wl_container_of(alloc->trash.next, pool_buffer, link);
+            wl_list_remove(&pool_buffer->link);
+            pthread_mutex_unlock(&alloc->pool_mutex);
+            pool_buffer_destroy(alloc, pool_buffer);
+            pthread_mutex_lock(&alloc->pool_mutex);
+            continue;
+        }
+
+        struct wlr_tgui_pool_hint *hint = NULL;
+        for (size_t i = 0; i < alloc->hints_len; i++) {
+            if (alloc->hints[i].pending > 0) {
+                hint = &alloc->hints[i];
+                break;
+            }
+        }
+        if (hint == NULL || alloc->pool_len >= TGUI_POOL_CAP) {
+            pthread_cond_wait(&alloc->pool_cond, &alloc->pool_mutex);
+            continue;
+        }
+
+        hint->pending--;
+        int width = hint->width, height = hint->height;
+        uint32_t format = hint->format;
+        pthread_mutex_unlock(&alloc->pool_mutex);
+
+        struct wlr_tgui_pool_buffer *pool_buffer =
+            calloc(1, sizeof(*pool_buffer));
+        if (pool_buffer != NULL &&
+            !pool_buffer_create(alloc, pool_buffer, width, height, format)) {
+            free(pool_buffer);
+            pool_buffer = NULL;
+        }
+
+        pthread_mutex_lock(&alloc->pool_mutex);
+        if (pool_buffer == NULL) {
+            continue;
+        }
+        // The prediction may have changed in the meantime
+        if (pool_find_hint(alloc, width, height, format) != NULL &&
+            alloc->pool_len < TGUI_POOL_CAP) {
+            wl_list_insert(&alloc->pool, &pool_buffer->link);
+            alloc->pool_len++;
+        } else {
+            pool_discard(alloc, pool_buffer);
+        }
+    }
+    pthread_mutex_unlock(&alloc->pool_mutex);
+
+    return NULL;
+}
+
+/**
+ * Remove the hints of an owner. pool_mutex must be locked.
+ */
+static void pool_remove_hints(struct wlr_tgui_allocator *alloc,
+                              const void *owner) {
+    size_t len = 0;
+    for (size_t i = 0; i < alloc->hints_len; i++) {
+        if (alloc->hints[i].owner != owner) {
+            alloc->hints[len++] = alloc->hints[i];
+        }
+    }
+    alloc->hints_len = len;
+    alloc->predicted = true;
+}
+
+void tgui_allocator_prefetch(struct wlr_allocator *wlr_allocator,
+                             const void *owner,
+                             const struct wlr_tgui_pool_hint *hints,
+                             size_t hints_len) {
+    struct wlr_tgui_allocator *alloc =
+        tgui_allocator_from_allocator(wlr_allocator);
+
+    pthread_mutex_lock(&alloc->pool_mutex);
+    pool_remove_hints(alloc, owner);
+    size_t first = alloc->hints_len;
+    for (size_t i = 0; i < hints_len; i++) {
+        if (alloc->hints_len == TGUI_POOL_HINTS) {
+            wlr_log(WLR_DEBUG, "Too many buffer size predictions");
+            break;
+        }
+        struct wlr_tgui_pool_hint *hint = &alloc->hints[alloc->hints_len++];
+        *hint = hints[i];
+        hint->pending = TGUI_POOL_PREFETCH;
+        hint->owner = owner;
+    }
+
+    // Cached buffers count towards the new hints, unless no owner wants them
+    // anymore
+    struct wlr_tgui_pool_buffer *pool_buffer, *tmp;
+    wl_list_for_each_safe(pool_buffer, tmp, &alloc->pool, link) {
+        if (pool_find_hint(alloc, pool_buffer->width, pool_buffer->height,
+                           pool_buffer->format) == NULL) {
+            wl_list_remove(&pool_buffer->link);
+            pool_discard(alloc, pool_buffer);
+            alloc->pool_len--;
+            continue;
+        }
+        for (size_t i = first; i < alloc->hints_len; i++) {
+            struct wlr_tgui_pool_hint *hint = &alloc->hints[i];
+            if (hint->width == pool_buffer->width &&
+                hint->height == pool_buffer->height &&
+                hint->format == pool_buffer->format && hint->pending > 0) {
+                hint->pending--;
+                break;
+            }
+        }
+    }
+
+    pthread_cond_signal(&alloc->pool_cond);
+    pthread_mutex_unlock(&alloc->pool_mutex);
+}
+
+void tgui_allocator_trim(struct wlr_allocator *wlr_allocator,
+                         const void *owner) {
+    struct wlr_tgui_allocator *alloc =
+        tgui_allocator_from_allocator(wlr_allocator);
+
+    pthread_mutex_lock(&alloc->pool_mutex);
+    pool_remove_hints(alloc, owner);
+
+    struct wlr_tgui_pool_buffer *pool_buffer, *tmp;
+    wl_list_for_each_safe(pool_buffer, tmp, &alloc->pool, link) {
+        if (pool_find_hint(alloc, pool_buffer->width, pool_buffer->height,
+                           pool_buffer->format) == NULL) {
+            wl_list_remove(&pool_buffer->link);
+            pool_discard(alloc, pool_buffer);
+            alloc->pool_len--;
+        }
+    }
+    pthread_mutex_unlock(&alloc->pool_mutex);
+}
+
+size_t tgui_allocator_get_resident_bytes(struct wlr_allocator *wlr_allocator) {
+    struct wlr_tgui_allocator *alloc =
+        tgui_allocator_from_allocator(wlr_allocator);
+
+    pthread_mutex_lock(&alloc->pool_mutex);
+    size_t bytes = alloc->resident_bytes;
+    pthread_mutex_unlock(&alloc->pool_mutex);
+    return bytes;
+}
+
+static struct wlr_buffer *
+allocator_create_buffer(struct wlr_allocator *wlr_allocator,
+                        int width,
+                        int height,
+                        const struct wlr_drm_format *format) {
+    struct wlr_tgui_allocator *alloc =
+        tgui_allocator_from_allocator(wlr_allocator);
+
+    if (!wlr_drm_format_has(format, DRM_FORMAT_MOD_INVALID) &&
+        !wlr_drm_format_has(format, DRM_FORMAT_MOD_LINEAR)) {
+        wlr_log(WLR_ERROR, "TGUI allocator only supports INVALID and "
+                           "LINEAR modifiers");
         return NULL;
     }
 
+    const struct wlr_pixel_format_info *info =
+        drm_get_pixel_format_info(format->format);
+    tgui_hardware_buffer_format tgui_format;
+    if (info == NULL || !get_tgui_format(format->format, &tgui_format)) {
+        wlr_log(WLR_ERROR, "Unsupported pixel format 0x%" PRIX32,
+                format->format);
+        return NULL;
+    }
+
+    struct wlr_tgui_buffer *buffer = calloc(1, sizeof(*buffer));
+    if (buffer == NULL) {
+        return NULL;
+    }
+
+    struct wlr_tgui_pool_buffer *pool_buffer =
+        pool_take(alloc, width, height, format->format);
+    if (pool_buffer == NULL) {
+        pool_buffer = calloc(1, sizeof(*pool_buffer));
+        if (pool_buffer == NULL ||
+            !pool_buffer_create(alloc, pool_buffer, width, height,
+                                format->format)) {
+            free(pool_buffer);
+            free(buffer);
+            return NULL;
+        }
+    }
+
+    buffer->allocator = alloc;
+    buffer->format = format->format;
+    buffer->bytes_per_pixel = info->bpp / 8;
+    buffer->conn = alloc->conn;
+    buffer->buffer = pool_buffer->buffer;
+    buffer->desc = pool_buffer->desc;
+    buffer->dmabuf_dev = pool_buffer->dmabuf_dev;
+    buffer->dmabuf_ino = pool_buffer->dmabuf_ino;
     buffer->dmabuf = (struct wlr_dmabuf_attributes) {
         .width = buffer->desc.stride,
         .height = buffer->desc.height,
@@ -164,10 +610,15 @@ allocator_create_buffer(struct wlr_allocator *wlr_allocator,
         .format = buffer->format,
         .modifier = DRM_FORMAT_MOD_LINEAR,
         .offset[0] = 0,
-        .stride[0] = buffer->desc.stride * 4,
-        .fd[0] = fd,
+        .stride[0] = buffer->desc.stride * buffer->bytes_per_pixel,
+        .fd[0] = pool_buffer->dmabuf_fd,
 
     };
+    free(pool_buffer);
+
+    wlr_buffer_init(&buffer->wlr_buffer, &buffer_impl, width, height);
+    wl_list_insert(&alloc->buffers, &buffer->allocator_link);
+    alloc->buffers_generation++;
 
     return &buffer->wlr_buffer;
 }
@@ -199,6 +650,32 @@ static bool load_android_library(struct wlr_tgui_allocator *allocator) {
 static void allocator_destroy(struct wlr_allocator *wlr_allocator) {
     struct wlr_tgui_allocator *alloc =
         tgui_allocator_from_allocator(wlr_allocator);
+
+    pthread_mutex_lock(&alloc->pool_mutex);
+    alloc->pool_thread_run = false;
+    pthread_cond_signal(&alloc->pool_cond);
+    pthread_mutex_unlock(&alloc->pool_mutex);
+    pthread_join(alloc->pool_thread, NULL);
+
+    struct wlr_tgui_pool_buffer *pool_buffer, *pool_tmp;
+    wl_list_for_each_safe(pool_buffer, pool_tmp, &alloc->pool, link) {
+        pool_buffer_destroy(alloc, pool_buffer);
+    }
+    wl_list_for_each_safe(pool_buffer, pool_tmp, &alloc->trash, link) {
+        pool_buffer_destroy(alloc, pool_buffer);
+    }
+    pthread_cond_destroy(&alloc->pool_cond);
+    pthread_mutex_destroy(&alloc->pool_mutex);
+
+    // Buffers may outlive the allocator, they just can't be imported or
+    // recycled anymore
+    struct wlr_tgui_buffer *buffer, *tmp;
+    wl_list_for_each_safe(buffer, tmp, &alloc->buffers, allocator_link) {
+        wl_list_remove(&buffer->allocator_link);
+        wl_list_init(&buffer->allocator_link);
+        buffer->allocator = NULL;
+    }
+
     dlclose(alloc->libandroid_handle);
     free(wlr_allocator);
 }
@@ -215,12 +692,28 @@ wlr_tgui_allocator_create(struct wlr_tgui_backend *backend) {
         return NULL;
     }
     allocator->conn = backend->conn;
+    wl_list_init(&allocator->buffers);
 
     if (!load_android_library(allocator)) {
         free(allocator);
         return NULL;
     }
 
+    wl_list_init(&allocator->pool);
+    wl_list_init(&allocator->trash);
+    pthread_mutex_init(&allocator->pool_mutex, NULL);
+    pthread_cond_init(&allocator->pool_cond, NULL);
+    allocator->pool_thread_run = true;
+    if (pthread_create(&allocator->pool_thread, NULL, pool_thread,
+                       allocator) != 0) {
+        wlr_log(WLR_ERROR, "Failed to start hardware buffer pool thread");
+        pthread_cond_destroy(&allocator->pool_cond);
+        pthread_mutex_destroy(&allocator->pool_mutex);
+        dlclose(allocator->libandroid_handle);
+        free(allocator);
+        return NULL;
+    }
+
     wlr_allocator_init(&allocator->wlr_allocator, &allocator_impl,
                        WLR_BUFFER_CAP_DMABUF | WLR_BUFFER_CAP_DATA_PTR);
     return &allocator->wlr_allocator;
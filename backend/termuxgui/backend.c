@@ -1,10 +1,16 @@
 #include <assert.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <pthread.h>
 #include <stdlib.h>
 #include <sys/eventfd.h>
 #include <unistd.h>
 
+#include <drm_fourcc.h>
+
 #include "backend/termuxgui.h"
+#include "util/env.h"
+#include "util/time.h"
 
 struct wlr_tgui_backend *
 tgui_backend_from_backend(struct wlr_backend *wlr_backend) {
@@ -25,6 +31,10 @@ static bool backend_start(struct wlr_backend *wlr_backend) {
                                &output->keyboard.base);
         wl_signal_emit_mutable(&backend->backend.events.new_input,
                                &output->pointer.base);
+        if (!backend->pointer_emulation) {
+            wl_signal_emit_mutable(&backend->backend.events.new_input,
+                                   &output->touch.base);
+        }
     }
 
     backend->started = true;
@@ -44,12 +54,15 @@ static void backend_destroy(struct wlr_backend *wlr_backend) {
     wl_list_for_each_safe(output, output_tmp, &backend->outputs, link) {
         wlr_output_destroy(&output->wlr_output);
     }
+    tgui_present_finish(backend);
 
     wlr_backend_finish(wlr_backend);
+    wlr_drm_format_set_finish(&backend->primary_formats);
 
     tgui_connection_destroy(backend->conn);
     pthread_join(backend->tgui_event_thread, NULL);
     wlr_queue_destroy(&backend->event_queue);
+    tgui_record_finish(backend);
 
     close(backend->fake_drm_fd);
     close(backend->tgui_event_fd);
@@ -82,6 +95,24 @@ static void handle_display_destroy(struct wl_listener *listener, void *data) {
     backend_destroy(&backend->backend);
 }
 
+static void record_input_latency(struct wlr_tgui_backend *backend,
+                                 int64_t latency_nsec) {
+    struct wlr_tgui_input_latency *latency = &backend->input_latency;
+    uint64_t us = latency_nsec > 0 ? latency_nsec / 1000 : 0;
+
+    size_t bucket = 0;
+    while (bucket < WLR_TGUI_LATENCY_BUCKETS - 1 && us >= (1ull << bucket)) {
+        bucket++;
+    }
+
+    latency->count++;
+    latency->total_us += us;
+    if (us > latency->max_us) {
+        latency->max_us = us;
+    }
+    latency->buckets[bucket]++;
+}
+
 static int handle_tgui_event(int fd, uint32_t mask, void *data) {
     struct wlr_tgui_backend *backend = data;
 
@@ -105,10 +136,19 @@ static int handle_tgui_event(int fd, uint32_t mask, void *data) {
     }
     struct wlr_tgui_event *event = wl_container_of(elm, event, link);
 
+    if (event->e.type == TGUI_EVENT_KEY || event->e.type == TGUI_EVENT_TOUCH) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        record_input_latency(backend,
+                             timespec_to_nsec(&now) - event->receive_nsec);
+    }
+
+    // Events are stamped with their reception time, not the dispatch time
+    uint64_t time_ms = event->receive_nsec / 1000000;
     struct wlr_tgui_output *output, *output_tmp;
     wl_list_for_each_safe(output, output_tmp, &backend->outputs, link) {
         if (event->e.activity == output->tgui_activity) {
-            handle_activity_event(&event->e, output);
+            handle_activity_event(&event->e, output, time_ms);
         }
     }
     tgui_event_destroy(&event->e);
@@ -122,9 +162,14 @@ static void *tgui_event_thread(void *data) {
 
     tgui_event event;
     while (tgui_wait_event(backend->conn, &event) == TGUI_ERR_OK) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+
         struct wlr_tgui_event *wlr_event = calloc(1, sizeof(*wlr_event));
         if (wlr_event) {
+            wlr_event->receive_nsec = timespec_to_nsec(&now);
             memcpy(&wlr_event->e, &event, sizeof(tgui_event));
+            tgui_record_event(backend, &event, wlr_event->receive_nsec);
 
             wlr_queue_push(&backend->event_queue, &wlr_event->link);
 
@@ -150,6 +195,52 @@ struct wlr_backend *wlr_tgui_backend_create(struct wl_display *display) {
 
     backend->display = display;
     backend->loop = wl_display_get_event_loop(display);
+    long paused_frame_rate = env_parse_int("WLR_TGUI_PAUSED_FRAME_RATE",
+                                           DEFAULT_PAUSED_FRAME_RATE);
+    if (paused_frame_rate >= 0 && paused_frame_rate <= INT_MAX) {
+        backend->paused_frame_rate = paused_frame_rate;
+    } else {
+        backend->paused_frame_rate = DEFAULT_PAUSED_FRAME_RATE;
+    }
+
+    backend->render_scale = 1.0;
+    const char *render_scale = getenv("WLR_TGUI_RENDER_SCALE");
+    if (render_scale != NULL) {
+        char *end;
+        float scale = strtof(render_scale, &end);
+        if (*end == '\0' && scale >= 0.25 && scale <= 1.0) {
+            backend->render_scale = scale;
+        } else {
+            wlr_log(WLR_ERROR, "Invalid WLR_TGUI_RENDER_SCALE: %s",
+                    render_scale);
+        }
+    }
+
+    static const char *touch_modes[] = {"touch", "pointer", NULL};
+    backend->pointer_emulation =
+        env_parse_switch("WLR_TGUI_TOUCH_MODE", touch_modes) == 1;
+    backend->trim_paused = env_parse_bool("WLR_TGUI_TRIM_PAUSED");
+
+    // Surface views are opaque, the alpha channel is wasted bandwidth unless
+    // asked for
+    static const char *formats[] = {"xbgr8888", "rgb565", "abgr8888", NULL};
+    static const uint32_t drm_formats[] = {
+        DRM_FORMAT_XBGR8888,
+        DRM_FORMAT_RGB565,
+        DRM_FORMAT_ABGR8888,
+    };
+    backend->output_format =
+        drm_formats[env_parse_switch("WLR_TGUI_OUTPUT_FORMAT", formats)];
+    for (size_t i = 0; i < sizeof(drm_formats) / sizeof(drm_formats[0]);
+         i++) {
+        wlr_drm_format_set_add(&backend->primary_formats, drm_formats[i],
+                               DRM_FORMAT_MOD_INVALID);
+        wlr_drm_format_set_add(&backend->primary_formats, drm_formats[i],
+                               DRM_FORMAT_MOD_LINEAR);
+    }
+
+    tgui_record_init(backend);
+
     backend->fake_drm_fd = open("/dev/null", O_RDONLY);
     backend->tgui_event_fd =
         eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK | EFD_SEMAPHORE);
@@ -158,6 +249,8 @@ struct wlr_backend *wlr_tgui_backend_create(struct wl_display *display) {
 
     if (tgui_connection_create(&backend->conn)) {
         wlr_log(WLR_ERROR, "Failed to create tgui_connection");
+        tgui_record_finish(backend);
+        wlr_drm_format_set_finish(&backend->primary_formats);
         wlr_backend_finish(&backend->backend);
         free(backend);
         return NULL;
@@ -174,6 +267,8 @@ struct wlr_backend *wlr_tgui_backend_create(struct wl_display *display) {
         wl_event_loop_add_fd(backend->loop, backend->tgui_event_fd, events,
                              handle_tgui_event, backend);
 
+    tgui_present_init(backend);
+
     wlr_queue_init(&backend->event_queue);
     pthread_create(&backend->tgui_event_thread, NULL, tgui_event_thread,
                    backend);
@@ -181,6 +276,22 @@ struct wlr_backend *wlr_tgui_backend_create(struct wl_display *display) {
     return &backend->backend;
 }
 
+void wlr_tgui_backend_get_input_latency(
+    struct wlr_backend *wlr_backend, struct wlr_tgui_input_latency *latency) {
+    struct wlr_tgui_backend *backend = tgui_backend_from_backend(wlr_backend);
+    *latency = backend->input_latency;
+}
+
+void wlr_tgui_backend_get_memory_stats(struct wlr_backend *wlr_backend,
+                                       struct wlr_tgui_memory_stats *stats) {
+    struct wlr_tgui_backend *backend = tgui_backend_from_backend(wlr_backend);
+    *stats = backend->memory_stats;
+    if (wlr_backend->allocator != NULL) {
+        stats->resident_bytes =
+            tgui_allocator_get_resident_bytes(wlr_backend->allocator);
+    }
+}
+
 bool wlr_backend_is_tgui(struct wlr_backend *backend) {
     return backend->impl == &backend_impl;
 }
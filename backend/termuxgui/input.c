@@ -1,4 +1,5 @@
 #include <android/keycodes.h>
+#include <inttypes.h>
 #include <linux/input-event-codes.h>
 #include <xkbcommon/xkbcommon.h>
 
@@ -68,23 +69,131 @@ static void move_cursor(struct wlr_tgui_output *output,
                           time_ms);
 }
 
-void handle_touch_event(tgui_event *e,
-                        struct wlr_tgui_output *output,
-                        uint64_t time_ms) {
+/**
+ * Get the size touch coordinates are relative to: the surface view when frames
+ * are upscaled to fill it, the output otherwise.
+ */
+static void get_touch_area(struct wlr_tgui_output *output,
+                           int *width,
+                           int *height) {
+    if (output->render_scale < 1.0 && output->view_width > 0 &&
+        output->view_height > 0) {
+        *width = output->view_width;
+        *height = output->view_height;
+    } else {
+        *width = output->wlr_output.width;
+        *height = output->wlr_output.height;
+    }
+}
+
+static void send_touch_frame(struct wlr_tgui_output *output) {
+    wl_signal_emit_mutable(&output->touch.events.frame, NULL);
+}
+
+/**
+ * Forward every touch point as is, with its pointer id.
+ */
+static void handle_native_touch(tgui_event *e,
+                                struct wlr_tgui_output *output,
+                                uint64_t time_ms,
+                                int width,
+                                int height) {
+    tgui_touch_pointer *pointers = e->touch.pointers[0];
+
+    switch (e->touch.action) {
+    case TGUI_TOUCH_DOWN:
+    case TGUI_TOUCH_POINTER_DOWN: {
+        if (e->touch.index >= e->touch.num_pointers) {
+            break;
+        }
+        tgui_touch_pointer *p = &pointers[e->touch.index];
+        struct wlr_touch_down_event ev = {
+            .touch = &output->touch,
+            .time_msec = time_ms,
+            .touch_id = p->id,
+            .x = (double) p->x / width,
+            .y = (double) p->y / height,
+        };
+        wl_signal_emit_mutable(&output->touch.events.down, &ev);
+        send_touch_frame(output);
+        break;
+    }
+    case TGUI_TOUCH_UP:
+    case TGUI_TOUCH_POINTER_UP: {
+        if (e->touch.index >= e->touch.num_pointers) {
+            break;
+        }
+        struct wlr_touch_up_event ev = {
+            .touch = &output->touch,
+            .time_msec = time_ms,
+            .touch_id = pointers[e->touch.index].id,
+        };
+        wl_signal_emit_mutable(&output->touch.events.up, &ev);
+        send_touch_frame(output);
+        break;
+    }
+    case TGUI_TOUCH_MOVE: {
+        for (uint32_t i = 0u; i < e->touch.num_pointers; i++) {
+            struct wlr_touch_motion_event ev = {
+                .touch = &output->touch,
+                .time_msec = time_ms,
+                .touch_id = pointers[i].id,
+                .x = (double) pointers[i].x / width,
+                .y = (double) pointers[i].y / height,
+            };
+            wl_signal_emit_mutable(&output->touch.events.motion, &ev);
+        }
+        send_touch_frame(output);
+        break;
+    }
+    case TGUI_TOUCH_CANCEL: {
+        for (uint32_t i = 0u; i < e->touch.num_pointers; i++) {
+            struct wlr_touch_cancel_event ev = {
+                .touch = &output->touch,
+                .time_msec = time_ms,
+                .touch_id = pointers[i].id,
+            };
+            wl_signal_emit_mutable(&output->touch.events.cancel, &ev);
+        }
+        send_touch_frame(output);
+        break;
+    }
+    default: {
+        break;
+    }
+    }
+}
+
+/**
+ * Translate touches into pointer events: taps click, long presses drag, and
+ * two-finger swipes scroll.
+ */
+static void emulate_pointer(tgui_event *e,
+                            struct wlr_tgui_output *output,
+                            uint64_t time_ms,
+                            int width,
+                            int height) {
+
     switch (e->touch.action) {
     case TGUI_TOUCH_DOWN: {
-        tgui_touch_pointer *p = &e->touch.pointers[e->touch.index][0];
+        if (e->touch.index >= e->touch.num_pointers) {
+            break;
+        }
+        tgui_touch_pointer *p = &e->touch.pointers[0][e->touch.index];
         memset(&output->touch_pointer, 0, sizeof(output->touch_pointer));
         output->touch_pointer.id = p->id;
         output->touch_pointer.max = 0;
-        output->touch_pointer.x = (double) p->x / output->wlr_output.width;
-        output->touch_pointer.y = (double) p->y / output->wlr_output.height;
+        output->touch_pointer.x = (double) p->x / width;
+        output->touch_pointer.y = (double) p->y / height;
         output->touch_pointer.time_ms = time_ms;
         break;
     }
     case TGUI_TOUCH_UP:
     case TGUI_TOUCH_POINTER_UP: {
-        tgui_touch_pointer *p = &e->touch.pointers[e->touch.index][0];
+        if (e->touch.index >= e->touch.num_pointers) {
+            break;
+        }
+        tgui_touch_pointer *p = &e->touch.pointers[0][e->touch.index];
         if (p->id == output->touch_pointer.id) {
             if (time_ms - output->touch_pointer.time_ms < 200 &&
                 output->touch_pointer.down == false &&
@@ -114,10 +223,10 @@ void handle_touch_event(tgui_event *e,
             if (p->id != output->touch_pointer.id) {
                 break;
             }
-            double x = (double) p->x / output->wlr_output.width;
-            double y = (double) p->y / output->wlr_output.height;
-            double px = (double) 1 / output->wlr_output.width;
-            double py = (double) 1 / output->wlr_output.height;
+            double x = (double) p->x / width;
+            double y = (double) p->y / height;
+            double px = (double) 1 / width;
+            double py = (double) 1 / height;
             double dx = output->touch_pointer.x - x;
             double dy = output->touch_pointer.y - y;
             if (dx >= px || dx <= -px || dy >= py || dy <= -py) {
@@ -127,14 +236,14 @@ void handle_touch_event(tgui_event *e,
             }
             if (output->touch_pointer.moved == true &&
                 e->touch.num_pointers == 2) {
-                static double s;
-                s += dy;
-                if (s > (double) 150 / output->wlr_output.height) {
+                output->touch_pointer.scroll += dy;
+                if (output->touch_pointer.scroll > (double) 150 / height) {
                     send_pointer_axis(output, 1, time_ms);
-                    s = 0;
-                } else if (s < (double) -150 / output->wlr_output.height) {
+                    output->touch_pointer.scroll = 0;
+                } else if (output->touch_pointer.scroll <
+                           (double) -150 / height) {
                     send_pointer_axis(output, -1, time_ms);
-                    s = 0;
+                    output->touch_pointer.scroll = 0;
                 }
             } else if (output->touch_pointer.moved == false &&
                        output->touch_pointer.down == false &&
@@ -157,78 +266,200 @@ void handle_touch_event(tgui_event *e,
     }
 }
 
+void handle_touch_event(tgui_event *e,
+                        struct wlr_tgui_output *output,
+                        uint64_t time_ms) {
+    int width, height;
+    get_touch_area(output, &width, &height);
+
+    if (output->backend->pointer_emulation) {
+        emulate_pointer(e, output, time_ms, width, height);
+    } else {
+        handle_native_touch(e, output, time_ms, width, height);
+    }
+}
+
+/**
+ * Linux keycodes and implied modifiers indexed by Android keycode. Entries
+ * left out have a zero (KEY_RESERVED) keycode.
+ */
 static const struct {
-    uint32_t android, linux, wlr_mod;
+    uint16_t linux;
+    uint16_t wlr_mod;
 } keymap[] = {
-    { AKEYCODE_0, KEY_0 },
-    { AKEYCODE_1, KEY_1 },
-    { AKEYCODE_2, KEY_2 },
-    { AKEYCODE_3, KEY_3 },
-    { AKEYCODE_4, KEY_4 },
-    { AKEYCODE_5, KEY_5 },
-    { AKEYCODE_6, KEY_6 },
-    { AKEYCODE_7, KEY_7 },
-    { AKEYCODE_8, KEY_8 },
-    { AKEYCODE_9, KEY_9 },
-    { AKEYCODE_A, KEY_A },
-    { AKEYCODE_B, KEY_B },
-    { AKEYCODE_C, KEY_C },
-    { AKEYCODE_D, KEY_D },
-    { AKEYCODE_E, KEY_E },
-    { AKEYCODE_F, KEY_F },
-    { AKEYCODE_G, KEY_G },
-    { AKEYCODE_H, KEY_H },
-    { AKEYCODE_I, KEY_I },
-    { AKEYCODE_J, KEY_J },
-    { AKEYCODE_K, KEY_K },
-    { AKEYCODE_L, KEY_L },
-    { AKEYCODE_M, KEY_M },
-    { AKEYCODE_N, KEY_N },
-    { AKEYCODE_O, KEY_O },
-    { AKEYCODE_P, KEY_P },
-    { AKEYCODE_Q, KEY_Q },
-    { AKEYCODE_R, KEY_R },
-    { AKEYCODE_S, KEY_S },
-    { AKEYCODE_T, KEY_T },
-    { AKEYCODE_U, KEY_U },
-    { AKEYCODE_V, KEY_V },
-    { AKEYCODE_W, KEY_W },
-    { AKEYCODE_X, KEY_X },
-    { AKEYCODE_Y, KEY_Y },
-    { AKEYCODE_Z, KEY_Z },
-    { AKEYCODE_ENTER, KEY_ENTER },
-    { AKEYCODE_SPACE, KEY_SPACE },
-    { AKEYCODE_DEL, KEY_BACKSPACE },
-    { AKEYCODE_SHIFT_LEFT, KEY_LEFTSHIFT },
-    { AKEYCODE_COMMA, KEY_COMMA },
-    { AKEYCODE_PERIOD, KEY_DOT },
-    { AKEYCODE_MINUS, KEY_MINUS },
-    { AKEYCODE_AT, KEY_2, WLR_MODIFIER_SHIFT },
-    { AKEYCODE_STAR, KEY_8, WLR_MODIFIER_SHIFT },
-    { AKEYCODE_POUND, KEY_3, WLR_MODIFIER_SHIFT },
-    { AKEYCODE_SEMICOLON, KEY_SEMICOLON },
-    { AKEYCODE_APOSTROPHE, KEY_APOSTROPHE },
-    { AKEYCODE_SLASH, KEY_SLASH },
-    { AKEYCODE_EQUALS, KEY_EQUAL },
-    { AKEYCODE_PLUS, KEY_EQUAL, WLR_MODIFIER_SHIFT },
-    { AKEYCODE_GRAVE, KEY_GRAVE },
-    { AKEYCODE_BACKSLASH, KEY_BACKSLASH },
-    { AKEYCODE_LEFT_BRACKET, KEY_LEFTBRACE },
-    { AKEYCODE_RIGHT_BRACKET, KEY_RIGHTBRACE },
+    [AKEYCODE_0] = { KEY_0 },
+    [AKEYCODE_1] = { KEY_1 },
+    [AKEYCODE_2] = { KEY_2 },
+    [AKEYCODE_3] = { KEY_3 },
+    [AKEYCODE_4] = { KEY_4 },
+    [AKEYCODE_5] = { KEY_5 },
+    [AKEYCODE_6] = { KEY_6 },
+    [AKEYCODE_7] = { KEY_7 },
+    [AKEYCODE_8] = { KEY_8 },
+    [AKEYCODE_9] = { KEY_9 },
+    [AKEYCODE_STAR] = { KEY_8, WLR_MODIFIER_SHIFT },
+    [AKEYCODE_POUND] = { KEY_3, WLR_MODIFIER_SHIFT },
+    [AKEYCODE_DPAD_UP] = { KEY_UP },
+    [AKEYCODE_DPAD_DOWN] = { KEY_DOWN },
+    [AKEYCODE_DPAD_LEFT] = { KEY_LEFT },
+    [AKEYCODE_DPAD_RIGHT] = { KEY_RIGHT },
+    [AKEYCODE_VOLUME_UP] = { KEY_VOLUMEUP },
+    [AKEYCODE_VOLUME_DOWN] = { KEY_VOLUMEDOWN },
+    [AKEYCODE_POWER] = { KEY_POWER },
+    [AKEYCODE_CAMERA] = { KEY_CAMERA },
+    [AKEYCODE_A] = { KEY_A },
+    [AKEYCODE_B] = { KEY_B },
+    [AKEYCODE_C] = { KEY_C },
+    [AKEYCODE_D] = { KEY_D },
+    [AKEYCODE_E] = { KEY_E },
+    [AKEYCODE_F] = { KEY_F },
+    [AKEYCODE_G] = { KEY_G },
+    [AKEYCODE_H] = { KEY_H },
+    [AKEYCODE_I] = { KEY_I },
+    [AKEYCODE_J] = { KEY_J },
+    [AKEYCODE_K] = { KEY_K },
+    [AKEYCODE_L] = { KEY_L },
+    [AKEYCODE_M] = { KEY_M },
+    [AKEYCODE_N] = { KEY_N },
+    [AKEYCODE_O] = { KEY_O },
+    [AKEYCODE_P] = { KEY_P },
+    [AKEYCODE_Q] = { KEY_Q },
+    [AKEYCODE_R] = { KEY_R },
+    [AKEYCODE_S] = { KEY_S },
+    [AKEYCODE_T] = { KEY_T },
+    [AKEYCODE_U] = { KEY_U },
+    [AKEYCODE_V] = { KEY_V },
+    [AKEYCODE_W] = { KEY_W },
+    [AKEYCODE_X] = { KEY_X },
+    [AKEYCODE_Y] = { KEY_Y },
+    [AKEYCODE_Z] = { KEY_Z },
+    [AKEYCODE_COMMA] = { KEY_COMMA },
+    [AKEYCODE_PERIOD] = { KEY_DOT },
+    [AKEYCODE_ALT_LEFT] = { KEY_LEFTALT },
+    [AKEYCODE_ALT_RIGHT] = { KEY_RIGHTALT },
+    [AKEYCODE_SHIFT_LEFT] = { KEY_LEFTSHIFT },
+    [AKEYCODE_SHIFT_RIGHT] = { KEY_RIGHTSHIFT },
+    [AKEYCODE_TAB] = { KEY_TAB },
+    [AKEYCODE_SPACE] = { KEY_SPACE },
+    [AKEYCODE_EXPLORER] = { KEY_WWW },
+    [AKEYCODE_ENVELOPE] = { KEY_MAIL },
+    [AKEYCODE_ENTER] = { KEY_ENTER },
+    [AKEYCODE_DEL] = { KEY_BACKSPACE },
+    [AKEYCODE_GRAVE] = { KEY_GRAVE },
+    [AKEYCODE_MINUS] = { KEY_MINUS },
+    [AKEYCODE_EQUALS] = { KEY_EQUAL },
+    [AKEYCODE_LEFT_BRACKET] = { KEY_LEFTBRACE },
+    [AKEYCODE_RIGHT_BRACKET] = { KEY_RIGHTBRACE },
+    [AKEYCODE_BACKSLASH] = { KEY_BACKSLASH },
+    [AKEYCODE_SEMICOLON] = { KEY_SEMICOLON },
+    [AKEYCODE_APOSTROPHE] = { KEY_APOSTROPHE },
+    [AKEYCODE_SLASH] = { KEY_SLASH },
+    [AKEYCODE_AT] = { KEY_2, WLR_MODIFIER_SHIFT },
+    [AKEYCODE_PLUS] = { KEY_EQUAL, WLR_MODIFIER_SHIFT },
+    [AKEYCODE_MENU] = { KEY_COMPOSE },
+    [AKEYCODE_SEARCH] = { KEY_SEARCH },
+    [AKEYCODE_MEDIA_PLAY_PAUSE] = { KEY_PLAYPAUSE },
+    [AKEYCODE_MEDIA_STOP] = { KEY_STOPCD },
+    [AKEYCODE_MEDIA_NEXT] = { KEY_NEXTSONG },
+    [AKEYCODE_MEDIA_PREVIOUS] = { KEY_PREVIOUSSONG },
+    [AKEYCODE_MEDIA_REWIND] = { KEY_REWIND },
+    [AKEYCODE_MEDIA_FAST_FORWARD] = { KEY_FASTFORWARD },
+    [AKEYCODE_MUTE] = { KEY_MICMUTE },
+    [AKEYCODE_PAGE_UP] = { KEY_PAGEUP },
+    [AKEYCODE_PAGE_DOWN] = { KEY_PAGEDOWN },
+    [AKEYCODE_ESCAPE] = { KEY_ESC },
+    [AKEYCODE_FORWARD_DEL] = { KEY_DELETE },
+    [AKEYCODE_CTRL_LEFT] = { KEY_LEFTCTRL },
+    [AKEYCODE_CTRL_RIGHT] = { KEY_RIGHTCTRL },
+    [AKEYCODE_CAPS_LOCK] = { KEY_CAPSLOCK },
+    [AKEYCODE_SCROLL_LOCK] = { KEY_SCROLLLOCK },
+    [AKEYCODE_META_LEFT] = { KEY_LEFTMETA },
+    [AKEYCODE_META_RIGHT] = { KEY_RIGHTMETA },
+    [AKEYCODE_SYSRQ] = { KEY_SYSRQ },
+    [AKEYCODE_BREAK] = { KEY_PAUSE },
+    [AKEYCODE_MOVE_HOME] = { KEY_HOME },
+    [AKEYCODE_MOVE_END] = { KEY_END },
+    [AKEYCODE_INSERT] = { KEY_INSERT },
+    [AKEYCODE_FORWARD] = { KEY_FORWARD },
+    [AKEYCODE_MEDIA_PLAY] = { KEY_PLAYCD },
+    [AKEYCODE_MEDIA_PAUSE] = { KEY_PAUSECD },
+    [AKEYCODE_F1] = { KEY_F1 },
+    [AKEYCODE_F2] = { KEY_F2 },
+    [AKEYCODE_F3] = { KEY_F3 },
+    [AKEYCODE_F4] = { KEY_F4 },
+    [AKEYCODE_F5] = { KEY_F5 },
+    [AKEYCODE_F6] = { KEY_F6 },
+    [AKEYCODE_F7] = { KEY_F7 },
+    [AKEYCODE_F8] = { KEY_F8 },
+    [AKEYCODE_F9] = { KEY_F9 },
+    [AKEYCODE_F10] = { KEY_F10 },
+    [AKEYCODE_F11] = { KEY_F11 },
+    [AKEYCODE_F12] = { KEY_F12 },
+    [AKEYCODE_NUM_LOCK] = { KEY_NUMLOCK },
+    [AKEYCODE_NUMPAD_0] = { KEY_KP0 },
+    [AKEYCODE_NUMPAD_1] = { KEY_KP1 },
+    [AKEYCODE_NUMPAD_2] = { KEY_KP2 },
+    [AKEYCODE_NUMPAD_3] = { KEY_KP3 },
+    [AKEYCODE_NUMPAD_4] = { KEY_KP4 },
+    [AKEYCODE_NUMPAD_5] = { KEY_KP5 },
+    [AKEYCODE_NUMPAD_6] = { KEY_KP6 },
+    [AKEYCODE_NUMPAD_7] = { KEY_KP7 },
+    [AKEYCODE_NUMPAD_8] = { KEY_KP8 },
+    [AKEYCODE_NUMPAD_9] = { KEY_KP9 },
+    [AKEYCODE_NUMPAD_DIVIDE] = { KEY_KPSLASH },
+    [AKEYCODE_NUMPAD_MULTIPLY] = { KEY_KPASTERISK },
+    [AKEYCODE_NUMPAD_SUBTRACT] = { KEY_KPMINUS },
+    [AKEYCODE_NUMPAD_ADD] = { KEY_KPPLUS },
+    [AKEYCODE_NUMPAD_DOT] = { KEY_KPDOT },
+    [AKEYCODE_NUMPAD_COMMA] = { KEY_KPCOMMA },
+    [AKEYCODE_NUMPAD_ENTER] = { KEY_KPENTER },
+    [AKEYCODE_NUMPAD_EQUALS] = { KEY_KPEQUAL },
+    [AKEYCODE_NUMPAD_LEFT_PAREN] = { KEY_KPLEFTPAREN },
+    [AKEYCODE_NUMPAD_RIGHT_PAREN] = { KEY_KPRIGHTPAREN },
+    [AKEYCODE_VOLUME_MUTE] = { KEY_MUTE },
+    [AKEYCODE_CALCULATOR] = { KEY_CALC },
+    [AKEYCODE_ZENKAKU_HANKAKU] = { KEY_ZENKAKUHANKAKU },
+    [AKEYCODE_MUHENKAN] = { KEY_MUHENKAN },
+    [AKEYCODE_HENKAN] = { KEY_HENKAN },
+    [AKEYCODE_KATAKANA_HIRAGANA] = { KEY_KATAKANAHIRAGANA },
+    [AKEYCODE_YEN] = { KEY_YEN },
+    [AKEYCODE_RO] = { KEY_RO },
+    [AKEYCODE_BRIGHTNESS_DOWN] = { KEY_BRIGHTNESSDOWN },
+    [AKEYCODE_BRIGHTNESS_UP] = { KEY_BRIGHTNESSUP },
 };
 
+#define UNMAPPED_KEY_LOG_INTERVAL_MS 5000
+
 static bool get_keycode_and_modifier(uint32_t code,
                                      uint32_t *keycode,
                                      uint32_t *out_mod) {
-    for (size_t i = 0; i < sizeof(keymap) / sizeof(*keymap); i++) {
-        if (code == keymap[i].android) {
-            *keycode = keymap[i].linux;
-            *out_mod = keymap[i].wlr_mod;
-            return true;
-        }
+    if (code >= sizeof(keymap) / sizeof(*keymap) ||
+        keymap[code].linux == KEY_RESERVED) {
+        return false;
     }
 
-    return false;
+    *keycode = keymap[code].linux;
+    *out_mod = keymap[code].wlr_mod;
+    return true;
+}
+
+/**
+ * Count unmapped keys and only log them from time to time, key repeat would
+ * otherwise flood the log.
+ */
+static void report_unmapped_key(struct wlr_tgui_backend *backend,
+                                tgui_event *e,
+                                uint64_t time_ms) {
+    backend->unmapped_keys++;
+    if (backend->unmapped_keys_logged_ms != 0 &&
+        time_ms - backend->unmapped_keys_logged_ms <
+            UNMAPPED_KEY_LOG_INTERVAL_MS) {
+        return;
+    }
+    backend->unmapped_keys_logged_ms = time_ms;
+    wlr_log(WLR_ERROR, "Unhandled keycode %d %c (%" PRIu64 " unhandled key "
+                       "events so far)",
+            e->key.code, e->key.codePoint, backend->unmapped_keys);
 }
 
 void handle_keyboard_event(tgui_event *e,
@@ -237,8 +468,7 @@ void handle_keyboard_event(tgui_event *e,
     uint32_t keycode, modifiers;
 
     if (!get_keycode_and_modifier(e->key.code, &keycode, &modifiers)) {
-        wlr_log(WLR_ERROR, "Unhandled keycode %d %c", e->key.code,
-                e->key.codePoint);
+        report_unmapped_key(output->backend, e, time_ms);
         return;
     }
 
@@ -249,9 +479,13 @@ void handle_keyboard_event(tgui_event *e,
     if (e->key.mod & TGUI_MOD_ALT)
         modifiers |= WLR_MODIFIER_ALT;
 
+    // Android only reports the held modifiers, Caps Lock and Num Lock are
+    // locked by xkb when their keys are pressed and must be kept
+    struct wlr_keyboard_modifiers *current = &output->keyboard.modifiers;
     xkb_layout_index_t group =
         xkb_state_key_get_layout(output->keyboard.xkb_state, keycode + 8);
-    wlr_keyboard_notify_modifiers(&output->keyboard, modifiers, 0, 0, group);
+    wlr_keyboard_notify_modifiers(&output->keyboard, modifiers,
+                                  current->latched, current->locked, group);
 
     struct wlr_keyboard_key_event key = {
         .time_msec = time_ms,
@@ -1,11 +1,16 @@
 #include <assert.h>
 #include <drm_fourcc.h>
+#include <math.h>
 #include <pthread.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/eventfd.h>
 #include <unistd.h>
 
 #include "backend/termuxgui.h"
+#include "render/drm_format_set.h"
+#include "render/pixman.h"
+#include "render/swapchain.h"
 #include "util/time.h"
 
 static const uint32_t SUPPORTED_OUTPUT_STATE =
@@ -29,9 +34,247 @@ static bool output_test(struct wlr_output *wlr_output,
         return false;
     }
 
+    if (state->committed & WLR_OUTPUT_STATE_BUFFER) {
+        // Compositor buffers sharing the memory of ours are presented
+        // directly, anything else (client buffers in particular) makes the
+        // caller fall back to rendering into our swapchain
+        struct wlr_tgui_buffer *buffer = tgui_buffer_import(
+            wlr_output->backend->allocator, state->buffer);
+        if (buffer == NULL) {
+            wlr_log(WLR_DEBUG, "Buffer can't be imported as tgui buffer");
+            return false;
+        }
+        if (&buffer->wlr_buffer != state->buffer &&
+            (buffer->queued || state->committed & WLR_OUTPUT_STATE_MODE ||
+             state->buffer->width != wlr_output->width ||
+             state->buffer->height != wlr_output->height)) {
+            wlr_log(WLR_DEBUG, "Imported buffer is busy or doesn't match the "
+                               "output size");
+            return false;
+        }
+    }
+
     return true;
 }
 
+static void present_buffer_release(struct wlr_tgui_buffer *buffer) {
+    struct wlr_buffer *source = buffer->scanout_source;
+    struct wlr_tgui_buffer *upscale_target = buffer->upscale_target;
+    buffer->scanout_source = NULL;
+    buffer->upscale_target = NULL;
+    buffer->present_output = NULL;
+    buffer->queued = false;
+    if (upscale_target != NULL) {
+        pixman_region32_fini(&buffer->upscale_damage);
+    }
+    wlr_buffer_unlock(&buffer->wlr_buffer);
+    if (source != NULL) {
+        wlr_buffer_unlock(source);
+    }
+    if (upscale_target != NULL) {
+        wlr_buffer_unlock(&upscale_target->wlr_buffer);
+    }
+}
+
+static bool output_needs_upscale(struct wlr_tgui_output *output,
+                                 struct wlr_buffer *buffer) {
+    return output->render_scale < 1.0 && output->view_width > 0 &&
+           output->view_height > 0 &&
+           (buffer->width != output->view_width ||
+            buffer->height != output->view_height);
+}
+
+static struct wlr_tgui_buffer *
+output_acquire_upscale_target(struct wlr_tgui_output *output,
+                              uint32_t format,
+                              int *age) {
+    struct wlr_swapchain *swapchain = output->upscale_swapchain;
+    if (swapchain == NULL || swapchain->width != output->view_width ||
+        swapchain->height != output->view_height ||
+        swapchain->format->format != format) {
+        wlr_swapchain_destroy(swapchain);
+        output->upscale_swapchain = NULL;
+
+        struct wlr_drm_format *drm_format = wlr_drm_format_create(format);
+        if (drm_format == NULL ||
+            !wlr_drm_format_add(&drm_format, DRM_FORMAT_MOD_LINEAR)) {
+            free(drm_format);
+            return NULL;
+        }
+        output->upscale_swapchain =
+            wlr_swapchain_create(output->backend->backend.allocator,
+                                 output->view_width, output->view_height,
+                                 drm_format);
+        free(drm_format);
+        if (output->upscale_swapchain == NULL) {
+            wlr_log(WLR_ERROR, "Failed to create upscale swapchain");
+            return NULL;
+        }
+    }
+
+    struct wlr_buffer *buffer =
+        wlr_swapchain_acquire(output->upscale_swapchain, age);
+    if (buffer == NULL) {
+        return NULL;
+    }
+    return tgui_buffer_from_buffer(buffer);
+}
+
+/**
+ * Scale damage of a buffer to the region of its upscale target which depends
+ * on it. The bilinear filter samples one neighbouring source pixel.
+ */
+static void scale_upscale_damage(pixman_region32_t *dst,
+                                 pixman_region32_t *src,
+                                 int src_width,
+                                 int src_height,
+                                 int dst_width,
+                                 int dst_height) {
+    double sx = (double) dst_width / src_width;
+    double sy = (double) dst_height / src_height;
+
+    int rects_len;
+    const pixman_box32_t *rects = pixman_region32_rectangles(src, &rects_len);
+    for (int i = 0; i < rects_len; i++) {
+        int x1 = floor((rects[i].x1 - 1) * sx);
+        int y1 = floor((rects[i].y1 - 1) * sy);
+        int x2 = ceil((rects[i].x2 + 1) * sx);
+        int y2 = ceil((rects[i].y2 + 1) * sy);
+        pixman_region32_union_rect(dst, dst, x1, y1, x2 - x1, y2 - y1);
+    }
+    pixman_region32_intersect_rect(dst, dst, 0, 0, dst_width, dst_height);
+}
+
+/**
+ * Attach the upscale target to a committed buffer, along with the region of
+ * the target which is out of date. The damage ring follows the submissions
+ * to the upscale swapchain, whose buffer ages it is indexed with.
+ */
+static void output_prepare_upscale(struct wlr_tgui_output *output,
+                                   struct wlr_tgui_buffer *buffer,
+                                   const struct wlr_output_state *state) {
+    struct wlr_damage_ring *ring = &output->upscale_damage_ring;
+    wlr_damage_ring_set_bounds(ring, state->buffer->width,
+                               state->buffer->height);
+    if (state->committed & WLR_OUTPUT_STATE_DAMAGE) {
+        wlr_damage_ring_add(ring, (pixman_region32_t *) &state->damage);
+    } else {
+        wlr_damage_ring_add_whole(ring);
+    }
+
+    int age;
+    struct wlr_tgui_buffer *target =
+        output_acquire_upscale_target(output, buffer->format, &age);
+    if (target == NULL) {
+        // The damage is kept for the next upscaled frame
+        return;
+    }
+
+    pixman_region32_t damage;
+    pixman_region32_init(&damage);
+    wlr_damage_ring_get_buffer_damage(ring, age, &damage);
+    pixman_region32_init(&buffer->upscale_damage);
+    scale_upscale_damage(&buffer->upscale_damage, &damage,
+                         state->buffer->width, state->buffer->height,
+                         target->wlr_buffer.width, target->wlr_buffer.height);
+    pixman_region32_fini(&damage);
+
+    wlr_swapchain_set_buffer_submitted(output->upscale_swapchain,
+                                       &target->wlr_buffer);
+    wlr_damage_ring_rotate(ring);
+    buffer->upscale_target = target;
+}
+
+/**
+ * Scale the contents of src to fill dst, only where dst is out of date.
+ * Called from the present thread.
+ */
+static bool upscale_buffer(struct wlr_tgui_buffer *src,
+                           struct wlr_tgui_buffer *dst) {
+    if (!pixman_region32_not_empty(&src->upscale_damage)) {
+        return true;
+    }
+
+    void *src_data, *dst_data;
+    uint32_t src_format, dst_format;
+    size_t src_stride, dst_stride;
+    if (!wlr_buffer_begin_data_ptr_access(&src->wlr_buffer,
+                                          WLR_BUFFER_DATA_PTR_ACCESS_READ,
+                                          &src_data, &src_format,
+                                          &src_stride)) {
+        return false;
+    }
+    if (!wlr_buffer_begin_data_ptr_access(&dst->wlr_buffer,
+                                          WLR_BUFFER_DATA_PTR_ACCESS_WRITE,
+                                          &dst_data, &dst_format,
+                                          &dst_stride)) {
+        wlr_buffer_end_data_ptr_access(&src->wlr_buffer);
+        return false;
+    }
+
+    pixman_image_t *src_image = pixman_image_create_bits_no_clear(
+        get_pixman_format_from_drm(src_format), src->wlr_buffer.width,
+        src->wlr_buffer.height, src_data, src_stride);
+    pixman_image_t *dst_image = pixman_image_create_bits_no_clear(
+        get_pixman_format_from_drm(dst_format), dst->wlr_buffer.width,
+        dst->wlr_buffer.height, dst_data, dst_stride);
+
+    bool ok = src_image != NULL && dst_image != NULL &&
+              pixman_image_set_clip_region32(dst_image, &src->upscale_damage);
+    if (ok) {
+        struct pixman_transform transform;
+        pixman_transform_init_scale(
+            &transform,
+            pixman_double_to_fixed((double) src->wlr_buffer.width /
+                                   dst->wlr_buffer.width),
+            pixman_double_to_fixed((double) src->wlr_buffer.height /
+                                   dst->wlr_buffer.height));
+        pixman_image_set_transform(src_image, &transform);
+        pixman_image_set_filter(src_image, PIXMAN_FILTER_BILINEAR, NULL, 0);
+        pixman_image_set_repeat(src_image, PIXMAN_REPEAT_PAD);
+        pixman_image_composite32(PIXMAN_OP_SRC, src_image, NULL, dst_image,
+                                 0, 0, 0, 0, 0, 0, dst->wlr_buffer.width,
+                                 dst->wlr_buffer.height);
+    }
+
+    if (src_image != NULL) {
+        pixman_image_unref(src_image);
+    }
+    if (dst_image != NULL) {
+        pixman_image_unref(dst_image);
+    }
+    wlr_buffer_end_data_ptr_access(&dst->wlr_buffer);
+    wlr_buffer_end_data_ptr_access(&src->wlr_buffer);
+    return ok;
+}
+
+static int handle_paused_frame(void *data) {
+    struct wlr_tgui_output *output = data;
+    if (output->trimmed) {
+        // Sent when the activity resumes
+        return 0;
+    }
+    output->paused_frame_pending = false;
+
+    struct wlr_output_event_present present_event = {
+        .commit_seq = output->wlr_output.commit_seq,
+        .presented = false,
+    };
+    wlr_output_send_present(&output->wlr_output, &present_event);
+    wlr_output_send_frame(&output->wlr_output);
+    return 0;
+}
+
+static void output_schedule_paused_frame(struct wlr_tgui_output *output) {
+    output->paused_frame_pending = true;
+
+    // Frames would bring back the buffers of trimmed outputs
+    int rate = output->backend->paused_frame_rate;
+    if (rate > 0 && !output->trimmed) {
+        wl_event_source_timer_update(output->paused_frame_timer, 1000 / rate);
+    }
+}
+
 static bool output_commit(struct wlr_output *wlr_output,
                           const struct wlr_output_state *state) {
     struct wlr_tgui_output *output = tgui_output_from_output(wlr_output);
@@ -45,50 +288,86 @@ static bool output_commit(struct wlr_output *wlr_output,
     }
 
     if (state->committed & WLR_OUTPUT_STATE_BUFFER) {
+        if (!output->tgui_activity_is_foreground) {
+            // Nothing is visible while the activity is paused, slow down the
+            // frame loop instead of presenting
+            output_schedule_paused_frame(output);
+            return true;
+        }
+
         struct wlr_tgui_buffer *buffer =
-            tgui_buffer_from_buffer(state->buffer);
+            tgui_buffer_import(wlr_output->backend->allocator, state->buffer);
+        assert(buffer != NULL);
 
         wlr_buffer_lock(&buffer->wlr_buffer);
-        wlr_queue_push(&output->present_queue, &buffer->link);
+        buffer->queued = true;
+        if (&buffer->wlr_buffer != state->buffer) {
+            // Keep the client from reusing its buffer while it's on screen
+            buffer->scanout_source = wlr_buffer_lock(state->buffer);
+        }
+        if (output_needs_upscale(output, state->buffer)) {
+            output_prepare_upscale(output, buffer, state);
+        }
+        buffer->present_output = output;
+
+        struct wlr_tgui_backend *backend = output->backend;
+        pthread_mutex_lock(&backend->present_mutex);
+        wl_list_insert(backend->present_pending.prev, &buffer->link);
+        pthread_cond_broadcast(&backend->present_cond);
+        pthread_mutex_unlock(&backend->present_mutex);
     }
 
     return true;
 }
 
+static void take_output_buffers(struct wl_list *dst,
+                                struct wl_list *src,
+                                struct wlr_tgui_output *output) {
+    struct wlr_tgui_buffer *buffer, *tmp;
+    wl_list_for_each_safe(buffer, tmp, src, link) {
+        if (buffer->present_output == output) {
+            wl_list_remove(&buffer->link);
+            wl_list_insert(dst->prev, &buffer->link);
+        }
+    }
+}
+
 static void output_destroy(struct wlr_output *wlr_output) {
     struct wlr_tgui_output *output = tgui_output_from_output(wlr_output);
-    output->present_thread_run = false;
+    struct wlr_tgui_backend *backend = output->backend;
 
     wl_list_remove(&output->link);
-    wl_event_source_remove(output->present_complete_source);
-    close(output->present_complete_fd);
+    wl_event_source_remove(output->paused_frame_timer);
+
+    // Wait for the present thread to be done with the activity before
+    // finishing it
+    struct wl_list buffers;
+    wl_list_init(&buffers);
+    pthread_mutex_lock(&backend->present_mutex);
+    take_output_buffers(&buffers, &backend->present_pending, output);
+    while (output->present_in_flight > 0) {
+        pthread_cond_wait(&backend->present_cond, &backend->present_mutex);
+    }
+    take_output_buffers(&buffers, &backend->present_done, output);
+    pthread_mutex_unlock(&backend->present_mutex);
+
+    struct wlr_tgui_buffer *buffer, *tmp;
+    wl_list_for_each_safe(buffer, tmp, &buffers, link) {
+        wl_list_remove(&buffer->link);
+        present_buffer_release(buffer);
+    }
 
     wlr_pointer_finish(&output->pointer);
+    wlr_touch_finish(&output->touch);
     wlr_keyboard_finish(&output->keyboard);
-    tgui_activity_finish(output->backend->conn, output->tgui_activity);
-
-    struct wl_list tmp_buffer, *tmp;
-    wlr_queue_push(&output->present_queue, &tmp_buffer);
-    pthread_join(output->present_thread, NULL);
+    tgui_activity_finish(backend->conn, output->tgui_activity);
 
-    while ((tmp = wlr_queue_pull(&output->present_queue, true)) != NULL) {
-        if (tmp == &tmp_buffer) {
-            continue;
-        }
-        struct wlr_tgui_buffer *buf = wl_container_of(tmp, buf, link);
-        wlr_buffer_unlock(&buf->wlr_buffer);
-    }
-    while ((tmp = wlr_queue_pull(&output->idle_queue, true)) != NULL) {
-        if (tmp == &tmp_buffer) {
-            continue;
-        }
-        struct wlr_tgui_buffer *buf = wl_container_of(tmp, buf, link);
-        wlr_buffer_unlock(&buf->wlr_buffer);
+    wlr_swapchain_destroy(output->upscale_swapchain);
+    wlr_damage_ring_finish(&output->upscale_damage_ring);
+    if (backend->backend.allocator != NULL) {
+        tgui_allocator_prefetch(backend->backend.allocator, output, NULL, 0);
     }
 
-    wlr_queue_destroy(&output->present_queue);
-    wlr_queue_destroy(&output->idle_queue);
-
     struct wlr_output_mode *mode, *tmp_mode;
     wl_list_for_each_safe(mode, tmp_mode, &output->wlr_output.modes, link) {
         wl_list_remove(&mode->link);
@@ -98,15 +377,34 @@ static void output_destroy(struct wlr_output *wlr_output) {
     free(output);
 }
 
+static const struct wlr_drm_format_set *
+output_get_primary_formats(struct wlr_output *wlr_output,
+                           uint32_t buffer_caps) {
+    struct wlr_tgui_output *output = tgui_output_from_output(wlr_output);
+    return &output->backend->primary_formats;
+}
+
 static const struct wlr_output_impl output_impl = {
     .destroy = output_destroy,
     .commit = output_commit,
+    .get_primary_formats = output_get_primary_formats,
 };
 
 bool wlr_output_is_tgui(struct wlr_output *wlr_output) {
     return wlr_output->impl == &output_impl;
 }
 
+void wlr_tgui_output_set_render_scale(struct wlr_output *wlr_output,
+                                      float scale) {
+    struct wlr_tgui_output *output = tgui_output_from_output(wlr_output);
+    if (scale < 0.25) {
+        scale = 0.25;
+    } else if (scale > 1.0) {
+        scale = 1.0;
+    }
+    output->render_scale = scale;
+}
+
 static struct wlr_output_mode *
 output_create_mode(struct wlr_tgui_output *output,
                    int32_t width,
@@ -129,6 +427,32 @@ output_create_mode(struct wlr_tgui_output *output,
     return mode;
 }
 
+/**
+ * Let the allocator prepare buffers for the sizes the next swapchains will
+ * most likely use, before the compositor asks for them.
+ */
+static void output_prefetch_buffers(struct wlr_tgui_output *output) {
+    struct wlr_allocator *allocator = output->backend->backend.allocator;
+    if (allocator == NULL || output->view_width <= 0 ||
+        output->view_height <= 0) {
+        return;
+    }
+
+    uint32_t format = output->backend->output_format;
+    struct wlr_tgui_pool_hint hints[2] = {
+        {output->view_width, output->view_height, format, 0},
+    };
+    size_t hints_len = 1;
+    if (output->render_scale < 1.0) {
+        hints[hints_len++] = (struct wlr_tgui_pool_hint) {
+            .width = output->view_width * output->render_scale,
+            .height = output->view_height * output->render_scale,
+            .format = format,
+        };
+    }
+    tgui_allocator_prefetch(allocator, output, hints, hints_len);
+}
+
 static void output_configure_surfaceview(struct wlr_tgui_output *output) {
     TRY_LOG(tgui_activity_set_orientation, output->backend->conn,
             output->tgui_activity, TGUI_ORIENTATION_LANDSCAPE);
@@ -149,11 +473,63 @@ static void output_configure_surfaceview(struct wlr_tgui_output *output) {
     float w, h;
     TRY_LOG(tgui_get_dimensions, output->backend->conn, output->tgui_activity,
             output->tgui_surfaceview, TGUI_UNIT_PX, &w, &h);
-    output_create_mode(output, w, h, DEFAULT_REFRESH, true);
+    output->view_width = w;
+    output->view_height = h;
+    tgui_record_view_size(output->backend, output);
+    if (output->render_scale < 1.0) {
+        output_create_mode(output, w, h, DEFAULT_REFRESH, false);
+        output_create_mode(output, w * output->render_scale,
+                           h * output->render_scale, DEFAULT_REFRESH, true);
+    } else {
+        output_create_mode(output, w, h, DEFAULT_REFRESH, true);
+    }
+    output_prefetch_buffers(output);
+}
+
+/**
+ * Release the buffers of a paused output, Android is more likely to kill
+ * processes holding a lot of memory in the background. They are allocated
+ * again by the first frame after the activity resumes, until then the output
+ * gets no frame events.
+ */
+static void output_trim(struct wlr_tgui_output *output) {
+    struct wlr_allocator *allocator = output->backend->backend.allocator;
+    if (allocator == NULL) {
+        return;
+    }
+    size_t resident = tgui_allocator_get_resident_bytes(allocator);
+
+    // Forget the sizes of this output first, so that its buffers are
+    // destroyed when released, including the ones still being presented
+    tgui_allocator_trim(allocator, output);
+    output->trimmed = true;
+
+    struct wlr_output *wlr_output = &output->wlr_output;
+    wlr_swapchain_destroy(wlr_output->swapchain);
+    wlr_output->swapchain = NULL;
+    wlr_swapchain_destroy(wlr_output->cursor_swapchain);
+    wlr_output->cursor_swapchain = NULL;
+    wlr_swapchain_destroy(output->upscale_swapchain);
+    output->upscale_swapchain = NULL;
+
+    // Damage would schedule a frame, and the compositor would render into
+    // a new swapchain: mark a frame as pending until the activity resumes
+    wlr_output->frame_pending = true;
+    output->trimmed_frame_pending = true;
+
+    size_t remaining = tgui_allocator_get_resident_bytes(allocator);
+    size_t released = resident > remaining ? resident - remaining : 0;
+    struct wlr_tgui_memory_stats *stats = &output->backend->memory_stats;
+    stats->trims++;
+    stats->trimmed_bytes += released;
+    wlr_log(WLR_INFO, "Trimmed paused output %s: %zu KiB released, %zu KiB "
+                      "of hardware buffers left",
+            wlr_output->name, released / 1024, remaining / 1024);
 }
 
-int handle_activity_event(tgui_event *e, struct wlr_tgui_output *output) {
-    uint64_t time_ms = get_current_time_msec();
+int handle_activity_event(tgui_event *e,
+                          struct wlr_tgui_output *output,
+                          uint64_t time_ms) {
     switch (e->type) {
     case TGUI_EVENT_CREATE: {
         output_configure_surfaceview(output);
@@ -162,11 +538,28 @@ int handle_activity_event(tgui_event *e, struct wlr_tgui_output *output) {
     case TGUI_EVENT_START:
     case TGUI_EVENT_RESUME: {
         output->tgui_activity_is_foreground = true;
+        if (output->trimmed) {
+            output->trimmed = false;
+            output_prefetch_buffers(output);
+        }
+        bool trimmed_frame_pending = output->trimmed_frame_pending;
+        output->trimmed_frame_pending = false;
+        if (output->paused_frame_pending) {
+            wl_event_source_timer_update(output->paused_frame_timer, 0);
+            handle_paused_frame(output);
+        } else if (trimmed_frame_pending) {
+            wlr_output_send_frame(&output->wlr_output);
+        }
+        // Frames rendered while paused haven't been presented
+        wlr_output_damage_whole(&output->wlr_output);
         wlr_output_schedule_frame(&output->wlr_output);
         break;
     }
     case TGUI_EVENT_PAUSE: {
         output->tgui_activity_is_foreground = false;
+        if (output->backend->trim_paused && !output->trimmed) {
+            output_trim(output);
+        }
         break;
     }
     case TGUI_EVENT_DESTROY: {
@@ -187,6 +580,17 @@ int handle_activity_event(tgui_event *e, struct wlr_tgui_output *output) {
         break;
     }
     case TGUI_EVENT_SURFACE_CHANGED: {
+        // Rotation or resize, the next swapchain will follow the new size
+        float w, h;
+        if (tgui_get_dimensions(output->backend->conn, output->tgui_activity,
+                                output->tgui_surfaceview, TGUI_UNIT_PX, &w,
+                                &h) == TGUI_ERR_OK) {
+            output->view_width = w;
+            output->view_height = h;
+            tgui_record_view_size(output->backend, output);
+            output_prefetch_buffers(output);
+        }
+
         struct wlr_pointer_motion_absolute_event ev = {
             .pointer = &output->pointer,
             .time_msec = time_ms,
@@ -208,36 +612,99 @@ int handle_activity_event(tgui_event *e, struct wlr_tgui_output *output) {
     return 0;
 }
 
-static void *present_queue_thread(void *data) {
-    struct wlr_tgui_output *output = data;
-    output->present_thread_run = true;
+static void present_buffer(struct wlr_tgui_buffer *buffer, bool superseded) {
+    struct wlr_tgui_output *output = buffer->present_output;
+
+    // The upscale target is brought up to date even if it isn't shown, the
+    // next upscaled frames only redraw their own damage on top of it
+    struct wlr_tgui_buffer *present = buffer;
+    if (buffer->upscale_target != NULL &&
+        upscale_buffer(buffer, buffer->upscale_target)) {
+        present = buffer->upscale_target;
+    }
+
+    if (superseded || !output->tgui_activity_is_foreground) {
+        return;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    tgui_err ret = tgui_surface_view_set_buffer(
+        output->backend->conn, output->tgui_activity,
+        output->tgui_surfaceview, &present->buffer);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (ret != TGUI_ERR_OK) {
+        wlr_log(WLR_ERROR, "tgui_surface_view_set_buffer failed: %s",
+                TGUI_ERR_TO_STR(ret));
+    }
+
+    tgui_record_present(output->backend, output, present,
+                        timespec_to_nsec(&start), timespec_to_nsec(&end),
+                        ret);
+}
+
+/**
+ * Whether a later buffer of the same output is part of the batch, in which
+ * case this one would be replaced before ever being seen.
+ */
+static bool buffer_is_superseded(struct wlr_tgui_buffer *buffer,
+                                 struct wl_list *batch) {
+    for (struct wl_list *elm = buffer->link.next; elm != batch;
+         elm = elm->next) {
+        struct wlr_tgui_buffer *next = wl_container_of(elm, next, link);
+        if (next->present_output == buffer->present_output) {
+            return true;
+        }
+    }
+    return false;
+}
 
-    while (output->present_thread_run) {
-        struct wl_list *elm = wlr_queue_pull(&output->present_queue, false);
-        struct wlr_tgui_buffer *buffer = wl_container_of(elm, buffer, link);
+static void *present_thread(void *data) {
+    struct wlr_tgui_backend *backend = data;
 
-        if (!output->present_thread_run) {
-            wlr_queue_push(&output->idle_queue, &buffer->link);
+    pthread_mutex_lock(&backend->present_mutex);
+    while (true) {
+        while (backend->present_thread_run &&
+               wl_list_empty(&backend->present_pending)) {
+            pthread_cond_wait(&backend->present_cond, &backend->present_mutex);
+        }
+        if (!backend->present_thread_run) {
             break;
         }
 
-        if (output->tgui_activity_is_foreground) {
-            TRY_LOG(tgui_surface_view_set_buffer, output->backend->conn,
-                    output->tgui_activity, output->tgui_surfaceview,
-                    &buffer->buffer);
-        } else {
-            usleep(1000000000 / DEFAULT_REFRESH);
+        // Take everything queued so far, so that the outputs which committed
+        // since the last wakeup are all served by this one
+        struct wl_list batch;
+        wl_list_init(&batch);
+        wl_list_insert_list(&batch, &backend->present_pending);
+        wl_list_init(&backend->present_pending);
+
+        struct wlr_tgui_buffer *buffer;
+        wl_list_for_each(buffer, &batch, link) {
+            buffer->present_output->present_in_flight++;
+        }
+        pthread_mutex_unlock(&backend->present_mutex);
+
+        wl_list_for_each(buffer, &batch, link) {
+            present_buffer(buffer, buffer_is_superseded(buffer, &batch));
         }
 
-        wlr_queue_push(&output->idle_queue, &buffer->link);
+        pthread_mutex_lock(&backend->present_mutex);
+        wl_list_for_each(buffer, &batch, link) {
+            buffer->present_output->present_in_flight--;
+        }
+        wl_list_insert_list(backend->present_done.prev, &batch);
+        pthread_cond_broadcast(&backend->present_cond);
 
-        eventfd_write(output->present_complete_fd, 1);
+        eventfd_write(backend->present_complete_fd, 1);
     }
-    return 0;
+    pthread_mutex_unlock(&backend->present_mutex);
+
+    return NULL;
 }
 
 static int present_complete(int fd, uint32_t mask, void *data) {
-    struct wlr_tgui_output *output = data;
+    struct wlr_tgui_backend *backend = data;
 
     if ((mask & WL_EVENT_HANGUP) || (mask & WL_EVENT_ERROR)) {
         if (mask & WL_EVENT_ERROR) {
@@ -251,22 +718,79 @@ static int present_complete(int fd, uint32_t mask, void *data) {
         return 0;
     }
 
-    struct wl_list *elm;
-    while ((elm = wlr_queue_pull(&output->idle_queue, true)) != NULL) {
-        struct wlr_tgui_buffer *buffer = wl_container_of(elm, buffer, link);
-        wlr_buffer_unlock(&buffer->wlr_buffer);
-    };
+    struct wl_list done;
+    wl_list_init(&done);
+    pthread_mutex_lock(&backend->present_mutex);
+    wl_list_insert_list(&done, &backend->present_done);
+    wl_list_init(&backend->present_done);
+    pthread_mutex_unlock(&backend->present_mutex);
+
+    struct wlr_tgui_buffer *buffer, *buffer_tmp;
+    wl_list_for_each_safe(buffer, buffer_tmp, &done, link) {
+        buffer->present_output->present_done = true;
+        wl_list_remove(&buffer->link);
+        present_buffer_release(buffer);
+    }
 
-    struct wlr_output_event_present present_event = {
-        .commit_seq = output->wlr_output.commit_seq + 1,
-        .presented = true,
-        .flags = WLR_OUTPUT_PRESENT_ZERO_COPY,
-    };
-    wlr_output_send_present(&output->wlr_output, &present_event);
-    wlr_output_send_frame(&output->wlr_output);
+    struct wlr_tgui_output *output, *output_tmp;
+    wl_list_for_each_safe(output, output_tmp, &backend->outputs, link) {
+        if (!output->present_done) {
+            continue;
+        }
+        output->present_done = false;
+
+        struct wlr_output_event_present present_event = {
+            .commit_seq = output->wlr_output.commit_seq + 1,
+            .presented = true,
+            .flags = WLR_OUTPUT_PRESENT_ZERO_COPY,
+        };
+        wlr_output_send_present(&output->wlr_output, &present_event);
+        if (output->trimmed) {
+            // A frame would bring back the buffers of the trimmed output,
+            // it's sent when the activity resumes
+            output->trimmed_frame_pending = true;
+        } else {
+            wlr_output_send_frame(&output->wlr_output);
+        }
+    }
     return 0;
 }
 
+void tgui_present_init(struct wlr_tgui_backend *backend) {
+    pthread_mutex_init(&backend->present_mutex, NULL);
+    pthread_cond_init(&backend->present_cond, NULL);
+    wl_list_init(&backend->present_pending);
+    wl_list_init(&backend->present_done);
+
+    uint32_t events = WL_EVENT_READABLE | WL_EVENT_ERROR | WL_EVENT_HANGUP;
+    backend->present_complete_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    backend->present_complete_source =
+        wl_event_loop_add_fd(backend->loop, backend->present_complete_fd,
+                             events, present_complete, backend);
+
+    assert(backend->present_complete_fd >= 0 &&
+           backend->present_complete_source != NULL);
+
+    backend->present_thread_run = true;
+    pthread_create(&backend->present_thread, NULL, present_thread, backend);
+}
+
+void tgui_present_finish(struct wlr_tgui_backend *backend) {
+    // Outputs are destroyed first and take their buffers with them
+    assert(wl_list_empty(&backend->present_pending));
+
+    pthread_mutex_lock(&backend->present_mutex);
+    backend->present_thread_run = false;
+    pthread_cond_broadcast(&backend->present_cond);
+    pthread_mutex_unlock(&backend->present_mutex);
+    pthread_join(backend->present_thread, NULL);
+
+    wl_event_source_remove(backend->present_complete_source);
+    close(backend->present_complete_fd);
+    pthread_cond_destroy(&backend->present_cond);
+    pthread_mutex_destroy(&backend->present_mutex);
+}
+
 const struct wlr_pointer_impl tgui_pointer_impl = {
     .name = "tgui-pointer",
 };
@@ -275,6 +799,10 @@ const struct wlr_keyboard_impl tgui_keyboard_impl = {
     .name = "tgui-keyboard",
 };
 
+const struct wlr_touch_impl tgui_touch_impl = {
+    .name = "tgui-touch",
+};
+
 struct wlr_output *wlr_tgui_add_output(struct wlr_backend *wlr_backend) {
     struct wlr_tgui_backend *backend = tgui_backend_from_backend(wlr_backend);
 
@@ -284,10 +812,10 @@ struct wlr_output *wlr_tgui_add_output(struct wlr_backend *wlr_backend) {
         return NULL;
     }
     output->backend = backend;
+    output->render_scale = backend->render_scale;
 
-    wlr_queue_init(&output->present_queue);
-    wlr_queue_init(&output->idle_queue);
     wlr_pointer_init(&output->pointer, &tgui_pointer_impl, "tgui-pointer");
+    wlr_touch_init(&output->touch, &tgui_touch_impl, "tgui-touch");
     wlr_keyboard_init(&output->keyboard, &tgui_keyboard_impl,
                       "tgui-keyboard");
 
@@ -299,12 +827,12 @@ struct wlr_output *wlr_tgui_add_output(struct wlr_backend *wlr_backend) {
     }
     wlr_output_init(&output->wlr_output, &backend->backend, &output_impl,
                     backend->display);
+    wlr_damage_ring_init(&output->upscale_damage_ring);
     struct wlr_output *wlr_output = &output->wlr_output;
 
     wlr_output->adaptive_sync_status = WLR_OUTPUT_ADAPTIVE_SYNC_ENABLED;
-    wlr_output_set_render_format(wlr_output, DRM_FORMAT_ABGR8888);
+    wlr_output_set_render_format(wlr_output, backend->output_format);
     wlr_output_set_transform(wlr_output, WL_OUTPUT_TRANSFORM_FLIPPED_180);
-    wlr_output_lock_attach_render(wlr_output, true);
 
     tgui_activity_configuration activity_config;
     tgui_activity_get_configuration(backend->conn, output->tgui_activity,
@@ -321,6 +849,7 @@ struct wlr_output *wlr_tgui_add_output(struct wlr_backend *wlr_backend) {
     char name[64];
     snprintf(name, sizeof(name), "TGUI-%zu", output_num);
     wlr_output_set_name(wlr_output, name);
+    output->touch.output_name = strdup(name);
     tgui_activity_set_task_description(output->backend->conn,
                                        output->tgui_activity, NULL, 0, name);
 
@@ -331,18 +860,9 @@ struct wlr_output *wlr_tgui_add_output(struct wlr_backend *wlr_backend) {
 
     wl_list_insert(&backend->outputs, &output->link);
 
-    uint32_t events = WL_EVENT_READABLE | WL_EVENT_ERROR | WL_EVENT_HANGUP;
-    output->present_complete_fd =
-        eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK | EFD_SEMAPHORE);
-    output->present_complete_source =
-        wl_event_loop_add_fd(backend->loop, output->present_complete_fd,
-                             events, present_complete, output);
-
-    assert(output->present_complete_fd >= 0 &&
-           output->present_complete_source != NULL);
-
-    pthread_create(&output->present_thread, NULL, present_queue_thread,
-                   output);
+    output->paused_frame_timer =
+        wl_event_loop_add_timer(backend->loop, handle_paused_frame, output);
+    assert(output->paused_frame_timer != NULL);
 
     if (backend->started) {
         wlr_output_update_enabled(wlr_output, true);
@@ -352,6 +872,10 @@ struct wlr_output *wlr_tgui_add_output(struct wlr_backend *wlr_backend) {
                                &output->keyboard.base);
         wl_signal_emit_mutable(&backend->backend.events.new_input,
                                &output->pointer.base);
+        if (!backend->pointer_emulation) {
+            wl_signal_emit_mutable(&backend->backend.events.new_input,
+                                   &output->touch.base);
+        }
     }
 
     return wlr_output;
@@ -0,0 +1,162 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "backend/termuxgui.h"
+#include "util/time.h"
+
+void tgui_record_init(struct wlr_tgui_backend *backend) {
+    const char *path = getenv("WLR_TGUI_RECORD");
+    if (path == NULL || path[0] == '\0') {
+        return;
+    }
+
+    FILE *file = fopen(path, "we");
+    if (file == NULL) {
+        wlr_log_errno(WLR_ERROR, "Failed to open trace file %s", path);
+        return;
+    }
+
+    struct wlr_tgui_trace_header header = {
+        .magic = WLR_TGUI_TRACE_MAGIC,
+        .version = WLR_TGUI_TRACE_VERSION,
+    };
+    if (fwrite(&header, sizeof(header), 1, file) != 1) {
+        wlr_log_errno(WLR_ERROR, "Failed to write trace file %s", path);
+        fclose(file);
+        return;
+    }
+
+    wlr_log(WLR_INFO, "Recording Termux:GUI session to %s", path);
+    backend->record_file = file;
+}
+
+void tgui_record_finish(struct wlr_tgui_backend *backend) {
+    if (backend->record_file != NULL) {
+        fclose(backend->record_file);
+        backend->record_file = NULL;
+    }
+}
+
+/**
+ * Records are written with a single fwrite, which is atomic with respect to
+ * the other threads writing to the file.
+ */
+static void record_write(struct wlr_tgui_backend *backend,
+                         struct wlr_tgui_trace_record *record,
+                         size_t size) {
+    record->size = size - sizeof(*record);
+    if (fwrite(record, size, 1, backend->record_file) != 1) {
+        wlr_log_errno(WLR_ERROR, "Failed to write trace");
+        clearerr(backend->record_file);
+    }
+}
+
+void tgui_record_event(struct wlr_tgui_backend *backend,
+                       const tgui_event *e,
+                       int64_t time_nsec) {
+    if (backend->record_file == NULL) {
+        return;
+    }
+
+    struct {
+        struct wlr_tgui_trace_record record;
+        struct wlr_tgui_trace_event event;
+        struct wlr_tgui_trace_pointer pointers[WLR_TGUI_TRACE_MAX_POINTERS];
+    } data = {
+        .record = {
+            .type = WLR_TGUI_TRACE_EVENT,
+            .time_nsec = time_nsec,
+        },
+        .event = {
+            .type = e->type,
+            .activity = e->activity,
+        },
+    };
+    size_t size = sizeof(data.record) + sizeof(data.event);
+
+    switch (e->type) {
+    case TGUI_EVENT_KEY:
+        data.event.key.code = e->key.code;
+        data.event.key.code_point = e->key.codePoint;
+        data.event.key.mod = e->key.mod;
+        data.event.key.down = e->key.down;
+        break;
+    case TGUI_EVENT_TOUCH:
+        data.event.touch.action = e->touch.action;
+        data.event.touch.index = e->touch.index;
+        data.event.touch.num_pointers = e->touch.num_pointers;
+        for (uint32_t i = 0; i < e->touch.num_pointers &&
+                             i < WLR_TGUI_TRACE_MAX_POINTERS;
+             i++) {
+            const tgui_touch_pointer *p = &e->touch.pointers[0][i];
+            data.pointers[i] = (struct wlr_tgui_trace_pointer) {
+                .id = p->id,
+                .x = p->x,
+                .y = p->y,
+            };
+            size += sizeof(data.pointers[i]);
+        }
+        break;
+    default:
+        break;
+    }
+
+    record_write(backend, &data.record, size);
+}
+
+void tgui_record_present(struct wlr_tgui_backend *backend,
+                         struct wlr_tgui_output *output,
+                         struct wlr_tgui_buffer *buffer,
+                         int64_t start_nsec,
+                         int64_t end_nsec,
+                         tgui_err result) {
+    if (backend->record_file == NULL) {
+        return;
+    }
+
+    struct {
+        struct wlr_tgui_trace_record record;
+        struct wlr_tgui_trace_present present;
+    } data = {
+        .record = {
+            .type = WLR_TGUI_TRACE_PRESENT,
+            .time_nsec = start_nsec,
+        },
+        .present = {
+            .activity = output->tgui_activity,
+            .width = buffer->wlr_buffer.width,
+            .height = buffer->wlr_buffer.height,
+            .format = buffer->format,
+            .duration_nsec = end_nsec - start_nsec,
+            .result = result,
+        },
+    };
+    record_write(backend, &data.record, sizeof(data));
+}
+
+void tgui_record_view_size(struct wlr_tgui_backend *backend,
+                           struct wlr_tgui_output *output) {
+    if (backend->record_file == NULL) {
+        return;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    struct {
+        struct wlr_tgui_trace_record record;
+        struct wlr_tgui_trace_view_size view_size;
+    } data = {
+        .record = {
+            .type = WLR_TGUI_TRACE_VIEW_SIZE,
+            .time_nsec = timespec_to_nsec(&now),
+        },
+        .view_size = {
+            .activity = output->tgui_activity,
+            .width = output->view_width,
+            .height = output->view_height,
+        },
+    };
+    record_write(backend, &data.record, sizeof(data));
+}
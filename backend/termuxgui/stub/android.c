@@ -0,0 +1,147 @@
+#define _GNU_SOURCE
+#include <android/hardware_buffer.h>
+#include <errno.h>
+#include <linux/memfd.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/**
+ * Hardware buffers backed by a memfd, which stands in for the dmabuf of a
+ * gralloc buffer. Rows are padded to 16 pixels as most gralloc
+ * implementations do, so that the stride differs from the width.
+ */
+struct AHardwareBuffer {
+    atomic_int refs;
+    AHardwareBuffer_Desc desc;
+    size_t size;
+    void *data;
+    atomic_int locks;
+    // native_handle_t with a single fd
+    struct {
+        int version;
+        int numFds;
+        int numInts;
+        int data[1];
+    } handle;
+};
+
+static uint32_t format_bytes_per_pixel(uint32_t format) {
+    switch (format) {
+    case AHARDWAREBUFFER_FORMAT_R8G8B8A8_UNORM:
+    case AHARDWAREBUFFER_FORMAT_R8G8B8X8_UNORM:
+        return 4;
+    case AHARDWAREBUFFER_FORMAT_R8G8B8_UNORM:
+        return 3;
+    case AHARDWAREBUFFER_FORMAT_R5G6B5_UNORM:
+        return 2;
+    default:
+        return 0;
+    }
+}
+
+int AHardwareBuffer_allocate(const AHardwareBuffer_Desc *desc,
+                             AHardwareBuffer **outBuffer) {
+    uint32_t bpp = format_bytes_per_pixel(desc->format);
+    if (bpp == 0 || desc->width == 0 || desc->height == 0 ||
+        desc->layers != 1) {
+        return -EINVAL;
+    }
+
+    AHardwareBuffer *buffer = calloc(1, sizeof(*buffer));
+    if (buffer == NULL) {
+        return -ENOMEM;
+    }
+    atomic_init(&buffer->refs, 1);
+    atomic_init(&buffer->locks, 0);
+    buffer->desc = *desc;
+    buffer->desc.stride = (desc->width + 15) & ~15u;
+    buffer->size = (size_t) buffer->desc.stride * desc->height * bpp;
+
+    // Bionic only declares memfd_create() from API level 30
+    int fd = syscall(SYS_memfd_create, "AHardwareBuffer", MFD_CLOEXEC);
+    if (fd < 0) {
+        free(buffer);
+        return -errno;
+    }
+    if (ftruncate(fd, buffer->size) != 0) {
+        int err = errno;
+        close(fd);
+        free(buffer);
+        return -err;
+    }
+    buffer->data =
+        mmap(NULL, buffer->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (buffer->data == MAP_FAILED) {
+        int err = errno;
+        close(fd);
+        free(buffer);
+        return -err;
+    }
+
+    buffer->handle.version = sizeof(buffer->handle);
+    buffer->handle.numFds = 1;
+    buffer->handle.numInts = 0;
+    buffer->handle.data[0] = fd;
+
+    *outBuffer = buffer;
+    return 0;
+}
+
+void AHardwareBuffer_acquire(AHardwareBuffer *buffer) {
+    atomic_fetch_add(&buffer->refs, 1);
+}
+
+void AHardwareBuffer_release(AHardwareBuffer *buffer) {
+    if (buffer == NULL || atomic_fetch_sub(&buffer->refs, 1) != 1) {
+        return;
+    }
+    munmap(buffer->data, buffer->size);
+    close(buffer->handle.data[0]);
+    free(buffer);
+}
+
+void AHardwareBuffer_describe(const AHardwareBuffer *buffer,
+                              AHardwareBuffer_Desc *outDesc) {
+    *outDesc = buffer->desc;
+}
+
+int AHardwareBuffer_lock(AHardwareBuffer *buffer,
+                         uint64_t usage,
+                         int32_t fence,
+                         const ARect *rect,
+                         void **outVirtualAddress) {
+    if (fence >= 0) {
+        close(fence);
+    }
+    if ((usage & ~(AHARDWAREBUFFER_USAGE_CPU_READ_MASK |
+                   AHARDWAREBUFFER_USAGE_CPU_WRITE_MASK)) != 0) {
+        return -EINVAL;
+    }
+    atomic_fetch_add(&buffer->locks, 1);
+    *outVirtualAddress = buffer->data;
+    return 0;
+}
+
+int AHardwareBuffer_unlock(AHardwareBuffer *buffer, int32_t *fence) {
+    if (atomic_fetch_sub(&buffer->locks, 1) <= 0) {
+        atomic_fetch_add(&buffer->locks, 1);
+        return -EINVAL;
+    }
+    if (fence != NULL) {
+        *fence = -1;
+    }
+    return 0;
+}
+
+/**
+ * Not part of the NDK, the backend looks it up with dlsym() to find the
+ * dmabuf of a buffer.
+ */
+const void *AHardwareBuffer_getNativeHandle(const AHardwareBuffer *buffer);
+
+const void *AHardwareBuffer_getNativeHandle(const AHardwareBuffer *buffer) {
+    return &buffer->handle;
+}
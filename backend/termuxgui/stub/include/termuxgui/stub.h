@@ -0,0 +1,29 @@
+/*
+ * Extensions of the stub libtermuxgui, for tests and tools to observe what
+ * the backend asked of the Termux:GUI plugin. Activities of the stub are
+ * created, started and resumed right away, unless a trace is replayed (see
+ * docs/env_vars.md).
+ */
+#ifndef TERMUXGUI_STUB_H
+#define TERMUXGUI_STUB_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct tgui_stub_stats {
+    uint64_t activities; // created
+    uint64_t events, input_events; // delivered by tgui_wait_event
+    uint64_t presents; // tgui_surface_view_set_buffer calls
+    uint64_t present_nsec; // spent in tgui_surface_view_set_buffer
+    uint64_t max_concurrent_presents;
+    uint64_t buffers_created, buffers_destroyed;
+    bool replaying;
+    bool replay_finished; // every event of the trace has been delivered
+};
+
+/**
+ * Get the statistics of all the connections of the process.
+ */
+void tgui_stub_get_stats(struct tgui_stub_stats *stats);
+
+#endif
@@ -0,0 +1,261 @@
+/*
+ * The subset of the termux-gui-c API used by the Termux:GUI backend,
+ * implemented by the stub libtermuxgui for builds and tests outside of
+ * Android. Only the declarations the backend relies on are kept, with the
+ * same names and calling conventions.
+ */
+#ifndef TERMUXGUI_TERMUXGUI_H
+#define TERMUXGUI_TERMUXGUI_H
+
+#include <android/hardware_buffer.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum tgui_err {
+    TGUI_ERR_OK = 0,
+    TGUI_ERR_SYSTEM,
+    TGUI_ERR_CONNECTION_LOST,
+    TGUI_ERR_ACTIVITY_DESTROYED,
+    TGUI_ERR_MESSAGE,
+    TGUI_ERR_NOMEM,
+    TGUI_ERR_EXCEPTION,
+    TGUI_ERR_VIEW_INVALID,
+    TGUI_ERR_API_LEVEL,
+} tgui_err;
+
+typedef struct tgui_connection_ *tgui_connection;
+typedef int tgui_activity;
+typedef int tgui_view;
+
+typedef enum tgui_activity_type {
+    TGUI_ACTIVITY_NORMAL,
+    TGUI_ACTIVITY_DIALOG,
+    TGUI_ACTIVITY_DIALOG_CANCEL_OUTSIDE,
+    TGUI_ACTIVITY_PIP,
+    TGUI_ACTIVITY_LOCKSCREEN,
+    TGUI_ACTIVITY_OVERLAY,
+} tgui_activity_type;
+
+typedef enum tgui_orientation {
+    TGUI_ORIENTATION_UNSPECIFIED,
+    TGUI_ORIENTATION_BEHIND,
+    TGUI_ORIENTATION_FULL_SENSOR,
+    TGUI_ORIENTATION_FULL_USER,
+    TGUI_ORIENTATION_LANDSCAPE,
+    TGUI_ORIENTATION_LOCKED,
+    TGUI_ORIENTATION_NOSENSOR,
+    TGUI_ORIENTATION_PORTRAIT,
+} tgui_orientation;
+
+typedef struct tgui_activity_configuration {
+    const char *dark_mode;
+    const char *country;
+    const char *language;
+    float density;
+    int screen_width, screen_height; // in dp
+    int font_scale;
+    bool keyboard_hidden;
+    tgui_orientation orientation;
+} tgui_activity_configuration;
+
+typedef enum tgui_inset {
+    TGUI_INSET_NAVIGATION_BAR,
+    TGUI_INSET_STATUS_BAR,
+    TGUI_INSET_ALL,
+} tgui_inset;
+
+typedef enum tgui_inset_behaviour {
+    TGUI_INSET_BEHAVIOUR_DEFAULT,
+    TGUI_INSET_BEHAVIOUR_TRANSIENT,
+} tgui_inset_behaviour;
+
+typedef enum tgui_view_visibility {
+    TGUI_VIS_VISIBLE,
+    TGUI_VIS_HIDDEN,
+    TGUI_VIS_GONE,
+} tgui_view_visibility;
+
+typedef enum tgui_surface_view_mismatch {
+    TGUI_MISMATCH_STICK_TOPLEFT,
+    TGUI_MISMATCH_CENTER_AXIS,
+} tgui_surface_view_mismatch;
+
+typedef enum tgui_view_size_unit {
+    TGUI_UNIT_PX,
+    TGUI_UNIT_DP,
+    TGUI_UNIT_SP,
+    TGUI_UNIT_PT,
+    TGUI_UNIT_MM,
+    TGUI_UNIT_IN,
+} tgui_view_size_unit;
+
+typedef enum tgui_hardware_buffer_format {
+    TGUI_HARDWARE_BUFFER_FORMAT_RGBA8888,
+    TGUI_HARDWARE_BUFFER_FORMAT_RGBX8888,
+    TGUI_HARDWARE_BUFFER_FORMAT_RGB888,
+    TGUI_HARDWARE_BUFFER_FORMAT_RGB565,
+} tgui_hardware_buffer_format;
+
+typedef enum tgui_hardware_buffer_cpu_frequency {
+    TGUI_HARDWARE_BUFFER_CPU_NEVER,
+    TGUI_HARDWARE_BUFFER_CPU_RARELY,
+    TGUI_HARDWARE_BUFFER_CPU_OFTEN,
+} tgui_hardware_buffer_cpu_frequency;
+
+typedef struct tgui_hardware_buffer {
+    AHardwareBuffer *buffer;
+    uint64_t id;
+} tgui_hardware_buffer;
+
+typedef enum tgui_touch_action {
+    TGUI_TOUCH_DOWN,
+    TGUI_TOUCH_UP,
+    TGUI_TOUCH_POINTER_DOWN,
+    TGUI_TOUCH_POINTER_UP,
+    TGUI_TOUCH_CANCEL,
+    TGUI_TOUCH_MOVE,
+} tgui_touch_action;
+
+typedef struct tgui_touch_pointer {
+    int32_t id;
+    float x, y; // in px, relative to the view
+} tgui_touch_pointer;
+
+typedef enum tgui_modifier {
+    TGUI_MOD_LSHIFT = 1 << 0,
+    TGUI_MOD_RSHIFT = 1 << 1,
+    TGUI_MOD_LCTRL = 1 << 2,
+    TGUI_MOD_RCTRL = 1 << 3,
+    TGUI_MOD_ALT = 1 << 4,
+    TGUI_MOD_FN = 1 << 5,
+    TGUI_MOD_CAPS_LOCK = 1 << 6,
+    TGUI_MOD_ALT_GR = 1 << 7,
+    TGUI_MOD_NUM_LOCK = 1 << 8,
+} tgui_modifier;
+
+typedef enum tgui_event_type {
+    TGUI_EVENT_CREATE,
+    TGUI_EVENT_START,
+    TGUI_EVENT_RESUME,
+    TGUI_EVENT_PAUSE,
+    TGUI_EVENT_STOP,
+    TGUI_EVENT_DESTROY,
+    TGUI_EVENT_KEY,
+    TGUI_EVENT_TOUCH,
+    TGUI_EVENT_SURFACE_CHANGED,
+    TGUI_EVENT_FRAME_COMPLETE,
+} tgui_event_type;
+
+typedef struct tgui_event {
+    tgui_event_type type;
+    tgui_activity activity;
+    tgui_view id;
+    union {
+        struct {
+            uint32_t code;
+            uint32_t codePoint;
+            uint32_t mod; // tgui_modifier
+            bool down;
+        } key;
+        struct {
+            tgui_touch_action action;
+            uint64_t time;
+            uint32_t index; // of the pointer which went down or up
+            uint32_t num_pointers;
+            // Samples of the pointers since the last event, each an array
+            // of num_pointers pointers
+            tgui_touch_pointer **pointers;
+        } touch;
+        struct {
+            uint64_t timestamp;
+        } frame_complete;
+    };
+} tgui_event;
+
+tgui_err tgui_connection_create(tgui_connection *conn);
+
+void tgui_connection_destroy(tgui_connection conn);
+
+tgui_err tgui_wait_event(tgui_connection conn, tgui_event *event);
+
+void tgui_event_destroy(tgui_event *event);
+
+tgui_err tgui_activity_create(tgui_connection conn,
+                              tgui_activity *activity,
+                              tgui_activity_type type,
+                              tgui_activity *parent,
+                              bool intercept_back);
+
+tgui_err tgui_activity_finish(tgui_connection conn, tgui_activity activity);
+
+tgui_err
+tgui_activity_get_configuration(tgui_connection conn,
+                                tgui_activity activity,
+                                tgui_activity_configuration *config);
+
+tgui_err tgui_activity_set_task_description(tgui_connection conn,
+                                            tgui_activity activity,
+                                            void *image,
+                                            size_t image_size,
+                                            const char *label);
+
+tgui_err tgui_activity_set_orientation(tgui_connection conn,
+                                       tgui_activity activity,
+                                       tgui_orientation orientation);
+
+tgui_err tgui_activity_configure_insets(tgui_connection conn,
+                                        tgui_activity activity,
+                                        tgui_inset inset,
+                                        tgui_inset_behaviour behaviour);
+
+tgui_err tgui_create_surface_view(tgui_connection conn,
+                                  tgui_activity activity,
+                                  tgui_view *view,
+                                  tgui_view *parent,
+                                  tgui_view_visibility visibility,
+                                  bool keyboard);
+
+tgui_err tgui_surface_view_config(tgui_connection conn,
+                                  tgui_activity activity,
+                                  tgui_view view,
+                                  uint32_t background,
+                                  tgui_surface_view_mismatch x,
+                                  tgui_surface_view_mismatch y,
+                                  int32_t frame_rate);
+
+tgui_err tgui_surface_view_set_buffer(tgui_connection conn,
+                                      tgui_activity activity,
+                                      tgui_view view,
+                                      tgui_hardware_buffer *buffer);
+
+tgui_err tgui_send_touch_event(tgui_connection conn,
+                               tgui_activity activity,
+                               tgui_view view,
+                               bool send);
+
+tgui_err tgui_focus(tgui_connection conn,
+                    tgui_activity activity,
+                    tgui_view view,
+                    bool force_soft);
+
+tgui_err tgui_get_dimensions(tgui_connection conn,
+                             tgui_activity activity,
+                             tgui_view view,
+                             tgui_view_size_unit unit,
+                             float *width,
+                             float *height);
+
+tgui_err
+tgui_hardware_buffer_create(tgui_connection conn,
+                            tgui_hardware_buffer *buffer,
+                            tgui_hardware_buffer_format format,
+                            uint32_t width,
+                            uint32_t height,
+                            tgui_hardware_buffer_cpu_frequency cpu_read,
+                            tgui_hardware_buffer_cpu_frequency cpu_write);
+
+tgui_err tgui_hardware_buffer_destroy(tgui_connection conn,
+                                      tgui_hardware_buffer *buffer);
+
+#endif
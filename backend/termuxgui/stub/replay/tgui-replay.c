@@ -0,0 +1,371 @@
+#define _POSIX_C_SOURCE 200809L
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <termuxgui/stub.h>
+#include <time.h>
+#include <wayland-server-core.h>
+#include <wlr/backend.h>
+#include <wlr/backend/termuxgui.h>
+#include <wlr/render/allocator.h>
+#include <wlr/render/pixman.h>
+#include <wlr/render/wlr_renderer.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_pointer.h>
+#include <wlr/types/wlr_scene.h>
+#include <wlr/types/wlr_touch.h>
+#include <wlr/util/log.h>
+
+#include "backend/termuxgui/trace.h"
+
+/**
+ * Replay a session recorded with WLR_TGUI_RECORD against the stub Termux:GUI
+ * library: one output is created per activity of the trace, showing an
+ * animated scene with a cursor following the pointer and touch input, and
+ * statistics are printed once every event has been handled.
+ */
+
+struct replay {
+    struct wl_display *display;
+    struct wlr_backend *backend;
+    struct wlr_renderer *renderer;
+    struct wlr_allocator *allocator;
+    struct wlr_scene *scene;
+    struct wlr_scene_rect *square, *cursor;
+    struct wl_event_source *check_timer;
+    struct wl_list outputs;
+
+    uint64_t frames;
+
+    struct wl_listener new_output;
+    struct wl_listener new_input;
+};
+
+struct replay_output {
+    struct replay *replay;
+    struct wlr_output *wlr_output;
+    struct wlr_scene_output *scene_output;
+    struct wl_list link;
+
+    struct wl_listener frame;
+    struct wl_listener destroy;
+};
+
+struct replay_input {
+    struct replay *replay;
+    struct wlr_input_device *device;
+
+    struct wl_listener event; // motion_absolute or down
+    struct wl_listener destroy;
+};
+
+static int64_t get_time_msec(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/**
+ * Count the distinct activities of a trace, one output is needed for each.
+ */
+static int count_trace_activities(const char *path) {
+    FILE *file = fopen(path, "re");
+    if (file == NULL) {
+        perror(path);
+        return -1;
+    }
+
+    struct wlr_tgui_trace_header header;
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        header.magic != WLR_TGUI_TRACE_MAGIC) {
+        fprintf(stderr, "%s is not a trace\n", path);
+        fclose(file);
+        return -1;
+    }
+
+    int32_t activities[64];
+    int activities_len = 0;
+    struct wlr_tgui_trace_record record;
+    while (fread(&record, sizeof(record), 1, file) == 1) {
+        struct wlr_tgui_trace_event event;
+        if (record.type != WLR_TGUI_TRACE_EVENT ||
+            record.size < sizeof(event)) {
+            fseek(file, record.size, SEEK_CUR);
+            continue;
+        }
+        if (fread(&event, sizeof(event), 1, file) != 1) {
+            break;
+        }
+        fseek(file, record.size - sizeof(event), SEEK_CUR);
+
+        bool found = false;
+        for (int i = 0; i < activities_len; i++) {
+            found = found || activities[i] == event.activity;
+        }
+        if (!found && activities_len < 64) {
+            activities[activities_len++] = event.activity;
+        }
+    }
+
+    fclose(file);
+    return activities_len;
+}
+
+static void output_handle_frame(struct wl_listener *listener, void *data) {
+    struct replay_output *output = wl_container_of(listener, output, frame);
+    struct replay *replay = output->replay;
+    struct wlr_output *wlr_output = output->wlr_output;
+
+    // Follow the surface view size once the activity has been created
+    struct wlr_output_mode *mode = wlr_output_preferred_mode(wlr_output);
+    if (mode != NULL && mode != wlr_output->current_mode) {
+        wlr_output_set_mode(wlr_output, mode);
+    }
+
+    int64_t t = get_time_msec();
+    int width = wlr_output->width > 64 ? wlr_output->width - 64 : 1;
+    wlr_scene_node_set_position(&replay->square->node, (t / 4) % width,
+                                wlr_output->height / 2);
+
+    if (wlr_scene_output_commit(output->scene_output)) {
+        replay->frames++;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    wlr_scene_output_send_frame_done(output->scene_output, &now);
+}
+
+static void output_handle_destroy(struct wl_listener *listener, void *data) {
+    struct replay_output *output = wl_container_of(listener, output, destroy);
+    wl_list_remove(&output->frame.link);
+    wl_list_remove(&output->destroy.link);
+    wl_list_remove(&output->link);
+    free(output);
+}
+
+static void handle_new_output(struct wl_listener *listener, void *data) {
+    struct replay *replay = wl_container_of(listener, replay, new_output);
+    struct wlr_output *wlr_output = data;
+
+    wlr_output_init_render(wlr_output, replay->allocator, replay->renderer);
+
+    struct replay_output *output = calloc(1, sizeof(*output));
+    if (output == NULL) {
+        return;
+    }
+    output->replay = replay;
+    output->wlr_output = wlr_output;
+    output->scene_output = wlr_scene_output_create(replay->scene, wlr_output);
+    output->frame.notify = output_handle_frame;
+    wl_signal_add(&wlr_output->events.frame, &output->frame);
+    output->destroy.notify = output_handle_destroy;
+    wl_signal_add(&wlr_output->events.destroy, &output->destroy);
+    wl_list_insert(&replay->outputs, &output->link);
+
+    struct wlr_output_mode *mode = wlr_output_preferred_mode(wlr_output);
+    if (mode != NULL) {
+        wlr_output_set_mode(wlr_output, mode);
+    }
+    wlr_output_enable(wlr_output, true);
+    if (!wlr_output_commit(wlr_output)) {
+        wlr_log(WLR_ERROR, "Failed to enable output %s", wlr_output->name);
+    }
+}
+
+static void input_handle_event(struct wl_listener *listener, void *data) {
+    struct replay_input *input = wl_container_of(listener, input, event);
+    struct replay *replay = input->replay;
+
+    // Outputs all show the scene from its origin
+    double x, y;
+    if (input->device->type == WLR_INPUT_DEVICE_POINTER) {
+        struct wlr_pointer_motion_absolute_event *event = data;
+        x = event->x;
+        y = event->y;
+    } else if (input->device->type == WLR_INPUT_DEVICE_TOUCH) {
+        struct wlr_touch_down_event *event = data;
+        x = event->x;
+        y = event->y;
+    } else {
+        return;
+    }
+    if (!wl_list_empty(&replay->outputs)) {
+        struct replay_output *output =
+            wl_container_of(replay->outputs.next, output, link);
+        wlr_scene_node_set_position(&replay->cursor->node,
+                                    x * output->wlr_output->width,
+                                    y * output->wlr_output->height);
+    }
+}
+
+static void input_handle_destroy(struct wl_listener *listener, void *data) {
+    struct replay_input *input = wl_container_of(listener, input, destroy);
+    wl_list_remove(&input->event.link);
+    wl_list_remove(&input->destroy.link);
+    free(input);
+}
+
+static void handle_new_input(struct wl_listener *listener, void *data) {
+    struct replay *replay = wl_container_of(listener, replay, new_input);
+    struct wlr_input_device *device = data;
+
+    struct wl_signal *signal;
+    switch (device->type) {
+    case WLR_INPUT_DEVICE_POINTER:
+        signal =
+            &wlr_pointer_from_input_device(device)->events.motion_absolute;
+        break;
+    case WLR_INPUT_DEVICE_TOUCH:
+        signal = &wlr_touch_from_input_device(device)->events.down;
+        break;
+    default:
+        return;
+    }
+
+    struct replay_input *input = calloc(1, sizeof(*input));
+    if (input == NULL) {
+        return;
+    }
+    input->replay = replay;
+    input->device = device;
+    input->event.notify = input_handle_event;
+    wl_signal_add(signal, &input->event);
+    input->destroy.notify = input_handle_destroy;
+    wl_signal_add(&device->events.destroy, &input->destroy);
+}
+
+static void print_stats(struct replay *replay) {
+    struct tgui_stub_stats stats;
+    tgui_stub_get_stats(&stats);
+    struct wlr_tgui_input_latency latency;
+    wlr_tgui_backend_get_input_latency(replay->backend, &latency);
+    struct wlr_tgui_memory_stats memory;
+    wlr_tgui_backend_get_memory_stats(replay->backend, &memory);
+
+    printf("events: %" PRIu64 " (%" PRIu64 " input)\n", stats.events,
+           stats.input_events);
+    printf("input latency: %.1f us mean, %" PRIu64 " us max\n",
+           latency.count > 0 ? (double) latency.total_us / latency.count : 0,
+           latency.max_us);
+    printf("frames: %" PRIu64 "\n", replay->frames);
+    printf("presents: %" PRIu64 ", %.1f us mean\n", stats.presents,
+           stats.presents > 0
+               ? (double) stats.present_nsec / stats.presents / 1000
+               : 0);
+    printf("hardware buffers: %" PRIu64 " created, %" PRIu64
+           " destroyed, %zu KiB resident\n",
+           stats.buffers_created, stats.buffers_destroyed,
+           memory.resident_bytes / 1024);
+    printf("trims: %" PRIu64 ", %" PRIu64 " KiB released\n", memory.trims,
+           memory.trimmed_bytes / 1024);
+}
+
+/**
+ * The replay is over once every event of the trace has been delivered by the
+ * stub and handled by the backend.
+ */
+static int handle_check_timer(void *data) {
+    struct replay *replay = data;
+
+    struct tgui_stub_stats stats;
+    tgui_stub_get_stats(&stats);
+    struct wlr_tgui_input_latency latency;
+    wlr_tgui_backend_get_input_latency(replay->backend, &latency);
+
+    if (stats.replay_finished && latency.count >= stats.input_events) {
+        print_stats(replay);
+        wl_display_terminate(replay->display);
+        return 0;
+    }
+
+    wl_event_source_timer_update(replay->check_timer, 10);
+    return 0;
+}
+
+static const char usage[] =
+    "usage: tgui-replay [-d] [-s speed] trace\n"
+    "\n"
+    "  -d        print debug logs\n"
+    "  -s speed  replay speed, 0 to replay as fast as possible "
+    "(default: 1)\n";
+
+int main(int argc, char *argv[]) {
+    enum wlr_log_importance verbosity = WLR_ERROR;
+    const char *speed = NULL;
+    int c;
+    while ((c = getopt(argc, argv, "ds:h")) != -1) {
+        switch (c) {
+        case 'd':
+            verbosity = WLR_DEBUG;
+            break;
+        case 's':
+            speed = optarg;
+            break;
+        default:
+            fprintf(stderr, "%s", usage);
+            return c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    if (optind != argc - 1) {
+        fprintf(stderr, "%s", usage);
+        return EXIT_FAILURE;
+    }
+    const char *path = argv[optind];
+    wlr_log_init(verbosity, NULL);
+
+    int outputs = count_trace_activities(path);
+    if (outputs < 0) {
+        return EXIT_FAILURE;
+    }
+    setenv("WLR_TGUI_REPLAY", path, true);
+    if (speed != NULL) {
+        setenv("WLR_TGUI_REPLAY_SPEED", speed, true);
+    }
+
+    struct replay replay = {0};
+    wl_list_init(&replay.outputs);
+    replay.display = wl_display_create();
+    replay.backend = wlr_tgui_backend_create(replay.display);
+    if (replay.backend == NULL) {
+        return EXIT_FAILURE;
+    }
+    replay.renderer = wlr_pixman_renderer_create();
+    replay.allocator =
+        wlr_allocator_autocreate(replay.backend, replay.renderer);
+    if (replay.renderer == NULL || replay.allocator == NULL) {
+        return EXIT_FAILURE;
+    }
+
+    replay.scene = wlr_scene_create();
+    wlr_scene_rect_create(&replay.scene->tree, 4096, 4096,
+                          (float[4]) {0.2, 0.2, 0.3, 1});
+    replay.square = wlr_scene_rect_create(&replay.scene->tree, 64, 64,
+                                          (float[4]) {0.8, 0.3, 0.2, 1});
+    replay.cursor = wlr_scene_rect_create(&replay.scene->tree, 16, 16,
+                                          (float[4]) {1, 1, 1, 1});
+
+    replay.new_output.notify = handle_new_output;
+    wl_signal_add(&replay.backend->events.new_output, &replay.new_output);
+    replay.new_input.notify = handle_new_input;
+    wl_signal_add(&replay.backend->events.new_input, &replay.new_input);
+
+    if (!wlr_backend_start(replay.backend)) {
+        return EXIT_FAILURE;
+    }
+    for (int i = 0; i < outputs; i++) {
+        wlr_tgui_add_output(replay.backend);
+    }
+
+    struct wl_event_loop *loop = wl_display_get_event_loop(replay.display);
+    replay.check_timer =
+        wl_event_loop_add_timer(loop, handle_check_timer, &replay);
+    wl_event_source_timer_update(replay.check_timer, 10);
+
+    wl_display_run(replay.display);
+
+    wl_event_source_remove(replay.check_timer);
+    wl_display_destroy(replay.display);
+    return EXIT_SUCCESS;
+}
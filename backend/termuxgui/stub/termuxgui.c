@@ -0,0 +1,870 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termuxgui/stub.h>
+#include <termuxgui/termuxgui.h>
+#include <time.h>
+
+#include "backend/termuxgui/trace.h"
+
+#define DEFAULT_VIEW_WIDTH 1280
+#define DEFAULT_VIEW_HEIGHT 720
+
+struct stub_activity {
+    tgui_activity id;
+    tgui_view view;
+    int width, height; // of the surface view, in px
+    bool finished;
+};
+
+/**
+ * A recorded event, along with the surface view size the backend read after
+ * handling it, if any.
+ */
+struct replay_event {
+    int64_t time_nsec;
+    size_t activity; // index in the order of first appearance in the trace
+    struct wlr_tgui_trace_event event;
+    struct wlr_tgui_trace_pointer pointers[WLR_TGUI_TRACE_MAX_POINTERS];
+    int view_width, view_height; // 0 if unchanged
+};
+
+struct replay_activity {
+    int32_t trace_id;
+    int64_t *present_nsec; // recorded durations of the presents
+    size_t presents_len, next_present;
+};
+
+struct replay {
+    struct replay_event *events;
+    size_t events_len, next_event;
+    struct replay_activity *activities;
+    size_t activities_len;
+    double speed; // 0 to deliver events as fast as possible
+    int64_t start_nsec; // when the first event was delivered
+};
+
+struct stub_event {
+    struct stub_event *next;
+    tgui_event event;
+};
+
+struct tgui_connection_ {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    bool closed;
+    int waiters;
+
+    struct stub_activity *activities;
+    size_t activities_len;
+    tgui_view next_view;
+
+    // Events generated by the stub, when not replaying
+    struct stub_event *queue_head, **queue_tail;
+
+    struct replay *replay;
+
+    int view_width, view_height;
+    int64_t present_nsec;
+    int64_t alloc_nsec;
+};
+
+static pthread_mutex_t stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct tgui_stub_stats stats;
+static uint64_t concurrent_presents;
+static tgui_activity next_activity = 1;
+static uint64_t next_buffer = 1;
+
+void tgui_stub_get_stats(struct tgui_stub_stats *out) {
+    pthread_mutex_lock(&stats_mutex);
+    *out = stats;
+    pthread_mutex_unlock(&stats_mutex);
+}
+
+static int64_t get_time_nsec(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static struct replay_activity *replay_get_activity(struct replay *replay,
+                                                   int32_t trace_id,
+                                                   size_t *index) {
+    for (size_t i = 0; i < replay->activities_len; i++) {
+        if (replay->activities[i].trace_id == trace_id) {
+            *index = i;
+            return &replay->activities[i];
+        }
+    }
+
+    struct replay_activity *activities =
+        realloc(replay->activities,
+                (replay->activities_len + 1) * sizeof(*activities));
+    if (activities == NULL) {
+        return NULL;
+    }
+    replay->activities = activities;
+    *index = replay->activities_len++;
+    struct replay_activity *activity = &activities[*index];
+    memset(activity, 0, sizeof(*activity));
+    activity->trace_id = trace_id;
+    return activity;
+}
+
+static void replay_destroy(struct replay *replay) {
+    if (replay == NULL) {
+        return;
+    }
+    for (size_t i = 0; i < replay->activities_len; i++) {
+        free(replay->activities[i].present_nsec);
+    }
+    free(replay->activities);
+    free(replay->events);
+    free(replay);
+}
+
+/**
+ * The backend records the surface view size after handling the event which
+ * changed it, from another thread than the one recording events: attach it
+ * to the last event of the activity which can change it.
+ */
+static void replay_set_view_size(struct replay *replay,
+                                 size_t activity,
+                                 const struct wlr_tgui_trace_view_size *size) {
+    for (size_t i = replay->events_len; i > 0; i--) {
+        struct replay_event *event = &replay->events[i - 1];
+        if (event->activity == activity &&
+            (event->event.type == TGUI_EVENT_CREATE ||
+             event->event.type == TGUI_EVENT_SURFACE_CHANGED)) {
+            event->view_width = size->width;
+            event->view_height = size->height;
+            return;
+        }
+    }
+}
+
+static bool replay_add_record(struct replay *replay,
+                              const struct wlr_tgui_trace_record *record,
+                              const void *payload) {
+    size_t activity_index;
+    switch (record->type) {
+    case WLR_TGUI_TRACE_EVENT: {
+        const struct wlr_tgui_trace_event *event = payload;
+        if (record->size < sizeof(*event)) {
+            return false;
+        }
+        uint32_t num_pointers = 0;
+        if (event->type == TGUI_EVENT_TOUCH) {
+            num_pointers = event->touch.num_pointers;
+            if (num_pointers > WLR_TGUI_TRACE_MAX_POINTERS) {
+                num_pointers = WLR_TGUI_TRACE_MAX_POINTERS;
+            }
+            if (record->size < sizeof(*event) + num_pointers *
+                                   sizeof(struct wlr_tgui_trace_pointer)) {
+                return false;
+            }
+        }
+        if (replay_get_activity(replay, event->activity, &activity_index) ==
+            NULL) {
+            return false;
+        }
+
+        struct replay_event *events =
+            realloc(replay->events,
+                    (replay->events_len + 1) * sizeof(*events));
+        if (events == NULL) {
+            return false;
+        }
+        replay->events = events;
+        struct replay_event *replay_event = &events[replay->events_len++];
+        memset(replay_event, 0, sizeof(*replay_event));
+        replay_event->time_nsec = record->time_nsec;
+        replay_event->activity = activity_index;
+        replay_event->event = *event;
+        if (event->type == TGUI_EVENT_TOUCH) {
+            replay_event->event.touch.num_pointers = num_pointers;
+            memcpy(replay_event->pointers, event + 1,
+                   num_pointers * sizeof(struct wlr_tgui_trace_pointer));
+        }
+        return true;
+    }
+    case WLR_TGUI_TRACE_PRESENT: {
+        const struct wlr_tgui_trace_present *present = payload;
+        if (record->size < sizeof(*present)) {
+            return false;
+        }
+        struct replay_activity *activity =
+            replay_get_activity(replay, present->activity, &activity_index);
+        if (activity == NULL) {
+            return false;
+        }
+        int64_t *durations =
+            realloc(activity->present_nsec,
+                    (activity->presents_len + 1) * sizeof(*durations));
+        if (durations == NULL) {
+            return false;
+        }
+        activity->present_nsec = durations;
+        durations[activity->presents_len++] = present->duration_nsec;
+        return true;
+    }
+    case WLR_TGUI_TRACE_VIEW_SIZE: {
+        const struct wlr_tgui_trace_view_size *size = payload;
+        if (record->size < sizeof(*size)) {
+            return false;
+        }
+        if (replay_get_activity(replay, size->activity, &activity_index) ==
+            NULL) {
+            return false;
+        }
+        replay_set_view_size(replay, activity_index, size);
+        return true;
+    }
+    default:
+        // Unknown records are skipped, they may come from newer versions
+        return true;
+    }
+}
+
+static struct replay *replay_load(const char *path) {
+    FILE *file = fopen(path, "re");
+    if (file == NULL) {
+        fprintf(stderr, "tgui stub: failed to open trace %s: %s\n", path,
+                strerror(errno));
+        return NULL;
+    }
+
+    struct replay *replay = calloc(1, sizeof(*replay));
+    void *payload = NULL;
+    if (replay == NULL) {
+        goto error;
+    }
+
+    struct wlr_tgui_trace_header header;
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        header.magic != WLR_TGUI_TRACE_MAGIC ||
+        header.version > WLR_TGUI_TRACE_VERSION) {
+        fprintf(stderr, "tgui stub: %s is not a supported trace\n", path);
+        goto error;
+    }
+
+    struct wlr_tgui_trace_record record;
+    while (fread(&record, sizeof(record), 1, file) == 1) {
+        void *buf = realloc(payload, record.size > 0 ? record.size : 1);
+        if (buf == NULL) {
+            goto error;
+        }
+        payload = buf;
+        if (record.size > 0 && fread(payload, record.size, 1, file) != 1) {
+            fprintf(stderr, "tgui stub: truncated trace %s\n", path);
+            goto error;
+        }
+        if (!replay_add_record(replay, &record, payload)) {
+            fprintf(stderr, "tgui stub: invalid record in trace %s\n", path);
+            goto error;
+        }
+    }
+
+    replay->speed = 1.0;
+    const char *speed = getenv("WLR_TGUI_REPLAY_SPEED");
+    if (speed != NULL) {
+        char *end;
+        double value = strtod(speed, &end);
+        if (*end == '\0' && value >= 0) {
+            replay->speed = value;
+        } else {
+            fprintf(stderr, "tgui stub: invalid WLR_TGUI_REPLAY_SPEED: %s\n",
+                    speed);
+        }
+    }
+
+    free(payload);
+    fclose(file);
+    return replay;
+
+error:
+    free(payload);
+    replay_destroy(replay);
+    fclose(file);
+    return NULL;
+}
+
+static struct stub_activity *get_activity(tgui_connection conn,
+                                          tgui_activity id) {
+    for (size_t i = 0; i < conn->activities_len; i++) {
+        if (conn->activities[i].id == id) {
+            return &conn->activities[i];
+        }
+    }
+    return NULL;
+}
+
+static void queue_event(tgui_connection conn,
+                        tgui_activity activity,
+                        tgui_event_type type) {
+    struct stub_event *event = calloc(1, sizeof(*event));
+    if (event == NULL) {
+        return;
+    }
+    event->event.type = type;
+    event->event.activity = activity;
+    *conn->queue_tail = event;
+    conn->queue_tail = &event->next;
+    pthread_cond_broadcast(&conn->cond);
+}
+
+static void parse_view_size(tgui_connection conn) {
+    conn->view_width = DEFAULT_VIEW_WIDTH;
+    conn->view_height = DEFAULT_VIEW_HEIGHT;
+    const char *size = getenv("WLR_TGUI_STUB_VIEW_SIZE");
+    if (size == NULL) {
+        return;
+    }
+    int width, height;
+    if (sscanf(size, "%dx%d", &width, &height) == 2 && width > 0 &&
+        height > 0) {
+        conn->view_width = width;
+        conn->view_height = height;
+    } else {
+        fprintf(stderr, "tgui stub: invalid WLR_TGUI_STUB_VIEW_SIZE: %s\n",
+                size);
+    }
+}
+
+tgui_err tgui_connection_create(tgui_connection *out) {
+    tgui_connection conn = calloc(1, sizeof(*conn));
+    if (conn == NULL) {
+        return TGUI_ERR_NOMEM;
+    }
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&conn->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_mutex_init(&conn->mutex, NULL);
+    conn->queue_tail = &conn->queue_head;
+    conn->next_view = 1;
+    parse_view_size(conn);
+
+    const char *present_usec = getenv("WLR_TGUI_STUB_PRESENT_USEC");
+    if (present_usec != NULL) {
+        conn->present_nsec = strtoll(present_usec, NULL, 10) * 1000;
+    }
+    const char *alloc_usec = getenv("WLR_TGUI_STUB_ALLOC_USEC");
+    if (alloc_usec != NULL) {
+        conn->alloc_nsec = strtoll(alloc_usec, NULL, 10) * 1000;
+    }
+
+    const char *path = getenv("WLR_TGUI_REPLAY");
+    if (path != NULL && path[0] != '\0') {
+        conn->replay = replay_load(path);
+        if (conn->replay == NULL) {
+            tgui_connection_destroy(conn);
+            return TGUI_ERR_SYSTEM;
+        }
+        pthread_mutex_lock(&stats_mutex);
+        stats.replaying = true;
+        stats.replay_finished = conn->replay->events_len == 0;
+        pthread_mutex_unlock(&stats_mutex);
+    }
+
+    *out = conn;
+    return TGUI_ERR_OK;
+}
+
+void tgui_connection_destroy(tgui_connection conn) {
+    // Wait for tgui_wait_event to return before the connection is freed
+    pthread_mutex_lock(&conn->mutex);
+    conn->closed = true;
+    pthread_cond_broadcast(&conn->cond);
+    while (conn->waiters > 0) {
+        pthread_cond_wait(&conn->cond, &conn->mutex);
+    }
+    pthread_mutex_unlock(&conn->mutex);
+
+    struct stub_event *event = conn->queue_head;
+    while (event != NULL) {
+        struct stub_event *next = event->next;
+        free(event);
+        event = next;
+    }
+    replay_destroy(conn->replay);
+    free(conn->activities);
+    pthread_cond_destroy(&conn->cond);
+    pthread_mutex_destroy(&conn->mutex);
+    free(conn);
+}
+
+static void count_event(const tgui_event *event, bool last) {
+    pthread_mutex_lock(&stats_mutex);
+    stats.events++;
+    if (event->type == TGUI_EVENT_KEY || event->type == TGUI_EVENT_TOUCH) {
+        stats.input_events++;
+    }
+    if (last) {
+        stats.replay_finished = true;
+    }
+    pthread_mutex_unlock(&stats_mutex);
+}
+
+/**
+ * Build the next event of the trace. Touch events carry a single sample of
+ * the recorded pointers, pointers[0][i] being the i-th one.
+ */
+static bool replay_build_event(tgui_connection conn,
+                               struct replay_event *replay_event,
+                               tgui_event *event) {
+    struct stub_activity *activity =
+        &conn->activities[replay_event->activity];
+    const struct wlr_tgui_trace_event *recorded = &replay_event->event;
+
+    memset(event, 0, sizeof(*event));
+    event->type = recorded->type;
+    event->activity = activity->id;
+    event->id = activity->view;
+
+    switch (recorded->type) {
+    case TGUI_EVENT_KEY:
+        event->key.code = recorded->key.code;
+        event->key.codePoint = recorded->key.code_point;
+        event->key.mod = recorded->key.mod;
+        event->key.down = recorded->key.down;
+        break;
+    case TGUI_EVENT_TOUCH: {
+        uint32_t n = recorded->touch.num_pointers;
+        tgui_touch_pointer **samples = calloc(1, sizeof(*samples));
+        tgui_touch_pointer *pointers = calloc(n > 0 ? n : 1,
+                                              sizeof(*pointers));
+        if (samples == NULL || pointers == NULL) {
+            free(samples);
+            free(pointers);
+            return false;
+        }
+        samples[0] = pointers;
+        for (uint32_t i = 0; i < n; i++) {
+            pointers[i] = (tgui_touch_pointer) {
+                .id = replay_event->pointers[i].id,
+                .x = replay_event->pointers[i].x,
+                .y = replay_event->pointers[i].y,
+            };
+        }
+        event->touch.action = recorded->touch.action;
+        event->touch.time = replay_event->time_nsec / 1000000;
+        event->touch.index = recorded->touch.index;
+        event->touch.num_pointers = n;
+        event->touch.pointers = samples;
+        break;
+    }
+    default:
+        break;
+    }
+
+    if (replay_event->view_width > 0 && replay_event->view_height > 0) {
+        activity->width = replay_event->view_width;
+        activity->height = replay_event->view_height;
+    }
+    return true;
+}
+
+/**
+ * Wait until the next event of the trace is due and its activity has been
+ * created, the k-th activity of the trace being the k-th one created by the
+ * backend. conn->mutex must be locked.
+ */
+static tgui_err replay_wait_event(tgui_connection conn, tgui_event *event) {
+    struct replay *replay = conn->replay;
+    while (!conn->closed) {
+        if (replay->next_event == replay->events_len) {
+            pthread_cond_wait(&conn->cond, &conn->mutex);
+            continue;
+        }
+
+        struct replay_event *replay_event =
+            &replay->events[replay->next_event];
+        if (replay_event->activity >= conn->activities_len) {
+            pthread_cond_wait(&conn->cond, &conn->mutex);
+            continue;
+        }
+
+        int64_t now = get_time_nsec();
+        if (replay->next_event == 0) {
+            replay->start_nsec = now;
+        }
+        if (replay->speed > 0) {
+            int64_t offset =
+                replay_event->time_nsec - replay->events[0].time_nsec;
+            int64_t due = replay->start_nsec + offset / replay->speed;
+            if (now < due) {
+                struct timespec deadline = {
+                    .tv_sec = due / 1000000000,
+                    .tv_nsec = due % 1000000000,
+                };
+                pthread_cond_timedwait(&conn->cond, &conn->mutex, &deadline);
+                continue;
+            }
+        }
+
+        if (!replay_build_event(conn, replay_event, event)) {
+            return TGUI_ERR_NOMEM;
+        }
+        replay->next_event++;
+        count_event(event, replay->next_event == replay->events_len);
+        return TGUI_ERR_OK;
+    }
+    return TGUI_ERR_CONNECTION_LOST;
+}
+
+tgui_err tgui_wait_event(tgui_connection conn, tgui_event *event) {
+    tgui_err err = TGUI_ERR_CONNECTION_LOST;
+
+    pthread_mutex_lock(&conn->mutex);
+    conn->waiters++;
+    if (conn->replay != NULL) {
+        err = replay_wait_event(conn, event);
+    } else {
+        while (!conn->closed && conn->queue_head == NULL) {
+            pthread_cond_wait(&conn->cond, &conn->mutex);
+        }
+        if (!conn->closed) {
+            struct stub_event *stub_event = conn->queue_head;
+            conn->queue_head = stub_event->next;
+            if (conn->queue_head == NULL) {
+                conn->queue_tail = &conn->queue_head;
+            }
+            *event = stub_event->event;
+            free(stub_event);
+            count_event(event, false);
+            err = TGUI_ERR_OK;
+        }
+    }
+    conn->waiters--;
+    pthread_cond_broadcast(&conn->cond);
+    pthread_mutex_unlock(&conn->mutex);
+
+    return err;
+}
+
+void tgui_event_destroy(tgui_event *event) {
+    if (event->type == TGUI_EVENT_TOUCH && event->touch.pointers != NULL) {
+        free(event->touch.pointers[0]);
+        free(event->touch.pointers);
+        event->touch.pointers = NULL;
+    }
+}
+
+tgui_err tgui_activity_create(tgui_connection conn,
+                              tgui_activity *activity,
+                              tgui_activity_type type,
+                              tgui_activity *parent,
+                              bool intercept_back) {
+    pthread_mutex_lock(&conn->mutex);
+    struct stub_activity *activities =
+        realloc(conn->activities,
+                (conn->activities_len + 1) * sizeof(*activities));
+    if (activities == NULL) {
+        pthread_mutex_unlock(&conn->mutex);
+        return TGUI_ERR_NOMEM;
+    }
+    conn->activities = activities;
+
+    pthread_mutex_lock(&stats_mutex);
+    tgui_activity id = next_activity++;
+    stats.activities++;
+    pthread_mutex_unlock(&stats_mutex);
+
+    activities[conn->activities_len++] = (struct stub_activity) {
+        .id = id,
+        .width = conn->view_width,
+        .height = conn->view_height,
+    };
+    if (conn->replay == NULL) {
+        queue_event(conn, id, TGUI_EVENT_CREATE);
+        queue_event(conn, id, TGUI_EVENT_START);
+        queue_event(conn, id, TGUI_EVENT_RESUME);
+    } else {
+        // The trace may be waiting for this activity
+        pthread_cond_broadcast(&conn->cond);
+    }
+    pthread_mutex_unlock(&conn->mutex);
+
+    *activity = id;
+    return TGUI_ERR_OK;
+}
+
+/**
+ * Find an activity which hasn't been finished. conn->mutex must be locked.
+ */
+static tgui_err check_activity(tgui_connection conn,
+                               tgui_activity id,
+                               struct stub_activity **out) {
+    struct stub_activity *activity = get_activity(conn, id);
+    if (activity == NULL) {
+        return TGUI_ERR_MESSAGE;
+    }
+    if (activity->finished) {
+        return TGUI_ERR_ACTIVITY_DESTROYED;
+    }
+    if (out != NULL) {
+        *out = activity;
+    }
+    return TGUI_ERR_OK;
+}
+
+static tgui_err activity_request(tgui_connection conn, tgui_activity id) {
+    pthread_mutex_lock(&conn->mutex);
+    tgui_err err = check_activity(conn, id, NULL);
+    pthread_mutex_unlock(&conn->mutex);
+    return err;
+}
+
+tgui_err tgui_activity_finish(tgui_connection conn, tgui_activity id) {
+    pthread_mutex_lock(&conn->mutex);
+    struct stub_activity *activity;
+    tgui_err err = check_activity(conn, id, &activity);
+    if (err == TGUI_ERR_OK) {
+        activity->finished = true;
+    }
+    pthread_mutex_unlock(&conn->mutex);
+    return err;
+}
+
+tgui_err
+tgui_activity_get_configuration(tgui_connection conn,
+                                tgui_activity id,
+                                tgui_activity_configuration *config) {
+    pthread_mutex_lock(&conn->mutex);
+    struct stub_activity *activity;
+    tgui_err err = check_activity(conn, id, &activity);
+    if (err == TGUI_ERR_OK) {
+        *config = (tgui_activity_configuration) {
+            .dark_mode = "false",
+            .country = "US",
+            .language = "en",
+            .density = 1.0,
+            .screen_width = activity->width,
+            .screen_height = activity->height,
+            .font_scale = 1,
+            .keyboard_hidden = true,
+            .orientation = TGUI_ORIENTATION_LANDSCAPE,
+        };
+    }
+    pthread_mutex_unlock(&conn->mutex);
+    return err;
+}
+
+tgui_err tgui_activity_set_task_description(tgui_connection conn,
+                                            tgui_activity activity,
+                                            void *image,
+                                            size_t image_size,
+                                            const char *label) {
+    return activity_request(conn, activity);
+}
+
+tgui_err tgui_activity_set_orientation(tgui_connection conn,
+                                       tgui_activity activity,
+                                       tgui_orientation orientation) {
+    return activity_request(conn, activity);
+}
+
+tgui_err tgui_activity_configure_insets(tgui_connection conn,
+                                        tgui_activity activity,
+                                        tgui_inset inset,
+                                        tgui_inset_behaviour behaviour) {
+    return activity_request(conn, activity);
+}
+
+tgui_err tgui_create_surface_view(tgui_connection conn,
+                                  tgui_activity id,
+                                  tgui_view *view,
+                                  tgui_view *parent,
+                                  tgui_view_visibility visibility,
+                                  bool keyboard) {
+    pthread_mutex_lock(&conn->mutex);
+    struct stub_activity *activity;
+    tgui_err err = check_activity(conn, id, &activity);
+    if (err == TGUI_ERR_OK) {
+        activity->view = conn->next_view++;
+        *view = activity->view;
+    }
+    pthread_mutex_unlock(&conn->mutex);
+    return err;
+}
+
+tgui_err tgui_surface_view_config(tgui_connection conn,
+                                  tgui_activity activity,
+                                  tgui_view view,
+                                  uint32_t background,
+                                  tgui_surface_view_mismatch x,
+                                  tgui_surface_view_mismatch y,
+                                  int32_t frame_rate) {
+    return activity_request(conn, activity);
+}
+
+tgui_err tgui_send_touch_event(tgui_connection conn,
+                               tgui_activity activity,
+                               tgui_view view,
+                               bool send) {
+    return activity_request(conn, activity);
+}
+
+tgui_err tgui_focus(tgui_connection conn,
+                    tgui_activity activity,
+                    tgui_view view,
+                    bool force_soft) {
+    return activity_request(conn, activity);
+}
+
+tgui_err tgui_get_dimensions(tgui_connection conn,
+                             tgui_activity id,
+                             tgui_view view,
+                             tgui_view_size_unit unit,
+                             float *width,
+                             float *height) {
+    pthread_mutex_lock(&conn->mutex);
+    struct stub_activity *activity;
+    tgui_err err = check_activity(conn, id, &activity);
+    if (err == TGUI_ERR_OK && activity->view != view) {
+        err = TGUI_ERR_VIEW_INVALID;
+    }
+    if (err == TGUI_ERR_OK) {
+        *width = activity->width;
+        *height = activity->height;
+    }
+    pthread_mutex_unlock(&conn->mutex);
+    return err;
+}
+
+static void sleep_nsec(int64_t duration) {
+    if (duration <= 0) {
+        return;
+    }
+    struct timespec delay = {
+        .tv_sec = duration / 1000000000,
+        .tv_nsec = duration % 1000000000,
+    };
+    while (nanosleep(&delay, &delay) != 0 && errno == EINTR) {
+        // Sleep for the remaining time
+    }
+}
+
+/**
+ * Get how long presenting a buffer takes: the recorded durations when
+ * replaying, in order, then the configured one. conn->mutex must be locked.
+ */
+static int64_t get_present_nsec(tgui_connection conn,
+                                struct stub_activity *activity) {
+    struct replay *replay = conn->replay;
+    if (replay != NULL) {
+        size_t index = activity - conn->activities;
+        if (index < replay->activities_len) {
+            struct replay_activity *recorded = &replay->activities[index];
+            if (recorded->next_present < recorded->presents_len) {
+                return recorded->present_nsec[recorded->next_present++];
+            }
+        }
+    }
+    return conn->present_nsec;
+}
+
+tgui_err tgui_surface_view_set_buffer(tgui_connection conn,
+                                      tgui_activity id,
+                                      tgui_view view,
+                                      tgui_hardware_buffer *buffer) {
+    int64_t start = get_time_nsec();
+
+    pthread_mutex_lock(&conn->mutex);
+    struct stub_activity *activity;
+    tgui_err err = check_activity(conn, id, &activity);
+    if (err == TGUI_ERR_OK &&
+        (activity->view != view || buffer == NULL ||
+         buffer->buffer == NULL)) {
+        err = TGUI_ERR_VIEW_INVALID;
+    }
+    int64_t duration = 0;
+    if (err == TGUI_ERR_OK) {
+        duration = get_present_nsec(conn, activity);
+    }
+    pthread_mutex_unlock(&conn->mutex);
+    if (err != TGUI_ERR_OK) {
+        return err;
+    }
+
+    pthread_mutex_lock(&stats_mutex);
+    concurrent_presents++;
+    if (concurrent_presents > stats.max_concurrent_presents) {
+        stats.max_concurrent_presents = concurrent_presents;
+    }
+    pthread_mutex_unlock(&stats_mutex);
+
+    sleep_nsec(duration);
+
+    pthread_mutex_lock(&stats_mutex);
+    concurrent_presents--;
+    stats.presents++;
+    stats.present_nsec += get_time_nsec() - start;
+    pthread_mutex_unlock(&stats_mutex);
+    return TGUI_ERR_OK;
+}
+
+tgui_err
+tgui_hardware_buffer_create(tgui_connection conn,
+                            tgui_hardware_buffer *buffer,
+                            tgui_hardware_buffer_format format,
+                            uint32_t width,
+                            uint32_t height,
+                            tgui_hardware_buffer_cpu_frequency cpu_read,
+                            tgui_hardware_buffer_cpu_frequency cpu_write) {
+    static const uint32_t ahb_formats[] = {
+        [TGUI_HARDWARE_BUFFER_FORMAT_RGBA8888] =
+            AHARDWAREBUFFER_FORMAT_R8G8B8A8_UNORM,
+        [TGUI_HARDWARE_BUFFER_FORMAT_RGBX8888] =
+            AHARDWAREBUFFER_FORMAT_R8G8B8X8_UNORM,
+        [TGUI_HARDWARE_BUFFER_FORMAT_RGB888] =
+            AHARDWAREBUFFER_FORMAT_R8G8B8_UNORM,
+        [TGUI_HARDWARE_BUFFER_FORMAT_RGB565] =
+            AHARDWAREBUFFER_FORMAT_R5G6B5_UNORM,
+    };
+    if ((size_t) format >= sizeof(ahb_formats) / sizeof(ahb_formats[0])) {
+        return TGUI_ERR_MESSAGE;
+    }
+
+    AHardwareBuffer_Desc desc = {
+        .width = width,
+        .height = height,
+        .layers = 1,
+        .format = ahb_formats[format],
+        .usage = AHARDWAREBUFFER_USAGE_CPU_READ_OFTEN |
+                 AHARDWAREBUFFER_USAGE_CPU_WRITE_OFTEN,
+    };
+    sleep_nsec(conn->alloc_nsec);
+    int ret = AHardwareBuffer_allocate(&desc, &buffer->buffer);
+    if (ret == -ENOMEM) {
+        return TGUI_ERR_NOMEM;
+    } else if (ret != 0) {
+        return TGUI_ERR_SYSTEM;
+    }
+
+    pthread_mutex_lock(&stats_mutex);
+    buffer->id = next_buffer++;
+    stats.buffers_created++;
+    pthread_mutex_unlock(&stats_mutex);
+    return TGUI_ERR_OK;
+}
+
+tgui_err tgui_hardware_buffer_destroy(tgui_connection conn,
+                                      tgui_hardware_buffer *buffer) {
+    if (buffer->buffer == NULL) {
+        return TGUI_ERR_MESSAGE;
+    }
+    AHardwareBuffer_release(buffer->buffer);
+    buffer->buffer = NULL;
+
+    pthread_mutex_lock(&stats_mutex);
+    stats.buffers_destroyed++;
+    pthread_mutex_unlock(&stats_mutex);
+    return TGUI_ERR_OK;
+}
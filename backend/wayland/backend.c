@@ -344,6 +344,9 @@ static void registry_global(void *data, struct wl_registry *registry,
 	if (strcmp(iface, wl_compositor_interface.name) == 0) {
 		wl->compositor = wl_registry_bind(registry, name,
 			&wl_compositor_interface, 4);
+	} else if (strcmp(iface, wl_subcompositor_interface.name) == 0) {
+		wl->subcompositor = wl_registry_bind(registry, name,
+			&wl_subcompositor_interface, 1);
 	} else if (strcmp(iface, wl_seat_interface.name) == 0) {
 		uint32_t target_version = version;
 		if (version < 5) {
@@ -491,6 +494,9 @@ static void backend_destroy(struct wlr_backend *backend) {
 	free(wl->drm_render_name);
 	free(wl->activation_token);
 	xdg_wm_base_destroy(wl->xdg_wm_base);
+	if (wl->subcompositor) {
+		wl_subcompositor_destroy(wl->subcompositor);
+	}
 	wl_compositor_destroy(wl->compositor);
 	wl_registry_destroy(wl->registry);
 	wl_display_flush(wl->remote_display);
@@ -30,7 +30,8 @@ static const uint32_t SUPPORTED_OUTPUT_STATE =
 	WLR_OUTPUT_STATE_BACKEND_OPTIONAL |
 	WLR_OUTPUT_STATE_BUFFER |
 	WLR_OUTPUT_STATE_MODE |
-	WLR_OUTPUT_STATE_ADAPTIVE_SYNC_ENABLED;
+	WLR_OUTPUT_STATE_ADAPTIVE_SYNC_ENABLED |
+	WLR_OUTPUT_STATE_OVERLAY;
 
 static size_t last_output_num = 0;
 
@@ -179,7 +180,7 @@ static struct wl_buffer *import_dmabuf(struct wlr_wl_backend *wl,
 static struct wl_buffer *import_shm(struct wlr_wl_backend *wl,
 		struct wlr_shm_attributes *shm) {
 	enum wl_shm_format wl_shm_format = convert_drm_format_to_wl_shm(shm->format);
-	uint32_t size = shm->stride * shm->height;
+	uint32_t size = shm->offset + shm->stride * shm->height;
 	struct wl_shm_pool *pool = wl_shm_create_pool(wl->shm, shm->fd, size);
 	if (pool == NULL) {
 		return NULL;
@@ -275,6 +276,58 @@ static bool output_test(struct wlr_output *wlr_output,
 		return false;
 	}
 
+	if (state->committed & WLR_OUTPUT_STATE_OVERLAY) {
+		if (output->backend->subcompositor == NULL) {
+			return false;
+		}
+		if (state->overlay_buffer != NULL &&
+				!test_buffer(output->backend, state->overlay_buffer)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static bool output_commit_overlay(struct wlr_wl_output *output,
+		const struct wlr_output_state *state) {
+	struct wlr_wl_backend *backend = output->backend;
+
+	if (state->overlay_buffer == NULL) {
+		if (output->overlay.surface != NULL) {
+			wl_surface_attach(output->overlay.surface, NULL, 0, 0);
+			wl_surface_commit(output->overlay.surface);
+		}
+		return true;
+	}
+
+	struct wlr_wl_buffer *buffer =
+		get_or_create_wl_buffer(backend, state->overlay_buffer);
+	if (buffer == NULL) {
+		return false;
+	}
+
+	if (output->overlay.surface == NULL) {
+		output->overlay.surface =
+			wl_compositor_create_surface(backend->compositor);
+		output->overlay.subsurface = wl_subcompositor_get_subsurface(
+			backend->subcompositor, output->overlay.surface, output->surface);
+
+		// Let input go through to the output surface
+		struct wl_region *region =
+			wl_compositor_create_region(backend->compositor);
+		wl_surface_set_input_region(output->overlay.surface, region);
+		wl_region_destroy(region);
+	}
+
+	// The subsurface is synchronized, so this is applied along with the next
+	// commit of the output surface
+	wl_subsurface_set_position(output->overlay.subsurface,
+		state->overlay_x, state->overlay_y);
+	wl_surface_attach(output->overlay.surface, buffer->wl_buffer, 0, 0);
+	wl_surface_damage_buffer(output->overlay.surface,
+		0, 0, INT32_MAX, INT32_MAX);
+	wl_surface_commit(output->overlay.surface);
 	return true;
 }
 
@@ -287,6 +340,11 @@ static bool output_commit(struct wlr_output *wlr_output,
 		return false;
 	}
 
+	if ((state->committed & WLR_OUTPUT_STATE_OVERLAY) &&
+			!output_commit_overlay(output, state)) {
+		return false;
+	}
+
 	if (state->committed & WLR_OUTPUT_STATE_BUFFER) {
 		struct wp_presentation_feedback *wp_feedback = NULL;
 		if (output->backend->presentation != NULL) {
@@ -351,6 +409,8 @@ static bool output_commit(struct wlr_output *wlr_output,
 			};
 			wlr_output_send_present(wlr_output, &present_event);
 		}
+	} else if (state->committed & WLR_OUTPUT_STATE_OVERLAY) {
+		wl_surface_commit(output->surface);
 	}
 
 	wl_display_flush(output->backend->remote_display);
@@ -420,6 +480,11 @@ static void output_destroy(struct wlr_output *wlr_output) {
 		wl_surface_destroy(output->cursor.surface);
 	}
 
+	if (output->overlay.surface) {
+		wl_subsurface_destroy(output->overlay.subsurface);
+		wl_surface_destroy(output->overlay.surface);
+	}
+
 	if (output->frame_callback) {
 		wl_callback_destroy(output->frame_callback);
 	}
@@ -21,6 +21,7 @@
 #include <wlr/util/log.h>
 
 #include "backend/x11.h"
+#include "render/pixel_format.h"
 #include "util/time.h"
 
 static const uint32_t SUPPORTED_OUTPUT_STATE =
@@ -208,6 +209,14 @@ static xcb_pixmap_t import_shm(struct wlr_x11_output *output,
 		return XCB_PIXMAP_NONE;
 	}
 
+	const struct wlr_pixel_format_info *info =
+		drm_get_pixel_format_info(shm->format);
+	if (info == NULL || shm->stride != shm->width * (int)info->bpp / 8) {
+		// X11 shm pixmaps have no stride of their own
+		wlr_log(WLR_DEBUG, "Cannot import shm buffer with padded stride");
+		return XCB_PIXMAP_NONE;
+	}
+
 	// xcb closes the FD after sending it
 	int fd = fcntl(shm->fd, F_DUPFD_CLOEXEC, 0);
 	if (fd < 0) {
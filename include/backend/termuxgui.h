@@ -4,6 +4,8 @@
 #include <android/hardware_buffer.h>
 #include <assert.h>
 #include <pthread.h>
+#include <stdio.h>
+#include <sys/types.h>
 #include <termuxgui/termuxgui.h>
 
 #include <wlr/backend/interface.h>
@@ -12,10 +14,20 @@
 #include <wlr/interfaces/wlr_keyboard.h>
 #include <wlr/interfaces/wlr_output.h>
 #include <wlr/interfaces/wlr_pointer.h>
+#include <wlr/interfaces/wlr_touch.h>
 #include <wlr/render/allocator.h>
+#include <wlr/render/drm_format_set.h>
+#include <wlr/types/wlr_damage_ring.h>
 #include <wlr/util/log.h>
 
+#include "backend/termuxgui/trace.h"
+
 #define DEFAULT_REFRESH (60 * 1000) // 60 Hz
+#define DEFAULT_PAUSED_FRAME_RATE 1 // Hz
+
+#define TGUI_POOL_CAP 8 // free hardware buffers kept for reuse
+#define TGUI_POOL_PREFETCH 2 // hardware buffers prepared per predicted size
+#define TGUI_POOL_HINTS 16 // predicted sizes, of all outputs
 
 #define TRY_LOG(func, ...)                                                   \
     do {                                                                     \
@@ -111,15 +123,62 @@ struct wlr_tgui_backend {
     struct wl_list outputs;
     struct wl_listener display_destroy;
     bool started;
+    int paused_frame_rate; // Hz, 0 to stop frame events while paused
+    float render_scale; // default render scale of new outputs
+    bool pointer_emulation; // translate touches into pointer events
+    bool trim_paused; // release the buffers of paused outputs
+    struct wlr_tgui_input_latency input_latency;
+    struct wlr_tgui_memory_stats memory_stats;
+    uint64_t unmapped_keys;
+    uint64_t unmapped_keys_logged_ms;
+    uint32_t output_format; // DRM format of the output buffers
+    struct wlr_drm_format_set primary_formats;
 
     tgui_connection conn;
     struct wlr_queue event_queue;
+
+    // Buffers of all outputs are presented by a single thread. The lists
+    // below and the present_in_flight counters of the outputs are protected
+    // by present_mutex.
+    pthread_t present_thread;
+    pthread_mutex_t present_mutex;
+    pthread_cond_t present_cond;
+    bool present_thread_run;
+    struct wl_list present_pending; // wlr_tgui_buffer.link, oldest first
+    struct wl_list present_done; // wlr_tgui_buffer.link
+    int present_complete_fd;
+    struct wl_event_source *present_complete_source;
+
+    FILE *record_file; // NULL unless recording a trace
+
     int fake_drm_fd;
     int tgui_event_fd;
     pthread_t tgui_event_thread;
     struct wl_event_source *tgui_event_source;
 };
 
+/**
+ * A hardware buffer along with its dmabuf, not wrapped in a wlr_buffer.
+ */
+struct wlr_tgui_pool_buffer {
+    struct wl_list link; // wlr_tgui_allocator.pool or trash
+
+    int width, height;
+    uint32_t format;
+    tgui_hardware_buffer buffer;
+    AHardwareBuffer_Desc desc;
+    int dmabuf_fd;
+    dev_t dmabuf_dev;
+    ino_t dmabuf_ino;
+};
+
+struct wlr_tgui_pool_hint {
+    int width, height;
+    uint32_t format;
+    int pending; // buffers left to allocate ahead of demand
+    const void *owner; // output the size is predicted for
+};
+
 struct wlr_tgui_allocator {
     struct wlr_allocator wlr_allocator;
 
@@ -136,6 +195,23 @@ struct wlr_tgui_allocator {
         const AHardwareBuffer *buffer);
 
     tgui_connection conn;
+    struct wl_list buffers; // wlr_tgui_buffer.allocator_link
+    uint64_t buffers_generation; // incremented when a buffer is added
+
+    // Hardware buffers are created and destroyed on a background thread when
+    // possible, each one costs a round trip to the plugin. All the fields
+    // below are protected by pool_mutex.
+    pthread_t pool_thread;
+    pthread_mutex_t pool_mutex;
+    pthread_cond_t pool_cond;
+    bool pool_thread_run;
+    struct wl_list pool; // wlr_tgui_pool_buffer.link, free buffers
+    size_t pool_len;
+    struct wl_list trash; // wlr_tgui_pool_buffer.link, to be destroyed
+    struct wlr_tgui_pool_hint hints[TGUI_POOL_HINTS]; // merged, of all owners
+    size_t hints_len;
+    bool predicted; // hints have been given, buffers of other sizes are unwanted
+    size_t resident_bytes; // hardware buffers not handed to the trash yet
 };
 
 struct wlr_tgui_buffer {
@@ -143,12 +219,30 @@ struct wlr_tgui_buffer {
 
     void *data;
     uint32_t format;
+    uint32_t bytes_per_pixel;
     tgui_connection conn;
     tgui_hardware_buffer buffer;
     AHardwareBuffer_Desc desc;
-    struct wl_list link;
+    struct wl_list link; // wlr_tgui_backend.present_pending or present_done
     struct wlr_dmabuf_attributes dmabuf;
     struct wlr_tgui_allocator *allocator;
+    struct wl_list allocator_link; // wlr_tgui_allocator.buffers
+
+    // Identity of the dmabuf, used to recognize foreign buffers sharing the
+    // same memory
+    dev_t dmabuf_dev;
+    ino_t dmabuf_ino;
+
+    // Queued for presentation, and the foreign buffer presented through this
+    // buffer which is kept locked until the presentation completes
+    bool queued;
+    struct wlr_tgui_output *present_output;
+    struct wlr_buffer *scanout_source;
+
+    // Full-size buffer this buffer is upscaled into before presentation, and
+    // the region of it which is out of date, valid along with upscale_target
+    struct wlr_tgui_buffer *upscale_target;
+    pixman_region32_t upscale_damage;
 };
 
 struct wlr_tgui_output {
@@ -161,21 +255,33 @@ struct wlr_tgui_output {
     tgui_view tgui_surfaceview;
     bool tgui_activity_is_foreground;
 
-    struct wlr_queue present_queue;
-    struct wlr_queue idle_queue;
-    bool present_thread_run;
-    pthread_t present_thread;
-    int present_complete_fd;
-    struct wl_event_source *present_complete_source;
+    // Buffers are rendered at render_scale times the size of the surface
+    // view, and upscaled to fill it on the present thread
+    float render_scale;
+    int view_width, view_height;
+    struct wlr_swapchain *upscale_swapchain;
+    struct wlr_damage_ring upscale_damage_ring; // in render buffer coordinates
+
+    // Throttled frame events while the activity is paused
+    struct wl_event_source *paused_frame_timer;
+    bool paused_frame_pending;
+    bool trimmed; // buffers released while paused
+    bool trimmed_frame_pending; // frame event held back while trimmed
+
+    int present_in_flight; // buffers being presented by the present thread
+    bool present_done; // a present completed since the last frame event
 
     struct wlr_pointer pointer;
     struct wlr_keyboard keyboard;
+    struct wlr_touch touch;
 
+    // Pointer emulation state
     struct {
         int id, max;
         double x, y;
         bool moved, down;
         uint64_t time_ms;
+        double scroll;
     } touch_pointer;
 
     double cursor_x, cursor_y;
@@ -184,6 +290,7 @@ struct wlr_tgui_output {
 struct wlr_tgui_event {
     tgui_event e;
     struct wl_list link;
+    int64_t receive_nsec; // CLOCK_MONOTONIC, when read from the connection
 };
 
 struct wlr_tgui_backend *
@@ -195,7 +302,73 @@ wlr_tgui_allocator_create(struct wlr_tgui_backend *backend);
 struct wlr_tgui_buffer *
 tgui_buffer_from_buffer(struct wlr_buffer *wlr_buffer);
 
-int handle_activity_event(tgui_event *e, struct wlr_tgui_output *output);
+/**
+ * Get the hardware buffer to present a buffer with: our own buffers, or
+ * compositor buffers sharing the memory of one of them, such as a dmabuf
+ * exported from it. This is a no-op for client buffers, which can't share
+ * memory with our hardware buffers. Returns NULL if the buffer can't be
+ * presented directly.
+ */
+struct wlr_tgui_buffer *tgui_buffer_import(struct wlr_allocator *wlr_allocator,
+                                           struct wlr_buffer *wlr_buffer);
+
+/**
+ * Prepare hardware buffers of the given sizes ahead of demand. Replaces the
+ * previous prediction of the same owner, the predictions of other owners are
+ * kept. Cached buffers of sizes no owner predicts anymore are dropped. An
+ * empty prediction forgets the owner.
+ */
+void tgui_allocator_prefetch(struct wlr_allocator *wlr_allocator,
+                             const void *owner,
+                             const struct wlr_tgui_pool_hint *hints,
+                             size_t hints_len);
+
+/**
+ * Forget the prediction of an owner, and drop the cached hardware buffers no
+ * other owner predicts. Buffers of these sizes released afterwards are
+ * destroyed instead of being cached, until the next tgui_allocator_prefetch.
+ */
+void tgui_allocator_trim(struct wlr_allocator *wlr_allocator,
+                         const void *owner);
+
+/**
+ * Get the size of the hardware buffers currently allocated, in use or cached.
+ */
+size_t tgui_allocator_get_resident_bytes(struct wlr_allocator *wlr_allocator);
+
+/**
+ * Start and stop the thread presenting the buffers of all outputs.
+ */
+void tgui_present_init(struct wlr_tgui_backend *backend);
+
+void tgui_present_finish(struct wlr_tgui_backend *backend);
+
+/**
+ * Open the trace file named by WLR_TGUI_RECORD, if any, and close it. The
+ * record functions do nothing unless a trace is being recorded, and may be
+ * called from any thread.
+ */
+void tgui_record_init(struct wlr_tgui_backend *backend);
+
+void tgui_record_finish(struct wlr_tgui_backend *backend);
+
+void tgui_record_event(struct wlr_tgui_backend *backend,
+                       const tgui_event *e,
+                       int64_t time_nsec);
+
+void tgui_record_present(struct wlr_tgui_backend *backend,
+                         struct wlr_tgui_output *output,
+                         struct wlr_tgui_buffer *buffer,
+                         int64_t start_nsec,
+                         int64_t end_nsec,
+                         tgui_err result);
+
+void tgui_record_view_size(struct wlr_tgui_backend *backend,
+                           struct wlr_tgui_output *output);
+
+int handle_activity_event(tgui_event *e,
+                          struct wlr_tgui_output *output,
+                          uint64_t time_ms);
 
 void handle_touch_event(tgui_event *e,
                         struct wlr_tgui_output *output,
@@ -0,0 +1,71 @@
+#ifndef BACKEND_TERMUXGUI_TRACE_H
+#define BACKEND_TERMUXGUI_TRACE_H
+
+#include <stdint.h>
+
+/**
+ * Sessions can be recorded to a trace file with WLR_TGUI_RECORD, and replayed
+ * against the stub Termux:GUI library with WLR_TGUI_REPLAY. A trace is a
+ * wlr_tgui_trace_header followed by records, each a wlr_tgui_trace_record
+ * followed by size bytes of payload, in host byte order.
+ */
+#define WLR_TGUI_TRACE_MAGIC 0x52544757 // "WGTR"
+#define WLR_TGUI_TRACE_VERSION 2
+#define WLR_TGUI_TRACE_MAX_POINTERS 10
+
+enum wlr_tgui_trace_type {
+    // wlr_tgui_trace_event, followed by one wlr_tgui_trace_pointer per
+    // recorded pointer for touch events
+    WLR_TGUI_TRACE_EVENT = 1,
+    // wlr_tgui_trace_present
+    WLR_TGUI_TRACE_PRESENT = 2,
+    // wlr_tgui_trace_view_size, the size of the surface view of an activity
+    // after its creation or a TGUI_EVENT_SURFACE_CHANGED event
+    WLR_TGUI_TRACE_VIEW_SIZE = 3,
+};
+
+struct wlr_tgui_trace_header {
+    uint32_t magic;
+    uint32_t version;
+};
+
+struct wlr_tgui_trace_record {
+    uint32_t type; // enum wlr_tgui_trace_type
+    uint32_t size; // payload size
+    int64_t time_nsec; // CLOCK_MONOTONIC
+};
+
+struct wlr_tgui_trace_event {
+    int32_t type; // tgui_event_type
+    int32_t activity;
+    union {
+        struct {
+            uint32_t code, code_point, mod, down;
+        } key;
+        struct {
+            int32_t action;
+            uint32_t index, num_pointers;
+        } touch;
+    };
+};
+
+struct wlr_tgui_trace_pointer {
+    int32_t id;
+    float x, y;
+};
+
+struct wlr_tgui_trace_present {
+    int32_t activity;
+    uint32_t width, height;
+    uint32_t format; // DRM fourcc
+    int64_t duration_nsec; // spent in tgui_surface_view_set_buffer
+    int32_t result; // tgui_err
+    uint32_t pad;
+};
+
+struct wlr_tgui_trace_view_size {
+    int32_t activity;
+    uint32_t width, height;
+};
+
+#endif
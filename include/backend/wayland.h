@@ -33,6 +33,7 @@ struct wlr_wl_backend {
 	struct wl_event_source *remote_display_src;
 	struct wl_registry *registry;
 	struct wl_compositor *compositor;
+	struct wl_subcompositor *subcompositor;
 	struct xdg_wm_base *xdg_wm_base;
 	struct zxdg_decoration_manager_v1 *zxdg_decoration_manager_v1;
 	struct zwp_pointer_gestures_v1 *zwp_pointer_gestures_v1;
@@ -85,6 +86,11 @@ struct wlr_wl_output {
 		struct wl_surface *surface;
 		int32_t hotspot_x, hotspot_y;
 	} cursor;
+
+	struct {
+		struct wl_surface *surface;
+		struct wl_subsurface *subsurface;
+	} overlay;
 };
 
 struct wlr_wl_pointer {
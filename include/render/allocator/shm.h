@@ -4,20 +4,67 @@
 #include <wlr/types/wlr_buffer.h>
 #include "render/allocator/allocator.h"
 
+/**
+ * A shared memory file from which several buffers are suballocated.
+ */
+struct wlr_shm_pool {
+	struct wlr_shm_allocator *allocator; // NULL if the allocator is gone
+	struct wl_list link; // wlr_shm_allocator.pools
+
+	int fd;
+	void *data;
+	size_t size;
+	size_t used; // bytes carved into slots so far
+
+	struct wl_list free_slots; // wlr_shm_pool_slot.link, sorted by offset
+	size_t n_slots, n_busy_slots;
+	size_t busy_bytes;
+};
+
+struct wlr_shm_pool_slot {
+	struct wlr_shm_pool *pool;
+	struct wl_list link; // wlr_shm_pool.free_slots, if free
+	size_t offset, size;
+};
+
 struct wlr_shm_buffer {
 	struct wlr_buffer base;
 	struct wlr_shm_attributes shm;
+	struct wlr_shm_pool_slot *slot;
 	void *data;
 	size_t size;
 };
 
 struct wlr_shm_allocator {
 	struct wlr_allocator base;
+
+	struct wl_list pools; // wlr_shm_pool.link
+};
+
+struct wlr_shm_pool_stats {
+	size_t size; // size of the backing file
+	size_t used; // bytes carved into slots
+	size_t busy; // bytes backing live buffers
+	size_t cached; // bytes of free slots kept for reuse
+	size_t n_buffers; // live buffers
 };
 
 /**
  * Creates a new shared memory allocator.
+ *
+ * Buffers are suballocated from a few large shared memory files, with packed
+ * strides and page-aligned offsets. Freed buffers are kept
+ * by size class and recycled by later allocations, adjacent free slots are
+ * merged, and their memory is released when too much of it is cached.
  */
 struct wlr_allocator *wlr_shm_allocator_create(void);
 
+/**
+ * Fill up to stats_len entries of stats with the usage of each pool, and
+ * return the total number of pools. Returns 0 if the allocator isn't a shm
+ * allocator.
+ */
+size_t wlr_shm_allocator_get_pool_stats(struct wlr_allocator *alloc,
+	struct wlr_shm_pool_stats *stats, size_t stats_len);
+
 #endif
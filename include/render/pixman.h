@@ -4,6 +4,7 @@
 #include <wlr/render/pixman.h>
 #include <wlr/render/wlr_renderer.h>
 #include <wlr/render/drm_format_set.h>
+#include <wlr/util/addon.h>
 #include "render/pixel_format.h"
 
 struct wlr_pixman_pixel_format {
@@ -46,6 +47,7 @@ struct wlr_pixman_texture {
 
 	void *data; // if created via texture_from_pixels
 	struct wlr_buffer *buffer; // if created via texture_from_buffer
+	struct wlr_addon buffer_addon;
 };
 
 pixman_format_code_t get_pixman_format_from_drm(uint32_t fmt);
@@ -5,7 +5,10 @@
 #include <wayland-server-core.h>
 #include <wlr/render/drm_format_set.h>
 
-#define WLR_SWAPCHAIN_CAP 4
+#define WLR_SWAPCHAIN_CAP 8
+// Number of acquisitions over which the in-flight depth is observed before
+// releasing unused buffers
+#define WLR_SWAPCHAIN_TRIM_PERIOD 120
 
 struct wlr_swapchain_slot {
 	struct wlr_buffer *buffer;
@@ -15,6 +18,14 @@ struct wlr_swapchain_slot {
 	struct wl_listener release;
 };
 
+struct wlr_swapchain_stats {
+	size_t acquired, failed; // number of acquisitions
+	size_t allocated, trimmed; // number of buffers
+	size_t age_sum; // sum of the ages of acquired buffers
+	size_t age_unknown; // acquisitions of buffers without defined contents
+	int max_in_flight;
+};
+
 struct wlr_swapchain {
 	struct wlr_allocator *allocator; // NULL if destroyed
 
@@ -23,6 +34,12 @@ struct wlr_swapchain {
 
 	struct wlr_swapchain_slot slots[WLR_SWAPCHAIN_CAP];
 
+	// Peak number of acquired slots during the current trim period
+	int period_in_flight;
+	size_t period_acquired;
+
+	struct wlr_swapchain_stats stats;
+
 	struct wl_listener allocator_destroy;
 };
 
@@ -33,6 +50,11 @@ void wlr_swapchain_destroy(struct wlr_swapchain *swapchain);
 /**
  * Acquire a buffer from the swap chain.
  *
+ * The free buffer with the smallest age is preferred, to keep the damage to
+ * repaint small. New buffers are allocated when all existing ones are in
+ * flight, up to WLR_SWAPCHAIN_CAP. Buffers left unused by the observed
+ * in-flight depth are periodically released.
+ *
  * The returned buffer is locked. When the caller is done with it, they must
  * unlock it by calling wlr_buffer_unlock.
  */
@@ -46,5 +68,11 @@ struct wlr_buffer *wlr_swapchain_acquire(struct wlr_swapchain *swapchain,
  */
 void wlr_swapchain_set_buffer_submitted(struct wlr_swapchain *swapchain,
 	struct wlr_buffer *buffer);
+/**
+ * Get the statistics of the swap chain since its creation. They are also
+ * logged when it's destroyed.
+ */
+void wlr_swapchain_get_stats(struct wlr_swapchain *swapchain,
+	struct wlr_swapchain_stats *stats);
 
 #endif
@@ -25,6 +25,19 @@ struct wlr_shm_client_buffer {
 struct wlr_shm_client_buffer *shm_client_buffer_get_or_create(
 	struct wl_resource *resource);
 
+/**
+ * Import source into a renderer other than the one the client buffer has
+ * been created with, if it has no texture for it yet. Must be called while
+ * source is locked by the compositor, the client may rewrite it afterwards.
+ */
+void client_buffer_import_texture(struct wlr_client_buffer *client_buffer,
+	struct wlr_renderer *renderer, struct wlr_buffer *source);
+/**
+ * Import source into every renderer prev had a texture for.
+ */
+void client_buffer_inherit_textures(struct wlr_client_buffer *client_buffer,
+	struct wlr_client_buffer *prev, struct wlr_buffer *source);
+
 /**
  * A read-only buffer that holds a data pointer.
  *
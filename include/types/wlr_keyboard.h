@@ -1,3 +1,6 @@
+#ifndef TYPES_WLR_KEYBOARD_H
+#define TYPES_WLR_KEYBOARD_H
+
 #include <wlr/types/wlr_keyboard.h>
 
 void keyboard_key_update(struct wlr_keyboard *keyboard,
@@ -6,3 +9,27 @@ void keyboard_key_update(struct wlr_keyboard *keyboard,
 bool keyboard_modifier_update(struct wlr_keyboard *keyboard);
 
 void keyboard_led_update(struct wlr_keyboard *keyboard);
+
+/**
+ * A sealed read-only shared memory file holding a keymap string. Keyboards
+ * with identical keymaps share the same file.
+ */
+struct wlr_keymap_shm {
+	uint64_t id; // unique among live entries
+	uint64_t hash;
+	size_t size;
+	int fd;
+	const char *data; // read-only mapping of fd
+	int n_refs;
+	struct wl_list link;
+};
+
+/**
+ * Get a reference to the shared memory file for a keymap string, creating it
+ * if no keyboard uses the same keymap yet. size includes the NUL terminator.
+ */
+struct wlr_keymap_shm *keymap_shm_get(const char *keymap_string, size_t size);
+
+void keymap_shm_unref(struct wlr_keymap_shm *keymap_shm);
+
+#endif
@@ -14,6 +14,16 @@ bool output_is_direct_scanout(struct wlr_output *output,
 struct wlr_drm_format *output_pick_format(struct wlr_output *output,
 	const struct wlr_drm_format_set *display_formats, uint32_t format);
 void output_clear_back_buffer(struct wlr_output *output);
+/**
+ * Get the refresh period reported by the last present event, falling back to
+ * the current mode's refresh rate. Returns 0 if unknown.
+ */
+int64_t output_get_refresh_nsec(struct wlr_output *output);
+/**
+ * Get the time elapsed since the last presented frame on the presentation
+ * clock, in nanoseconds. Returns -1 if no frame has been presented yet.
+ */
+int64_t output_get_time_since_present(struct wlr_output *output);
 bool output_ensure_buffer(struct wlr_output *output,
 	const struct wlr_output_state *state, bool *new_back_buffer);
 
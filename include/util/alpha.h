@@ -0,0 +1,14 @@
+#ifndef UTIL_ALPHA_H
+#define UTIL_ALPHA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Check whether a row of 32-bit pixels storing alpha in their most significant
+ * byte (e.g. DRM_FORMAT_ARGB8888 and DRM_FORMAT_ABGR8888) is fully opaque.
+ */
+bool alpha_row_is_opaque(const uint32_t *row, size_t len);
+
+#endif
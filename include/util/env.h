@@ -8,4 +8,9 @@ bool env_parse_bool(const char *option);
 
 ssize_t env_parse_switch(const char *option, const char **switches);
 
+/**
+ * Parse an integer option, returning fallback if unset or invalid.
+ */
+long env_parse_int(const char *option, long fallback);
+
 #endif
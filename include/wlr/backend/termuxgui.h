@@ -9,9 +9,36 @@
 #ifndef WLR_BACKEND_TERMUXGUI_H
 #define WLR_BACKEND_TERMUXGUI_H
 
+#include <stdint.h>
 #include <wlr/backend.h>
 #include <wlr/types/wlr_output.h>
 
+#define WLR_TGUI_LATENCY_BUCKETS 16
+
+/**
+ * Delay between the reception of input events from the Termux:GUI plugin and
+ * their dispatch on the compositor thread.
+ */
+struct wlr_tgui_input_latency {
+	uint64_t count;
+	uint64_t total_us, max_us;
+	// buckets[0] counts latencies below 1 µs, buckets[i] the ones in
+	// [2^(i-1), 2^i) µs, and the last bucket all longer ones
+	uint64_t buckets[WLR_TGUI_LATENCY_BUCKETS];
+};
+
+/**
+ * Hardware buffer memory of a Termux:GUI backend.
+ */
+struct wlr_tgui_memory_stats {
+	size_t resident_bytes; // hardware buffers currently allocated
+	// Paused outputs whose buffers have been released, see
+	// WLR_TGUI_TRIM_PAUSED, and the memory released when they were trimmed.
+	// Buffers still being presented at that time are not included.
+	uint64_t trims;
+	uint64_t trimmed_bytes;
+};
+
 /**
  * Creates a Termux:GUI backend, and connection to the Termux:GUI plugin.
  * A Termux:GUI backend has no outputs or inputs by default.
@@ -25,6 +52,32 @@ struct wlr_backend *wlr_tgui_backend_create(struct wl_display *display);
  */
 struct wlr_output *wlr_tgui_add_output(struct wlr_backend *backend);
 
+/**
+ * Set the render scale of a Termux:GUI output, between 0.25 and 1.
+ *
+ * The preferred mode of the output is the size of its surface view multiplied
+ * by the render scale, and frames are upscaled to fill the surface view. This
+ * trades sharpness for rendering cost. It takes effect when the surface view
+ * is created, so it must be called right after wlr_tgui_add_output().
+ *
+ * Upscaling is a bilinear pass on the CPU over the damaged region, which costs
+ * more than rendering small damage at full size: a scale below 1 only pays off
+ * when most frames repaint a large part of the output, as games and video do.
+ */
+void wlr_tgui_output_set_render_scale(struct wlr_output *output, float scale);
+
+/**
+ * Get the input latency statistics of a Termux:GUI backend since its creation.
+ */
+void wlr_tgui_backend_get_input_latency(struct wlr_backend *backend,
+	struct wlr_tgui_input_latency *latency);
+
+/**
+ * Get the hardware buffer memory statistics of a Termux:GUI backend.
+ */
+void wlr_tgui_backend_get_memory_stats(struct wlr_backend *backend,
+	struct wlr_tgui_memory_stats *stats);
+
 bool wlr_backend_is_tgui(struct wlr_backend *backend);
 bool wlr_output_is_tgui(struct wlr_output *output);
 
@@ -141,6 +141,9 @@ struct wlr_client_buffer {
 	/**
 	 * The buffer's texture, if any. A buffer will not have a texture if the
 	 * client destroys the buffer before it has been released.
+	 *
+	 * This texture belongs to the renderer the client buffer has been created
+	 * with. Use wlr_client_buffer_get_texture() for other renderers.
 	 */
 	struct wlr_texture *texture;
 	/**
@@ -153,6 +156,9 @@ struct wlr_client_buffer {
 	struct wl_listener source_destroy;
 
 	size_t n_ignore_locks;
+
+	struct wlr_renderer *renderer; // renderer owning the texture field
+	struct wl_list textures; // client_buffer_texture.link, other renderers
 };
 
 /**
@@ -171,10 +177,25 @@ struct wlr_client_buffer *wlr_client_buffer_get(struct wlr_buffer *buffer);
  * Check if a resource is a wl_buffer resource.
  */
 bool wlr_resource_is_buffer(struct wl_resource *resource);
+/**
+ * Get a texture of the client buffer for the given renderer.
+ *
+ * Textures are imported when the buffer is committed, for the renderers of
+ * the outputs the surface is on and the renderers which had a texture of the
+ * previous buffer, then kept up to date by wlr_client_buffer_apply_damage()
+ * alongside the main texture. Other renderers import the source on first use
+ * if it hasn't been released to the client yet, which is the case as long as
+ * the main texture references it (e.g. with the pixman renderer). Returns
+ * NULL if the source has been released, or if the import failed: the
+ * texture then shows up with the next commit.
+ */
+struct wlr_texture *wlr_client_buffer_get_texture(
+	struct wlr_client_buffer *client_buffer, struct wlr_renderer *renderer);
 /**
  * Try to update the buffer's content.
  *
- * Fails if there's more than one reference to the buffer or if the texture
+ * The textures of all renderers are updated with the same damage. Fails if
+ * there's more than one reference to the buffer or if one of the textures
  * isn't mutable.
  */
 bool wlr_client_buffer_apply_damage(struct wlr_client_buffer *client_buffer,
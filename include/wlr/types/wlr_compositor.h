@@ -166,6 +166,12 @@ struct wlr_surface {
 	} previous;
 
 	bool opaque;
+
+	// Opaque pixels found by scanning the alpha channel of the buffer, in
+	// buffer-local coordinates
+	bool alpha_scan;
+	pixman_region32_t alpha_opaque;
+	uint32_t alpha_format; // of the scanned pixels, DRM_FORMAT_INVALID if none
 };
 
 struct wlr_renderer;
@@ -180,6 +186,10 @@ struct wlr_compositor {
 		struct wl_signal new_surface;
 		struct wl_signal destroy;
 	} events;
+
+	// private state
+
+	bool alpha_scan;
 };
 
 typedef void (*wlr_surface_iterator_func_t)(struct wlr_surface *surface,
@@ -17,6 +17,9 @@
 /* For triple buffering, a history of two frames is required. */
 #define WLR_DAMAGE_RING_PREVIOUS_LEN 2
 
+/* Default maximum number of rectangles before damage is simplified. */
+#define WLR_DAMAGE_RING_MAX_RECTS 20
+
 struct wlr_box;
 
 struct wlr_damage_ring {
@@ -29,6 +32,9 @@ struct wlr_damage_ring {
 
 	pixman_region32_t previous[WLR_DAMAGE_RING_PREVIOUS_LEN];
 	size_t previous_idx;
+
+	int max_rects;
+	int tile_size;
 };
 
 void wlr_damage_ring_init(struct wlr_damage_ring *ring);
@@ -46,6 +52,20 @@ void wlr_damage_ring_finish(struct wlr_damage_ring *ring);
 void wlr_damage_ring_set_bounds(struct wlr_damage_ring *ring,
 	int32_t width, int32_t height);
 
+/**
+ * Set the rectangle budget of the ring.
+ *
+ * When the current or accumulated damage is made of more than max_rects
+ * rectangles, it is simplified: if tile_size is positive, damage is first
+ * rounded out to a grid of tile_size x tile_size tiles, and if that still
+ * exceeds the budget (or tile_size is zero) it is collapsed to its extents.
+ * The simplified damage always contains the original damage.
+ *
+ * By default, max_rects is WLR_DAMAGE_RING_MAX_RECTS and tile_size is zero.
+ */
+void wlr_damage_ring_set_rect_budget(struct wlr_damage_ring *ring,
+	int max_rects, int tile_size);
+
 /**
  * Add a region to the current damage.
  *
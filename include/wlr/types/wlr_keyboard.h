@@ -40,6 +40,7 @@ enum wlr_keyboard_modifier {
 #define WLR_KEYBOARD_KEYS_CAP 32
 
 struct wlr_keyboard_impl;
+struct wlr_keymap_shm;
 
 struct wlr_keyboard_modifiers {
 	xkb_mod_mask_t depressed;
@@ -56,7 +57,7 @@ struct wlr_keyboard {
 
 	char *keymap_string;
 	size_t keymap_size;
-	int keymap_fd;
+	int keymap_fd; // read-only, shared with other keyboards
 	struct xkb_keymap *keymap;
 	struct xkb_state *xkb_state;
 	xkb_led_index_t led_indexes[WLR_LED_COUNT];
@@ -92,6 +93,10 @@ struct wlr_keyboard {
 	} events;
 
 	void *data;
+
+	// private state
+
+	struct wlr_keymap_shm *keymap_shm;
 };
 
 struct wlr_keyboard_key_event {
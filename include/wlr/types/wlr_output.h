@@ -67,6 +67,7 @@ enum wlr_output_state_field {
 	WLR_OUTPUT_STATE_GAMMA_LUT = 1 << 7,
 	WLR_OUTPUT_STATE_RENDER_FORMAT = 1 << 8,
 	WLR_OUTPUT_STATE_SUBPIXEL = 1 << 9,
+	WLR_OUTPUT_STATE_OVERLAY = 1 << 10,
 };
 
 enum wlr_output_state_mode_type {
@@ -104,6 +105,10 @@ struct wlr_output_state {
 	// only valid if WLR_OUTPUT_STATE_GAMMA_LUT
 	uint16_t *gamma_lut;
 	size_t gamma_lut_size;
+
+	// only valid if WLR_OUTPUT_STATE_OVERLAY
+	struct wlr_buffer *overlay_buffer; // NULL to disable the overlay
+	int overlay_x, overlay_y; // output-buffer-local coordinates
 };
 
 struct wlr_output_impl;
@@ -197,6 +202,16 @@ struct wlr_output {
 	struct wlr_swapchain *swapchain;
 	struct wlr_buffer *back_buffer;
 
+	// Frame scheduling, see wlr_output_set_frame_delay()
+	bool frame_delay;
+	bool frame_delayed; // a frame event is waiting for the timer
+	int frame_timer_fd;
+	struct wl_event_source *frame_timer;
+	int64_t frame_margin; // nsec
+	int64_t frame_render_time; // nsec, estimate of the frame-to-commit time
+	struct timespec frame_sent, last_present; // presentation clock
+	int64_t present_refresh; // nsec, 0 if unknown
+
 	struct wl_listener display_destroy;
 
 	struct wlr_addon_set addons;
@@ -404,6 +419,17 @@ bool wlr_output_attach_render(struct wlr_output *output, int *buffer_age);
  */
 void wlr_output_attach_buffer(struct wlr_output *output,
 	struct wlr_buffer *buffer);
+/**
+ * Attach a buffer to be displayed above the primary buffer on an overlay
+ * plane, with its top-left corner at (x, y) in output-buffer-local
+ * coordinates. A NULL buffer disables the overlay. The overlay is kept until
+ * it's changed by a later commit.
+ *
+ * Few backends have an overlay plane. Compositors can check whether it is
+ * supported by calling wlr_output_test().
+ */
+void wlr_output_attach_overlay(struct wlr_output *output,
+	struct wlr_buffer *buffer, int x, int y);
 /**
  * Get the preferred format for reading pixels.
  * This function might change the current rendering context.
@@ -451,6 +477,18 @@ bool wlr_output_commit_state(struct wlr_output *output,
  * it is a no-op.
  */
 void wlr_output_schedule_frame(struct wlr_output *output);
+/**
+ * Enable or disable delaying frame events until just before the predicted
+ * deadline of the next refresh cycle, so that compositors sample input and
+ * client state as late as possible.
+ *
+ * The deadline is extrapolated from the last present event and the refresh
+ * period, falling back to the current mode's refresh rate. The time needed
+ * by the compositor to commit a frame after a frame event is tracked, and a
+ * safety margin (WLR_OUTPUT_FRAME_MARGIN) is added on top of it. Frame
+ * events are sent right away when no recent present event is known.
+ */
+void wlr_output_set_frame_delay(struct wlr_output *output, bool enabled);
 /**
  * Returns the maximum length of each gamma ramp, or 0 if unsupported.
  */
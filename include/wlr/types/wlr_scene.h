@@ -20,15 +20,21 @@
  */
 
 #include <pixman.h>
+#include <time.h>
 #include <wayland-server-core.h>
 #include <wlr/types/wlr_compositor.h>
 #include <wlr/types/wlr_damage_ring.h>
 
 struct wlr_output;
 struct wlr_output_layout;
+struct wlr_swapchain;
 struct wlr_xdg_surface;
 struct wlr_layer_surface_v1;
 
+/* Number of past buffer commits whose damage is kept for texture updates. */
+#define WLR_SCENE_BUFFER_DAMAGE_LEN 4
+#define WLR_SCENE_RENDER_AHEAD_MAX 2
+
 struct wlr_scene_node;
 struct wlr_scene_buffer;
 
@@ -65,6 +71,10 @@ struct wlr_scene_node {
 	// private state
 
 	pixman_region32_t visible;
+
+	// Opaque region in node-local coordinates, recomputed when dirty
+	pixman_region32_t opaque;
+	bool opaque_dirty;
 };
 
 enum wlr_scene_debug_damage_option {
@@ -96,6 +106,9 @@ struct wlr_scene {
 	enum wlr_scene_debug_damage_option debug_damage_option;
 	bool direct_scanout;
 	bool calculate_visibility;
+	bool cull_occluded;
+	int stats_interval; // seconds, 0 if statistics are not logged
+	int hidden_frame_rate; // Hz, 0 to withhold frame callbacks
 };
 
 /** A scene-graph node displaying a single surface. */
@@ -113,6 +126,10 @@ struct wlr_scene_surface {
 	struct wl_listener frame_done;
 	struct wl_listener surface_destroy;
 	struct wl_listener surface_commit;
+
+	// Throttled frame callbacks while the surface isn't displayed
+	struct wl_event_source *hidden_frame_timer;
+	struct timespec last_frame_done;
 };
 
 /** A scene-graph node displaying a solid-colored rectangle */
@@ -150,11 +167,32 @@ struct wlr_scene_buffer {
 	// private state
 
 	uint64_t active_outputs;
-	struct wlr_texture *texture;
+	struct wlr_texture *texture; // only for buffers not in the texture cache
 	struct wlr_fbox src_box;
 	int dst_width, dst_height;
 	enum wl_output_transform transform;
 	pixman_region32_t opaque_region;
+
+	// Damage of the last buffer commits, used to bring cached textures of
+	// previously displayed buffers up to date
+	uint64_t texture_source, texture_commit;
+	pixman_region32_t texture_damage[WLR_SCENE_BUFFER_DAMAGE_LEN];
+};
+
+/** Rendering statistics of a scene output, see wlr_scene_output_get_stats() */
+struct wlr_scene_output_stats {
+	uint64_t frames; // frames rendered
+	uint64_t damage_pixels; // pixels damaged in rendered frames
+	uint64_t background_pixels; // pixels cleared before drawing nodes
+	uint64_t rect_pixels, buffer_pixels; // pixels drawn per node type
+	uint64_t scissor_rects, draw_calls;
+	uint64_t nodes_drawn;
+	uint64_t nodes_culled; // damaged, but fully covered by opaque nodes
+	uint64_t scanout_hits, scanout_misses;
+	// scan-out with the nodes above the buffer on the output overlay plane
+	uint64_t overlay_hits, overlay_misses;
+	// frames rendered ahead, and committed or dropped for a newer frame
+	uint64_t render_ahead_hits, render_ahead_drops;
 };
 
 /** A viewport for an output in the scene-graph */
@@ -176,6 +214,7 @@ struct wlr_scene_output {
 
 	uint8_t index;
 	bool prev_scanout;
+	struct wlr_box layout_box; // position and effective resolution
 
 	struct wl_listener output_commit;
 	struct wl_listener output_mode;
@@ -185,6 +224,25 @@ struct wlr_scene_output {
 	struct wl_list damage_highlight_regions;
 
 	struct wl_array render_list;
+	struct wl_array render_regions; // pixman_region32_t, one per render_list entry
+
+	struct wlr_swapchain *overlay_swapchain;
+	bool overlay_active;
+	int overlay_retry_delay; // frames
+
+	bool stats_enabled;
+	struct wlr_scene_output_stats stats, logged_stats;
+	struct timespec stats_logged_at;
+
+	uint64_t epoch; // unique, tags the render sequence of back buffers
+	uint64_t render_seq; // number of frames rendered
+	int64_t render_time; // nsec, moving average
+
+	int render_ahead_depth;
+	struct wlr_buffer *render_ahead[WLR_SCENE_RENDER_AHEAD_MAX]; // oldest first
+	int render_ahead_len;
+	pixman_region32_t render_ahead_damage; // since the last commit
+	struct wl_event_source *render_ahead_idle;
 };
 
 /** A layer shell scene helper */
@@ -272,6 +330,13 @@ struct wlr_scene *wlr_scene_create(void);
  */
 void wlr_scene_set_presentation(struct wlr_scene *scene,
 	struct wlr_presentation *presentation);
+/**
+ * Set the rate in Hz at which surfaces that aren't displayed on any output,
+ * because they are occluded, off-screen or disabled, receive frame callbacks.
+ * Such surfaces get no frame callbacks at all when the rate is 0, which is
+ * the default.
+ */
+void wlr_scene_set_hidden_frame_rate(struct wlr_scene *scene, int rate);
 
 /**
  * Add a node displaying nothing but its children.
@@ -398,6 +463,29 @@ void wlr_scene_output_set_position(struct wlr_scene_output *scene_output,
  * Render and commit an output.
  */
 bool wlr_scene_output_commit(struct wlr_scene_output *scene_output);
+/**
+ * Enable or disable collection of overdraw and fill-rate statistics. Counters
+ * are reset when enabling.
+ */
+void wlr_scene_output_set_stats_enabled(struct wlr_scene_output *scene_output,
+	bool enabled);
+/**
+ * Get the statistics accumulated since they were enabled. Returns false if
+ * statistics are disabled for this output.
+ */
+bool wlr_scene_output_get_stats(struct wlr_scene_output *scene_output,
+	struct wlr_scene_output_stats *stats);
+/**
+ * Set how many frames may be rendered ahead while the output is still waiting
+ * for the previous frame to be presented, at most WLR_SCENE_RENDER_AHEAD_MAX.
+ *
+ * A frame is rendered as soon as the scene changes, if the measured render
+ * time allows it to be ready before the next frame event. The newest one is
+ * then committed by wlr_scene_output_commit() when nothing changed since.
+ * 0 disables rendering ahead, which is the default.
+ */
+void wlr_scene_output_set_render_ahead(struct wlr_scene_output *scene_output,
+	int depth);
 /**
  * Call wlr_surface_send_frame_done() on all surfaces in the scene rendered by
  * wlr_scene_output_commit() for which wlr_scene_surface.primary_output
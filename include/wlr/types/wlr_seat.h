@@ -67,6 +67,11 @@ struct wlr_seat_client {
 		int32_t last_discrete[2];
 		double acc_axis[2];
 	} value120;
+
+	// private state
+
+	// Keymap last sent to the client's keyboards, 0 if none
+	uint64_t keymap_id;
 };
 
 struct wlr_touch_point {
@@ -18,6 +18,7 @@
 
 #include <stdbool.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <string.h>
 #include <errno.h>
 
@@ -40,9 +41,29 @@ typedef void (*wlr_log_func_t)(enum wlr_log_importance importance,
  *
  * This function can be called multiple times to update the verbosity or
  * callback function.
+ *
+ * If the callback is NULL and the WLR_LOG_ASYNC environment variable is set
+ * to 1, wlr_log_stderr_async() is used.
  */
 void wlr_log_init(enum wlr_log_importance verbosity, wlr_log_func_t callback);
 
+/**
+ * Asynchronous stderr logger, suitable as a wlr_log_init() callback.
+ *
+ * Messages are formatted on the calling thread into a fixed-size ring and
+ * written to stderr by a background thread, so logging never blocks on a slow
+ * stderr. When the ring is full, errors are written synchronously after the
+ * queued messages and other messages are dropped.
+ */
+void wlr_log_stderr_async(enum wlr_log_importance importance,
+	const char *fmt, va_list args);
+
+/**
+ * Get the number of messages dropped by wlr_log_stderr_async() because its
+ * ring was full.
+ */
+uint64_t wlr_log_get_dropped(void);
+
 /**
  * Get the current log verbosity configured by wlr_log_init().
  */
@@ -1,3 +1,4 @@
+#define _DEFAULT_SOURCE // for MADV_REMOVE
 #include <assert.h>
 #include <drm_fourcc.h>
 #include <stdlib.h>
@@ -12,7 +13,257 @@
 #include "render/allocator/shm.h"
 #include "util/shm.h"
 
+// Minimum size of a shared memory file, larger buffers get their own file
+#define POOL_MIN_SIZE (4 * 1024 * 1024)
+// Fully unused pools are released once this many bytes are cached
+#define MAX_CACHED_SIZE (32 * 1024 * 1024)
+
 static const struct wlr_buffer_impl buffer_impl;
+static const struct wlr_allocator_interface allocator_impl;
+
+static size_t align_up(size_t value, size_t align) {
+	return (value + align - 1) / align * align;
+}
+
+static size_t get_page_size(void) {
+	static size_t page_size = 0;
+	if (page_size == 0) {
+		long ret = sysconf(_SC_PAGESIZE);
+		page_size = ret > 0 ? (size_t)ret : 4096;
+	}
+	return page_size;
+}
+
+/**
+ * Round a size up to its size class: page-aligned, then the next power of two
+ * or 1.5 times a power of two. This bounds the waste to a third of the slot
+ * while letting similarly-sized buffers share slots.
+ */
+static size_t get_size_class(size_t size) {
+	size_t page_size = get_page_size();
+	size = align_up(size, page_size);
+	size_t class = page_size;
+	while (class < size) {
+		if (class >= 2 * page_size && class + class / 2 >= size) {
+			return class + class / 2;
+		}
+		class *= 2;
+	}
+	return class;
+}
+
+static struct wlr_shm_allocator *shm_allocator_from_allocator(
+		struct wlr_allocator *wlr_allocator) {
+	assert(wlr_allocator->impl == &allocator_impl);
+	return (struct wlr_shm_allocator *)wlr_allocator;
+}
+
+static struct wlr_shm_pool *pool_create(struct wlr_shm_allocator *allocator,
+		size_t size) {
+	struct wlr_shm_pool *pool = calloc(1, sizeof(*pool));
+	if (pool == NULL) {
+		return NULL;
+	}
+
+	pool->fd = allocate_shm_file(size);
+	if (pool->fd < 0) {
+		free(pool);
+		return NULL;
+	}
+
+	pool->data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		pool->fd, 0);
+	if (pool->data == MAP_FAILED) {
+		wlr_log_errno(WLR_ERROR, "mmap failed");
+		close(pool->fd);
+		free(pool);
+		return NULL;
+	}
+
+	pool->size = size;
+	pool->allocator = allocator;
+	wl_list_init(&pool->free_slots);
+	wl_list_insert(&allocator->pools, &pool->link);
+
+	wlr_log(WLR_DEBUG, "Created shm pool of %zu bytes", size);
+	return pool;
+}
+
+static void pool_destroy(struct wlr_shm_pool *pool) {
+	assert(pool->n_busy_slots == 0);
+
+	struct wlr_shm_pool_slot *slot, *tmp;
+	wl_list_for_each_safe(slot, tmp, &pool->free_slots, link) {
+		wl_list_remove(&slot->link);
+		free(slot);
+	}
+
+	wlr_log(WLR_DEBUG, "Destroying shm pool of %zu bytes", pool->size);
+	wl_list_remove(&pool->link);
+	munmap(pool->data, pool->size);
+	close(pool->fd);
+	free(pool);
+}
+
+static size_t allocator_get_cached_size(struct wlr_shm_allocator *allocator) {
+	size_t cached = 0;
+	struct wlr_shm_pool *pool;
+	wl_list_for_each(pool, &allocator->pools, link) {
+		cached += pool->used - pool->busy_bytes;
+	}
+	return cached;
+}
+
+static struct wlr_shm_pool_slot *pool_take_free_slot(
+		struct wlr_shm_pool_slot *slot, size_t size) {
+	struct wlr_shm_pool *pool = slot->pool;
+	if (slot->size > size) {
+		// Split the slot, the remainder stays free in place
+		struct wlr_shm_pool_slot *rest = calloc(1, sizeof(*rest));
+		if (rest == NULL) {
+			return NULL;
+		}
+		rest->pool = pool;
+		rest->offset = slot->offset + size;
+		rest->size = slot->size - size;
+		wl_list_insert(&slot->link, &rest->link);
+		slot->size = size;
+		pool->n_slots++;
+	}
+
+	wl_list_remove(&slot->link);
+	wl_list_init(&slot->link);
+	return slot;
+}
+
+static struct wlr_shm_pool_slot *allocator_get_slot(
+		struct wlr_shm_allocator *allocator, size_t size) {
+	size_t class = get_size_class(size);
+
+	// Prefer recycling a free slot of the same size class, then splitting
+	// the smallest larger one
+	struct wlr_shm_pool_slot *best = NULL;
+	struct wlr_shm_pool *pool;
+	wl_list_for_each(pool, &allocator->pools, link) {
+		struct wlr_shm_pool_slot *slot;
+		wl_list_for_each(slot, &pool->free_slots, link) {
+			if (slot->size == class) {
+				return pool_take_free_slot(slot, class);
+			}
+			if (slot->size > class &&
+					(best == NULL || slot->size < best->size)) {
+				best = slot;
+			}
+		}
+	}
+	if (best != NULL) {
+		struct wlr_shm_pool_slot *slot = pool_take_free_slot(best, class);
+		if (slot != NULL) {
+			return slot;
+		}
+	}
+
+	struct wlr_shm_pool *found = NULL;
+	wl_list_for_each(pool, &allocator->pools, link) {
+		if (pool->size - pool->used >= class) {
+			found = pool;
+			break;
+		}
+	}
+	if (found == NULL) {
+		size_t pool_size = class > POOL_MIN_SIZE ? class : POOL_MIN_SIZE;
+		found = pool_create(allocator, pool_size);
+		if (found == NULL) {
+			return NULL;
+		}
+	}
+
+	struct wlr_shm_pool_slot *slot = calloc(1, sizeof(*slot));
+	if (slot == NULL) {
+		if (found->n_slots == 0) {
+			pool_destroy(found);
+		}
+		return NULL;
+	}
+	slot->pool = found;
+	slot->offset = found->used;
+	slot->size = class;
+	wl_list_init(&slot->link);
+
+	found->used += class;
+	found->n_slots++;
+	return slot;
+}
+
+static void pool_remove_free_slot(struct wlr_shm_pool_slot *slot) {
+	wl_list_remove(&slot->link);
+	slot->pool->n_slots--;
+	free(slot);
+}
+
+/**
+ * Give the memory of a free range back to the system. The range stays
+ * mapped, and reads as zeroes once reused.
+ */
+static void pool_discard_range(struct wlr_shm_pool *pool, size_t offset,
+		size_t size) {
+#ifdef MADV_REMOVE
+	if (size == 0) {
+		return;
+	}
+	if (madvise((char *)pool->data + offset, size, MADV_REMOVE) != 0) {
+		wlr_log_errno(WLR_DEBUG, "madvise(MADV_REMOVE) failed");
+	}
+#endif
+}
+
+static void slot_release(struct wlr_shm_pool_slot *slot) {
+	struct wlr_shm_pool *pool = slot->pool;
+	assert(pool->n_busy_slots > 0);
+	pool->n_busy_slots--;
+	pool->busy_bytes -= slot->size;
+
+	// Free slots are sorted by offset, and merged with their free neighbours
+	// so that slots of other size classes can be carved out of them
+	struct wlr_shm_pool_slot *prev = NULL, *next = NULL, *iter;
+	wl_list_for_each(iter, &pool->free_slots, link) {
+		if (iter->offset > slot->offset) {
+			next = iter;
+			break;
+		}
+		prev = iter;
+	}
+	wl_list_insert(next != NULL ? next->link.prev : pool->free_slots.prev,
+		&slot->link);
+	if (next != NULL && slot->offset + slot->size == next->offset) {
+		slot->size += next->size;
+		pool_remove_free_slot(next);
+	}
+	if (prev != NULL && prev->offset + prev->size == slot->offset) {
+		prev->size += slot->size;
+		pool_remove_free_slot(slot);
+		slot = prev;
+	}
+
+	// Free space at the end of the pool can be carved again
+	size_t offset = slot->offset, size = slot->size;
+	if (offset + size == pool->used) {
+		pool->used = offset;
+		pool_remove_free_slot(slot);
+	}
+
+	if (pool->n_busy_slots > 0) {
+		if (pool->allocator != NULL &&
+				allocator_get_cached_size(pool->allocator) > MAX_CACHED_SIZE) {
+			pool_discard_range(pool, offset, size);
+		}
+		return;
+	}
+	if (pool->allocator == NULL ||
+			allocator_get_cached_size(pool->allocator) > MAX_CACHED_SIZE) {
+		pool_destroy(pool);
+	}
+}
 
 static struct wlr_shm_buffer *shm_buffer_from_buffer(
 		struct wlr_buffer *wlr_buffer) {
@@ -22,8 +273,7 @@ static struct wlr_shm_buffer *shm_buffer_from_buffer(
 
 static void buffer_destroy(struct wlr_buffer *wlr_buffer) {
 	struct wlr_shm_buffer *buffer = shm_buffer_from_buffer(wlr_buffer);
-	munmap(buffer->data, buffer->size);
-	close(buffer->shm.fd);
+	slot_release(buffer->slot);
 	free(buffer);
 }
 
@@ -57,6 +307,9 @@ static const struct wlr_buffer_impl buffer_impl = {
 static struct wlr_buffer *allocator_create_buffer(
 		struct wlr_allocator *wlr_allocator, int width, int height,
 		const struct wlr_drm_format *format) {
+	struct wlr_shm_allocator *allocator =
+		shm_allocator_from_allocator(wlr_allocator);
+
 	const struct wlr_pixel_format_info *info =
 		drm_get_pixel_format_info(format->format);
 	if (info == NULL) {
@@ -68,38 +321,51 @@ static struct wlr_buffer *allocator_create_buffer(
 	if (buffer == NULL) {
 		return NULL;
 	}
-	wlr_buffer_init(&buffer->base, &buffer_impl, width, height);
 
-	// TODO: consider using a single file for multiple buffers
 	int bytes_per_pixel = info->bpp / 8;
-	int stride = width * bytes_per_pixel; // TODO: align?
-	buffer->size = stride * height;
-	buffer->shm.fd = allocate_shm_file(buffer->size);
-	if (buffer->shm.fd < 0) {
+	// Strides are packed: X11 shm pixmaps have no stride of their own
+	int stride = width * bytes_per_pixel;
+	buffer->size = (size_t)stride * height;
+	buffer->slot = allocator_get_slot(allocator, buffer->size);
+	if (buffer->slot == NULL) {
 		free(buffer);
 		return NULL;
 	}
 
+	struct wlr_shm_pool *pool = buffer->slot->pool;
+	pool->n_busy_slots++;
+	pool->busy_bytes += buffer->slot->size;
+
+	wlr_buffer_init(&buffer->base, &buffer_impl, width, height);
+
+	buffer->data = (char *)pool->data + buffer->slot->offset;
+	buffer->shm.fd = pool->fd;
 	buffer->shm.format = format->format;
 	buffer->shm.width = width;
 	buffer->shm.height = height;
 	buffer->shm.stride = stride;
-	buffer->shm.offset = 0;
-
-	buffer->data = mmap(NULL, buffer->size, PROT_READ | PROT_WRITE, MAP_SHARED,
-		buffer->shm.fd, 0);
-	if (buffer->data == MAP_FAILED) {
-		wlr_log_errno(WLR_ERROR, "mmap failed");
-		close(buffer->shm.fd);
-		free(buffer);
-		return NULL;
-	}
+	buffer->shm.offset = buffer->slot->offset;
 
 	return &buffer->base;
 }
 
 static void allocator_destroy(struct wlr_allocator *wlr_allocator) {
-	free(wlr_allocator);
+	struct wlr_shm_allocator *allocator =
+		shm_allocator_from_allocator(wlr_allocator);
+
+	// Pools still backing live buffers are destroyed with their last buffer
+	struct wlr_shm_pool *pool, *tmp;
+	wl_list_for_each_safe(pool, tmp, &allocator->pools, link) {
+		if (pool->n_busy_slots == 0) {
+			pool_destroy(pool);
+		} else {
+			pool->allocator = NULL;
+			wl_list_remove(&pool->link);
+			wl_list_init(&pool->link);
+		}
+	}
+
+	free(allocator);
 }
 
 static const struct wlr_allocator_interface allocator_impl = {
@@ -107,6 +373,30 @@ static const struct wlr_allocator_interface allocator_impl = {
 	.create_buffer = allocator_create_buffer,
 };
 
+size_t wlr_shm_allocator_get_pool_stats(struct wlr_allocator *alloc,
+		struct wlr_shm_pool_stats *stats, size_t stats_len) {
+	if (alloc->impl != &allocator_impl) {
+		return 0;
+	}
+	struct wlr_shm_allocator *allocator = shm_allocator_from_allocator(alloc);
+
+	size_t n = 0;
+	struct wlr_shm_pool *pool;
+	wl_list_for_each(pool, &allocator->pools, link) {
+		if (n < stats_len) {
+			stats[n] = (struct wlr_shm_pool_stats){
+				.size = pool->size,
+				.used = pool->used,
+				.busy = pool->busy_bytes,
+				.cached = pool->used - pool->busy_bytes,
+				.n_buffers = pool->n_busy_slots,
+			};
+		}
+		n++;
+	}
+	return n;
+}
+
 struct wlr_allocator *wlr_shm_allocator_create(void) {
 	struct wlr_shm_allocator *allocator = calloc(1, sizeof(*allocator));
 	if (allocator == NULL) {
@@ -114,6 +404,7 @@ struct wlr_allocator *wlr_shm_allocator_create(void) {
 	}
 	wlr_allocator_init(&allocator->base, &allocator_impl,
 		WLR_BUFFER_CAP_DATA_PTR | WLR_BUFFER_CAP_SHM);
+	wl_list_init(&allocator->pools);
 
 	wlr_log(WLR_DEBUG, "Created shm allocator");
 	return &allocator->base;
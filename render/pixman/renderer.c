@@ -46,17 +46,29 @@ static struct wlr_pixman_texture *get_texture(
 	return (struct wlr_pixman_texture *)wlr_texture;
 }
 
-static void texture_destroy(struct wlr_texture *wlr_texture) {
-	struct wlr_pixman_texture *texture = get_texture(wlr_texture);
+static void pixman_texture_destroy(struct wlr_pixman_texture *texture) {
 	wl_list_remove(&texture->link);
+	if (texture->buffer != NULL) {
+		wlr_addon_finish(&texture->buffer_addon);
+	}
 	pixman_image_unref(texture->image);
-	wlr_buffer_unlock(texture->buffer);
 	free(texture->data);
 	free(texture);
 }
 
+static void texture_unref(struct wlr_texture *wlr_texture) {
+	struct wlr_pixman_texture *texture = get_texture(wlr_texture);
+	if (texture->buffer != NULL) {
+		// Keep the texture around, in case the buffer is re-used later. It's
+		// destroyed along with the buffer.
+		wlr_buffer_unlock(texture->buffer);
+	} else {
+		pixman_texture_destroy(texture);
+	}
+}
+
 static const struct wlr_texture_impl texture_impl = {
-	.destroy = texture_destroy,
+	.destroy = texture_unref,
 };
 
 struct wlr_pixman_texture *pixman_create_texture(
@@ -215,6 +227,35 @@ static void matrix_to_pixman_transform(struct pixman_transform *transform,
 	pixman_transform_from_pixman_f_transform(transform, &ftr);
 }
 
+/**
+ * Get the destination box covered by the unit square transformed by a matrix,
+ * if it's axis-aligned and lands on pixel boundaries.
+ */
+static bool matrix_get_pixel_box(const float mat[static 9],
+		pixman_box32_t *box) {
+	if (mat[6] != 0.0 || mat[7] != 0.0 ||
+			!((mat[1] == 0.0 && mat[3] == 0.0) ||
+			(mat[0] == 0.0 && mat[4] == 0.0))) {
+		return false;
+	}
+
+	float x1 = mat[2], y1 = mat[5];
+	float x2 = mat[0] + mat[1] + mat[2], y2 = mat[3] + mat[4] + mat[5];
+	float x = fminf(x1, x2), y = fminf(y1, y2);
+	float width = fabsf(x2 - x1), height = fabsf(y2 - y1);
+	if (fabsf(x - roundf(x)) > 0.01 || fabsf(y - roundf(y)) > 0.01 ||
+			fabsf(width - roundf(width)) > 0.01 ||
+			fabsf(height - roundf(height)) > 0.01) {
+		return false;
+	}
+
+	box->x1 = roundf(x);
+	box->y1 = roundf(y);
+	box->x2 = box->x1 + roundf(width);
+	box->y2 = box->y1 + roundf(height);
+	return true;
+}
+
 static bool pixman_render_subtexture_with_matrix(
 		struct wlr_renderer *wlr_renderer, struct wlr_texture *wlr_texture,
 		const struct wlr_fbox *fbox, const float matrix[static 9],
@@ -245,11 +286,6 @@ static bool pixman_render_subtexture_with_matrix(
 		}
 	}
 
-	// TODO: don't create a mask if alpha == 1.0
-	struct pixman_color mask_colour = {0};
-	mask_colour.alpha = 0xFFFF * alpha;
-	pixman_image_t *mask = pixman_image_create_solid_fill(&mask_colour);
-
 	float m[9];
 	memcpy(m, matrix, sizeof(m));
 	wlr_matrix_scale(m, 1.0 / fbox->width, 1.0 / fbox->height);
@@ -260,17 +296,33 @@ static bool pixman_render_subtexture_with_matrix(
 
 	pixman_image_set_transform(texture->image, &transform);
 
-	// TODO clip properly with src_x and src_y
-	pixman_image_composite32(PIXMAN_OP_OVER, texture->image, mask,
-			buffer->image, 0, 0, 0, 0, 0, 0, renderer->width,
-			renderer->height);
+	// Opaque textures can be copied instead of blended, as long as the copy
+	// is restricted to the destination box
+	pixman_box32_t box;
+	if (alpha == 1.0 && texture->format_info != NULL &&
+			!texture->format_info->has_alpha &&
+			matrix_get_pixel_box(matrix, &box)) {
+		pixman_image_composite32(PIXMAN_OP_SRC, texture->image, NULL,
+			buffer->image, box.x1, box.y1, 0, 0, box.x1, box.y1,
+			box.x2 - box.x1, box.y2 - box.y1);
+	} else {
+		// TODO: don't create a mask if alpha == 1.0
+		struct pixman_color mask_colour = {0};
+		mask_colour.alpha = 0xFFFF * alpha;
+		pixman_image_t *mask = pixman_image_create_solid_fill(&mask_colour);
+
+		// TODO clip properly with src_x and src_y
+		pixman_image_composite32(PIXMAN_OP_OVER, texture->image, mask,
+				buffer->image, 0, 0, 0, 0, 0, 0, renderer->width,
+				renderer->height);
+
+		pixman_image_unref(mask);
+	}
 
 	if (texture->buffer != NULL) {
 		wlr_buffer_end_data_ptr_access(texture->buffer);
 	}
 
-	pixman_image_unref(mask);
-
 	return true;
 }
 
@@ -367,6 +419,17 @@ static struct wlr_pixman_texture *pixman_texture_create(
 	return texture;
 }
 
+static void texture_handle_buffer_destroy(struct wlr_addon *addon) {
+	struct wlr_pixman_texture *texture =
+		wl_container_of(addon, texture, buffer_addon);
+	pixman_texture_destroy(texture);
+}
+
+static const struct wlr_addon_interface texture_addon_impl = {
+	.name = "wlr_pixman_texture",
+	.destroy = texture_handle_buffer_destroy,
+};
+
 static struct wlr_texture *pixman_texture_from_buffer(
 		struct wlr_renderer *wlr_renderer, struct wlr_buffer *buffer) {
 	struct wlr_pixman_renderer *renderer = get_renderer(wlr_renderer);
@@ -380,6 +443,27 @@ static struct wlr_texture *pixman_texture_from_buffer(
 	}
 	wlr_buffer_end_data_ptr_access(buffer);
 
+	// The texture wraps the buffer's memory, so it's always up to date,
+	// unless the memory has been remapped since (e.g. wl_shm_pool.resize)
+	struct wlr_addon *addon =
+		wlr_addon_find(&buffer->addons, renderer, &texture_addon_impl);
+	if (addon != NULL) {
+		struct wlr_pixman_texture *texture =
+			wl_container_of(addon, texture, buffer_addon);
+		if (pixman_image_get_data(texture->image) != data) {
+			pixman_image_t *image = pixman_image_create_bits_no_clear(
+				texture->format, buffer->width, buffer->height, data, stride);
+			if (image == NULL) {
+				wlr_log(WLR_ERROR, "Failed to create pixman image");
+				return NULL;
+			}
+			pixman_image_unref(texture->image);
+			texture->image = image;
+		}
+		wlr_buffer_lock(texture->buffer);
+		return &texture->wlr_texture;
+	}
+
 	struct wlr_pixman_texture *texture = pixman_texture_create(renderer,
 		drm_format, buffer->width, buffer->height);
 	if (texture == NULL) {
@@ -396,6 +480,8 @@ static struct wlr_texture *pixman_texture_from_buffer(
 	}
 
 	texture->buffer = wlr_buffer_lock(buffer);
+	wlr_addon_init(&texture->buffer_addon, &buffer->addons, renderer,
+		&texture_addon_impl);
 
 	return &texture->wlr_texture;
 }
@@ -437,7 +523,7 @@ static void pixman_destroy(struct wlr_renderer *wlr_renderer) {
 
 	struct wlr_pixman_texture *tex, *tex_tmp;
 	wl_list_for_each_safe(tex, tex_tmp, &renderer->textures, link) {
-		wlr_texture_destroy(&tex->wlr_texture);
+		pixman_texture_destroy(tex);
 	}
 
 	wlr_drm_format_set_finish(&renderer->drm_formats);
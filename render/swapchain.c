@@ -48,6 +48,19 @@ void wlr_swapchain_destroy(struct wlr_swapchain *swapchain) {
 	if (swapchain == NULL) {
 		return;
 	}
+
+	const struct wlr_swapchain_stats *stats = &swapchain->stats;
+	if (stats->acquired > 0) {
+		size_t aged = stats->acquired - stats->age_unknown;
+		wlr_log(WLR_DEBUG, "Swapchain %dx%d: %zu acquisitions (%zu failed), "
+			"%zu buffers allocated, %zu trimmed, %d at most in flight, "
+			"average age %.1f (%zu unknown)", swapchain->width,
+			swapchain->height, stats->acquired, stats->failed,
+			stats->allocated, stats->trimmed, stats->max_in_flight,
+			aged > 0 ? (double)stats->age_sum / aged : 0.0,
+			stats->age_unknown);
+	}
+
 	for (size_t i = 0; i < WLR_SWAPCHAIN_CAP; i++) {
 		slot_reset(&swapchain->slots[i]);
 	}
@@ -80,36 +93,121 @@ static struct wlr_buffer *slot_acquire(struct wlr_swapchain *swapchain,
 	return wlr_buffer_lock(slot->buffer);
 }
 
-struct wlr_buffer *wlr_swapchain_acquire(struct wlr_swapchain *swapchain,
-		int *age) {
-	struct wlr_swapchain_slot *free_slot = NULL;
+static void swapchain_trim(struct wlr_swapchain *swapchain) {
+	// Keep one spare buffer above the observed depth, and at least two
+	int target = swapchain->period_in_flight + 1;
+	if (target < 2) {
+		target = 2;
+	}
+
+	int n_buffers = 0;
+	for (size_t i = 0; i < WLR_SWAPCHAIN_CAP; i++) {
+		if (swapchain->slots[i].buffer != NULL) {
+			n_buffers++;
+		}
+	}
+
+	while (n_buffers > target) {
+		// Release the free buffer with the least useful contents
+		struct wlr_swapchain_slot *oldest = NULL;
+		for (size_t i = 0; i < WLR_SWAPCHAIN_CAP; i++) {
+			struct wlr_swapchain_slot *slot = &swapchain->slots[i];
+			if (slot->buffer == NULL || slot->acquired) {
+				continue;
+			}
+			if (oldest == NULL || slot->age == 0 ||
+					(oldest->age != 0 && slot->age > oldest->age)) {
+				oldest = slot;
+			}
+		}
+		if (oldest == NULL) {
+			break;
+		}
+		wlr_log(WLR_DEBUG, "Releasing unused swapchain buffer");
+		slot_reset(oldest);
+		swapchain->stats.trimmed++;
+		n_buffers--;
+	}
+
+	swapchain->period_in_flight = 0;
+	swapchain->period_acquired = 0;
+}
+
+static struct wlr_swapchain_slot *swapchain_find_slot(
+		struct wlr_swapchain *swapchain) {
+	struct wlr_swapchain_slot *best = NULL, *empty = NULL;
 	for (size_t i = 0; i < WLR_SWAPCHAIN_CAP; i++) {
 		struct wlr_swapchain_slot *slot = &swapchain->slots[i];
 		if (slot->acquired) {
 			continue;
 		}
-		if (slot->buffer != NULL) {
-			return slot_acquire(swapchain, slot, age);
+		if (slot->buffer == NULL) {
+			if (empty == NULL) {
+				empty = slot;
+			}
+			continue;
+		}
+		// Age 0 means undefined contents, which is worse than any other age
+		if (best == NULL || (slot->age != 0 &&
+				(best->age == 0 || slot->age < best->age))) {
+			best = slot;
 		}
-		free_slot = slot;
 	}
-	if (free_slot == NULL) {
+	return best != NULL ? best : empty;
+}
+
+struct wlr_buffer *wlr_swapchain_acquire(struct wlr_swapchain *swapchain,
+		int *age) {
+	if (swapchain->period_acquired >= WLR_SWAPCHAIN_TRIM_PERIOD) {
+		swapchain_trim(swapchain);
+	}
+
+	int in_flight = 1;
+	for (size_t i = 0; i < WLR_SWAPCHAIN_CAP; i++) {
+		if (swapchain->slots[i].acquired) {
+			in_flight++;
+		}
+	}
+
+	struct wlr_swapchain_slot *slot = swapchain_find_slot(swapchain);
+	if (slot == NULL) {
 		wlr_log(WLR_ERROR, "No free output buffer slot");
+		swapchain->stats.failed++;
 		return NULL;
 	}
 
-	if (swapchain->allocator == NULL) {
-		return NULL;
+	if (slot->buffer == NULL) {
+		if (swapchain->allocator == NULL) {
+			swapchain->stats.failed++;
+			return NULL;
+		}
+
+		wlr_log(WLR_DEBUG, "Allocating new swapchain buffer");
+		slot->buffer = wlr_allocator_create_buffer(swapchain->allocator,
+			swapchain->width, swapchain->height, swapchain->format);
+		if (slot->buffer == NULL) {
+			wlr_log(WLR_ERROR, "Failed to allocate buffer");
+			swapchain->stats.failed++;
+			return NULL;
+		}
+		swapchain->stats.allocated++;
 	}
 
-	wlr_log(WLR_DEBUG, "Allocating new swapchain buffer");
-	free_slot->buffer = wlr_allocator_create_buffer(swapchain->allocator,
-		swapchain->width, swapchain->height, swapchain->format);
-	if (free_slot->buffer == NULL) {
-		wlr_log(WLR_ERROR, "Failed to allocate buffer");
-		return NULL;
+	if (in_flight > swapchain->period_in_flight) {
+		swapchain->period_in_flight = in_flight;
+	}
+	if (in_flight > swapchain->stats.max_in_flight) {
+		swapchain->stats.max_in_flight = in_flight;
 	}
-	return slot_acquire(swapchain, free_slot, age);
+	swapchain->period_acquired++;
+	swapchain->stats.acquired++;
+	if (slot->age == 0) {
+		swapchain->stats.age_unknown++;
+	} else {
+		swapchain->stats.age_sum += slot->age;
+	}
+
+	return slot_acquire(swapchain, slot, age);
 }
 
 static bool swapchain_has_buffer(struct wlr_swapchain *swapchain,
@@ -142,3 +240,8 @@ void wlr_swapchain_set_buffer_submitted(struct wlr_swapchain *swapchain,
 		}
 	}
 }
+
+void wlr_swapchain_get_stats(struct wlr_swapchain *swapchain,
+		struct wlr_swapchain_stats *stats) {
+	*stats = swapchain->stats;
+}
@@ -0,0 +1,119 @@
+#include <drm_fourcc.h>
+#include <pixman.h>
+#include <stdlib.h>
+#include <wlr/interfaces/wlr_output.h>
+#include "common.h"
+#include "util/alpha.h"
+
+/**
+ * Weigh the alpha scan of an ARGB8888 buffer without translucent pixels
+ * against what knowing it's opaque saves: the background below it is culled
+ * from scene rendering, and a renderer can copy it instead of blending it.
+ */
+
+#define OUTPUT_WIDTH 1920
+#define OUTPUT_HEIGHT 1080
+#define WIDTH 1600
+#define HEIGHT 900
+#define FRAMES 100
+
+static bool scalar_row_is_opaque(const uint32_t *row, size_t len) {
+	uint32_t acc = 0xFF000000;
+	for (size_t i = 0; i < len; i++) {
+		acc &= row[i];
+	}
+	return (acc & 0xFF000000) == 0xFF000000;
+}
+
+static double bench_scan(uint32_t *data,
+		bool (*row_is_opaque)(const uint32_t *row, size_t len)) {
+	int64_t start = test_get_time_nsec();
+	int opaque_rows = 0;
+	for (int frame = 0; frame < FRAMES; frame++) {
+		for (int y = 0; y < HEIGHT; y++) {
+			opaque_rows += row_is_opaque(&data[y * WIDTH], WIDTH);
+		}
+	}
+	if (opaque_rows != FRAMES * HEIGHT) {
+		exit(EXIT_FAILURE);
+	}
+	return (test_get_time_nsec() - start) / 1000.0 / FRAMES;
+}
+
+static double bench_scene(bool opaque) {
+	struct test_server server;
+	if (!test_server_init(&server, NULL, NULL)) {
+		exit(EXIT_FAILURE);
+	}
+	struct wlr_scene_output *scene_output =
+		test_server_add_output(&server, OUTPUT_WIDTH, OUTPUT_HEIGHT);
+	if (scene_output == NULL) {
+		exit(EXIT_FAILURE);
+	}
+
+	wlr_scene_rect_create(&server.scene->tree, OUTPUT_WIDTH, OUTPUT_HEIGHT,
+		(float[4]){ 0.2, 0.2, 0.3, 1 });
+	struct wlr_buffer *buffer =
+		test_buffer_create(WIDTH, HEIGHT, DRM_FORMAT_ARGB8888, 0xFF336699);
+	struct wlr_scene_buffer *scene_buffer =
+		wlr_scene_buffer_create(&server.scene->tree, buffer);
+	wlr_scene_node_set_position(&scene_buffer->node, 160, 90);
+	if (opaque) {
+		pixman_region32_t region;
+		pixman_region32_init_rect(&region, 0, 0, WIDTH, HEIGHT);
+		wlr_scene_buffer_set_opaque_region(scene_buffer, &region);
+		pixman_region32_fini(&region);
+	}
+	test_output_commit(scene_output);
+
+	int64_t elapsed = 0;
+	for (int frame = 0; frame < FRAMES; frame++) {
+		wlr_output_damage_whole(scene_output->output);
+		int64_t start = test_get_time_nsec();
+		test_output_commit(scene_output);
+		elapsed += test_get_time_nsec() - start;
+	}
+
+	wlr_scene_node_destroy(&scene_buffer->node);
+	wlr_buffer_drop(buffer);
+	test_server_finish(&server);
+	return elapsed / 1000.0 / FRAMES;
+}
+
+static double bench_composite(uint32_t *data, pixman_op_t op) {
+	pixman_image_t *src = pixman_image_create_bits_no_clear(PIXMAN_a8r8g8b8,
+		WIDTH, HEIGHT, data, WIDTH * 4);
+	pixman_image_t *dst = pixman_image_create_bits(PIXMAN_x8r8g8b8,
+		OUTPUT_WIDTH, OUTPUT_HEIGHT, NULL, 0);
+	int64_t start = test_get_time_nsec();
+	for (int frame = 0; frame < FRAMES; frame++) {
+		pixman_image_composite32(op, src, NULL, dst, 0, 0, 0, 0,
+			160, 90, WIDTH, HEIGHT);
+	}
+	double elapsed = (test_get_time_nsec() - start) / 1000.0 / FRAMES;
+	pixman_image_unref(src);
+	pixman_image_unref(dst);
+	return elapsed;
+}
+
+int main(void) {
+	uint32_t *data = malloc((size_t)WIDTH * HEIGHT * 4);
+	if (data == NULL) {
+		return EXIT_FAILURE;
+	}
+	for (size_t i = 0; i < (size_t)WIDTH * HEIGHT; i++) {
+		data[i] = 0xFF000000 | (uint32_t)(i * 2654435761u >> 8);
+	}
+
+	printf("scan %dx%d: %.1f us, %.1f us without SIMD\n", WIDTH, HEIGHT,
+		bench_scan(data, alpha_row_is_opaque),
+		bench_scan(data, scalar_row_is_opaque));
+	printf("scene frame: %.1f us translucent, %.1f us opaque\n",
+		bench_scene(false), bench_scene(true));
+	printf("composite %dx%d: %.1f us blended, %.1f us copied\n",
+		WIDTH, HEIGHT, bench_composite(data, PIXMAN_OP_OVER),
+		bench_composite(data, PIXMAN_OP_SRC));
+
+	free(data);
+	return EXIT_SUCCESS;
+}
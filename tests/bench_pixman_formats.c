@@ -0,0 +1,104 @@
+#include <drm_fourcc.h>
+#include <stdlib.h>
+#include <wlr/render/drm_format_set.h>
+#include <wlr/render/pixman.h>
+#include <wlr/types/wlr_matrix.h>
+#include "common.h"
+#include "render/allocator/shm.h"
+#include "render/pixel_format.h"
+
+/**
+ * Draw a full-screen texture onto a 1920x1080 render buffer of the same
+ * format with the pixman renderer, the way the Termux:GUI backend renders
+ * into its output buffers. Opaque textures drawn at full alpha are copied
+ * with PIXMAN_OP_SRC, others are blended with PIXMAN_OP_OVER: XBGR8888 is
+ * also drawn at an alpha just below 1 to tell the cost of the operator from
+ * the one of the format.
+ */
+
+#define WIDTH 1920
+#define HEIGHT 1080
+#define FRAMES 100
+
+struct format_case {
+	const char *name;
+	uint32_t format;
+	float alpha;
+};
+
+static const struct format_case cases[] = {
+	{ "ABGR8888 OP_OVER", DRM_FORMAT_ABGR8888, 1.0 },
+	{ "XBGR8888 OP_OVER", DRM_FORMAT_XBGR8888, 0.999 },
+	{ "XBGR8888 OP_SRC", DRM_FORMAT_XBGR8888, 1.0 },
+	{ "RGB565 OP_SRC", DRM_FORMAT_RGB565, 1.0 },
+};
+
+static bool run(struct wlr_renderer *renderer, struct wlr_allocator *alloc,
+		const struct format_case *c) {
+	const struct wlr_pixel_format_info *info =
+		drm_get_pixel_format_info(c->format);
+	struct wlr_drm_format_set formats = {0};
+	wlr_drm_format_set_add(&formats, c->format, DRM_FORMAT_MOD_LINEAR);
+	struct wlr_buffer *target = wlr_allocator_create_buffer(alloc,
+		WIDTH, HEIGHT, wlr_drm_format_set_get(&formats, c->format));
+	wlr_drm_format_set_finish(&formats);
+
+	size_t stride = (size_t)WIDTH * info->bpp / 8;
+	unsigned char *pixels = malloc(stride * HEIGHT);
+	if (target == NULL || pixels == NULL) {
+		free(pixels);
+		return false;
+	}
+	for (size_t i = 0; i < stride * HEIGHT; i++) {
+		pixels[i] = i % 251;
+	}
+	struct wlr_texture *texture = wlr_texture_from_pixels(renderer,
+		c->format, stride, WIDTH, HEIGHT, pixels);
+	free(pixels);
+	if (texture == NULL) {
+		wlr_buffer_drop(target);
+		return false;
+	}
+
+	float projection[9], matrix[9];
+	wlr_matrix_identity(projection);
+	struct wlr_box box = { 0, 0, WIDTH, HEIGHT };
+	wlr_matrix_project_box(matrix, &box, WL_OUTPUT_TRANSFORM_NORMAL, 0,
+		projection);
+
+	int64_t elapsed = 0;
+	for (int frame = 0; frame < FRAMES; frame++) {
+		if (!wlr_renderer_begin_with_buffer(renderer, target)) {
+			break;
+		}
+		int64_t start = test_get_time_nsec();
+		wlr_render_texture_with_matrix(renderer, texture, matrix, c->alpha);
+		elapsed += test_get_time_nsec() - start;
+		wlr_renderer_end(renderer);
+	}
+
+	double usec = elapsed / 1000.0 / FRAMES;
+	printf("%s: %.1f us per frame, %.0f MiB/s\n", c->name, usec,
+		(double)stride * HEIGHT / usec * 1000000 / (1024 * 1024));
+
+	wlr_texture_destroy(texture);
+	wlr_buffer_drop(target);
+	return true;
+}
+
+int main(void) {
+	struct wlr_renderer *renderer = wlr_pixman_renderer_create();
+	struct wlr_allocator *alloc = wlr_shm_allocator_create();
+	if (renderer == NULL || alloc == NULL) {
+		return EXIT_FAILURE;
+	}
+
+	bool ok = true;
+	for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]) && ok; i++) {
+		ok = run(renderer, alloc, &cases[i]);
+	}
+
+	wlr_allocator_destroy(alloc);
+	wlr_renderer_destroy(renderer);
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
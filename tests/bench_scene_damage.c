@@ -0,0 +1,100 @@
+#include <inttypes.h>
+#include <stdlib.h>
+#include <wlr/types/wlr_damage_ring.h>
+#include "common.h"
+
+/**
+ * Commit a 1920x1080 scene where many small rects move every frame, under
+ * different rectangle budgets of the output damage ring. The "grid" pattern
+ * spreads the rects evenly over the output, the "diagonal" one puts them
+ * along its diagonal so that the extents of the damage are the whole output
+ * while the damage itself is small.
+ */
+
+#define WIDTH 1920
+#define HEIGHT 1080
+#define RECTS 400
+#define RECT_SIZE 8
+#define FRAMES 200
+
+struct budget {
+	const char *name;
+	int max_rects, tile_size;
+};
+
+static const struct budget budgets[] = {
+	{ "unbounded", 1 << 20, 0 },
+	{ "extents", WLR_DAMAGE_RING_MAX_RECTS, 0 },
+	{ "tiles", 64, 64 },
+};
+
+static void place_rect(struct wlr_scene_rect *rect, const char *pattern,
+		int i, int frame) {
+	int x, y;
+	if (pattern[0] == 'g') {
+		x = (i % 20) * (WIDTH / 20);
+		y = (i / 20) * (HEIGHT / 20);
+	} else {
+		x = i * (WIDTH - RECT_SIZE - 1) / RECTS;
+		y = i * (HEIGHT - RECT_SIZE - 1) / RECTS;
+	}
+	wlr_scene_node_set_position(&rect->node, x + frame % 2, y);
+}
+
+static bool run(const char *pattern, const struct budget *budget) {
+	struct test_server server;
+	if (!test_server_init(&server, NULL, NULL)) {
+		return false;
+	}
+	struct wlr_scene_output *scene_output =
+		test_server_add_output(&server, WIDTH, HEIGHT);
+	if (scene_output == NULL) {
+		return false;
+	}
+	wlr_damage_ring_set_rect_budget(&scene_output->damage_ring,
+		budget->max_rects, budget->tile_size);
+
+	wlr_scene_rect_create(&server.scene->tree, WIDTH, HEIGHT,
+		(float[4]){ 0.2, 0.2, 0.3, 1 });
+	struct wlr_scene_rect *rects[RECTS];
+	for (int i = 0; i < RECTS; i++) {
+		rects[i] = wlr_scene_rect_create(&server.scene->tree,
+			RECT_SIZE, RECT_SIZE, (float[4]){ 0.8, 0.3, 0.2, 1 });
+		place_rect(rects[i], pattern, i, 0);
+	}
+	test_output_commit(scene_output);
+	wlr_scene_output_set_stats_enabled(scene_output, true);
+
+	int64_t elapsed = 0;
+	for (int frame = 1; frame <= FRAMES; frame++) {
+		for (int i = 0; i < RECTS; i++) {
+			place_rect(rects[i], pattern, i, frame);
+		}
+		int64_t start = test_get_time_nsec();
+		test_output_commit(scene_output);
+		elapsed += test_get_time_nsec() - start;
+	}
+
+	struct wlr_scene_output_stats stats;
+	wlr_scene_output_get_stats(scene_output, &stats);
+	uint64_t frames = stats.frames > 0 ? stats.frames : 1;
+	printf("%s/%s: %.1f us per commit, %" PRIu64 " damaged pixels, "
+		"%" PRIu64 " scissor rects per frame\n", pattern, budget->name,
+		elapsed / 1000.0 / FRAMES, stats.damage_pixels / frames,
+		stats.scissor_rects / frames);
+
+	test_server_finish(&server);
+	return true;
+}
+
+int main(void) {
+	const char *patterns[] = { "grid", "diagonal" };
+	for (size_t i = 0; i < sizeof(patterns) / sizeof(patterns[0]); i++) {
+		for (size_t j = 0; j < sizeof(budgets) / sizeof(budgets[0]); j++) {
+			if (!run(patterns[i], &budgets[j])) {
+				return EXIT_FAILURE;
+			}
+		}
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,94 @@
+#include <drm_fourcc.h>
+#include <stdlib.h>
+#include "common.h"
+#include "renderer.h"
+
+/**
+ * Commit many client buffers with small damage on a scene shown on many
+ * outputs side by side, with mixed scales, as a dozen headless capture
+ * outputs would. Each buffer lies on a single output, the others only have
+ * to reject its damage. The test renderer keeps rendering out of the way.
+ */
+
+#define OUTPUT_WIDTH 320
+#define OUTPUT_HEIGHT 240
+#define BUFFER_SIZE 64
+#define FRAMES 200
+
+static void run(int outputs_len, int clients_len) {
+	struct test_server server;
+	if (!test_server_init(&server, NULL, test_renderer_create)) {
+		exit(EXIT_FAILURE);
+	}
+
+	struct wlr_scene_output **outputs =
+		calloc(outputs_len, sizeof(*outputs));
+	int x = 0;
+	for (int i = 0; i < outputs_len; i++) {
+		outputs[i] = test_server_add_output(&server,
+			OUTPUT_WIDTH, OUTPUT_HEIGHT);
+		if (outputs[i] == NULL) {
+			exit(EXIT_FAILURE);
+		}
+		int scale = i % 3 == 2 ? 2 : 1;
+		wlr_output_set_scale(outputs[i]->output, scale);
+		wlr_output_commit(outputs[i]->output);
+		wlr_scene_output_set_position(outputs[i], x, 0);
+		x += OUTPUT_WIDTH / scale;
+	}
+
+	struct wlr_buffer *buffer = test_buffer_create(BUFFER_SIZE, BUFFER_SIZE,
+		DRM_FORMAT_XRGB8888, 0xFF000000);
+	struct wlr_scene_buffer **clients =
+		calloc(clients_len, sizeof(*clients));
+	for (int i = 0; i < clients_len; i++) {
+		clients[i] = wlr_scene_buffer_create(&server.scene->tree, buffer);
+		struct wlr_scene_output *output = outputs[i % outputs_len];
+		wlr_scene_node_set_position(&clients[i]->node,
+			output->x + (i / outputs_len) * 8, (i / outputs_len) * 8);
+	}
+	for (int i = 0; i < outputs_len; i++) {
+		test_output_commit(outputs[i]);
+	}
+
+	int64_t damage_time = 0, commit_time = 0;
+	for (int frame = 0; frame < FRAMES; frame++) {
+		int64_t start = test_get_time_nsec();
+		for (int i = 0; i < clients_len; i++) {
+			pixman_region32_t damage;
+			pixman_region32_init_rect(&damage,
+				frame % (BUFFER_SIZE - 8), 0, 8, 8);
+			wlr_scene_buffer_set_buffer_with_damage(clients[i], buffer,
+				&damage);
+			pixman_region32_fini(&damage);
+		}
+		int64_t end = test_get_time_nsec();
+		damage_time += end - start;
+
+		for (int i = 0; i < outputs_len; i++) {
+			test_output_commit(outputs[i]);
+		}
+		commit_time += test_get_time_nsec() - end;
+	}
+
+	printf("outputs=%d clients=%d: %.2f us per client commit, "
+		"%.1f us to commit all outputs\n", outputs_len, clients_len,
+		damage_time / 1000.0 / FRAMES / clients_len,
+		commit_time / 1000.0 / FRAMES);
+
+	for (int i = 0; i < clients_len; i++) {
+		wlr_scene_node_destroy(&clients[i]->node);
+	}
+	wlr_buffer_drop(buffer);
+	free(clients);
+	free(outputs);
+	test_server_finish(&server);
+}
+
+int main(void) {
+	run(1, 48);
+	run(4, 48);
+	run(12, 48);
+	run(12, 192);
+	return EXIT_SUCCESS;
+}
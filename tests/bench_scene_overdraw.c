@@ -0,0 +1,93 @@
+#define _POSIX_C_SOURCE 200809L
+#include <drm_fourcc.h>
+#include <stdlib.h>
+#include <wlr/types/wlr_damage_ring.h>
+#include "common.h"
+
+/**
+ * Repaint a 1920x1080 desktop of stacked windows over a wallpaper with and
+ * without culling the parts of nodes covered by opaque nodes above them
+ * (WLR_SCENE_DISABLE_CULLING), and report the overdraw from the scene
+ * output statistics: pixels drawn, background included, per damaged pixel.
+ * Without culling the background is still culled, as it was before nodes
+ * were. Visible regions already exclude occluded parts unless
+ * WLR_SCENE_DISABLE_VISIBILITY is set: both settings are measured.
+ */
+
+#define WIDTH 1920
+#define HEIGHT 1080
+#define WINDOWS 6
+#define FRAMES 100
+
+static bool run(bool visibility, bool cull) {
+	setenv("WLR_SCENE_DISABLE_VISIBILITY", visibility ? "0" : "1", true);
+	setenv("WLR_SCENE_DISABLE_CULLING", cull ? "0" : "1", true);
+
+	struct test_server server;
+	if (!test_server_init(&server, NULL, NULL)) {
+		return false;
+	}
+	struct wlr_scene_output *scene_output =
+		test_server_add_output(&server, WIDTH, HEIGHT);
+	if (scene_output == NULL) {
+		return false;
+	}
+
+	// An opaque wallpaper, overlapping opaque windows, a translucent panel
+	struct wlr_buffer *wallpaper = test_buffer_create(WIDTH, HEIGHT,
+		DRM_FORMAT_XRGB8888, 0xFF203040);
+	struct wlr_buffer *window = test_buffer_create(800, 600,
+		DRM_FORMAT_XRGB8888, 0xFFC0C0C0);
+	struct wlr_buffer *panel = test_buffer_create(WIDTH, 48,
+		DRM_FORMAT_ARGB8888, 0x80000000);
+	if (wallpaper == NULL || window == NULL || panel == NULL) {
+		return false;
+	}
+	wlr_scene_buffer_create(&server.scene->tree, wallpaper);
+	for (int i = 0; i < WINDOWS; i++) {
+		struct wlr_scene_buffer *scene_buffer =
+			wlr_scene_buffer_create(&server.scene->tree, window);
+		wlr_scene_node_set_position(&scene_buffer->node,
+			100 + i * 160, 80 + i * 60);
+	}
+	wlr_scene_buffer_create(&server.scene->tree, panel);
+	wlr_buffer_drop(wallpaper);
+	wlr_buffer_drop(window);
+	wlr_buffer_drop(panel);
+
+	test_output_commit(scene_output);
+	wlr_scene_output_set_stats_enabled(scene_output, true);
+
+	int64_t elapsed = 0;
+	for (int frame = 0; frame < FRAMES; frame++) {
+		wlr_damage_ring_add_whole(&scene_output->damage_ring);
+		int64_t start = test_get_time_nsec();
+		test_output_commit(scene_output);
+		elapsed += test_get_time_nsec() - start;
+	}
+
+	struct wlr_scene_output_stats stats;
+	wlr_scene_output_get_stats(scene_output, &stats);
+	uint64_t drawn = stats.background_pixels + stats.rect_pixels +
+		stats.buffer_pixels;
+	uint64_t frames = stats.frames > 0 ? stats.frames : 1;
+	printf("visibility %s, culling %s: %.1f us per frame, overdraw %.2f, "
+		"%.1f nodes drawn and %.1f culled per frame\n",
+		visibility ? "on" : "off", cull ? "on" : "off",
+		elapsed / 1000.0 / FRAMES,
+		stats.damage_pixels > 0 ? (double)drawn / stats.damage_pixels : 0.0,
+		(double)stats.nodes_drawn / frames,
+		(double)stats.nodes_culled / frames);
+
+	test_server_finish(&server);
+	return true;
+}
+
+int main(void) {
+	for (int visibility = 0; visibility <= 1; visibility++) {
+		if (!run(visibility, false) || !run(visibility, true)) {
+			return EXIT_FAILURE;
+		}
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,142 @@
+#include <drm_fourcc.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include "common.h"
+
+/**
+ * Measure the latency from a scene change to the present of the frame
+ * showing it on a 1920x1080 headless output, with and without render-ahead.
+ * The scene changes CHANGE_MSEC after each frame event, like a client
+ * committing a new buffer in the middle of the refresh cycle: with
+ * render-ahead the frame is rendered right away, otherwise on the next frame
+ * event before being committed.
+ */
+
+#define WIDTH 1920
+#define HEIGHT 1080
+#define WINDOWS 8
+#define CHANGE_MSEC 4
+#define FRAMES 120
+#define TIMEOUT_NSEC (10 * 1000000000LL)
+
+struct compositor {
+	struct wlr_scene_output *scene_output;
+	struct wlr_scene_buffer *windows[WINDOWS];
+	struct wl_event_source *change_timer;
+	int frames, changes;
+	int64_t changed_at; // 0 if the change has been presented
+	int64_t latency, frame_time;
+	int presented;
+	struct wl_listener frame;
+	struct wl_listener present;
+};
+
+static void handle_frame(struct wl_listener *listener, void *data) {
+	struct compositor *compositor =
+		wl_container_of(listener, compositor, frame);
+	compositor->frames++;
+	int64_t start = test_get_time_nsec();
+	wlr_scene_output_commit(compositor->scene_output);
+	compositor->frame_time += test_get_time_nsec() - start;
+	wl_event_source_timer_update(compositor->change_timer, CHANGE_MSEC);
+}
+
+static void handle_present(struct wl_listener *listener, void *data) {
+	struct compositor *compositor =
+		wl_container_of(listener, compositor, present);
+	struct wlr_output_event_present *event = data;
+	if (!event->presented || compositor->changed_at == 0) {
+		return;
+	}
+	compositor->latency += test_get_time_nsec() - compositor->changed_at;
+	compositor->presented++;
+	compositor->changed_at = 0;
+}
+
+static int handle_change(void *data) {
+	struct compositor *compositor = data;
+	if (compositor->changed_at != 0) {
+		// The previous change hasn't been presented yet
+		return 0;
+	}
+	// Translucent windows shifting by a pixel, blended over each other
+	compositor->changes++;
+	for (int i = 0; i < WINDOWS; i++) {
+		wlr_scene_node_set_position(&compositor->windows[i]->node,
+			i * 64 + compositor->changes % 2, i * 32);
+	}
+	compositor->changed_at = test_get_time_nsec();
+	return 0;
+}
+
+static bool run(int depth) {
+	struct test_server server;
+	if (!test_server_init(&server, NULL, NULL)) {
+		return false;
+	}
+	struct wlr_scene_output *scene_output =
+		test_server_add_output(&server, WIDTH, HEIGHT);
+	if (scene_output == NULL) {
+		return false;
+	}
+	struct wl_event_loop *loop = wl_display_get_event_loop(server.display);
+
+	struct compositor compositor = {
+		.scene_output = scene_output,
+		.frame.notify = handle_frame,
+		.present.notify = handle_present,
+	};
+	compositor.change_timer =
+		wl_event_loop_add_timer(loop, handle_change, &compositor);
+
+	wlr_scene_rect_create(&server.scene->tree, WIDTH, HEIGHT,
+		(float[4]){ 0.2, 0.2, 0.3, 1 });
+	struct wlr_buffer *buffer = test_buffer_create(WIDTH / 2, HEIGHT / 2,
+		DRM_FORMAT_ARGB8888, 0x80404040);
+	if (buffer == NULL) {
+		return false;
+	}
+	for (int i = 0; i < WINDOWS; i++) {
+		compositor.windows[i] =
+			wlr_scene_buffer_create(&server.scene->tree, buffer);
+		wlr_scene_node_set_position(&compositor.windows[i]->node,
+			i * 64, i * 32);
+	}
+	wlr_buffer_drop(buffer);
+
+	wl_signal_add(&scene_output->output->events.frame, &compositor.frame);
+	wl_signal_add(&scene_output->output->events.present, &compositor.present);
+	wlr_scene_output_set_stats_enabled(scene_output, true);
+	wlr_scene_output_set_render_ahead(scene_output, depth);
+
+	int64_t deadline = test_get_time_nsec() + TIMEOUT_NSEC;
+	while (compositor.presented < FRAMES &&
+			test_get_time_nsec() < deadline) {
+		wl_event_loop_dispatch(loop, -1);
+	}
+
+	struct wlr_scene_output_stats stats;
+	wlr_scene_output_get_stats(scene_output, &stats);
+	int presented = compositor.presented > 0 ? compositor.presented : 1;
+	int frames = compositor.frames > 0 ? compositor.frames : 1;
+	printf("render-ahead %d: %.1f us commit-to-present, "
+		"%.1f us in the frame handler, %" PRIu64 " hits, %" PRIu64 " drops\n",
+		depth, compositor.latency / 1000.0 / presented,
+		compositor.frame_time / 1000.0 / frames,
+		stats.render_ahead_hits, stats.render_ahead_drops);
+
+	wl_list_remove(&compositor.frame.link);
+	wl_list_remove(&compositor.present.link);
+	wl_event_source_remove(compositor.change_timer);
+	test_server_finish(&server);
+	return true;
+}
+
+int main(void) {
+	for (int depth = 0; depth <= WLR_SCENE_RENDER_AHEAD_MAX; depth++) {
+		if (!run(depth)) {
+			return EXIT_FAILURE;
+		}
+	}
+	return EXIT_SUCCESS;
+}
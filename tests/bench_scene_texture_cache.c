@@ -0,0 +1,84 @@
+#include <drm_fourcc.h>
+#include <stdlib.h>
+#include <wlr/interfaces/wlr_buffer.h>
+#include "common.h"
+#include "renderer.h"
+
+/**
+ * Show a 1920x1080 scene buffer alternating between two compositor-owned
+ * buffers with a small damaged patch, as a swapchain of an embedded renderer
+ * does, and compare with a new buffer on every frame. Textures of the test
+ * renderer are copies in main memory, which stand in for uploads to video
+ * memory.
+ */
+
+#define WIDTH 1920
+#define HEIGHT 1080
+#define PATCH 64
+#define FRAMES 200
+
+static void run(const char *name, bool alternate) {
+	struct test_server server;
+	if (!test_server_init(&server, NULL, test_renderer_create)) {
+		exit(EXIT_FAILURE);
+	}
+	const struct test_renderer_stats *stats =
+		test_renderer_get_stats(server.renderer);
+	// Larger than the buffer so that it isn't scanned out
+	struct wlr_scene_output *scene_output =
+		test_server_add_output(&server, WIDTH, HEIGHT + 1);
+
+	struct wlr_buffer *buffers[2] = {
+		test_buffer_create(WIDTH, HEIGHT, DRM_FORMAT_XRGB8888, 0xFF000000),
+		test_buffer_create(WIDTH, HEIGHT, DRM_FORMAT_XRGB8888, 0xFF0000FF),
+	};
+	struct wlr_scene_buffer *scene_buffer =
+		wlr_scene_buffer_create(&server.scene->tree, buffers[0]);
+	test_output_commit(scene_output);
+	wlr_scene_buffer_set_buffer(scene_buffer, buffers[1]);
+	test_output_commit(scene_output);
+
+	uint64_t upload_bytes = stats->upload_bytes;
+	uint64_t textures_created = stats->textures_created;
+	int64_t elapsed = 0;
+	for (int i = 0; i < FRAMES; i++) {
+		struct wlr_buffer *buffer;
+		if (alternate) {
+			buffer = buffers[i % 2];
+		} else {
+			buffer = test_buffer_create(WIDTH, HEIGHT, DRM_FORMAT_XRGB8888,
+				0xFF000000);
+		}
+
+		pixman_region32_t damage;
+		pixman_region32_init_rect(&damage,
+			(i * PATCH) % (WIDTH - PATCH), (i * PATCH) % (HEIGHT - PATCH),
+			PATCH, PATCH);
+		int64_t start = test_get_time_nsec();
+		wlr_scene_buffer_set_buffer_with_damage(scene_buffer, buffer,
+			&damage);
+		test_output_commit(scene_output);
+		elapsed += test_get_time_nsec() - start;
+		pixman_region32_fini(&damage);
+
+		if (!alternate) {
+			wlr_buffer_drop(buffer);
+		}
+	}
+
+	printf("%s: %.1f us per frame, %.1f KiB uploaded per frame, "
+		"%.2f imports per frame\n", name, elapsed / 1000.0 / FRAMES,
+		(stats->upload_bytes - upload_bytes) / 1024.0 / FRAMES,
+		(double)(stats->textures_created - textures_created) / FRAMES);
+
+	wlr_scene_buffer_set_buffer(scene_buffer, NULL);
+	wlr_buffer_drop(buffers[0]);
+	wlr_buffer_drop(buffers[1]);
+	test_server_finish(&server);
+}
+
+int main(void) {
+	run("alternating buffers", true);
+	run("new buffer per frame", false);
+	return EXIT_SUCCESS;
+}
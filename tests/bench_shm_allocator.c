@@ -0,0 +1,256 @@
+#define _POSIX_C_SOURCE 200809L
+#include <drm_fourcc.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <wlr/interfaces/wlr_output.h>
+#include <wlr/render/drm_format_set.h>
+#include "common.h"
+#include "render/allocator/shm.h"
+#include "util/shm.h"
+
+/**
+ * Allocate the buffers of many outputs, 3 swapchain buffers and a cursor
+ * each, and reallocate them on mode changes. Allocation latency is compared
+ * with a shm file per buffer, and shared memory use is read from the
+ * process status.
+ */
+
+#define OUTPUTS 16
+#define SWAPCHAIN_LEN 3
+#define ROUNDS 20
+#define CURSOR_SIZE 64
+
+static const struct {
+	int width, height;
+} modes[] = {
+	{ 1920, 1080 },
+	{ 1280, 720 },
+	{ 2560, 1440 },
+};
+
+#define MODES_LEN (sizeof(modes) / sizeof(modes[0]))
+#define BUFFERS_LEN (OUTPUTS * (SWAPCHAIN_LEN + 1))
+
+static long get_rss_shmem_kib(void) {
+	FILE *f = fopen("/proc/self/status", "r");
+	if (f == NULL) {
+		return -1;
+	}
+	long kib = -1;
+	char line[256];
+	while (fgets(line, sizeof(line), f) != NULL) {
+		if (strncmp(line, "RssShmem:", 9) == 0) {
+			kib = strtol(line + 9, NULL, 10);
+			break;
+		}
+	}
+	fclose(f);
+	return kib;
+}
+
+/**
+ * A shm file per buffer, as the allocator used to do.
+ */
+struct file_buffer {
+	int fd;
+	void *data;
+	size_t size;
+};
+
+static bool file_buffer_create(struct file_buffer *buffer,
+		int width, int height) {
+	buffer->size = (size_t)width * height * 4;
+	buffer->fd = allocate_shm_file(buffer->size);
+	if (buffer->fd < 0) {
+		return false;
+	}
+	buffer->data = mmap(NULL, buffer->size, PROT_READ | PROT_WRITE,
+		MAP_SHARED, buffer->fd, 0);
+	if (buffer->data == MAP_FAILED) {
+		close(buffer->fd);
+		return false;
+	}
+	return true;
+}
+
+static void file_buffer_destroy(struct file_buffer *buffer) {
+	munmap(buffer->data, buffer->size);
+	close(buffer->fd);
+}
+
+/**
+ * Touch a buffer as the renderer would, so that its pages count.
+ */
+static void touch(void *data, size_t size) {
+	for (size_t i = 0; i < size; i += 4096) {
+		((char *)data)[i] = 1;
+	}
+}
+
+static void buffer_size(int i, int round, int *width, int *height) {
+	if (i % (SWAPCHAIN_LEN + 1) == SWAPCHAIN_LEN) {
+		*width = *height = CURSOR_SIZE;
+	} else {
+		*width = modes[round % MODES_LEN].width;
+		*height = modes[round % MODES_LEN].height;
+	}
+}
+
+static void bench_files(void) {
+	static struct file_buffer buffers[BUFFERS_LEN];
+	long peak_kib = 0;
+	int64_t elapsed = 0;
+	for (int round = 0; round < ROUNDS; round++) {
+		int64_t start = test_get_time_nsec();
+		for (int i = 0; i < BUFFERS_LEN; i++) {
+			int width, height;
+			buffer_size(i, round, &width, &height);
+			if (!file_buffer_create(&buffers[i], width, height)) {
+				exit(EXIT_FAILURE);
+			}
+		}
+		elapsed += test_get_time_nsec() - start;
+
+		for (int i = 0; i < BUFFERS_LEN; i++) {
+			touch(buffers[i].data, buffers[i].size);
+		}
+		long kib = get_rss_shmem_kib();
+		peak_kib = kib > peak_kib ? kib : peak_kib;
+
+		start = test_get_time_nsec();
+		for (int i = 0; i < BUFFERS_LEN; i++) {
+			file_buffer_destroy(&buffers[i]);
+		}
+		elapsed += test_get_time_nsec() - start;
+	}
+
+	printf("file per buffer: %.1f us per alloc+free, %ld KiB peak RssShmem, "
+		"%ld KiB after\n", elapsed / 1000.0 / ROUNDS / BUFFERS_LEN,
+		peak_kib, get_rss_shmem_kib());
+}
+
+static void bench_allocator(void) {
+	struct wlr_allocator *alloc = wlr_shm_allocator_create();
+	struct wlr_drm_format_set formats = {0};
+	wlr_drm_format_set_add(&formats, DRM_FORMAT_XRGB8888,
+		DRM_FORMAT_MOD_LINEAR);
+	const struct wlr_drm_format *format =
+		wlr_drm_format_set_get(&formats, DRM_FORMAT_XRGB8888);
+	if (alloc == NULL || format == NULL) {
+		exit(EXIT_FAILURE);
+	}
+
+	static struct wlr_buffer *buffers[BUFFERS_LEN];
+	long peak_kib = 0;
+	int64_t elapsed = 0;
+	for (int round = 0; round < ROUNDS; round++) {
+		int64_t start = test_get_time_nsec();
+		for (int i = 0; i < BUFFERS_LEN; i++) {
+			int width, height;
+			buffer_size(i, round, &width, &height);
+			buffers[i] = wlr_allocator_create_buffer(alloc,
+				width, height, format);
+			if (buffers[i] == NULL) {
+				exit(EXIT_FAILURE);
+			}
+		}
+		elapsed += test_get_time_nsec() - start;
+
+		for (int i = 0; i < BUFFERS_LEN; i++) {
+			void *data;
+			uint32_t fmt;
+			size_t stride;
+			if (wlr_buffer_begin_data_ptr_access(buffers[i],
+					WLR_BUFFER_DATA_PTR_ACCESS_WRITE, &data, &fmt, &stride)) {
+				touch(data, stride * buffers[i]->height);
+				wlr_buffer_end_data_ptr_access(buffers[i]);
+			}
+		}
+		long kib = get_rss_shmem_kib();
+		peak_kib = kib > peak_kib ? kib : peak_kib;
+
+		start = test_get_time_nsec();
+		for (int i = 0; i < BUFFERS_LEN; i++) {
+			wlr_buffer_drop(buffers[i]);
+		}
+		elapsed += test_get_time_nsec() - start;
+	}
+
+	struct wlr_shm_pool_stats stats[64];
+	size_t n_pools = wlr_shm_allocator_get_pool_stats(alloc, stats, 64);
+	size_t pool_bytes = 0, cached_bytes = 0;
+	for (size_t i = 0; i < n_pools && i < 64; i++) {
+		pool_bytes += stats[i].size;
+		cached_bytes += stats[i].cached;
+	}
+	printf("shm allocator: %.1f us per alloc+free, %ld KiB peak RssShmem, "
+		"%ld KiB after, %zu pools of %zu KiB, %zu KiB cached\n",
+		elapsed / 1000.0 / ROUNDS / BUFFERS_LEN, peak_kib,
+		get_rss_shmem_kib(), n_pools, pool_bytes / 1024,
+		cached_bytes / 1024);
+
+	wlr_allocator_destroy(alloc);
+	wlr_drm_format_set_finish(&formats);
+}
+
+/**
+ * Go through mode changes on headless outputs rendering a scene, which
+ * reallocates their swapchains.
+ */
+static void bench_headless(void) {
+	struct test_server server;
+	if (!test_server_init(&server, NULL, NULL)) {
+		exit(EXIT_FAILURE);
+	}
+	struct wlr_scene_output *outputs[OUTPUTS];
+	for (int i = 0; i < OUTPUTS; i++) {
+		outputs[i] = test_server_add_output(&server,
+			modes[0].width, modes[0].height);
+		if (outputs[i] == NULL) {
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	long peak_kib = 0;
+	int64_t elapsed = 0;
+	for (int round = 0; round < ROUNDS; round++) {
+		int64_t start = test_get_time_nsec();
+		for (int i = 0; i < OUTPUTS; i++) {
+			wlr_output_set_custom_mode(outputs[i]->output,
+				modes[round % MODES_LEN].width,
+				modes[round % MODES_LEN].height, 0);
+			// Fill the swapchain
+			for (int j = 0; j < SWAPCHAIN_LEN; j++) {
+				wlr_output_damage_whole(outputs[i]->output);
+				test_output_commit(outputs[i]);
+			}
+		}
+		elapsed += test_get_time_nsec() - start;
+		long kib = get_rss_shmem_kib();
+		peak_kib = kib > peak_kib ? kib : peak_kib;
+	}
+
+	struct wlr_shm_pool_stats stats[64];
+	size_t n_pools =
+		wlr_shm_allocator_get_pool_stats(server.allocator, stats, 64);
+	size_t busy_bytes = 0, pool_bytes = 0;
+	for (size_t i = 0; i < n_pools && i < 64; i++) {
+		busy_bytes += stats[i].busy;
+		pool_bytes += stats[i].size;
+	}
+	printf("headless outputs=%d: %.1f ms per mode change of all outputs, "
+		"%ld KiB peak RssShmem, %zu pools of %zu KiB, %zu KiB busy\n",
+		OUTPUTS, elapsed / 1e6 / ROUNDS, peak_kib, n_pools,
+		pool_bytes / 1024, busy_bytes / 1024);
+
+	test_server_finish(&server);
+}
+
+int main(void) {
+	bench_files();
+	bench_allocator();
+	bench_headless();
+	return EXIT_SUCCESS;
+}
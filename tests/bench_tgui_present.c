@@ -0,0 +1,182 @@
+#define _POSIX_C_SOURCE 200809L
+#include <dirent.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <termuxgui/stub.h>
+#include <wlr/backend/termuxgui.h>
+#include <wlr/types/wlr_output.h>
+#include "common.h"
+
+/**
+ * Present frames on N Termux:GUI outputs at once against the stub plugin,
+ * whose presents take WLR_TGUI_STUB_PRESENT_USEC. Every output renders as
+ * fast as its frame events allow, so the throughput shows how well presents
+ * of different outputs are batched by the present thread.
+ */
+
+#define FRAMES_PER_OUTPUT 120
+#define TIMEOUT_NSEC (30 * 1000000000LL)
+
+struct bench {
+	struct test_server server;
+	struct wlr_scene_rect *square;
+	struct wl_list outputs;
+	int outputs_len;
+
+	struct wl_listener new_output;
+};
+
+struct bench_output {
+	struct bench *bench;
+	struct wlr_scene_output *scene_output;
+	int frames;
+	struct wl_list link;
+
+	struct wl_listener frame;
+};
+
+static void output_handle_frame(struct wl_listener *listener, void *data) {
+	struct bench_output *output = wl_container_of(listener, output, frame);
+	struct wlr_output *wlr_output = output->scene_output->output;
+
+	struct wlr_output_mode *mode = wlr_output_preferred_mode(wlr_output);
+	if (mode != NULL && mode != wlr_output->current_mode) {
+		wlr_output_set_mode(wlr_output, mode);
+	}
+
+	// Damage part of every output on each frame
+	struct wlr_scene_node *node = &output->bench->square->node;
+	wlr_scene_node_set_position(node, (node->x + 8) % 256, node->y);
+
+	if (wlr_scene_output_commit(output->scene_output) &&
+			wlr_output->current_mode != NULL) {
+		output->frames++;
+	}
+}
+
+static void handle_new_output(struct wl_listener *listener, void *data) {
+	struct bench *bench = wl_container_of(listener, bench, new_output);
+	struct wlr_output *wlr_output = data;
+
+	wlr_output_init_render(wlr_output, bench->server.allocator,
+		bench->server.renderer);
+
+	struct bench_output *output = calloc(1, sizeof(*output));
+	if (output == NULL) {
+		return;
+	}
+	output->bench = bench;
+	output->scene_output =
+		wlr_scene_output_create(bench->server.scene, wlr_output);
+	output->frame.notify = output_handle_frame;
+	wl_signal_add(&wlr_output->events.frame, &output->frame);
+	wl_list_insert(&bench->outputs, &output->link);
+
+	wlr_output_enable(wlr_output, true);
+	wlr_output_commit(wlr_output);
+}
+
+static int count_threads(void) {
+	DIR *dir = opendir("/proc/self/task");
+	if (dir == NULL) {
+		return -1;
+	}
+	int n = 0;
+	struct dirent *entry;
+	while ((entry = readdir(dir)) != NULL) {
+		n += entry->d_name[0] != '.';
+	}
+	closedir(dir);
+	return n;
+}
+
+static bool outputs_done(struct bench *bench) {
+	struct bench_output *output;
+	wl_list_for_each(output, &bench->outputs, link) {
+		if (output->frames < FRAMES_PER_OUTPUT) {
+			return false;
+		}
+	}
+	return bench->outputs_len == wl_list_length(&bench->outputs);
+}
+
+static bool run(int outputs_len) {
+	struct bench bench = { .outputs_len = outputs_len };
+	wl_list_init(&bench.outputs);
+	if (!test_server_init(&bench.server, wlr_tgui_backend_create, NULL)) {
+		fprintf(stderr, "failed to create the Termux:GUI backend\n");
+		return false;
+	}
+	wlr_scene_rect_create(&bench.server.scene->tree, 4096, 4096,
+		(float[4]){ 0.2, 0.2, 0.3, 1 });
+	bench.square = wlr_scene_rect_create(&bench.server.scene->tree, 64, 64,
+		(float[4]){ 0.8, 0.3, 0.2, 1 });
+
+	bench.new_output.notify = handle_new_output;
+	wl_signal_add(&bench.server.backend->events.new_output,
+		&bench.new_output);
+
+	struct tgui_stub_stats before;
+	tgui_stub_get_stats(&before);
+	for (int i = 0; i < outputs_len; i++) {
+		wlr_tgui_add_output(bench.server.backend);
+	}
+
+	struct wl_event_loop *loop =
+		wl_display_get_event_loop(bench.server.display);
+	int64_t start = test_get_time_nsec();
+	int threads = 0;
+	bool ok = true;
+	while (!outputs_done(&bench)) {
+		wl_event_loop_dispatch(loop, 10);
+		int n = count_threads();
+		threads = n > threads ? n : threads;
+		if (test_get_time_nsec() - start > TIMEOUT_NSEC) {
+			fprintf(stderr, "timed out with %d outputs\n", outputs_len);
+			ok = false;
+			break;
+		}
+	}
+	int64_t elapsed = test_get_time_nsec() - start;
+
+	struct tgui_stub_stats after;
+	tgui_stub_get_stats(&after);
+	uint64_t presents = after.presents - before.presents;
+	uint64_t present_nsec = after.present_nsec - before.present_nsec;
+	uint64_t frames = 0;
+	struct bench_output *output;
+	wl_list_for_each(output, &bench.outputs, link) {
+		frames += output->frames;
+	}
+
+	printf("outputs=%d: %.1f frames/s per output, %.1f frames/s total\n",
+		outputs_len, frames * 1e9 / elapsed / outputs_len,
+		frames * 1e9 / elapsed);
+	printf("outputs=%d: %" PRIu64 " presents, %.1f us mean, "
+		"%" PRIu64 " max concurrent, %d threads\n", outputs_len, presents,
+		presents > 0 ? (double)present_nsec / presents / 1000 : 0,
+		after.max_concurrent_presents, threads);
+
+	struct bench_output *tmp;
+	wl_list_for_each_safe(output, tmp, &bench.outputs, link) {
+		wl_list_remove(&output->frame.link);
+		wl_list_remove(&output->link);
+		free(output);
+	}
+	wl_list_remove(&bench.new_output.link);
+	test_server_finish(&bench.server);
+	return ok;
+}
+
+int main(int argc, char *argv[]) {
+	setenv("WLR_TGUI_STUB_VIEW_SIZE", "320x240", false);
+	setenv("WLR_TGUI_STUB_PRESENT_USEC", "2000", false);
+
+	int max_outputs = argc > 1 ? atoi(argv[1]) : 8;
+	for (int n = 1; n <= max_outputs; n *= 2) {
+		if (!run(n)) {
+			return EXIT_FAILURE;
+		}
+	}
+	return EXIT_SUCCESS;
+}
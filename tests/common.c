@@ -0,0 +1,177 @@
+#define _POSIX_C_SOURCE 200809L
+#include <assert.h>
+#include <drm_fourcc.h>
+#include <stdlib.h>
+#include <time.h>
+#include <wlr/backend/headless.h>
+#include <wlr/backend/termuxgui.h>
+#include <wlr/interfaces/wlr_buffer.h>
+#include <wlr/interfaces/wlr_output.h>
+#include <wlr/render/pixman.h>
+#include <wlr/util/log.h>
+#include "backend/termuxgui.h"
+#include "common.h"
+#include "util/time.h"
+
+int test_failures = 0;
+
+bool test_server_init(struct test_server *server,
+		struct wlr_backend *(*create_backend)(struct wl_display *display),
+		struct wlr_renderer *(*create_renderer)(void)) {
+	wlr_log_init(WLR_ERROR, NULL);
+
+	*server = (struct test_server){0};
+	server->display = wl_display_create();
+	if (server->display == NULL) {
+		return false;
+	}
+	if (create_backend == NULL) {
+		create_backend = wlr_headless_backend_create;
+	}
+	if (create_renderer == NULL) {
+		create_renderer = wlr_pixman_renderer_create;
+	}
+	server->backend = create_backend(server->display);
+	server->renderer = create_renderer();
+	if (server->backend == NULL || server->renderer == NULL) {
+		return false;
+	}
+	server->allocator =
+		wlr_allocator_autocreate(server->backend, server->renderer);
+	server->scene = wlr_scene_create();
+	if (server->allocator == NULL || server->scene == NULL) {
+		return false;
+	}
+	return wlr_backend_start(server->backend);
+}
+
+void test_server_finish(struct test_server *server) {
+	if (server->scene != NULL) {
+		wlr_scene_node_destroy(&server->scene->tree.node);
+	}
+	// The allocator of a Termux:GUI backend belongs to its connection
+	bool owns_allocator = server->backend != NULL &&
+		!wlr_backend_is_tgui(server->backend);
+	if (server->display != NULL) {
+		wl_display_destroy_clients(server->display);
+		wl_display_destroy(server->display);
+	}
+	if (owns_allocator) {
+		wlr_allocator_destroy(server->allocator);
+	}
+	wlr_renderer_destroy(server->renderer);
+}
+
+struct wlr_scene_output *test_server_add_output(struct test_server *server,
+		int width, int height) {
+	struct wlr_output *output =
+		wlr_headless_add_output(server->backend, width, height);
+	if (output == NULL) {
+		return NULL;
+	}
+	wlr_output_init_render(output, server->allocator, server->renderer);
+	wlr_output_enable(output, true);
+	if (!wlr_output_commit(output)) {
+		return NULL;
+	}
+	return wlr_scene_output_create(server->scene, output);
+}
+
+struct wlr_output *test_server_add_tgui_output(struct test_server *server) {
+	struct wlr_output *wlr_output = wlr_tgui_add_output(server->backend);
+	if (wlr_output == NULL) {
+		return NULL;
+	}
+	struct wlr_tgui_output *output = (struct wlr_tgui_output *)wlr_output;
+	wlr_output_init_render(wlr_output, server->allocator, server->renderer);
+
+	struct wl_event_loop *loop = wl_display_get_event_loop(server->display);
+	int64_t deadline = test_get_time_nsec() + 5000000000LL;
+	while (!output->tgui_activity_is_foreground) {
+		if (test_get_time_nsec() > deadline) {
+			return NULL;
+		}
+		wl_event_loop_dispatch(loop, 10);
+	}
+
+	// The preferred mode is the size of the surface view
+	struct wlr_output_mode *mode = wlr_output_preferred_mode(wlr_output);
+	if (mode == NULL) {
+		return NULL;
+	}
+	wlr_output_set_mode(wlr_output, mode);
+	wlr_output_enable(wlr_output, true);
+	if (!wlr_output_commit(wlr_output)) {
+		return NULL;
+	}
+	return wlr_output;
+}
+
+bool test_output_commit(struct wlr_scene_output *scene_output) {
+	bool ok = wlr_scene_output_commit(scene_output);
+	if (scene_output->output->frame_pending) {
+		wlr_output_send_frame(scene_output->output);
+	}
+	return ok;
+}
+
+struct test_buffer {
+	struct wlr_buffer base;
+	void *data;
+	uint32_t format;
+	size_t stride;
+};
+
+static void test_buffer_destroy(struct wlr_buffer *wlr_buffer) {
+	struct test_buffer *buffer = wl_container_of(wlr_buffer, buffer, base);
+	free(buffer->data);
+	free(buffer);
+}
+
+static bool test_buffer_begin_data_ptr_access(struct wlr_buffer *wlr_buffer,
+		uint32_t flags, void **data, uint32_t *format, size_t *stride) {
+	struct test_buffer *buffer = wl_container_of(wlr_buffer, buffer, base);
+	*data = buffer->data;
+	*format = buffer->format;
+	*stride = buffer->stride;
+	return true;
+}
+
+static void test_buffer_end_data_ptr_access(struct wlr_buffer *wlr_buffer) {
+	// This space is intentionally left blank
+}
+
+static const struct wlr_buffer_impl test_buffer_impl = {
+	.destroy = test_buffer_destroy,
+	.begin_data_ptr_access = test_buffer_begin_data_ptr_access,
+	.end_data_ptr_access = test_buffer_end_data_ptr_access,
+};
+
+struct wlr_buffer *test_buffer_create(int width, int height, uint32_t format,
+		uint32_t pixel) {
+	assert(format == DRM_FORMAT_ARGB8888 || format == DRM_FORMAT_XRGB8888);
+
+	struct test_buffer *buffer = calloc(1, sizeof(*buffer));
+	if (buffer == NULL) {
+		return NULL;
+	}
+	wlr_buffer_init(&buffer->base, &test_buffer_impl, width, height);
+	buffer->format = format;
+	buffer->stride = (size_t)width * 4;
+	buffer->data = malloc(buffer->stride * height);
+	if (buffer->data == NULL) {
+		free(buffer);
+		return NULL;
+	}
+	uint32_t *pixels = buffer->data;
+	for (size_t i = 0; i < (size_t)width * height; i++) {
+		pixels[i] = pixel;
+	}
+	return &buffer->base;
+}
+
+int64_t test_get_time_nsec(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return timespec_to_nsec(&now);
+}
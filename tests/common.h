@@ -0,0 +1,76 @@
+#ifndef TESTS_COMMON_H
+#define TESTS_COMMON_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <wayland-server-core.h>
+#include <wlr/backend.h>
+#include <wlr/render/allocator.h>
+#include <wlr/render/wlr_renderer.h>
+#include <wlr/types/wlr_buffer.h>
+#include <wlr/types/wlr_scene.h>
+
+/**
+ * Tests are executables returning a non-zero status if a check failed, and
+ * benchmarks print one "name: value unit" line per measurement.
+ */
+extern int test_failures;
+
+#define CHECK(cond) \
+	do { \
+		if (!(cond)) { \
+			fprintf(stderr, "%s:%d: check failed: %s\n", \
+				__FILE__, __LINE__, #cond); \
+			test_failures++; \
+		} \
+	} while (0)
+
+/**
+ * A compositor rendering a scene.
+ */
+struct test_server {
+	struct wl_display *display;
+	struct wlr_backend *backend;
+	struct wlr_renderer *renderer;
+	struct wlr_allocator *allocator;
+	struct wlr_scene *scene;
+};
+
+/**
+ * Set up a server around a backend and a renderer, which are headless and
+ * pixman if NULL. The backend is started.
+ */
+bool test_server_init(struct test_server *server,
+	struct wlr_backend *(*create_backend)(struct wl_display *display),
+	struct wlr_renderer *(*create_renderer)(void));
+void test_server_finish(struct test_server *server);
+
+/**
+ * Add a headless output of the given size to the scene.
+ */
+struct wlr_scene_output *test_server_add_output(struct test_server *server,
+	int width, int height);
+
+/**
+ * Add a Termux:GUI output and run the event loop until its activity is in the
+ * foreground, then enable it with the size of its surface view. Returns NULL
+ * if that takes more than 5 seconds.
+ */
+struct wlr_output *test_server_add_tgui_output(struct test_server *server);
+
+/**
+ * Render and commit an output, then mark the frame as presented right away
+ * so that the output can be committed again without running the event loop.
+ */
+bool test_output_commit(struct wlr_scene_output *scene_output);
+
+/**
+ * Create a buffer in main memory filled with a pixel value.
+ */
+struct wlr_buffer *test_buffer_create(int width, int height, uint32_t format,
+	uint32_t pixel);
+
+int64_t test_get_time_nsec(void);
+
+#endif
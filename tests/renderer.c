@@ -0,0 +1,258 @@
+#include <assert.h>
+#include <drm_fourcc.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wlr/interfaces/wlr_buffer.h>
+#include <wlr/render/drm_format_set.h>
+#include <wlr/render/interface.h>
+#include "renderer.h"
+
+static const uint32_t formats[] = {
+	DRM_FORMAT_ARGB8888,
+	DRM_FORMAT_XRGB8888,
+};
+
+struct test_renderer {
+	struct wlr_renderer base;
+	struct wlr_drm_format_set render_formats;
+	struct test_renderer_stats stats;
+};
+
+struct test_texture {
+	struct wlr_texture base;
+	struct test_renderer *renderer;
+	uint32_t *data;
+};
+
+static const struct wlr_renderer_impl renderer_impl;
+static const struct wlr_texture_impl texture_impl;
+
+static struct test_renderer *test_renderer_from_renderer(
+		struct wlr_renderer *wlr_renderer) {
+	assert(wlr_renderer->impl == &renderer_impl);
+	struct test_renderer *renderer =
+		wl_container_of(wlr_renderer, renderer, base);
+	return renderer;
+}
+
+static struct test_texture *test_texture_from_texture(
+		struct wlr_texture *wlr_texture) {
+	assert(wlr_texture->impl == &texture_impl);
+	struct test_texture *texture =
+		wl_container_of(wlr_texture, texture, base);
+	return texture;
+}
+
+static bool is_supported_format(uint32_t format) {
+	for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+		if (formats[i] == format) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static void texture_copy_rect(struct test_texture *texture, void *data,
+		size_t stride, const pixman_box32_t *box) {
+	size_t width = box->x2 - box->x1;
+	for (int y = box->y1; y < box->y2; y++) {
+		memcpy(&texture->data[y * texture->base.width + box->x1],
+			(char *)data + y * stride + box->x1 * 4, width * 4);
+	}
+	texture->renderer->stats.upload_bytes +=
+		width * (box->y2 - box->y1) * 4;
+}
+
+static bool test_texture_update_from_buffer(struct wlr_texture *wlr_texture,
+		struct wlr_buffer *buffer, pixman_region32_t *damage) {
+	struct test_texture *texture = test_texture_from_texture(wlr_texture);
+
+	void *data;
+	uint32_t format;
+	size_t stride;
+	if (!wlr_buffer_begin_data_ptr_access(buffer,
+			WLR_BUFFER_DATA_PTR_ACCESS_READ, &data, &format, &stride)) {
+		return false;
+	}
+	if (!is_supported_format(format)) {
+		wlr_buffer_end_data_ptr_access(buffer);
+		return false;
+	}
+
+	int n_rects;
+	pixman_box32_t *rects = pixman_region32_rectangles(damage, &n_rects);
+	for (int i = 0; i < n_rects; i++) {
+		texture_copy_rect(texture, data, stride, &rects[i]);
+	}
+	wlr_buffer_end_data_ptr_access(buffer);
+
+	texture->renderer->stats.updates++;
+	return true;
+}
+
+static void test_texture_destroy(struct wlr_texture *wlr_texture) {
+	struct test_texture *texture = test_texture_from_texture(wlr_texture);
+	texture->renderer->stats.textures_destroyed++;
+	if (texture->renderer->stats.last_drawn == wlr_texture) {
+		texture->renderer->stats.last_drawn = NULL;
+	}
+	free(texture->data);
+	free(texture);
+}
+
+static const struct wlr_texture_impl texture_impl = {
+	.update_from_buffer = test_texture_update_from_buffer,
+	.destroy = test_texture_destroy,
+};
+
+static struct wlr_texture *test_texture_from_buffer(
+		struct wlr_renderer *wlr_renderer, struct wlr_buffer *buffer) {
+	struct test_renderer *renderer = test_renderer_from_renderer(wlr_renderer);
+
+	void *data;
+	uint32_t format;
+	size_t stride;
+	if (!wlr_buffer_begin_data_ptr_access(buffer,
+			WLR_BUFFER_DATA_PTR_ACCESS_READ, &data, &format, &stride)) {
+		return NULL;
+	}
+
+	struct test_texture *texture = NULL;
+	if (!is_supported_format(format)) {
+		goto out;
+	}
+	texture = calloc(1, sizeof(*texture));
+	if (texture == NULL) {
+		goto out;
+	}
+	wlr_texture_init(&texture->base, &texture_impl,
+		buffer->width, buffer->height);
+	texture->renderer = renderer;
+	texture->data = malloc((size_t)buffer->width * buffer->height * 4);
+	if (texture->data == NULL) {
+		free(texture);
+		texture = NULL;
+		goto out;
+	}
+	pixman_box32_t box = { 0, 0, buffer->width, buffer->height };
+	texture_copy_rect(texture, data, stride, &box);
+	renderer->stats.textures_created++;
+
+out:
+	wlr_buffer_end_data_ptr_access(buffer);
+	return texture != NULL ? &texture->base : NULL;
+}
+
+static bool test_bind_buffer(struct wlr_renderer *wlr_renderer,
+		struct wlr_buffer *buffer) {
+	return true;
+}
+
+static void test_begin(struct wlr_renderer *wlr_renderer,
+		uint32_t width, uint32_t height) {
+	// This space is intentionally left blank
+}
+
+static void test_clear(struct wlr_renderer *wlr_renderer,
+		const float color[static 4]) {
+	// This space is intentionally left blank
+}
+
+static void test_scissor(struct wlr_renderer *wlr_renderer,
+		struct wlr_box *box) {
+	// This space is intentionally left blank
+}
+
+static bool test_render_subtexture_with_matrix(
+		struct wlr_renderer *wlr_renderer, struct wlr_texture *texture,
+		const struct wlr_fbox *box, const float matrix[static 9],
+		float alpha) {
+	struct test_renderer *renderer = test_renderer_from_renderer(wlr_renderer);
+	renderer->stats.draws++;
+	renderer->stats.last_drawn = texture;
+	return true;
+}
+
+static void test_render_quad_with_matrix(struct wlr_renderer *wlr_renderer,
+		const float color[static 4], const float matrix[static 9]) {
+	// This space is intentionally left blank
+}
+
+static const uint32_t *test_get_shm_texture_formats(
+		struct wlr_renderer *wlr_renderer, size_t *len) {
+	*len = sizeof(formats) / sizeof(formats[0]);
+	return formats;
+}
+
+static const struct wlr_drm_format_set *test_get_render_formats(
+		struct wlr_renderer *wlr_renderer) {
+	struct test_renderer *renderer = test_renderer_from_renderer(wlr_renderer);
+	return &renderer->render_formats;
+}
+
+static uint32_t test_get_render_buffer_caps(
+		struct wlr_renderer *wlr_renderer) {
+	return WLR_BUFFER_CAP_DATA_PTR;
+}
+
+static void test_destroy(struct wlr_renderer *wlr_renderer) {
+	struct test_renderer *renderer = test_renderer_from_renderer(wlr_renderer);
+	wlr_drm_format_set_finish(&renderer->render_formats);
+	free(renderer);
+}
+
+static const struct wlr_renderer_impl renderer_impl = {
+	.bind_buffer = test_bind_buffer,
+	.begin = test_begin,
+	.clear = test_clear,
+	.scissor = test_scissor,
+	.render_subtexture_with_matrix = test_render_subtexture_with_matrix,
+	.render_quad_with_matrix = test_render_quad_with_matrix,
+	.get_shm_texture_formats = test_get_shm_texture_formats,
+	.get_render_formats = test_get_render_formats,
+	.get_render_buffer_caps = test_get_render_buffer_caps,
+	.texture_from_buffer = test_texture_from_buffer,
+	.destroy = test_destroy,
+};
+
+struct wlr_renderer *test_renderer_create(void) {
+	struct test_renderer *renderer = calloc(1, sizeof(*renderer));
+	if (renderer == NULL) {
+		return NULL;
+	}
+	wlr_renderer_init(&renderer->base, &renderer_impl);
+	for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+		wlr_drm_format_set_add(&renderer->render_formats, formats[i],
+			DRM_FORMAT_MOD_INVALID);
+		wlr_drm_format_set_add(&renderer->render_formats, formats[i],
+			DRM_FORMAT_MOD_LINEAR);
+	}
+	return &renderer->base;
+}
+
+const struct test_renderer_stats *test_renderer_get_stats(
+		struct wlr_renderer *wlr_renderer) {
+	struct test_renderer *renderer = test_renderer_from_renderer(wlr_renderer);
+	return &renderer->stats;
+}
+
+bool test_texture_matches_buffer(struct wlr_texture *wlr_texture,
+		struct wlr_buffer *buffer) {
+	struct test_texture *texture = test_texture_from_texture(wlr_texture);
+
+	void *data;
+	uint32_t format;
+	size_t stride;
+	if (!wlr_buffer_begin_data_ptr_access(buffer,
+			WLR_BUFFER_DATA_PTR_ACCESS_READ, &data, &format, &stride)) {
+		return false;
+	}
+	bool matches = texture->base.width == (uint32_t)buffer->width &&
+		texture->base.height == (uint32_t)buffer->height;
+	for (int y = 0; matches && y < buffer->height; y++) {
+		matches = memcmp(&texture->data[y * texture->base.width],
+			(char *)data + y * stride, buffer->width * 4) == 0;
+	}
+	wlr_buffer_end_data_ptr_access(buffer);
+	return matches;
+}
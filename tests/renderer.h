@@ -0,0 +1,31 @@
+#ifndef TESTS_RENDERER_H
+#define TESTS_RENDERER_H
+
+#include <stdint.h>
+#include <wlr/render/wlr_renderer.h>
+#include <wlr/render/wlr_texture.h>
+#include <wlr/types/wlr_buffer.h>
+
+/**
+ * Calls of a test renderer. Nothing is drawn, but textures hold a copy of
+ * their buffer in main memory, as GPU renderers do in video memory.
+ */
+struct test_renderer_stats {
+	uint64_t textures_created, textures_destroyed;
+	uint64_t updates; // wlr_texture_update_from_buffer() calls
+	uint64_t upload_bytes; // copied by imports and updates
+	uint64_t draws; // textures drawn
+	struct wlr_texture *last_drawn;
+};
+
+struct wlr_renderer *test_renderer_create(void);
+const struct test_renderer_stats *test_renderer_get_stats(
+	struct wlr_renderer *renderer);
+
+/**
+ * Check whether a texture of a test renderer holds the contents of a buffer.
+ */
+bool test_texture_matches_buffer(struct wlr_texture *texture,
+	struct wlr_buffer *buffer);
+
+#endif
@@ -0,0 +1,36 @@
+#include <stdlib.h>
+#include "common.h"
+#include "util/alpha.h"
+
+#define MAX_LEN 130
+
+/**
+ * Rows of every length up to a few vector blocks, at every alignment, with a
+ * translucent pixel at each position.
+ */
+int main(void) {
+	uint32_t pixels[MAX_LEN + 8];
+	for (size_t offset = 0; offset < 8; offset++) {
+		for (size_t len = 0; len <= MAX_LEN; len++) {
+			uint32_t *row = &pixels[offset];
+			for (size_t i = 0; i < len; i++) {
+				row[i] = 0xFF000000 | (uint32_t)(i * 0x010203);
+			}
+			CHECK(alpha_row_is_opaque(row, len));
+
+			for (size_t i = 0; i < len; i++) {
+				uint32_t saved = row[i];
+				row[i] = 0xFE123456;
+				CHECK(!alpha_row_is_opaque(row, len));
+				row[i] = 0x00FFFFFF;
+				CHECK(!alpha_row_is_opaque(row, len));
+				row[i] = saved;
+			}
+
+			// Pixels past the end of the row don't count
+			row[len] = 0x00000000;
+			CHECK(alpha_row_is_opaque(row, len));
+		}
+	}
+	return test_failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
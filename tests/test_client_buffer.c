@@ -0,0 +1,155 @@
+#define _POSIX_C_SOURCE 200809L
+#include <drm_fourcc.h>
+#include <stdlib.h>
+#include <wlr/backend/headless.h>
+#include <wlr/render/pixman.h>
+#include "common.h"
+
+/**
+ * Textures of client buffers for the renderers of outputs the surface
+ * entered after the commit: they are imported on first use as long as the
+ * source hasn't been released to the client.
+ */
+
+#define SIZE 32
+
+struct renderer_output {
+	struct wlr_renderer *renderer;
+	struct wlr_allocator *allocator;
+	struct wlr_scene_output *scene_output;
+};
+
+static bool renderer_output_init(struct renderer_output *ro,
+		struct test_server *server, struct wlr_renderer *renderer) {
+	*ro = (struct renderer_output){ .renderer = renderer };
+	ro->allocator = wlr_allocator_autocreate(server->backend, renderer);
+	if (ro->allocator == NULL) {
+		return false;
+	}
+	struct wlr_output *output =
+		wlr_headless_add_output(server->backend, 2 * SIZE, 2 * SIZE);
+	if (output == NULL) {
+		return false;
+	}
+	wlr_output_init_render(output, ro->allocator, renderer);
+	wlr_output_enable(output, true);
+	if (!wlr_output_commit(output)) {
+		return false;
+	}
+	ro->scene_output = wlr_scene_output_create(server->scene, output);
+	return ro->scene_output != NULL;
+}
+
+static void renderer_output_finish(struct renderer_output *ro) {
+	if (ro->scene_output != NULL) {
+		struct wlr_output *output = ro->scene_output->output;
+		wlr_scene_output_destroy(ro->scene_output);
+		wlr_output_destroy(output);
+	}
+	wlr_allocator_destroy(ro->allocator);
+	wlr_renderer_destroy(ro->renderer);
+}
+
+/**
+ * Commit a source buffer the way wlr_surface does: locked while the client
+ * buffer is created, then released.
+ */
+static struct wlr_client_buffer *commit_buffer(struct wlr_buffer *source,
+		struct wlr_renderer *renderer) {
+	wlr_buffer_lock(source);
+	struct wlr_client_buffer *client_buffer =
+		wlr_client_buffer_create(source, renderer);
+	wlr_buffer_unlock(source);
+	return client_buffer;
+}
+
+/**
+ * Show a client buffer created with the first renderer on an output of the
+ * other one.
+ */
+static void test_enter(struct test_server *server,
+		struct wlr_renderer *renderer, struct renderer_output *other,
+		bool expect_texture) {
+	struct wlr_buffer *source = test_buffer_create(SIZE, SIZE,
+		DRM_FORMAT_XRGB8888, 0xFF00FF00);
+	CHECK(source != NULL);
+	struct wlr_client_buffer *client_buffer = commit_buffer(source, renderer);
+	CHECK(client_buffer != NULL);
+	if (client_buffer == NULL) {
+		wlr_buffer_drop(source);
+		return;
+	}
+
+	struct wlr_texture *texture =
+		wlr_client_buffer_get_texture(client_buffer, other->renderer);
+	CHECK((texture != NULL) == expect_texture);
+	if (texture != NULL) {
+		CHECK(texture->width == SIZE && texture->height == SIZE);
+		// Imported once
+		CHECK(wlr_client_buffer_get_texture(client_buffer,
+			other->renderer) == texture);
+	}
+
+	struct wlr_scene_buffer *scene_buffer =
+		wlr_scene_buffer_create(&server->scene->tree, &client_buffer->base);
+	CHECK(test_output_commit(other->scene_output));
+
+	wlr_scene_node_destroy(&scene_buffer->node);
+	wlr_buffer_drop(&client_buffer->base);
+	wlr_buffer_drop(source);
+}
+
+/**
+ * GLES2 needs a render node, which may not be available.
+ */
+static struct wlr_renderer *create_gles2_renderer(struct test_server *server) {
+	setenv("WLR_RENDERER", "gles2", true);
+	struct wlr_renderer *renderer = wlr_renderer_autocreate(server->backend);
+	unsetenv("WLR_RENDERER");
+	return renderer;
+}
+
+int main(void) {
+	struct test_server server;
+	if (!test_server_init(&server, NULL, NULL)) {
+		fprintf(stderr, "failed to create the server\n");
+		return EXIT_FAILURE;
+	}
+	struct wlr_scene_output *scene_output =
+		test_server_add_output(&server, 2 * SIZE, 2 * SIZE);
+	CHECK(scene_output != NULL);
+
+	// A pixman texture references its source, which isn't released until
+	// the client buffer is destroyed: other renderers can import it later
+	struct renderer_output pixman;
+	CHECK(renderer_output_init(&pixman, &server,
+		wlr_pixman_renderer_create()));
+	test_enter(&server, server.renderer, &pixman, true);
+	renderer_output_finish(&pixman);
+
+	struct wlr_renderer *renderer = create_gles2_renderer(&server);
+	struct renderer_output gles2;
+	if (renderer == NULL) {
+		fprintf(stderr, "GLES2 renderer unavailable, skipping\n");
+	} else if (!renderer_output_init(&gles2, &server, renderer)) {
+		fprintf(stderr, "GLES2 output unavailable, skipping\n");
+		renderer_output_finish(&gles2);
+	} else {
+		test_enter(&server, server.renderer, &gles2, true);
+		renderer_output_finish(&gles2);
+	}
+
+	// The other way around, the GLES2 texture is a copy and the source is
+	// released right away: it can't be read anymore
+	renderer = create_gles2_renderer(&server);
+	if (renderer != NULL) {
+		CHECK(renderer_output_init(&pixman, &server,
+			wlr_pixman_renderer_create()));
+		test_enter(&server, renderer, &pixman, false);
+		renderer_output_finish(&pixman);
+		wlr_renderer_destroy(renderer);
+	}
+
+	test_server_finish(&server);
+	return test_failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,144 @@
+#include <stdlib.h>
+#include <wlr/types/wlr_damage_ring.h>
+#include "common.h"
+
+static bool region_contains(pixman_region32_t *region,
+		pixman_region32_t *other) {
+	pixman_region32_t diff;
+	pixman_region32_init(&diff);
+	pixman_region32_subtract(&diff, other, region);
+	bool contains = !pixman_region32_not_empty(&diff);
+	pixman_region32_fini(&diff);
+	return contains;
+}
+
+static bool region_is_tile_aligned(pixman_region32_t *region, int tile_size) {
+	int n_rects;
+	pixman_box32_t *rects = pixman_region32_rectangles(region, &n_rects);
+	for (int i = 0; i < n_rects; i++) {
+		if (rects[i].x1 % tile_size != 0 || rects[i].y1 % tile_size != 0 ||
+				rects[i].x2 % tile_size != 0 ||
+				rects[i].y2 % tile_size != 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Scattered 1x1 damage, one pixel every 16 pixels in a 256x256 square at
+ * (x, y).
+ */
+static void add_scattered_damage(pixman_region32_t *region, int x, int y) {
+	for (int i = 0; i < 256; i += 16) {
+		for (int j = 0; j < 256; j += 16) {
+			pixman_region32_union_rect(region, region, x + j, y + i, 1, 1);
+		}
+	}
+}
+
+static void test_default_budget(void) {
+	struct wlr_damage_ring ring;
+	wlr_damage_ring_init(&ring);
+	wlr_damage_ring_set_bounds(&ring, 1920, 1080);
+	wlr_damage_ring_rotate(&ring);
+
+	pixman_region32_t damage;
+	pixman_region32_init(&damage);
+	add_scattered_damage(&damage, 0, 0);
+	CHECK(pixman_region32_n_rects(&damage) > WLR_DAMAGE_RING_MAX_RECTS);
+
+	CHECK(wlr_damage_ring_add(&ring, &damage));
+	CHECK(pixman_region32_n_rects(&ring.current) <=
+		WLR_DAMAGE_RING_MAX_RECTS);
+	CHECK(region_contains(&ring.current, &damage));
+
+	// Without a tile size, damage collapses to its extents
+	pixman_box32_t *extents = pixman_region32_extents(&ring.current);
+	CHECK(pixman_region32_n_rects(&ring.current) == 1);
+	CHECK(extents->x1 == 0 && extents->y1 == 0);
+	CHECK(extents->x2 == 241 && extents->y2 == 241);
+
+	pixman_region32_fini(&damage);
+	wlr_damage_ring_finish(&ring);
+}
+
+static void test_tiles(void) {
+	struct wlr_damage_ring ring;
+	wlr_damage_ring_init(&ring);
+	wlr_damage_ring_set_bounds(&ring, 1920, 1080);
+	wlr_damage_ring_set_rect_budget(&ring, 8, 64);
+	wlr_damage_ring_rotate(&ring);
+
+	// Two far apart clusters are kept apart
+	pixman_region32_t damage;
+	pixman_region32_init(&damage);
+	add_scattered_damage(&damage, 64, 64);
+	add_scattered_damage(&damage, 1280, 640);
+
+	CHECK(wlr_damage_ring_add(&ring, &damage));
+	CHECK(pixman_region32_n_rects(&ring.current) <= 8);
+	CHECK(pixman_region32_n_rects(&ring.current) >= 2);
+	CHECK(region_contains(&ring.current, &damage));
+	CHECK(region_is_tile_aligned(&ring.current, 64));
+	pixman_box32_t hole = { .x1 = 512, .y1 = 512, .x2 = 576, .y2 = 576 };
+	CHECK(pixman_region32_contains_rectangle(&ring.current, &hole) ==
+		PIXMAN_REGION_OUT);
+
+	// Tiles are clipped to the bounds of the ring
+	wlr_damage_ring_rotate(&ring);
+	pixman_region32_clear(&damage);
+	add_scattered_damage(&damage, 1700, 900);
+	CHECK(wlr_damage_ring_add(&ring, &damage));
+	CHECK(pixman_region32_n_rects(&ring.current) <= 8);
+	pixman_box32_t *extents = pixman_region32_extents(&ring.current);
+	CHECK(extents->x2 <= 1920 && extents->y2 <= 1080);
+
+	pixman_region32_fini(&damage);
+	wlr_damage_ring_finish(&ring);
+}
+
+static void test_buffer_damage(void) {
+	struct wlr_damage_ring ring;
+	wlr_damage_ring_init(&ring);
+	wlr_damage_ring_set_bounds(&ring, 1920, 1080);
+	wlr_damage_ring_set_rect_budget(&ring, 4, 0);
+	wlr_damage_ring_rotate(&ring);
+
+	// Each frame is within budget, their union isn't
+	pixman_region32_t all;
+	pixman_region32_init(&all);
+	for (int i = 0; i < 2; i++) {
+		for (int j = 0; j < 3; j++) {
+			struct wlr_box box = { .x = i * 300 + j * 100, .y = j * 200,
+				.width = 10, .height = 10 };
+			CHECK(wlr_damage_ring_add_box(&ring, &box));
+			pixman_region32_union_rect(&all, &all,
+				box.x, box.y, box.width, box.height);
+		}
+		CHECK(pixman_region32_n_rects(&ring.current) == 3);
+		wlr_damage_ring_rotate(&ring);
+	}
+
+	pixman_region32_t damage;
+	pixman_region32_init(&damage);
+	wlr_damage_ring_get_buffer_damage(&ring, 3, &damage);
+	CHECK(pixman_region32_n_rects(&damage) <= 4);
+	CHECK(region_contains(&damage, &all));
+
+	// Unknown buffer ages damage everything
+	wlr_damage_ring_get_buffer_damage(&ring, 0, &damage);
+	pixman_box32_t *extents = pixman_region32_extents(&damage);
+	CHECK(extents->x2 == 1920 && extents->y2 == 1080);
+
+	pixman_region32_fini(&damage);
+	pixman_region32_fini(&all);
+	wlr_damage_ring_finish(&ring);
+}
+
+int main(void) {
+	test_default_budget();
+	test_tiles();
+	test_buffer_damage();
+	return test_failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,99 @@
+#include <stdlib.h>
+#include <wlr/interfaces/wlr_output.h>
+#include "common.h"
+
+/**
+ * Delayed frame events on a headless output: the frame event is held back
+ * until shortly before the next refresh deadline, and dropped if a buffer is
+ * committed in the meantime, as the commit can't be followed by another one
+ * before the backend sends its own frame event.
+ */
+
+#define TIMEOUT_NSEC (1000 * 1000000LL)
+
+struct frame_log {
+	int frames;
+	int frames_while_pending;
+	struct wl_listener frame;
+};
+
+static void handle_frame(struct wl_listener *listener, void *data) {
+	struct frame_log *log = wl_container_of(listener, log, frame);
+	struct wlr_output *output = data;
+	log->frames++;
+	if (output->frame_pending) {
+		log->frames_while_pending++;
+	}
+}
+
+static bool commit_buffer(struct wlr_output *output) {
+	if (!wlr_output_attach_render(output, NULL)) {
+		return false;
+	}
+	wlr_renderer_begin(output->renderer, output->width, output->height);
+	wlr_renderer_clear(output->renderer, (float[4]){ 0, 0, 0, 1 });
+	wlr_renderer_end(output->renderer);
+	return wlr_output_commit(output);
+}
+
+static void dispatch_until_frame(struct test_server *server,
+		struct frame_log *log, int frames) {
+	struct wl_event_loop *loop = wl_display_get_event_loop(server->display);
+	int64_t deadline = test_get_time_nsec() + TIMEOUT_NSEC;
+	while (log->frames < frames && test_get_time_nsec() < deadline) {
+		wl_event_loop_dispatch(loop, 1);
+	}
+}
+
+int main(void) {
+	struct test_server server;
+	if (!test_server_init(&server, NULL, NULL)) {
+		fprintf(stderr, "failed to create the server\n");
+		return EXIT_FAILURE;
+	}
+	struct wlr_scene_output *scene_output =
+		test_server_add_output(&server, 64, 64);
+	CHECK(scene_output != NULL);
+	if (scene_output == NULL) {
+		test_server_finish(&server);
+		return EXIT_FAILURE;
+	}
+	struct wlr_output *output = scene_output->output;
+	wlr_output_set_frame_delay(output, true);
+
+	struct frame_log log = { .frame.notify = handle_frame };
+	wl_signal_add(&output->events.frame, &log.frame);
+
+	// The present event of the enabling commit starts the refresh cycle
+	// frame events follow
+	dispatch_until_frame(&server, &log, 1);
+	CHECK(log.frames == 1);
+
+	// Frame events are delayed within the refresh cycle
+	CHECK(commit_buffer(output));
+	wlr_output_send_frame(output);
+	CHECK(output->frame_delayed);
+	CHECK(log.frames == 1);
+
+	// A buffer committed in the meantime drops the delayed frame event,
+	// the next one comes once the backend is done with the buffer
+	CHECK(commit_buffer(output));
+	CHECK(!output->frame_delayed);
+	dispatch_until_frame(&server, &log, 2);
+	CHECK(log.frames == 2);
+	CHECK(log.frames_while_pending == 0);
+	CHECK(!output->frame_pending);
+
+	// Disabling the delay sends a delayed frame event right away
+	CHECK(commit_buffer(output));
+	wlr_output_send_frame(output);
+	CHECK(output->frame_delayed);
+	wlr_output_set_frame_delay(output, false);
+	CHECK(!output->frame_delayed);
+	CHECK(log.frames == 3);
+	CHECK(log.frames_while_pending == 0);
+
+	wl_list_remove(&log.frame.link);
+	test_server_finish(&server);
+	return test_failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,134 @@
+#include <drm_fourcc.h>
+#include <stdlib.h>
+#include <wlr/util/region.h>
+#include "common.h"
+
+#define SIZE 256
+#define OUTPUTS 8
+
+static const float scales[OUTPUTS] = { 1, 2, 2, 1, 2, 1, 1, 2 };
+
+struct layout {
+	struct test_server server;
+	struct wlr_scene_output *outputs[OUTPUTS];
+	int x[OUTPUTS]; // outputs are side by side
+};
+
+static void layout_clear_damage(struct layout *layout) {
+	for (int i = 0; i < OUTPUTS; i++) {
+		test_output_commit(layout->outputs[i]);
+		CHECK(!pixman_region32_not_empty(
+			&layout->outputs[i]->damage_ring.current));
+	}
+}
+
+/**
+ * Check that only the outputs crossed by a box in layout coordinates have
+ * been damaged, and by at least that box.
+ */
+static void check_damage(struct layout *layout, int x, int y,
+		int width, int height, bool exact) {
+	for (int i = 0; i < OUTPUTS; i++) {
+		struct wlr_scene_output *scene_output = layout->outputs[i];
+		pixman_region32_t expected;
+		pixman_region32_init_rect(&expected, x, y, width, height);
+		pixman_region32_intersect_rect(&expected, &expected,
+			layout->x[i], 0, SIZE / scales[i], SIZE / scales[i]);
+		pixman_region32_translate(&expected, -layout->x[i], 0);
+		wlr_region_scale(&expected, &expected, scales[i]);
+
+		pixman_region32_t *damage = &scene_output->damage_ring.current;
+		if (!pixman_region32_not_empty(&expected)) {
+			CHECK(!pixman_region32_not_empty(damage));
+		} else if (exact) {
+			CHECK(pixman_region32_equal(damage, &expected));
+		} else {
+			pixman_region32_t missing;
+			pixman_region32_init(&missing);
+			pixman_region32_subtract(&missing, &expected, damage);
+			CHECK(!pixman_region32_not_empty(&missing));
+			pixman_region32_fini(&missing);
+		}
+		pixman_region32_fini(&expected);
+	}
+}
+
+static void test_rects(struct layout *layout) {
+	struct wlr_scene_tree *tree =
+		wlr_scene_tree_create(&layout->server.scene->tree);
+	wlr_scene_node_set_enabled(&tree->node, false);
+	struct wlr_scene_rect *inside =
+		wlr_scene_rect_create(tree, 20, 20, (float[4]){ 1, 0, 0, 1 });
+	wlr_scene_node_set_position(&inside->node, layout->x[3] + 10, 10);
+	layout_clear_damage(layout);
+
+	// Damage within a single output
+	wlr_scene_node_set_enabled(&tree->node, true);
+	check_damage(layout, layout->x[3] + 10, 10, 20, 20, true);
+	layout_clear_damage(layout);
+
+	// Damage across two outputs with the same scale, which share the
+	// scaled damage
+	struct wlr_scene_rect *across =
+		wlr_scene_rect_create(tree, 40, 10, (float[4]){ 0, 1, 0, 1 });
+	wlr_scene_node_set_position(&across->node, layout->x[2] - 20, 30);
+	layout_clear_damage(layout);
+	wlr_scene_rect_set_color(across, (float[4]){ 0, 0, 1, 1 });
+	check_damage(layout, layout->x[2] - 20, 30, 40, 10, true);
+	layout_clear_damage(layout);
+
+	// Damage across outputs with different scales
+	wlr_scene_node_set_position(&across->node, layout->x[5] - 20, 30);
+	layout_clear_damage(layout);
+	wlr_scene_rect_set_color(across, (float[4]){ 1, 0, 1, 1 });
+	check_damage(layout, layout->x[5] - 20, 30, 40, 10, true);
+	layout_clear_damage(layout);
+
+	wlr_scene_node_destroy(&tree->node);
+	layout_clear_damage(layout);
+}
+
+static void test_buffer(struct layout *layout) {
+	struct wlr_buffer *buffer =
+		test_buffer_create(64, 64, DRM_FORMAT_XRGB8888, 0xFF000000);
+	struct wlr_scene_buffer *scene_buffer =
+		wlr_scene_buffer_create(&layout->server.scene->tree, buffer);
+	wlr_scene_node_set_position(&scene_buffer->node, layout->x[6] + 32, 32);
+	layout_clear_damage(layout);
+
+	pixman_region32_t damage;
+	pixman_region32_init_rect(&damage, 8, 8, 8, 8);
+	wlr_scene_buffer_set_buffer_with_damage(scene_buffer, buffer, &damage);
+	pixman_region32_fini(&damage);
+	check_damage(layout, layout->x[6] + 40, 40, 8, 8, false);
+
+	wlr_scene_node_destroy(&scene_buffer->node);
+	wlr_buffer_drop(buffer);
+	layout_clear_damage(layout);
+}
+
+int main(void) {
+	struct layout layout;
+	if (!test_server_init(&layout.server, NULL, NULL)) {
+		return EXIT_FAILURE;
+	}
+	int x = 0;
+	for (int i = 0; i < OUTPUTS; i++) {
+		struct wlr_scene_output *scene_output =
+			test_server_add_output(&layout.server, SIZE, SIZE);
+		CHECK(scene_output != NULL);
+		wlr_output_set_scale(scene_output->output, scales[i]);
+		CHECK(wlr_output_commit(scene_output->output));
+		wlr_scene_output_set_position(scene_output, x, 0);
+		layout.outputs[i] = scene_output;
+		layout.x[i] = x;
+		x += SIZE / scales[i];
+	}
+	layout_clear_damage(&layout);
+
+	test_rects(&layout);
+	test_buffer(&layout);
+
+	test_server_finish(&layout.server);
+	return test_failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,181 @@
+#include <drm_fourcc.h>
+#include <stdlib.h>
+#include <wlr/interfaces/wlr_output.h>
+#include "common.h"
+
+#define SIZE 256
+
+struct commit_log {
+	uint32_t committed;
+	struct wlr_buffer *buffer;
+	struct wl_listener commit;
+};
+
+static void handle_commit(struct wl_listener *listener, void *data) {
+	struct commit_log *log = wl_container_of(listener, log, commit);
+	struct wlr_output_event_commit *event = data;
+	log->committed = event->committed;
+	log->buffer = event->buffer;
+}
+
+static void get_stats(struct wlr_scene_output *scene_output,
+		struct wlr_scene_output_stats *stats) {
+	CHECK(wlr_scene_output_get_stats(scene_output, stats));
+}
+
+/**
+ * An output without an overlay plane, as DRM, X11 and Termux:GUI ones are.
+ */
+static bool no_overlay_output_test(struct wlr_output *output,
+		const struct wlr_output_state *state) {
+	return !(state->committed & WLR_OUTPUT_STATE_OVERLAY) ||
+		state->overlay_buffer == NULL;
+}
+
+static bool no_overlay_output_commit(struct wlr_output *output,
+		const struct wlr_output_state *state) {
+	if (!no_overlay_output_test(output, state)) {
+		return false;
+	}
+	if (state->committed & WLR_OUTPUT_STATE_BUFFER) {
+		struct wlr_output_event_present present_event = {
+			.commit_seq = output->commit_seq + 1,
+			.presented = true,
+		};
+		wlr_output_send_present(output, &present_event);
+	}
+	return true;
+}
+
+static void no_overlay_output_destroy(struct wlr_output *output) {
+	free(output);
+}
+
+static const struct wlr_output_impl no_overlay_output_impl = {
+	.test = no_overlay_output_test,
+	.commit = no_overlay_output_commit,
+	.destroy = no_overlay_output_destroy,
+};
+
+static struct wlr_scene_output *add_no_overlay_output(
+		struct test_server *server) {
+	struct wlr_output *output = calloc(1, sizeof(*output));
+	if (output == NULL) {
+		return NULL;
+	}
+	wlr_output_init(output, server->backend, &no_overlay_output_impl,
+		server->display);
+	wlr_output_update_custom_mode(output, SIZE, SIZE, 0);
+	wlr_output_init_render(output, server->allocator, server->renderer);
+	wlr_output_enable(output, true);
+	if (!wlr_output_commit(output)) {
+		return NULL;
+	}
+	return wlr_scene_output_create(server->scene, output);
+}
+
+static void test_headless(struct test_server *server,
+		struct wlr_buffer *video) {
+	struct wlr_scene_output *scene_output =
+		test_server_add_output(server, SIZE, SIZE);
+	CHECK(scene_output != NULL);
+	struct commit_log log = { .commit.notify = handle_commit };
+	wl_signal_add(&scene_output->output->events.commit, &log.commit);
+	wlr_scene_output_set_stats_enabled(scene_output, true);
+	struct wlr_scene_output_stats stats;
+
+	struct wlr_scene_tree *tree = wlr_scene_tree_create(&server->scene->tree);
+	wlr_scene_buffer_create(tree, video);
+	CHECK(test_output_commit(scene_output));
+	get_stats(scene_output, &stats);
+	CHECK(stats.scanout_hits == 1);
+	CHECK(log.buffer == video);
+
+	// A subtitle on top goes to the overlay plane
+	struct wlr_scene_rect *subtitle = wlr_scene_rect_create(tree,
+		SIZE / 2, SIZE / 8, (float[4]){ 1, 1, 1, 1 });
+	wlr_scene_node_set_position(&subtitle->node, SIZE / 4, SIZE * 3 / 4);
+	CHECK(test_output_commit(scene_output));
+	get_stats(scene_output, &stats);
+	CHECK(stats.overlay_hits == 1);
+	CHECK(stats.frames == 0);
+	CHECK(log.buffer == video);
+	CHECK(log.committed & WLR_OUTPUT_STATE_OVERLAY);
+
+	// Nodes covering too much of the output are composited
+	wlr_scene_rect_set_size(subtitle, SIZE / 2, SIZE * 3 / 4);
+	wlr_scene_node_set_position(&subtitle->node, 0, 0);
+	CHECK(test_output_commit(scene_output));
+	get_stats(scene_output, &stats);
+	CHECK(stats.overlay_hits == 1);
+	CHECK(stats.frames == 1);
+	CHECK(log.buffer != NULL && log.buffer != video);
+	CHECK(log.committed & WLR_OUTPUT_STATE_OVERLAY);
+
+	// And the overlay comes back once they shrink
+	wlr_scene_rect_set_size(subtitle, SIZE / 2, SIZE / 8);
+	CHECK(test_output_commit(scene_output));
+	get_stats(scene_output, &stats);
+	CHECK(stats.overlay_hits == 2);
+	CHECK(log.buffer == video);
+
+	wlr_scene_node_destroy(&tree->node);
+	wl_list_remove(&log.commit.link);
+	wlr_output_destroy(scene_output->output);
+}
+
+static void test_no_overlay(struct test_server *server,
+		struct wlr_buffer *video) {
+	struct wlr_scene_output *scene_output = add_no_overlay_output(server);
+	CHECK(scene_output != NULL);
+	struct commit_log log = { .commit.notify = handle_commit };
+	wl_signal_add(&scene_output->output->events.commit, &log.commit);
+	wlr_scene_output_set_stats_enabled(scene_output, true);
+	struct wlr_scene_output_stats stats;
+
+	struct wlr_scene_tree *tree = wlr_scene_tree_create(&server->scene->tree);
+	wlr_scene_buffer_create(tree, video);
+	struct wlr_scene_rect *subtitle = wlr_scene_rect_create(tree,
+		SIZE / 2, SIZE / 8, (float[4]){ 1, 1, 1, 1 });
+
+	// The backend rejects the overlay, the scene falls back to compositing
+	CHECK(test_output_commit(scene_output));
+	get_stats(scene_output, &stats);
+	CHECK(stats.overlay_misses == 1);
+	CHECK(stats.frames == 1);
+	CHECK(log.buffer != NULL && log.buffer != video);
+
+	// And doesn't try again right away
+	wlr_scene_node_set_position(&subtitle->node, 0, SIZE / 8);
+	CHECK(test_output_commit(scene_output));
+	get_stats(scene_output, &stats);
+	CHECK(stats.overlay_misses == 1);
+	CHECK(stats.frames == 2);
+
+	// Lone buffers are still scanned out
+	wlr_scene_node_destroy(&subtitle->node);
+	CHECK(test_output_commit(scene_output));
+	get_stats(scene_output, &stats);
+	CHECK(stats.scanout_hits == 1);
+	CHECK(log.buffer == video);
+
+	wlr_scene_node_destroy(&tree->node);
+	wl_list_remove(&log.commit.link);
+	wlr_output_destroy(scene_output->output);
+}
+
+int main(void) {
+	struct test_server server;
+	if (!test_server_init(&server, NULL, NULL)) {
+		return EXIT_FAILURE;
+	}
+	struct wlr_buffer *video =
+		test_buffer_create(SIZE, SIZE, DRM_FORMAT_XRGB8888, 0xFF203040);
+
+	test_headless(&server, video);
+	test_no_overlay(&server, video);
+
+	wlr_buffer_drop(video);
+	test_server_finish(&server);
+	return test_failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
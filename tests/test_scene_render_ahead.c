@@ -0,0 +1,129 @@
+#include <stdlib.h>
+#include <wlr/interfaces/wlr_buffer.h>
+#include "common.h"
+
+/**
+ * Render-ahead on a headless output: a scene change while a frame is pending
+ * is rendered right away, and committed without rendering again on the frame
+ * event if nothing changed since. Otherwise it's dropped for a fresh frame.
+ */
+
+#define SIZE 64
+#define TIMEOUT_NSEC (1000 * 1000000LL)
+
+struct compositor {
+	struct wlr_scene_output *scene_output;
+	int frames;
+	uint32_t committed_pixel; // top-left pixel of the last committed buffer
+	struct wl_listener frame;
+	struct wl_listener commit;
+};
+
+static void handle_frame(struct wl_listener *listener, void *data) {
+	struct compositor *compositor =
+		wl_container_of(listener, compositor, frame);
+	compositor->frames++;
+	wlr_scene_output_commit(compositor->scene_output);
+}
+
+static void handle_commit(struct wl_listener *listener, void *data) {
+	struct compositor *compositor =
+		wl_container_of(listener, compositor, commit);
+	struct wlr_output_event_commit *event = data;
+	void *ptr;
+	uint32_t format;
+	size_t stride;
+	if (event->buffer == NULL || !wlr_buffer_begin_data_ptr_access(
+			event->buffer, WLR_BUFFER_DATA_PTR_ACCESS_READ,
+			&ptr, &format, &stride)) {
+		return;
+	}
+	compositor->committed_pixel = *(uint32_t *)ptr & 0x00FFFFFF;
+	wlr_buffer_end_data_ptr_access(event->buffer);
+}
+
+static void dispatch_until_frame(struct test_server *server,
+		struct compositor *compositor, int frames) {
+	struct wl_event_loop *loop = wl_display_get_event_loop(server->display);
+	int64_t deadline = test_get_time_nsec() + TIMEOUT_NSEC;
+	while (compositor->frames < frames && test_get_time_nsec() < deadline) {
+		wl_event_loop_dispatch(loop, 1);
+	}
+}
+
+static void get_stats(struct compositor *compositor,
+		struct wlr_scene_output_stats *stats) {
+	CHECK(wlr_scene_output_get_stats(compositor->scene_output, stats));
+}
+
+int main(void) {
+	struct test_server server;
+	if (!test_server_init(&server, NULL, NULL)) {
+		fprintf(stderr, "failed to create the server\n");
+		return EXIT_FAILURE;
+	}
+	struct wlr_scene_output *scene_output =
+		test_server_add_output(&server, SIZE, SIZE);
+	CHECK(scene_output != NULL);
+	if (scene_output == NULL) {
+		test_server_finish(&server);
+		return EXIT_FAILURE;
+	}
+	struct wlr_output *output = scene_output->output;
+	struct wl_event_loop *loop = wl_display_get_event_loop(server.display);
+
+	struct compositor compositor = {
+		.scene_output = scene_output,
+		.frame.notify = handle_frame,
+		.commit.notify = handle_commit,
+	};
+	wl_signal_add(&output->events.frame, &compositor.frame);
+	wl_signal_add(&output->events.commit, &compositor.commit);
+	wlr_scene_output_set_stats_enabled(scene_output, true);
+	wlr_scene_output_set_render_ahead(scene_output, 1);
+
+	struct wlr_scene_rect *rect = wlr_scene_rect_create(&server.scene->tree,
+		SIZE, SIZE, (float[4]){ 1, 0, 0, 1 });
+	dispatch_until_frame(&server, &compositor, 1);
+	CHECK(output->frame_pending);
+	CHECK(compositor.committed_pixel == 0xFF0000);
+
+	// A change while the frame is pending is rendered right away
+	struct wlr_scene_output_stats before, stats;
+	get_stats(&compositor, &before);
+	wlr_scene_rect_set_color(rect, (float[4]){ 0, 1, 0, 1 });
+	wl_event_loop_dispatch(loop, 0);
+	get_stats(&compositor, &stats);
+	CHECK(stats.frames == before.frames + 1);
+	CHECK(scene_output->render_ahead_len == 1);
+	CHECK(compositor.frames == 1);
+	CHECK(compositor.committed_pixel == 0xFF0000);
+
+	// And committed on the frame event without rendering again
+	dispatch_until_frame(&server, &compositor, 2);
+	get_stats(&compositor, &stats);
+	CHECK(stats.frames == before.frames + 1);
+	CHECK(stats.render_ahead_hits == before.render_ahead_hits + 1);
+	CHECK(scene_output->render_ahead_len == 0);
+	CHECK(compositor.committed_pixel == 0x00FF00);
+
+	// Another change after rendering ahead drops the frame
+	get_stats(&compositor, &before);
+	wlr_scene_rect_set_color(rect, (float[4]){ 0, 0, 1, 1 });
+	wl_event_loop_dispatch(loop, 0);
+	CHECK(scene_output->render_ahead_len == 1);
+	wlr_scene_rect_set_color(rect, (float[4]){ 1, 1, 1, 1 });
+	wl_event_loop_dispatch(loop, 0);
+	CHECK(scene_output->render_ahead_len == 1);
+	dispatch_until_frame(&server, &compositor, 3);
+	get_stats(&compositor, &stats);
+	CHECK(stats.frames == before.frames + 2);
+	CHECK(stats.render_ahead_drops == before.render_ahead_drops + 1);
+	CHECK(stats.render_ahead_hits == before.render_ahead_hits);
+	CHECK(compositor.committed_pixel == 0xFFFFFF);
+
+	wl_list_remove(&compositor.frame.link);
+	wl_list_remove(&compositor.commit.link);
+	test_server_finish(&server);
+	return test_failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
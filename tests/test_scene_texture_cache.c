@@ -0,0 +1,178 @@
+#include <drm_fourcc.h>
+#include <stdlib.h>
+#include <wlr/interfaces/wlr_buffer.h>
+#include "common.h"
+#include "renderer.h"
+
+#define SIZE 256
+#define PATCH 16
+
+static void fill(struct wlr_buffer *buffer, struct wlr_box *box,
+		uint32_t pixel) {
+	void *data;
+	uint32_t format;
+	size_t stride;
+	if (!wlr_buffer_begin_data_ptr_access(buffer,
+			WLR_BUFFER_DATA_PTR_ACCESS_WRITE, &data, &format, &stride)) {
+		return;
+	}
+	for (int y = box->y; y < box->y + box->height; y++) {
+		uint32_t *row = (uint32_t *)((char *)data + y * stride);
+		for (int x = box->x; x < box->x + box->width; x++) {
+			row[x] = pixel;
+		}
+	}
+	wlr_buffer_end_data_ptr_access(buffer);
+}
+
+struct buffer_watch {
+	int released;
+	bool destroyed;
+	struct wl_listener release;
+	struct wl_listener destroy;
+};
+
+static void handle_release(struct wl_listener *listener, void *data) {
+	struct buffer_watch *watch = wl_container_of(listener, watch, release);
+	watch->released++;
+}
+
+static void handle_destroy(struct wl_listener *listener, void *data) {
+	struct buffer_watch *watch = wl_container_of(listener, watch, destroy);
+	watch->destroyed = true;
+	wl_list_remove(&watch->release.link);
+	wl_list_remove(&watch->destroy.link);
+}
+
+static void watch_buffer(struct buffer_watch *watch, struct wlr_buffer *buffer) {
+	watch->release.notify = handle_release;
+	wl_signal_add(&buffer->events.release, &watch->release);
+	watch->destroy.notify = handle_destroy;
+	wl_signal_add(&buffer->events.destroy, &watch->destroy);
+}
+
+/**
+ * The pixman renderer wraps buffers rather than uploading them, and keeps its
+ * textures attached to them itself: the texture of each buffer is reused
+ * without keeping the buffer from being released.
+ */
+static void test_pixman(void) {
+	struct test_server server;
+	if (!test_server_init(&server, NULL, NULL)) {
+		CHECK(false);
+		return;
+	}
+	struct wlr_scene_output *scene_output =
+		test_server_add_output(&server, 2 * SIZE, 2 * SIZE);
+	CHECK(scene_output != NULL);
+
+	struct wlr_buffer *buffers[2] = {
+		test_buffer_create(SIZE, SIZE, DRM_FORMAT_XRGB8888, 0xFF000000),
+		test_buffer_create(SIZE, SIZE, DRM_FORMAT_XRGB8888, 0xFF0000FF),
+	};
+	struct buffer_watch watch = {0};
+	watch_buffer(&watch, buffers[0]);
+
+	struct wlr_scene_buffer *scene_buffer =
+		wlr_scene_buffer_create(&server.scene->tree, buffers[0]);
+	test_output_commit(scene_output);
+	struct wlr_texture *texture = scene_buffer->texture;
+	CHECK(texture != NULL);
+
+	wlr_scene_buffer_set_buffer(scene_buffer, buffers[1]);
+	test_output_commit(scene_output);
+	CHECK(scene_buffer->texture != NULL && scene_buffer->texture != texture);
+	CHECK(watch.released == 1);
+
+	wlr_scene_buffer_set_buffer(scene_buffer, buffers[0]);
+	test_output_commit(scene_output);
+	CHECK(scene_buffer->texture == texture);
+
+	wlr_scene_buffer_set_buffer(scene_buffer, NULL);
+	CHECK(watch.released == 2);
+	wlr_buffer_drop(buffers[0]);
+	wlr_buffer_drop(buffers[1]);
+	CHECK(watch.destroyed);
+
+	test_server_finish(&server);
+}
+
+int main(void) {
+	test_pixman();
+
+	struct test_server server;
+	if (!test_server_init(&server, NULL, test_renderer_create)) {
+		return EXIT_FAILURE;
+	}
+	const struct test_renderer_stats *stats =
+		test_renderer_get_stats(server.renderer);
+
+	// The output is larger than the buffer, which is never scanned out
+	struct wlr_scene_output *scene_output =
+		test_server_add_output(&server, 2 * SIZE, 2 * SIZE);
+	CHECK(scene_output != NULL);
+
+	struct wlr_buffer *buffers[2] = {
+		test_buffer_create(SIZE, SIZE, DRM_FORMAT_XRGB8888, 0xFF000000),
+		test_buffer_create(SIZE, SIZE, DRM_FORMAT_XRGB8888, 0xFF0000FF),
+	};
+	struct wlr_scene_buffer *scene_buffer =
+		wlr_scene_buffer_create(&server.scene->tree, buffers[0]);
+	test_output_commit(scene_output);
+	CHECK(stats->textures_created == 1);
+	CHECK(stats->last_drawn != NULL &&
+		test_texture_matches_buffer(stats->last_drawn, buffers[0]));
+
+	wlr_scene_buffer_set_buffer(scene_buffer, buffers[1]);
+	test_output_commit(scene_output);
+	CHECK(stats->textures_created == 2);
+
+	// Alternate between the buffers, redrawing a small patch of each: the
+	// texture of each buffer is reused and only the damage is uploaded
+	for (int i = 0; i < 8; i++) {
+		struct wlr_buffer *buffer = buffers[i % 2];
+		struct wlr_box box = { i * PATCH, i * PATCH, PATCH, PATCH };
+		fill(buffer, &box, 0xFF000000 | (i * 0x20) << 8);
+
+		pixman_region32_t damage;
+		pixman_region32_init_rect(&damage,
+			box.x, box.y, box.width, box.height);
+		uint64_t upload_bytes = stats->upload_bytes;
+		wlr_scene_buffer_set_buffer_with_damage(scene_buffer, buffer,
+			&damage);
+		pixman_region32_fini(&damage);
+		test_output_commit(scene_output);
+
+		CHECK(stats->textures_created == 2);
+		// The second buffer was set without damage, the first one catches
+		// up with it once
+		CHECK(i == 0 ||
+			stats->upload_bytes - upload_bytes <= 2 * PATCH * PATCH * 4);
+		CHECK(stats->last_drawn != NULL &&
+			test_texture_matches_buffer(stats->last_drawn, buffer));
+	}
+
+	// Without a buffer in between, the damage history doesn't apply anymore:
+	// the cached texture is updated as a whole
+	wlr_scene_buffer_set_buffer(scene_buffer, NULL);
+	test_output_commit(scene_output);
+	struct wlr_box box = { 0, 0, SIZE, PATCH };
+	fill(buffers[0], &box, 0xFFFFFFFF);
+	uint64_t upload_bytes = stats->upload_bytes;
+	wlr_scene_buffer_set_buffer(scene_buffer, buffers[0]);
+	test_output_commit(scene_output);
+	CHECK(stats->textures_created == 2);
+	CHECK(stats->upload_bytes - upload_bytes == SIZE * SIZE * 4);
+	CHECK(stats->last_drawn != NULL &&
+		test_texture_matches_buffer(stats->last_drawn, buffers[0]));
+
+	// Cached textures go away with their buffer
+	uint64_t textures_destroyed = stats->textures_destroyed;
+	wlr_scene_buffer_set_buffer(scene_buffer, NULL);
+	wlr_buffer_drop(buffers[0]);
+	wlr_buffer_drop(buffers[1]);
+	CHECK(stats->textures_destroyed == textures_destroyed + 2);
+
+	test_server_finish(&server);
+	return test_failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,97 @@
+#include <drm_fourcc.h>
+#include <stdlib.h>
+#include <wlr/render/drm_format_set.h>
+#include "common.h"
+#include "render/allocator/shm.h"
+#include "render/swapchain.h"
+
+/**
+ * Swap chain buffers left unused by the in-flight depth observed over
+ * WLR_SWAPCHAIN_TRIM_PERIOD acquisitions are released, down to one spare
+ * buffer and at least two buffers.
+ */
+
+#define SIZE 16
+
+static int count_buffers(struct wlr_swapchain *swapchain) {
+	int n = 0;
+	for (size_t i = 0; i < WLR_SWAPCHAIN_CAP; i++) {
+		if (swapchain->slots[i].buffer != NULL) {
+			n++;
+		}
+	}
+	return n;
+}
+
+/**
+ * Acquire and submit n buffers at once, then release them.
+ */
+static void render_frames(struct wlr_swapchain *swapchain, int in_flight) {
+	struct wlr_buffer *buffers[WLR_SWAPCHAIN_CAP];
+	for (int i = 0; i < in_flight; i++) {
+		buffers[i] = wlr_swapchain_acquire(swapchain, NULL);
+		CHECK(buffers[i] != NULL);
+		if (buffers[i] != NULL) {
+			wlr_swapchain_set_buffer_submitted(swapchain, buffers[i]);
+		}
+	}
+	for (int i = 0; i < in_flight; i++) {
+		wlr_buffer_unlock(buffers[i]);
+	}
+}
+
+int main(void) {
+	struct wlr_allocator *alloc = wlr_shm_allocator_create();
+	struct wlr_drm_format_set formats = {0};
+	wlr_drm_format_set_add(&formats, DRM_FORMAT_XRGB8888,
+		DRM_FORMAT_MOD_LINEAR);
+	struct wlr_swapchain *swapchain = wlr_swapchain_create(alloc, SIZE, SIZE,
+		wlr_drm_format_set_get(&formats, DRM_FORMAT_XRGB8888));
+	CHECK(swapchain != NULL);
+	if (swapchain == NULL) {
+		return EXIT_FAILURE;
+	}
+	struct wlr_swapchain_stats stats;
+
+	// A burst of three buffers in flight in the first period
+	render_frames(swapchain, 3);
+	for (int i = 3; i < WLR_SWAPCHAIN_TRIM_PERIOD; i++) {
+		render_frames(swapchain, 1);
+	}
+	wlr_swapchain_get_stats(swapchain, &stats);
+	CHECK(stats.acquired == WLR_SWAPCHAIN_TRIM_PERIOD);
+	CHECK(stats.allocated == 3);
+	CHECK(stats.max_in_flight == 3);
+
+	// Three buffers and a spare are kept at the end of the period
+	render_frames(swapchain, 1);
+	wlr_swapchain_get_stats(swapchain, &stats);
+	CHECK(stats.trimmed == 0);
+	CHECK(count_buffers(swapchain) == 3);
+
+	// A period with a single buffer in flight releases one of three
+	for (int i = 1; i < WLR_SWAPCHAIN_TRIM_PERIOD; i++) {
+		render_frames(swapchain, 1);
+	}
+	wlr_swapchain_get_stats(swapchain, &stats);
+	CHECK(stats.trimmed == 0);
+	render_frames(swapchain, 1);
+	wlr_swapchain_get_stats(swapchain, &stats);
+	CHECK(stats.trimmed == 1);
+	CHECK(count_buffers(swapchain) == 2);
+
+	// Two buffers are always kept
+	for (int i = 0; i < 2 * WLR_SWAPCHAIN_TRIM_PERIOD; i++) {
+		render_frames(swapchain, 1);
+	}
+	wlr_swapchain_get_stats(swapchain, &stats);
+	CHECK(stats.trimmed == 1);
+	CHECK(count_buffers(swapchain) == 2);
+	CHECK(stats.allocated == 3);
+	CHECK(stats.failed == 0);
+
+	wlr_swapchain_destroy(swapchain);
+	wlr_drm_format_set_finish(&formats);
+	wlr_allocator_destroy(alloc);
+	return test_failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
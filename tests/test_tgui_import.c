@@ -0,0 +1,275 @@
+#define _POSIX_C_SOURCE 200809L
+#include <drm_fourcc.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <termuxgui/stub.h>
+#include <unistd.h>
+#include <wlr/backend/termuxgui.h>
+#include <wlr/interfaces/wlr_buffer.h>
+#include <wlr/render/allocator.h>
+#include <wlr/render/drm_format_set.h>
+#include "backend/termuxgui.h"
+#include "common.h"
+#include "util/shm.h"
+
+/**
+ * Import client dmabufs against the stub Termux:GUI plugin, whose hardware
+ * buffers are memfds: a dmabuf sharing the memory of one of our buffers is
+ * scanned out, any other one is composited and not looked up again until
+ * the allocator creates a new buffer. Client buffers are never looked up.
+ */
+
+#define TIMEOUT_NSEC (5 * 1000000000LL)
+
+struct dmabuf_buffer {
+	struct wlr_buffer base;
+	struct wlr_dmabuf_attributes dmabuf;
+	int get_dmabuf_calls;
+	void *data; // mapped on first access
+};
+
+static size_t dmabuf_buffer_size(struct dmabuf_buffer *buffer) {
+	return (size_t)buffer->dmabuf.stride[0] * buffer->base.height;
+}
+
+static void dmabuf_buffer_destroy(struct wlr_buffer *wlr_buffer) {
+	struct dmabuf_buffer *buffer = wl_container_of(wlr_buffer, buffer, base);
+	if (buffer->data != NULL) {
+		munmap(buffer->data, dmabuf_buffer_size(buffer));
+	}
+	wlr_dmabuf_attributes_finish(&buffer->dmabuf);
+	free(buffer);
+}
+
+static bool dmabuf_buffer_get_dmabuf(struct wlr_buffer *wlr_buffer,
+		struct wlr_dmabuf_attributes *dmabuf) {
+	struct dmabuf_buffer *buffer = wl_container_of(wlr_buffer, buffer, base);
+	buffer->get_dmabuf_calls++;
+	*dmabuf = buffer->dmabuf;
+	return true;
+}
+
+static bool dmabuf_buffer_begin_data_ptr_access(struct wlr_buffer *wlr_buffer,
+		uint32_t flags, void **data, uint32_t *format, size_t *stride) {
+	struct dmabuf_buffer *buffer = wl_container_of(wlr_buffer, buffer, base);
+	if (buffer->data == NULL) {
+		void *ptr = mmap(NULL, dmabuf_buffer_size(buffer),
+			PROT_READ | PROT_WRITE, MAP_SHARED, buffer->dmabuf.fd[0], 0);
+		if (ptr == MAP_FAILED) {
+			return false;
+		}
+		buffer->data = ptr;
+	}
+	*data = buffer->data;
+	*format = buffer->dmabuf.format;
+	*stride = buffer->dmabuf.stride[0];
+	return true;
+}
+
+static void dmabuf_buffer_end_data_ptr_access(struct wlr_buffer *wlr_buffer) {
+	// This space is intentionally left blank
+}
+
+static const struct wlr_buffer_impl dmabuf_buffer_impl = {
+	.destroy = dmabuf_buffer_destroy,
+	.get_dmabuf = dmabuf_buffer_get_dmabuf,
+	.begin_data_ptr_access = dmabuf_buffer_begin_data_ptr_access,
+	.end_data_ptr_access = dmabuf_buffer_end_data_ptr_access,
+};
+
+/**
+ * Create a client buffer with the layout of the given dmabuf, backed by fd
+ * which it takes ownership of.
+ */
+static struct dmabuf_buffer *dmabuf_buffer_create(int width, int height,
+		const struct wlr_dmabuf_attributes *attribs, int fd) {
+	struct dmabuf_buffer *buffer = calloc(1, sizeof(*buffer));
+	if (buffer == NULL) {
+		close(fd);
+		return NULL;
+	}
+	wlr_buffer_init(&buffer->base, &dmabuf_buffer_impl, width, height);
+	buffer->dmabuf = *attribs;
+	buffer->dmabuf.fd[0] = fd;
+	return buffer;
+}
+
+static struct wlr_buffer *allocate(struct test_server *server,
+		int width, int height) {
+	struct wlr_drm_format_set formats = {0};
+	wlr_drm_format_set_add(&formats, DRM_FORMAT_XBGR8888,
+		DRM_FORMAT_MOD_LINEAR);
+	struct wlr_buffer *buffer = wlr_allocator_create_buffer(server->allocator,
+		width, height, wlr_drm_format_set_get(&formats, DRM_FORMAT_XBGR8888));
+	wlr_drm_format_set_finish(&formats);
+	return buffer;
+}
+
+static void get_stats(struct wlr_scene_output *scene_output,
+		struct wlr_scene_output_stats *stats) {
+	CHECK(wlr_scene_output_get_stats(scene_output, stats));
+}
+
+/**
+ * Commit the scene and run the event loop until the stub plugin got the
+ * frame.
+ */
+static bool commit_and_present(struct test_server *server,
+		struct wlr_scene_output *scene_output) {
+	struct tgui_stub_stats before, after;
+	tgui_stub_get_stats(&before);
+	if (!wlr_scene_output_commit(scene_output)) {
+		return false;
+	}
+
+	struct wl_event_loop *loop = wl_display_get_event_loop(server->display);
+	int64_t deadline = test_get_time_nsec() + TIMEOUT_NSEC;
+	do {
+		if (test_get_time_nsec() > deadline) {
+			return false;
+		}
+		wl_event_loop_dispatch(loop, 10);
+		tgui_stub_get_stats(&after);
+	} while (after.presents == before.presents ||
+		scene_output->output->frame_pending);
+	return true;
+}
+
+static void test_import(struct test_server *server,
+		struct wlr_buffer *native, int width, int height) {
+	struct wlr_dmabuf_attributes attribs;
+	CHECK(wlr_buffer_get_dmabuf(native, &attribs));
+
+	// A client buffer sharing the memory of ours is ours
+	struct dmabuf_buffer *alias = dmabuf_buffer_create(width, height,
+		&attribs, dup(attribs.fd[0]));
+	CHECK(alias != NULL);
+	struct wlr_tgui_buffer *imported =
+		tgui_buffer_import(server->allocator, &alias->base);
+	CHECK(imported != NULL && &imported->wlr_buffer == native);
+
+	// Unless a client committed it, clients can't get hold of our buffers
+	wlr_buffer_lock(&alias->base);
+	struct wlr_client_buffer *client_buffer =
+		wlr_client_buffer_create(&alias->base, server->renderer);
+	wlr_buffer_unlock(&alias->base);
+	CHECK(client_buffer != NULL);
+	if (client_buffer != NULL) {
+		int calls = alias->get_dmabuf_calls;
+		CHECK(tgui_buffer_import(server->allocator,
+			&client_buffer->base) == NULL);
+		CHECK(alias->get_dmabuf_calls == calls);
+		wlr_buffer_drop(&client_buffer->base);
+	}
+
+	// Not with another size, though
+	struct dmabuf_buffer *smaller = dmabuf_buffer_create(width / 2, height,
+		&attribs, dup(attribs.fd[0]));
+	CHECK(smaller != NULL);
+	CHECK(tgui_buffer_import(server->allocator, &smaller->base) == NULL);
+	wlr_buffer_drop(&smaller->base);
+
+	// Foreign memory of the same layout isn't
+	struct dmabuf_buffer *foreign = dmabuf_buffer_create(width, height,
+		&attribs, allocate_shm_file(attribs.stride[0] * height));
+	CHECK(foreign != NULL && foreign->dmabuf.fd[0] >= 0);
+	CHECK(tgui_buffer_import(server->allocator, &foreign->base) == NULL);
+	CHECK(foreign->get_dmabuf_calls == 1);
+
+	// And isn't looked up again while the allocator has the same buffers
+	CHECK(tgui_buffer_import(server->allocator, &foreign->base) == NULL);
+	CHECK(foreign->get_dmabuf_calls == 1);
+
+	struct wlr_buffer *other = allocate(server, width, height);
+	CHECK(other != NULL);
+	CHECK(tgui_buffer_import(server->allocator, &foreign->base) == NULL);
+	CHECK(foreign->get_dmabuf_calls == 2);
+	wlr_buffer_drop(other);
+
+	// Buffers without a dmabuf can't be imported
+	struct wlr_buffer *shm = test_buffer_create(width, height,
+		DRM_FORMAT_XRGB8888, 0xff000000);
+	CHECK(shm != NULL);
+	CHECK(tgui_buffer_import(server->allocator, shm) == NULL);
+	wlr_buffer_drop(shm);
+
+	wlr_buffer_drop(&alias->base);
+	wlr_buffer_drop(&foreign->base);
+}
+
+static void test_scanout(struct test_server *server,
+		struct wlr_output *output, struct wlr_buffer *native) {
+	struct wlr_scene_output *scene_output =
+		wlr_scene_output_create(server->scene, output);
+	CHECK(scene_output != NULL);
+	wlr_scene_output_set_stats_enabled(scene_output, true);
+	struct wlr_scene_output_stats stats;
+
+	struct wlr_dmabuf_attributes attribs;
+	CHECK(wlr_buffer_get_dmabuf(native, &attribs));
+	struct dmabuf_buffer *alias = dmabuf_buffer_create(output->width,
+		output->height, &attribs, dup(attribs.fd[0]));
+	CHECK(alias != NULL);
+	struct dmabuf_buffer *foreign = dmabuf_buffer_create(output->width,
+		output->height, &attribs,
+		allocate_shm_file(attribs.stride[0] * output->height));
+	CHECK(foreign != NULL);
+
+	// A fullscreen client rendering into our memory is scanned out
+	struct wlr_scene_buffer *scene_buffer =
+		wlr_scene_buffer_create(&server->scene->tree, &alias->base);
+	CHECK(commit_and_present(server, scene_output));
+	get_stats(scene_output, &stats);
+	CHECK(stats.scanout_hits == 1);
+	CHECK(stats.frames == 0);
+
+	// Any other one is composited
+	wlr_scene_buffer_set_buffer(scene_buffer, &foreign->base);
+	CHECK(commit_and_present(server, scene_output));
+	get_stats(scene_output, &stats);
+	CHECK(stats.scanout_misses == 1);
+	CHECK(stats.frames == 1);
+	int calls = foreign->get_dmabuf_calls;
+
+	// Without looking its memory up on every frame
+	wlr_scene_buffer_set_buffer_with_damage(scene_buffer, &foreign->base,
+		NULL);
+	CHECK(commit_and_present(server, scene_output));
+	get_stats(scene_output, &stats);
+	CHECK(stats.scanout_misses == 2);
+	CHECK(foreign->get_dmabuf_calls == calls);
+
+	wlr_scene_node_destroy(&scene_buffer->node);
+	wlr_buffer_drop(&alias->base);
+	wlr_buffer_drop(&foreign->base);
+	wlr_scene_output_destroy(scene_output);
+}
+
+int main(void) {
+	setenv("WLR_TGUI_STUB_VIEW_SIZE", "320x240", false);
+	setenv("WLR_TGUI_STUB_PRESENT_USEC", "0", false);
+
+	struct test_server server;
+	if (!test_server_init(&server, wlr_tgui_backend_create, NULL)) {
+		fprintf(stderr, "failed to create the Termux:GUI backend\n");
+		return EXIT_FAILURE;
+	}
+	struct wlr_output *output = test_server_add_tgui_output(&server);
+	CHECK(output != NULL);
+	if (output == NULL) {
+		test_server_finish(&server);
+		return EXIT_FAILURE;
+	}
+
+	struct wlr_buffer *native = allocate(&server, output->width,
+		output->height);
+	CHECK(native != NULL);
+	if (native != NULL) {
+		test_import(&server, native, output->width, output->height);
+		test_scanout(&server, output, native);
+		wlr_buffer_drop(native);
+	}
+
+	test_server_finish(&server);
+	return test_failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,151 @@
+#define _POSIX_C_SOURCE 200809L
+#include <drm_fourcc.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <termuxgui/stub.h>
+#include <wlr/backend/termuxgui.h>
+#include <wlr/render/drm_format_set.h>
+#include "backend/termuxgui.h"
+#include "common.h"
+
+/**
+ * Hardware buffers prepared ahead of demand by the pool thread of the
+ * allocator, against a stub plugin which takes ALLOC_USEC to create one: a
+ * predicted size is served from the pool without waiting for the plugin, and
+ * the predictions of different outputs don't evict each other's buffers.
+ */
+
+#define ALLOC_USEC 20000
+#define TIMEOUT_NSEC (5 * 1000000000LL)
+
+static size_t get_pool_len(struct test_server *server) {
+	struct wlr_tgui_allocator *alloc =
+		wl_container_of(server->allocator, alloc, wlr_allocator);
+	pthread_mutex_lock(&alloc->pool_mutex);
+	size_t len = alloc->pool_len;
+	pthread_mutex_unlock(&alloc->pool_mutex);
+	return len;
+}
+
+/**
+ * Run the event loop until the pool holds len buffers.
+ */
+static bool wait_pool_len(struct test_server *server, size_t len) {
+	struct wl_event_loop *loop = wl_display_get_event_loop(server->display);
+	int64_t deadline = test_get_time_nsec() + TIMEOUT_NSEC;
+	while (get_pool_len(server) != len) {
+		if (test_get_time_nsec() > deadline) {
+			return false;
+		}
+		wl_event_loop_dispatch(loop, 10);
+	}
+	return true;
+}
+
+static void prefetch(struct test_server *server, const void *owner,
+		int width, int height) {
+	struct wlr_tgui_pool_hint hint = {
+		.width = width,
+		.height = height,
+		.format = DRM_FORMAT_XBGR8888,
+	};
+	tgui_allocator_prefetch(server->allocator, owner, &hint, 1);
+}
+
+/**
+ * Allocate a buffer and check whether the stub plugin created one for it.
+ */
+static struct wlr_buffer *allocate(struct test_server *server,
+		int width, int height, bool *created) {
+	struct wlr_drm_format_set formats = {0};
+	wlr_drm_format_set_add(&formats, DRM_FORMAT_XBGR8888,
+		DRM_FORMAT_MOD_LINEAR);
+	struct tgui_stub_stats before, after;
+	tgui_stub_get_stats(&before);
+	struct wlr_buffer *buffer = wlr_allocator_create_buffer(server->allocator,
+		width, height, wlr_drm_format_set_get(&formats, DRM_FORMAT_XBGR8888));
+	tgui_stub_get_stats(&after);
+	wlr_drm_format_set_finish(&formats);
+	*created = after.buffers_created != before.buffers_created;
+	return buffer;
+}
+
+static void test_prediction(struct test_server *server, const void *owner) {
+	prefetch(server, owner, 64, 64);
+	CHECK(wait_pool_len(server, TGUI_POOL_PREFETCH));
+
+	// Served from the pool, without waiting for the plugin
+	bool created;
+	int64_t start = test_get_time_nsec();
+	struct wlr_buffer *buffer = allocate(server, 64, 64, &created);
+	int64_t elapsed = test_get_time_nsec() - start;
+	CHECK(buffer != NULL);
+	CHECK(!created);
+	CHECK(elapsed < ALLOC_USEC * 1000LL);
+	CHECK(get_pool_len(server) == TGUI_POOL_PREFETCH - 1);
+
+	// Released buffers of a predicted size go back to the pool
+	wlr_buffer_drop(buffer);
+	CHECK(get_pool_len(server) == TGUI_POOL_PREFETCH);
+
+	// Other sizes are created synchronously
+	start = test_get_time_nsec();
+	buffer = allocate(server, 48, 48, &created);
+	elapsed = test_get_time_nsec() - start;
+	CHECK(buffer != NULL);
+	CHECK(created);
+	CHECK(elapsed >= ALLOC_USEC * 1000LL);
+	wlr_buffer_drop(buffer);
+	CHECK(get_pool_len(server) == TGUI_POOL_PREFETCH);
+}
+
+static void test_owners(struct test_server *server, const void *first,
+		const void *second) {
+	prefetch(server, second, 96, 96);
+	CHECK(wait_pool_len(server, 2 * TGUI_POOL_PREFETCH));
+
+	// A new prediction of the first owner only drops its own buffers
+	prefetch(server, first, 128, 128);
+	CHECK(wait_pool_len(server, 2 * TGUI_POOL_PREFETCH));
+	bool created;
+	struct wlr_buffer *buffer = allocate(server, 96, 96, &created);
+	CHECK(buffer != NULL && !created);
+	wlr_buffer_drop(buffer);
+	buffer = allocate(server, 128, 128, &created);
+	CHECK(buffer != NULL && !created);
+	wlr_buffer_drop(buffer);
+
+	// Two owners predicting the same size, forgetting one keeps the buffers
+	prefetch(server, first, 96, 96);
+	CHECK(wait_pool_len(server, TGUI_POOL_PREFETCH));
+	tgui_allocator_prefetch(server->allocator, first, NULL, 0);
+	CHECK(get_pool_len(server) == TGUI_POOL_PREFETCH);
+	buffer = allocate(server, 96, 96, &created);
+	CHECK(buffer != NULL && !created);
+	wlr_buffer_drop(buffer);
+
+	// Forgetting the last one drops them
+	tgui_allocator_prefetch(server->allocator, second, NULL, 0);
+	CHECK(get_pool_len(server) == 0);
+}
+
+int main(void) {
+	char alloc_usec[16];
+	snprintf(alloc_usec, sizeof(alloc_usec), "%d", ALLOC_USEC);
+	setenv("WLR_TGUI_STUB_ALLOC_USEC", alloc_usec, true);
+
+	struct test_server server;
+	if (!test_server_init(&server, wlr_tgui_backend_create, NULL)) {
+		fprintf(stderr, "failed to create the Termux:GUI backend\n");
+		test_server_finish(&server);
+		return EXIT_FAILURE;
+	}
+
+	// Owners stand for outputs
+	int owners[2];
+	test_prediction(&server, &owners[0]);
+	test_owners(&server, &owners[0], &owners[1]);
+
+	test_server_finish(&server);
+	return test_failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,401 @@
+#define _POSIX_C_SOURCE 200809L
+#include <linux/input-event-codes.h>
+#include <stdlib.h>
+#include <termuxgui/termuxgui.h>
+#include <wlr/backend/termuxgui.h>
+#include <wlr/types/wlr_pointer.h>
+#include <wlr/types/wlr_touch.h>
+#include "common.h"
+#include "trace.h"
+
+/**
+ * Replay touch traces against the stub Termux:GUI plugin, and check the
+ * events the backend emits: touch points with their ids, and in pointer
+ * emulation mode, taps of the first finger and two-finger scrolling
+ * accumulated per output.
+ *
+ * Every trace ends on an activity gating it, see test_trace_run_gate().
+ */
+
+#define MAX_RECORDS 32
+
+/**
+ * Collects the input devices of the outputs, in the order they're added.
+ */
+struct devices {
+	struct wlr_touch *touch[3];
+	struct wlr_pointer *pointer[3];
+	size_t touch_len, pointer_len;
+	struct wl_listener new_input;
+};
+
+static void handle_new_input(struct wl_listener *listener, void *data) {
+	struct devices *devices = wl_container_of(listener, devices, new_input);
+	struct wlr_input_device *device = data;
+	switch (device->type) {
+	case WLR_INPUT_DEVICE_TOUCH:
+		if (devices->touch_len < 3) {
+			devices->touch[devices->touch_len++] =
+				wlr_touch_from_input_device(device);
+		}
+		break;
+	case WLR_INPUT_DEVICE_POINTER:
+		if (devices->pointer_len < 3) {
+			devices->pointer[devices->pointer_len++] =
+				wlr_pointer_from_input_device(device);
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+enum record_type {
+	RECORD_DOWN,
+	RECORD_UP,
+	RECORD_MOTION,
+	RECORD_CANCEL,
+};
+
+struct touch_record {
+	enum record_type type;
+	int32_t id;
+	double x, y;
+};
+
+struct touch_log {
+	struct touch_record records[MAX_RECORDS];
+	size_t len;
+	int frames;
+
+	struct wl_listener down, up, motion, cancel, frame;
+};
+
+static void touch_log_add(struct touch_log *log, enum record_type type,
+		int32_t id, double x, double y) {
+	if (log->len < MAX_RECORDS) {
+		log->records[log->len++] = (struct touch_record){
+			.type = type,
+			.id = id,
+			.x = x,
+			.y = y,
+		};
+	}
+}
+
+static void touch_handle_down(struct wl_listener *listener, void *data) {
+	struct touch_log *log = wl_container_of(listener, log, down);
+	struct wlr_touch_down_event *event = data;
+	touch_log_add(log, RECORD_DOWN, event->touch_id, event->x, event->y);
+}
+
+static void touch_handle_up(struct wl_listener *listener, void *data) {
+	struct touch_log *log = wl_container_of(listener, log, up);
+	struct wlr_touch_up_event *event = data;
+	touch_log_add(log, RECORD_UP, event->touch_id, 0, 0);
+}
+
+static void touch_handle_motion(struct wl_listener *listener, void *data) {
+	struct touch_log *log = wl_container_of(listener, log, motion);
+	struct wlr_touch_motion_event *event = data;
+	touch_log_add(log, RECORD_MOTION, event->touch_id, event->x, event->y);
+}
+
+static void touch_handle_cancel(struct wl_listener *listener, void *data) {
+	struct touch_log *log = wl_container_of(listener, log, cancel);
+	struct wlr_touch_cancel_event *event = data;
+	touch_log_add(log, RECORD_CANCEL, event->touch_id, 0, 0);
+}
+
+static void touch_handle_frame(struct wl_listener *listener, void *data) {
+	struct touch_log *log = wl_container_of(listener, log, frame);
+	log->frames++;
+}
+
+static void check_record(const struct touch_log *log, size_t i,
+		enum record_type type, int32_t id, double x, double y) {
+	CHECK(i < log->len);
+	if (i >= log->len) {
+		return;
+	}
+	const struct touch_record *record = &log->records[i];
+	CHECK(record->type == type);
+	CHECK(record->id == id);
+	CHECK(record->x == x && record->y == y);
+}
+
+static void test_touch(void) {
+	struct test_trace trace;
+	CHECK(test_trace_open(&trace));
+	test_trace_activity(&trace, 1, 400, 300);
+	test_trace_event(&trace, 2, TGUI_EVENT_CREATE);
+
+	// Two fingers, the first one lifted before the second one is cancelled
+	test_trace_touch(&trace, 1, TGUI_TOUCH_DOWN, 0,
+		TEST_TRACE_POINTERS({ 7, 100, 150 }));
+	test_trace_touch(&trace, 1, TGUI_TOUCH_POINTER_DOWN, 1,
+		TEST_TRACE_POINTERS({ 7, 100, 150 }, { 3, 200, 75 }));
+	test_trace_touch(&trace, 1, TGUI_TOUCH_MOVE, 0,
+		TEST_TRACE_POINTERS({ 7, 120, 150 }, { 3, 200, 90 }));
+	test_trace_touch(&trace, 1, TGUI_TOUCH_POINTER_UP, 0,
+		TEST_TRACE_POINTERS({ 7, 120, 150 }, { 3, 200, 90 }));
+	test_trace_touch(&trace, 1, TGUI_TOUCH_MOVE, 0,
+		TEST_TRACE_POINTERS({ 3, 220, 90 }));
+	test_trace_touch(&trace, 1, TGUI_TOUCH_CANCEL, 0,
+		TEST_TRACE_POINTERS({ 3, 220, 90 }));
+
+	// Ids are reused by later touches
+	test_trace_touch(&trace, 1, TGUI_TOUCH_DOWN, 0,
+		TEST_TRACE_POINTERS({ 7, 0, 300 }));
+	test_trace_touch(&trace, 1, TGUI_TOUCH_UP, 0,
+		TEST_TRACE_POINTERS({ 7, 0, 300 }));
+	test_trace_event(&trace, 2, TGUI_EVENT_DESTROY);
+	CHECK(test_trace_close(&trace));
+
+	setenv("WLR_TGUI_REPLAY", trace.path, true);
+	setenv("WLR_TGUI_TOUCH_MODE", "touch", true);
+	struct test_server server;
+	if (!test_server_init(&server, wlr_tgui_backend_create, NULL)) {
+		CHECK(!"failed to create the Termux:GUI backend");
+		test_server_finish(&server);
+		test_trace_remove(&trace);
+		return;
+	}
+
+	struct devices devices = { .new_input.notify = handle_new_input };
+	wl_signal_add(&server.backend->events.new_input, &devices.new_input);
+	struct wlr_output *output = test_server_add_tgui_output(&server);
+	wl_list_remove(&devices.new_input.link);
+	CHECK(output != NULL && output->width == 400 && output->height == 300);
+	CHECK(devices.touch_len == 1);
+	if (output == NULL || devices.touch_len != 1) {
+		test_server_finish(&server);
+		test_trace_remove(&trace);
+		return;
+	}
+
+	struct touch_log log = {
+		.down.notify = touch_handle_down,
+		.up.notify = touch_handle_up,
+		.motion.notify = touch_handle_motion,
+		.cancel.notify = touch_handle_cancel,
+		.frame.notify = touch_handle_frame,
+	};
+	struct wlr_touch *touch = devices.touch[0];
+	wl_signal_add(&touch->events.down, &log.down);
+	wl_signal_add(&touch->events.up, &log.up);
+	wl_signal_add(&touch->events.motion, &log.motion);
+	wl_signal_add(&touch->events.cancel, &log.cancel);
+	wl_signal_add(&touch->events.frame, &log.frame);
+
+	CHECK(test_trace_run_gate(&server));
+
+	CHECK(log.len == 9);
+	CHECK(log.frames == 8);
+	check_record(&log, 0, RECORD_DOWN, 7, 0.25, 0.5);
+	check_record(&log, 1, RECORD_DOWN, 3, 0.5, 0.25);
+	check_record(&log, 2, RECORD_MOTION, 7, 0.3, 0.5);
+	check_record(&log, 3, RECORD_MOTION, 3, 0.5, 0.3);
+	check_record(&log, 4, RECORD_UP, 7, 0, 0);
+	check_record(&log, 5, RECORD_MOTION, 3, 0.55, 0.3);
+	check_record(&log, 6, RECORD_CANCEL, 3, 0, 0);
+	check_record(&log, 7, RECORD_DOWN, 7, 0, 1);
+	check_record(&log, 8, RECORD_UP, 7, 0, 0);
+
+	wl_list_remove(&log.down.link);
+	wl_list_remove(&log.up.link);
+	wl_list_remove(&log.motion.link);
+	wl_list_remove(&log.cancel.link);
+	wl_list_remove(&log.frame.link);
+	test_server_finish(&server);
+	test_trace_remove(&trace);
+}
+
+struct axis_record {
+	int output;
+	int32_t delta_discrete;
+};
+
+struct button_record {
+	int output;
+	uint32_t button;
+	enum wlr_button_state state;
+};
+
+struct pointer_log {
+	struct axis_record axis[MAX_RECORDS];
+	size_t axis_len;
+	struct button_record buttons[MAX_RECORDS];
+	size_t buttons_len;
+
+	struct wl_listener axis_listeners[2], button[2];
+};
+
+static void pointer_log_axis(struct pointer_log *log, int output,
+		struct wlr_pointer_axis_event *event) {
+	if (log->axis_len < MAX_RECORDS) {
+		log->axis[log->axis_len++] = (struct axis_record){
+			.output = output,
+			.delta_discrete = event->delta_discrete,
+		};
+	}
+}
+
+static void handle_axis_0(struct wl_listener *listener, void *data) {
+	struct pointer_log *log =
+		wl_container_of(listener, log, axis_listeners[0]);
+	pointer_log_axis(log, 0, data);
+}
+
+static void handle_axis_1(struct wl_listener *listener, void *data) {
+	struct pointer_log *log =
+		wl_container_of(listener, log, axis_listeners[1]);
+	pointer_log_axis(log, 1, data);
+}
+
+static void pointer_log_button(struct pointer_log *log, int output,
+		struct wlr_pointer_button_event *event) {
+	if (log->buttons_len < MAX_RECORDS) {
+		log->buttons[log->buttons_len++] = (struct button_record){
+			.output = output,
+			.button = event->button,
+			.state = event->state,
+		};
+	}
+}
+
+static void handle_button_0(struct wl_listener *listener, void *data) {
+	struct pointer_log *log = wl_container_of(listener, log, button[0]);
+	pointer_log_button(log, 0, data);
+}
+
+static void handle_button_1(struct wl_listener *listener, void *data) {
+	struct pointer_log *log = wl_container_of(listener, log, button[1]);
+	pointer_log_button(log, 1, data);
+}
+
+static void test_pointer_emulation(void) {
+	// Both outputs scroll every 150 px, a fraction of their height apart
+	struct test_trace trace;
+	CHECK(test_trace_open(&trace));
+	test_trace_activity(&trace, 1, 400, 300);
+	test_trace_activity(&trace, 2, 400, 600);
+	test_trace_event(&trace, 3, TGUI_EVENT_CREATE);
+
+	// Interleaved two-finger swipes, which only scroll once their own
+	// output has seen 150 px of movement
+	test_trace_touch(&trace, 1, TGUI_TOUCH_DOWN, 0,
+		TEST_TRACE_POINTERS({ 1, 200, 200 }));
+	test_trace_touch(&trace, 2, TGUI_TOUCH_DOWN, 0,
+		TEST_TRACE_POINTERS({ 1, 200, 400 }));
+	test_trace_touch(&trace, 1, TGUI_TOUCH_MOVE, 0,
+		TEST_TRACE_POINTERS({ 1, 200, 100 }, { 2, 250, 100 }));
+	test_trace_touch(&trace, 2, TGUI_TOUCH_MOVE, 0,
+		TEST_TRACE_POINTERS({ 1, 200, 300 }, { 2, 250, 300 }));
+	test_trace_touch(&trace, 1, TGUI_TOUCH_MOVE, 0,
+		TEST_TRACE_POINTERS({ 1, 200, 40 }, { 2, 250, 40 }));
+	test_trace_touch(&trace, 2, TGUI_TOUCH_MOVE, 0,
+		TEST_TRACE_POINTERS({ 1, 200, 240 }, { 2, 250, 240 }));
+
+	// And back down on the first output
+	test_trace_touch(&trace, 1, TGUI_TOUCH_MOVE, 0,
+		TEST_TRACE_POINTERS({ 1, 200, 100 }, { 2, 250, 100 }));
+	test_trace_touch(&trace, 1, TGUI_TOUCH_MOVE, 0,
+		TEST_TRACE_POINTERS({ 1, 200, 200 }, { 2, 250, 200 }));
+	test_trace_touch(&trace, 1, TGUI_TOUCH_UP, 0,
+		TEST_TRACE_POINTERS({ 1, 200, 200 }));
+	test_trace_touch(&trace, 2, TGUI_TOUCH_UP, 0,
+		TEST_TRACE_POINTERS({ 1, 200, 240 }));
+
+	// A tap on the second output, during which another finger comes and
+	// goes: only the finger which went down first clicks
+	test_trace_touch(&trace, 2, TGUI_TOUCH_DOWN, 0,
+		TEST_TRACE_POINTERS({ 5, 100, 100 }));
+	test_trace_touch(&trace, 2, TGUI_TOUCH_POINTER_DOWN, 1,
+		TEST_TRACE_POINTERS({ 5, 100, 100 }, { 6, 300, 100 }));
+	test_trace_touch(&trace, 2, TGUI_TOUCH_POINTER_UP, 1,
+		TEST_TRACE_POINTERS({ 5, 100, 100 }, { 6, 300, 100 }));
+	test_trace_touch(&trace, 2, TGUI_TOUCH_UP, 0,
+		TEST_TRACE_POINTERS({ 5, 100, 100 }));
+	test_trace_event(&trace, 3, TGUI_EVENT_DESTROY);
+	CHECK(test_trace_close(&trace));
+
+	setenv("WLR_TGUI_REPLAY", trace.path, true);
+	setenv("WLR_TGUI_TOUCH_MODE", "pointer", true);
+	struct test_server server;
+	if (!test_server_init(&server, wlr_tgui_backend_create, NULL)) {
+		CHECK(!"failed to create the Termux:GUI backend");
+		test_server_finish(&server);
+		test_trace_remove(&trace);
+		return;
+	}
+
+	struct devices devices = { .new_input.notify = handle_new_input };
+	wl_signal_add(&server.backend->events.new_input, &devices.new_input);
+	struct wlr_output *first = test_server_add_tgui_output(&server);
+	struct wlr_output *second = test_server_add_tgui_output(&server);
+	wl_list_remove(&devices.new_input.link);
+	CHECK(first != NULL && first->height == 300);
+	CHECK(second != NULL && second->height == 600);
+	// Touches are only forwarded as such without pointer emulation
+	CHECK(devices.touch_len == 0);
+	CHECK(devices.pointer_len == 2);
+	if (first == NULL || second == NULL || devices.pointer_len != 2) {
+		test_server_finish(&server);
+		test_trace_remove(&trace);
+		return;
+	}
+
+	struct pointer_log log = {
+		.axis_listeners = {
+			{ .notify = handle_axis_0 },
+			{ .notify = handle_axis_1 },
+		},
+		.button = {
+			{ .notify = handle_button_0 },
+			{ .notify = handle_button_1 },
+		},
+	};
+	for (int i = 0; i < 2; i++) {
+		wl_signal_add(&devices.pointer[i]->events.axis,
+			&log.axis_listeners[i]);
+		wl_signal_add(&devices.pointer[i]->events.button, &log.button[i]);
+	}
+
+	CHECK(test_trace_run_gate(&server));
+
+	CHECK(log.axis_len == 3);
+	CHECK(log.buttons_len == 2);
+	if (log.buttons_len == 2) {
+		CHECK(log.buttons[0].output == 1);
+		CHECK(log.buttons[0].button == BTN_LEFT);
+		CHECK(log.buttons[0].state == WLR_BUTTON_PRESSED);
+		CHECK(log.buttons[1].output == 1);
+		CHECK(log.buttons[1].button == BTN_LEFT);
+		CHECK(log.buttons[1].state == WLR_BUTTON_RELEASED);
+	}
+	if (log.axis_len == 3) {
+		CHECK(log.axis[0].output == 0);
+		CHECK(log.axis[0].delta_discrete > 0);
+		CHECK(log.axis[1].output == 1);
+		CHECK(log.axis[1].delta_discrete > 0);
+		CHECK(log.axis[2].output == 0);
+		CHECK(log.axis[2].delta_discrete < 0);
+	}
+
+	for (int i = 0; i < 2; i++) {
+		wl_list_remove(&log.axis_listeners[i].link);
+		wl_list_remove(&log.button[i].link);
+	}
+	test_server_finish(&server);
+	test_trace_remove(&trace);
+}
+
+int main(void) {
+	setenv("WLR_TGUI_REPLAY_SPEED", "0", true);
+
+	test_touch();
+	test_pointer_emulation();
+
+	return test_failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
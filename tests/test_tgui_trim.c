@@ -0,0 +1,115 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <termuxgui/stub.h>
+#include <termuxgui/termuxgui.h>
+#include <wlr/backend/termuxgui.h>
+#include "common.h"
+#include "trace.h"
+
+/**
+ * Pause a Termux:GUI output with WLR_TGUI_TRIM_PAUSED against the stub
+ * plugin: its buffers are released, and damage while it's paused must not
+ * bring them back.
+ */
+
+#define WAIT_NSEC (200 * 1000000LL)
+#define TIMEOUT_NSEC (5 * 1000000000LL)
+
+struct compositor {
+	struct wlr_scene_output *scene_output;
+	int frames;
+	struct wl_listener frame;
+};
+
+static void handle_frame(struct wl_listener *listener, void *data) {
+	struct compositor *compositor =
+		wl_container_of(listener, compositor, frame);
+	compositor->frames++;
+	wlr_scene_output_commit(compositor->scene_output);
+}
+
+static size_t get_resident_bytes(struct test_server *server) {
+	struct wlr_tgui_memory_stats stats;
+	wlr_tgui_backend_get_memory_stats(server->backend, &stats);
+	return stats.resident_bytes;
+}
+
+int main(void) {
+	setenv("WLR_TGUI_REPLAY_SPEED", "0", true);
+	setenv("WLR_TGUI_STUB_PRESENT_USEC", "0", true);
+	setenv("WLR_TGUI_TRIM_PAUSED", "1", true);
+
+	struct test_trace trace;
+	CHECK(test_trace_open(&trace));
+	test_trace_activity(&trace, 1, 320, 240);
+	// The gating activity prefetches buffers for its surface view, keep
+	// them small
+	test_trace_event(&trace, 2, TGUI_EVENT_CREATE);
+	test_trace_view_size(&trace, 2, 16, 16);
+	test_trace_event(&trace, 1, TGUI_EVENT_PAUSE);
+	test_trace_event(&trace, 1, TGUI_EVENT_STOP);
+	test_trace_event(&trace, 2, TGUI_EVENT_DESTROY);
+	CHECK(test_trace_close(&trace));
+	setenv("WLR_TGUI_REPLAY", trace.path, true);
+
+	struct test_server server;
+	if (!test_server_init(&server, wlr_tgui_backend_create, NULL)) {
+		fprintf(stderr, "failed to create the Termux:GUI backend\n");
+		test_server_finish(&server);
+		test_trace_remove(&trace);
+		return EXIT_FAILURE;
+	}
+	struct wlr_output *output = test_server_add_tgui_output(&server);
+	CHECK(output != NULL);
+	if (output == NULL) {
+		test_server_finish(&server);
+		test_trace_remove(&trace);
+		return EXIT_FAILURE;
+	}
+
+	struct compositor compositor = {
+		.scene_output = wlr_scene_output_create(server.scene, output),
+		.frame.notify = handle_frame,
+	};
+	wl_signal_add(&output->events.frame, &compositor.frame);
+	struct wlr_scene_rect *cursor = wlr_scene_rect_create(
+		&server.scene->tree, 8, 16, (float[4]){ 1, 1, 1, 1 });
+
+	// Render and present a first frame
+	struct wl_event_loop *loop = wl_display_get_event_loop(server.display);
+	struct tgui_stub_stats stub_stats;
+	int64_t deadline = test_get_time_nsec() + TIMEOUT_NSEC;
+	do {
+		wl_event_loop_dispatch(loop, 10);
+		tgui_stub_get_stats(&stub_stats);
+	} while ((compositor.frames == 0 || stub_stats.presents == 0) &&
+		test_get_time_nsec() < deadline);
+	CHECK(compositor.frames > 0);
+	size_t resident = get_resident_bytes(&server);
+	CHECK(resident > 0);
+
+	// Pause the activity
+	CHECK(test_trace_run_gate(&server));
+	struct wlr_tgui_memory_stats stats;
+	wlr_tgui_backend_get_memory_stats(server.backend, &stats);
+	CHECK(stats.trims == 1);
+	CHECK(stats.resident_bytes < resident);
+	resident = stats.resident_bytes;
+
+	// A blinking cursor while paused
+	int frames = compositor.frames;
+	for (int i = 0; i < 4; i++) {
+		wlr_scene_node_set_enabled(&cursor->node, i % 2 == 1);
+		deadline = test_get_time_nsec() + WAIT_NSEC / 4;
+		while (test_get_time_nsec() < deadline) {
+			wl_event_loop_dispatch(loop, 10);
+		}
+	}
+	CHECK(compositor.frames == frames);
+	CHECK(get_resident_bytes(&server) <= resident);
+
+	wl_list_remove(&compositor.frame.link);
+	test_server_finish(&server);
+	test_trace_remove(&trace);
+	return test_failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
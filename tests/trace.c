@@ -0,0 +1,127 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <termuxgui/termuxgui.h>
+#include <unistd.h>
+#include <wlr/backend/termuxgui.h>
+#include "trace.h"
+
+bool test_trace_open(struct test_trace *trace) {
+	const char *dir = getenv("TMPDIR");
+	snprintf(trace->path, sizeof(trace->path), "%s/wlr-tgui-trace-XXXXXX",
+		dir != NULL ? dir : "/tmp");
+	int fd = mkstemp(trace->path);
+	if (fd < 0) {
+		return false;
+	}
+	trace->file = fdopen(fd, "w");
+	if (trace->file == NULL) {
+		close(fd);
+		unlink(trace->path);
+		return false;
+	}
+	trace->time_nsec = 0;
+	struct wlr_tgui_trace_header header = {
+		.magic = WLR_TGUI_TRACE_MAGIC,
+		.version = WLR_TGUI_TRACE_VERSION,
+	};
+	return fwrite(&header, sizeof(header), 1, trace->file) == 1;
+}
+
+bool test_trace_close(struct test_trace *trace) {
+	return fclose(trace->file) == 0;
+}
+
+void test_trace_remove(struct test_trace *trace) {
+	unlink(trace->path);
+}
+
+static void trace_write(struct test_trace *trace,
+		enum wlr_tgui_trace_type type, const void *payload, size_t size,
+		const void *extra, size_t extra_size) {
+	trace->time_nsec += 1000000;
+	struct wlr_tgui_trace_record record = {
+		.type = type,
+		.size = size + extra_size,
+		.time_nsec = trace->time_nsec,
+	};
+	CHECK(fwrite(&record, sizeof(record), 1, trace->file) == 1);
+	CHECK(fwrite(payload, size, 1, trace->file) == 1);
+	if (extra_size > 0) {
+		CHECK(fwrite(extra, extra_size, 1, trace->file) == 1);
+	}
+}
+
+void test_trace_event(struct test_trace *trace, int32_t activity,
+		int32_t type) {
+	struct wlr_tgui_trace_event event = {
+		.type = type,
+		.activity = activity,
+	};
+	trace_write(trace, WLR_TGUI_TRACE_EVENT, &event, sizeof(event), NULL, 0);
+}
+
+void test_trace_view_size(struct test_trace *trace, int32_t activity,
+		uint32_t width, uint32_t height) {
+	struct wlr_tgui_trace_view_size size = {
+		.activity = activity,
+		.width = width,
+		.height = height,
+	};
+	trace_write(trace, WLR_TGUI_TRACE_VIEW_SIZE, &size, sizeof(size),
+		NULL, 0);
+}
+
+void test_trace_activity(struct test_trace *trace, int32_t activity,
+		uint32_t width, uint32_t height) {
+	test_trace_event(trace, activity, TGUI_EVENT_CREATE);
+	test_trace_view_size(trace, activity, width, height);
+	test_trace_event(trace, activity, TGUI_EVENT_START);
+	test_trace_event(trace, activity, TGUI_EVENT_RESUME);
+}
+
+void test_trace_touch(struct test_trace *trace, int32_t activity,
+		int32_t action, uint32_t index, uint32_t num_pointers,
+		const struct wlr_tgui_trace_pointer *pointers) {
+	struct wlr_tgui_trace_event event = {
+		.type = TGUI_EVENT_TOUCH,
+		.activity = activity,
+		.touch = {
+			.action = action,
+			.index = index,
+			.num_pointers = num_pointers,
+		},
+	};
+	trace_write(trace, WLR_TGUI_TRACE_EVENT, &event, sizeof(event),
+		pointers, num_pointers * sizeof(*pointers));
+}
+
+struct gate {
+	bool done;
+	struct wl_listener destroy;
+};
+
+static void gate_handle_destroy(struct wl_listener *listener, void *data) {
+	struct gate *gate = wl_container_of(listener, gate, destroy);
+	gate->done = true;
+	wl_list_remove(&gate->destroy.link);
+}
+
+bool test_trace_run_gate(struct test_server *server) {
+	struct wlr_output *output = wlr_tgui_add_output(server->backend);
+	if (output == NULL) {
+		return false;
+	}
+	struct gate gate = { .destroy.notify = gate_handle_destroy };
+	wl_signal_add(&output->events.destroy, &gate.destroy);
+
+	struct wl_event_loop *loop = wl_display_get_event_loop(server->display);
+	int64_t deadline = test_get_time_nsec() + 5000000000LL;
+	while (!gate.done) {
+		if (test_get_time_nsec() > deadline) {
+			wl_list_remove(&gate.destroy.link);
+			return false;
+		}
+		wl_event_loop_dispatch(loop, 10);
+	}
+	return true;
+}
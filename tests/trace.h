@@ -0,0 +1,79 @@
+#ifndef TESTS_TRACE_H
+#define TESTS_TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "backend/termuxgui/trace.h"
+#include "common.h"
+
+/**
+ * A Termux:GUI trace written by a test, to be replayed by the stub plugin
+ * with WLR_TGUI_REPLAY. Events of an activity are delivered once the backend
+ * created as many activities as the trace had seen when the activity first
+ * appeared.
+ */
+struct test_trace {
+	FILE *file;
+	char path[256];
+	int64_t time_nsec;
+};
+
+/**
+ * Create a trace in $TMPDIR, or /tmp.
+ */
+bool test_trace_open(struct test_trace *trace);
+/**
+ * Finish writing the trace, it can then be replayed.
+ */
+bool test_trace_close(struct test_trace *trace);
+void test_trace_remove(struct test_trace *trace);
+
+/**
+ * Record an event without payload, type being a tgui_event_type.
+ */
+void test_trace_event(struct test_trace *trace, int32_t activity,
+	int32_t type);
+
+/**
+ * Record the size of the surface view of an activity, after its creation.
+ */
+void test_trace_view_size(struct test_trace *trace, int32_t activity,
+	uint32_t width, uint32_t height);
+
+/**
+ * Record the creation of an activity with a surface view of the given size,
+ * brought to the foreground.
+ */
+void test_trace_activity(struct test_trace *trace, int32_t activity,
+	uint32_t width, uint32_t height);
+
+/**
+ * Record a touch event, action being a tgui_touch_action. See
+ * TEST_TRACE_POINTERS().
+ */
+void test_trace_touch(struct test_trace *trace, int32_t activity,
+	int32_t action, uint32_t index, uint32_t num_pointers,
+	const struct wlr_tgui_trace_pointer *pointers);
+
+/**
+ * Expand to the num_pointers and pointers arguments of test_trace_touch(),
+ * from a list of { id, x, y } pointers.
+ */
+#define TEST_TRACE_POINTERS(...) \
+	(sizeof((struct wlr_tgui_trace_pointer[]){ __VA_ARGS__ }) / \
+		sizeof(struct wlr_tgui_trace_pointer)), \
+	(struct wlr_tgui_trace_pointer[]){ __VA_ARGS__ }
+
+/**
+ * Add a Termux:GUI output for an activity which gates the rest of the trace,
+ * and run the event loop until the trace destroys it. Returns false if that
+ * takes more than 5 seconds.
+ *
+ * Ending a trace with the creation of an extra activity and its destruction
+ * holds back its events until the outputs they go to are set up, and tells
+ * when all of them have been handled.
+ */
+bool test_trace_run_gate(struct test_server *server);
+
+#endif
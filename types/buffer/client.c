@@ -7,6 +7,59 @@
 
 static const struct wlr_buffer_impl client_buffer_impl;
 
+/**
+ * A texture of a client buffer for a renderer other than the one it has been
+ * created with.
+ */
+struct client_buffer_texture {
+	struct wlr_client_buffer *client_buffer;
+	struct wlr_renderer *renderer;
+	struct wlr_texture *texture;
+	struct wl_list link; // wlr_client_buffer.textures
+
+	struct wl_listener renderer_destroy;
+};
+
+static void client_buffer_texture_destroy(
+		struct client_buffer_texture *cb_texture) {
+	wl_list_remove(&cb_texture->link);
+	wl_list_remove(&cb_texture->renderer_destroy.link);
+	wlr_texture_destroy(cb_texture->texture);
+	free(cb_texture);
+}
+
+static void client_buffer_texture_handle_renderer_destroy(
+		struct wl_listener *listener, void *data) {
+	struct client_buffer_texture *cb_texture =
+		wl_container_of(listener, cb_texture, renderer_destroy);
+	client_buffer_texture_destroy(cb_texture);
+}
+
+static struct client_buffer_texture *client_buffer_import(
+		struct wlr_client_buffer *client_buffer, struct wlr_renderer *renderer,
+		struct wlr_buffer *source) {
+	struct client_buffer_texture *cb_texture = calloc(1, sizeof(*cb_texture));
+	if (cb_texture == NULL) {
+		return NULL;
+	}
+
+	cb_texture->texture = wlr_texture_from_buffer(renderer, source);
+	if (cb_texture->texture == NULL) {
+		free(cb_texture);
+		return NULL;
+	}
+
+	cb_texture->client_buffer = client_buffer;
+	cb_texture->renderer = renderer;
+	wl_list_insert(&client_buffer->textures, &cb_texture->link);
+
+	cb_texture->renderer_destroy.notify =
+		client_buffer_texture_handle_renderer_destroy;
+	wl_signal_add(&renderer->events.destroy, &cb_texture->renderer_destroy);
+
+	return cb_texture;
+}
+
 struct wlr_client_buffer *wlr_client_buffer_get(struct wlr_buffer *buffer) {
 	if (buffer->impl != &client_buffer_impl) {
 		return NULL;
@@ -24,6 +77,10 @@ static struct wlr_client_buffer *client_buffer_from_buffer(
 static void client_buffer_destroy(struct wlr_buffer *buffer) {
 	struct wlr_client_buffer *client_buffer = client_buffer_from_buffer(buffer);
 	wl_list_remove(&client_buffer->source_destroy.link);
+	struct client_buffer_texture *cb_texture, *tmp;
+	wl_list_for_each_safe(cb_texture, tmp, &client_buffer->textures, link) {
+		client_buffer_texture_destroy(cb_texture);
+	}
 	wlr_texture_destroy(client_buffer->texture);
 	free(client_buffer);
 }
@@ -71,6 +128,8 @@ struct wlr_client_buffer *wlr_client_buffer_create(struct wlr_buffer *buffer,
 		texture->width, texture->height);
 	client_buffer->source = buffer;
 	client_buffer->texture = texture;
+	client_buffer->renderer = renderer;
+	wl_list_init(&client_buffer->textures);
 
 	wl_signal_add(&buffer->events.destroy, &client_buffer->source_destroy);
 	client_buffer->source_destroy.notify = client_buffer_handle_source_destroy;
@@ -89,5 +148,86 @@ bool wlr_client_buffer_apply_damage(struct wlr_client_buffer *client_buffer,
 		return false;
 	}
 
-	return wlr_texture_update_from_buffer(client_buffer->texture, next, damage);
+	if (!wlr_texture_update_from_buffer(client_buffer->texture, next, damage)) {
+		return false;
+	}
+
+	// Textures which can't be updated in place, such as pixman textures
+	// wrapping their source, are imported again from the new buffer
+	struct client_buffer_texture *cb_texture;
+	wl_list_for_each(cb_texture, &client_buffer->textures, link) {
+		if (cb_texture->texture != NULL &&
+				wlr_texture_update_from_buffer(cb_texture->texture, next,
+					damage)) {
+			continue;
+		}
+		struct wlr_texture *texture =
+			wlr_texture_from_buffer(cb_texture->renderer, next);
+		if (texture == NULL) {
+			wlr_log(WLR_ERROR, "Failed to create texture");
+		}
+		wlr_texture_destroy(cb_texture->texture);
+		cb_texture->texture = texture;
+	}
+
+	return true;
+}
+
+struct wlr_texture *wlr_client_buffer_get_texture(
+		struct wlr_client_buffer *client_buffer, struct wlr_renderer *renderer) {
+	if (renderer == client_buffer->renderer) {
+		return client_buffer->texture;
+	}
+
+	struct client_buffer_texture *cb_texture;
+	wl_list_for_each(cb_texture, &client_buffer->textures, link) {
+		if (cb_texture->renderer == renderer) {
+			return cb_texture->texture;
+		}
+	}
+
+	// The surface entered an output of this renderer after the commit. The
+	// source can still be read if the compositor holds a lock on it, such as
+	// the one of a pixman texture, once released the client may be drawing
+	// into it.
+	struct wlr_buffer *source = client_buffer->source;
+	if (source == NULL || source->n_locks == 0) {
+		return NULL;
+	}
+	cb_texture = client_buffer_import(client_buffer, renderer, source);
+	if (cb_texture == NULL) {
+		wlr_log(WLR_ERROR, "Failed to create texture");
+		return NULL;
+	}
+	return cb_texture->texture;
+}
+
+void client_buffer_import_texture(struct wlr_client_buffer *client_buffer,
+		struct wlr_renderer *renderer, struct wlr_buffer *source) {
+	if (renderer == client_buffer->renderer) {
+		return;
+	}
+
+	struct client_buffer_texture *cb_texture;
+	wl_list_for_each(cb_texture, &client_buffer->textures, link) {
+		if (cb_texture->renderer == renderer) {
+			if (cb_texture->texture == NULL) {
+				cb_texture->texture = wlr_texture_from_buffer(renderer, source);
+			}
+			return;
+		}
+	}
+
+	if (client_buffer_import(client_buffer, renderer, source) == NULL) {
+		wlr_log(WLR_ERROR, "Failed to create texture");
+	}
+}
+
+void client_buffer_inherit_textures(struct wlr_client_buffer *client_buffer,
+		struct wlr_client_buffer *prev, struct wlr_buffer *source) {
+	struct client_buffer_texture *prev_texture;
+	wl_list_for_each(prev_texture, &prev->textures, link) {
+		client_buffer_import_texture(client_buffer, prev_texture->renderer,
+			source);
+	}
 }
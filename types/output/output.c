@@ -3,6 +3,8 @@
 #include <backend/backend.h>
 #include <drm_fourcc.h>
 #include <stdlib.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
 #include <wlr/interfaces/wlr_output.h>
 #include <wlr/types/wlr_compositor.h>
 #include <wlr/types/wlr_matrix.h>
@@ -12,9 +14,16 @@
 #include "types/wlr_output.h"
 #include "util/env.h"
 #include "util/global.h"
+#include "util/time.h"
 
 #define OUTPUT_VERSION 4
 
+#define DEFAULT_FRAME_MARGIN 2000 // usec
+// Present events older than this don't help predicting the next deadline
+#define FRAME_DELAY_MAX_PRESENT_AGE 1000000000 // nsec
+// Frame events due sooner than this are sent right away
+#define FRAME_DELAY_MIN 500000 // nsec
+
 static void send_geometry(struct wl_resource *resource) {
 	struct wlr_output *output = wlr_output_from_resource(resource);
 
@@ -336,6 +345,8 @@ static void output_state_finish(struct wlr_output_state *state) {
 	// wlr_buffer_unlock(). Reset the field to NULL to ensure nobody mistakenly
 	// reads it after output_state_finish().
 	state->buffer = NULL;
+	wlr_buffer_unlock(state->overlay_buffer);
+	state->overlay_buffer = NULL;
 	pixman_region32_fini(&state->damage);
 	free(state->gamma_lut);
 }
@@ -384,6 +395,17 @@ void wlr_output_init(struct wlr_output *output, struct wlr_backend *backend,
 
 	wlr_addon_set_init(&output->addons);
 
+	output->frame_timer_fd = -1;
+	long frame_margin = env_parse_int("WLR_OUTPUT_FRAME_MARGIN",
+		DEFAULT_FRAME_MARGIN);
+	if (frame_margin < 0) {
+		frame_margin = DEFAULT_FRAME_MARGIN;
+	}
+	output->frame_margin = (int64_t)frame_margin * 1000;
+	if (env_parse_bool("WLR_OUTPUT_FRAME_DELAY")) {
+		wlr_output_set_frame_delay(output, true);
+	}
+
 	output->display_destroy.notify = handle_display_destroy;
 	wl_display_add_destroy_listener(display, &output->display_destroy);
 }
@@ -420,6 +442,13 @@ void wlr_output_destroy(struct wlr_output *output) {
 		wl_event_source_remove(output->idle_done);
 	}
 
+	if (output->frame_timer != NULL) {
+		wl_event_source_remove(output->frame_timer);
+	}
+	if (output->frame_timer_fd >= 0) {
+		close(output->frame_timer_fd);
+	}
+
 	free(output->name);
 	free(output->description);
 	free(output->make);
@@ -493,9 +522,16 @@ static void output_state_clear_gamma_lut(struct wlr_output_state *state) {
 	state->committed &= ~WLR_OUTPUT_STATE_GAMMA_LUT;
 }
 
+static void output_state_clear_overlay(struct wlr_output_state *state) {
+	wlr_buffer_unlock(state->overlay_buffer);
+	state->overlay_buffer = NULL;
+	state->committed &= ~WLR_OUTPUT_STATE_OVERLAY;
+}
+
 static void output_state_clear(struct wlr_output_state *state) {
 	output_state_clear_buffer(state);
 	output_state_clear_gamma_lut(state);
+	output_state_clear_overlay(state);
 	pixman_region32_clear(&state->damage);
 	state->committed = 0;
 }
@@ -721,6 +757,68 @@ bool wlr_output_test(struct wlr_output *output) {
 	return wlr_output_test_state(output, &state);
 }
 
+int64_t output_get_refresh_nsec(struct wlr_output *output) {
+	if (output->present_refresh > 0) {
+		return output->present_refresh;
+	}
+	if (output->refresh > 0) {
+		return 1000000000000ll / output->refresh;
+	}
+	return 0;
+}
+
+int64_t output_get_time_since_present(struct wlr_output *output) {
+	if (output->last_present.tv_sec == 0 &&
+			output->last_present.tv_nsec == 0) {
+		return -1;
+	}
+
+	struct timespec now, elapsed;
+	clockid_t clock = wlr_backend_get_presentation_clock(output->backend);
+	clock_gettime(clock, &now);
+	timespec_sub(&elapsed, &now, &output->last_present);
+	int64_t since_present = timespec_to_nsec(&elapsed);
+	return since_present >= 0 ? since_present : -1;
+}
+
+static void output_cancel_delayed_frame(struct wlr_output *output) {
+	if (!output->frame_delayed) {
+		return;
+	}
+	struct itimerspec timer = {0};
+	timerfd_settime(output->frame_timer_fd, 0, &timer, NULL);
+	output->frame_delayed = false;
+}
+
+static void output_update_frame_render_time(struct wlr_output *output) {
+	if (!output->frame_delay || (output->frame_sent.tv_sec == 0 &&
+			output->frame_sent.tv_nsec == 0)) {
+		return;
+	}
+
+	struct timespec now, elapsed;
+	clockid_t clock = wlr_backend_get_presentation_clock(output->backend);
+	clock_gettime(clock, &now);
+	timespec_sub(&elapsed, &now, &output->frame_sent);
+	output->frame_sent = (struct timespec){0};
+
+	// A frame event which didn't lead to a commit leaves the output idle, the
+	// next commit then comes from something else and isn't a render time
+	int64_t sample = timespec_to_nsec(&elapsed);
+	int64_t refresh = output_get_refresh_nsec(output);
+	if (sample > (refresh > 0 ? refresh : FRAME_DELAY_MAX_PRESENT_AGE)) {
+		return;
+	}
+
+	// Follow slower frames right away, but forget them slowly
+	if (sample > output->frame_render_time) {
+		output->frame_render_time = sample;
+	} else {
+		output->frame_render_time =
+			(output->frame_render_time * 7 + sample) / 8;
+	}
+}
+
 bool wlr_output_commit_state(struct wlr_output *output,
 		const struct wlr_output_state *state) {
 	uint32_t unchanged = output_compare_state(output, state);
@@ -825,6 +923,10 @@ bool wlr_output_commit_state(struct wlr_output *output,
 	if (pending.committed & WLR_OUTPUT_STATE_BUFFER) {
 		output->frame_pending = true;
 		output->needs_frame = false;
+		output_update_frame_render_time(output);
+		// The frame event of this buffer comes from the backend, a delayed
+		// one would ask for a frame which can't be committed yet
+		output_cancel_delayed_frame(output);
 	}
 
 	if ((pending.committed & WLR_OUTPUT_STATE_BUFFER) &&
@@ -883,13 +985,120 @@ void wlr_output_attach_buffer(struct wlr_output *output,
 	output_state_attach_buffer(&output->pending, buffer);
 }
 
-void wlr_output_send_frame(struct wlr_output *output) {
-	output->frame_pending = false;
+void wlr_output_attach_overlay(struct wlr_output *output,
+		struct wlr_buffer *buffer, int x, int y) {
+	output_state_clear_overlay(&output->pending);
+	output->pending.committed |= WLR_OUTPUT_STATE_OVERLAY;
+	if (buffer != NULL) {
+		output->pending.overlay_buffer = wlr_buffer_lock(buffer);
+	}
+	output->pending.overlay_x = x;
+	output->pending.overlay_y = y;
+}
+
+static void output_emit_frame(struct wlr_output *output) {
+	if (output->frame_delay) {
+		clockid_t clock = wlr_backend_get_presentation_clock(output->backend);
+		clock_gettime(clock, &output->frame_sent);
+	}
 	if (output->enabled) {
 		wl_signal_emit_mutable(&output->events.frame, output);
 	}
 }
 
+static int output_handle_frame_timer(int fd, uint32_t mask, void *data) {
+	struct wlr_output *output = data;
+
+	uint64_t expirations;
+	if (read(fd, &expirations, sizeof(expirations)) < 0) {
+		return 0;
+	}
+
+	if (output->frame_delayed) {
+		output->frame_delayed = false;
+		output_emit_frame(output);
+	}
+	return 0;
+}
+
+/**
+ * Arm the frame timer so that the frame event fires just in time for the
+ * compositor to commit before the next refresh deadline. Returns false if the
+ * frame event should be sent right away.
+ */
+static bool output_delay_frame(struct wlr_output *output) {
+	int64_t refresh = output_get_refresh_nsec(output);
+	if (!output->frame_delay || refresh <= 0) {
+		return false;
+	}
+
+	int64_t since_present = output_get_time_since_present(output);
+	if (since_present < 0 || since_present > FRAME_DELAY_MAX_PRESENT_AGE) {
+		return false;
+	}
+
+	struct timespec now;
+	clockid_t clock = wlr_backend_get_presentation_clock(output->backend);
+	clock_gettime(clock, &now);
+
+	// First refresh cycle whose deadline can still be met
+	int64_t budget = output->frame_render_time + output->frame_margin;
+	int64_t deadline = ((since_present + budget) / refresh + 1) * refresh;
+	int64_t delay = deadline - budget - since_present;
+	if (delay < FRAME_DELAY_MIN) {
+		return false;
+	}
+
+	struct timespec frame_at;
+	timespec_from_nsec(&frame_at, timespec_to_nsec(&now) + delay);
+	struct itimerspec timer = { .it_value = frame_at };
+	if (timerfd_settime(output->frame_timer_fd, TFD_TIMER_ABSTIME,
+			&timer, NULL) != 0) {
+		wlr_log_errno(WLR_ERROR, "Failed to arm frame timer");
+		return false;
+	}
+
+	output->frame_delayed = true;
+	return true;
+}
+
+void wlr_output_set_frame_delay(struct wlr_output *output, bool enabled) {
+	if (enabled && output->frame_timer == NULL) {
+		clockid_t clock = wlr_backend_get_presentation_clock(output->backend);
+		output->frame_timer_fd =
+			timerfd_create(clock, TFD_CLOEXEC | TFD_NONBLOCK);
+		if (output->frame_timer_fd < 0) {
+			wlr_log_errno(WLR_ERROR, "Failed to create frame timer");
+			return;
+		}
+
+		struct wl_event_loop *ev = wl_display_get_event_loop(output->display);
+		output->frame_timer = wl_event_loop_add_fd(ev, output->frame_timer_fd,
+			WL_EVENT_READABLE, output_handle_frame_timer, output);
+		if (output->frame_timer == NULL) {
+			wlr_log(WLR_ERROR, "Failed to add frame timer to event loop");
+			close(output->frame_timer_fd);
+			output->frame_timer_fd = -1;
+			return;
+		}
+	}
+
+	output->frame_delay = enabled;
+	output->frame_sent = (struct timespec){0};
+	if (!enabled && output->frame_delayed) {
+		output_cancel_delayed_frame(output);
+		output_emit_frame(output);
+	}
+}
+
+void wlr_output_send_frame(struct wlr_output *output) {
+	output->frame_pending = false;
+	if (output->frame_delayed || output_delay_frame(output)) {
+		return;
+	}
+	output_emit_frame(output);
+}
+
 static void schedule_frame_handle_idle_timer(void *data) {
 	struct wlr_output *output = data;
 	output->idle_frame = NULL;
@@ -904,7 +1113,8 @@ void wlr_output_schedule_frame(struct wlr_output *output) {
 	// work.
 	wlr_output_update_needs_frame(output);
 
-	if (output->frame_pending || output->idle_frame != NULL) {
+	if (output->frame_pending || output->idle_frame != NULL ||
+			output->frame_delayed) {
 		return;
 	}
 
@@ -932,6 +1142,11 @@ void wlr_output_send_present(struct wlr_output *output,
 		event->when = &now;
 	}
 
+	if (event->presented) {
+		output->last_present = *event->when;
+		output->present_refresh = event->refresh;
+	}
+
 	wl_signal_emit_mutable(&output->events.present, event);
 }
 
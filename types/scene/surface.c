@@ -1,8 +1,15 @@
+#define _POSIX_C_SOURCE 200809L
 #include <assert.h>
 #include <stdlib.h>
+#include <time.h>
 #include <wlr/types/wlr_scene.h>
 #include <wlr/types/wlr_presentation_time.h>
+#include <wlr/util/log.h>
 #include "types/wlr_scene.h"
+#include "util/time.h"
+
+static void scene_surface_schedule_hidden_frame(
+	struct wlr_scene_surface *surface);
 
 static void handle_scene_buffer_output_enter(
 		struct wl_listener *listener, void *data) {
@@ -20,6 +27,13 @@ static void handle_scene_buffer_output_leave(
 	struct wlr_scene_output *output = data;
 
 	wlr_surface_send_leave(surface->surface, output->output);
+
+	// A client waiting for a frame callback when the surface got hidden
+	// would otherwise never hear back
+	if (surface->buffer->primary_output == NULL &&
+			!wl_list_empty(&surface->surface->current.frame_callback_list)) {
+		scene_surface_schedule_hidden_frame(surface);
+	}
 }
 
 static void handle_scene_buffer_output_present(
@@ -46,6 +60,55 @@ static void handle_scene_buffer_frame_done(
 	struct timespec *now = data;
 
 	wlr_surface_send_frame_done(surface->surface, now);
+	surface->last_frame_done = *now;
+}
+
+static int handle_hidden_frame_timer(void *data) {
+	struct wlr_scene_surface *surface = data;
+
+	int lx, ly;
+	bool enabled = wlr_scene_node_coords(&surface->buffer->node, &lx, &ly);
+	if (surface->buffer->primary_output != NULL && enabled) {
+		// Displayed again, the output sends the frame callbacks
+		return 0;
+	}
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	wlr_surface_send_frame_done(surface->surface, &now);
+	surface->last_frame_done = now;
+	return 0;
+}
+
+static void scene_surface_schedule_hidden_frame(
+		struct wlr_scene_surface *surface) {
+	struct wlr_scene *scene = scene_node_get_root(&surface->buffer->node);
+	if (scene->hidden_frame_rate == 0) {
+		return;
+	}
+
+	if (surface->hidden_frame_timer == NULL) {
+		struct wl_client *client =
+			wl_resource_get_client(surface->surface->resource);
+		struct wl_event_loop *loop =
+			wl_display_get_event_loop(wl_client_get_display(client));
+		surface->hidden_frame_timer = wl_event_loop_add_timer(loop,
+			handle_hidden_frame_timer, surface);
+		if (surface->hidden_frame_timer == NULL) {
+			wlr_log(WLR_ERROR, "Failed to create hidden frame timer");
+			return;
+		}
+	}
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	int64_t elapsed = timespec_to_msec(&now) -
+		timespec_to_msec(&surface->last_frame_done);
+	int64_t delay = 1000 / scene->hidden_frame_rate - elapsed;
+	if (delay < 1) {
+		delay = 1;
+	}
+	wl_event_source_timer_update(surface->hidden_frame_timer, delay);
 }
 
 static void scene_surface_handle_surface_destroy(
@@ -119,9 +182,13 @@ static void handle_scene_surface_surface_commit(
 	int lx, ly;
 	bool enabled = wlr_scene_node_coords(&scene_buffer->node, &lx, &ly);
 
-	if (!wl_list_empty(&surface->surface->current.frame_callback_list) &&
-			surface->buffer->primary_output != NULL && enabled) {
+	if (wl_list_empty(&surface->surface->current.frame_callback_list)) {
+		return;
+	}
+	if (surface->buffer->primary_output != NULL && enabled) {
 		wlr_output_schedule_frame(surface->buffer->primary_output->output);
+	} else {
+		scene_surface_schedule_hidden_frame(surface);
 	}
 }
 
@@ -147,6 +214,10 @@ static void surface_addon_destroy(struct wlr_addon *addon) {
 	wl_list_remove(&surface->surface_destroy.link);
 	wl_list_remove(&surface->surface_commit.link);
 
+	if (surface->hidden_frame_timer != NULL) {
+		wl_event_source_remove(surface->hidden_frame_timer);
+	}
+
 	free(surface);
 }
 
@@ -1,8 +1,12 @@
 #define _POSIX_C_SOURCE 200809L
 #include <assert.h>
+#include <drm_fourcc.h>
+#include <inttypes.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 #include <wlr/backend.h>
+#include <wlr/render/pixman.h>
 #include <wlr/render/wlr_renderer.h>
 #include <wlr/types/wlr_compositor.h>
 #include <wlr/types/wlr_damage_ring.h>
@@ -11,7 +15,11 @@
 #include <wlr/types/wlr_scene.h>
 #include <wlr/util/log.h>
 #include <wlr/util/region.h>
+#include "render/allocator/allocator.h"
+#include "render/swapchain.h"
 #include "types/wlr_buffer.h"
+#include "types/wlr_matrix.h"
+#include "types/wlr_output.h"
 #include "types/wlr_scene.h"
 #include "util/array.h"
 #include "util/env.h"
@@ -19,6 +27,15 @@
 
 #define HIGHLIGHT_DAMAGE_FADEOUT_TIME 250
 
+// Nodes above a scanned out buffer are only put on an overlay plane if their
+// bounding box covers at most 1/OVERLAY_MAX_FRACTION of the output
+#define OVERLAY_MAX_FRACTION 4
+// Number of frames to wait after the backend rejected an overlay
+#define OVERLAY_RETRY_DELAY 120
+
+static uint64_t next_texture_source = 1;
+static uint64_t next_output_epoch = 1;
+
 static struct wlr_scene_tree *scene_tree_from_node(struct wlr_scene_node *node) {
 	assert(node->type == WLR_SCENE_NODE_TREE);
 	struct wlr_scene_tree *tree = wl_container_of(node, tree, node);
@@ -64,6 +81,8 @@ static void scene_node_init(struct wlr_scene_node *node,
 
 	wl_signal_init(&node->events.destroy);
 	pixman_region32_init(&node->visible);
+	pixman_region32_init(&node->opaque);
+	node->opaque_dirty = true;
 
 	if (parent != NULL) {
 		wl_list_insert(parent->children.prev, &node->link);
@@ -109,6 +128,9 @@ void wlr_scene_node_destroy(struct wlr_scene_node *node) {
 		wlr_texture_destroy(scene_buffer->texture);
 		wlr_buffer_unlock(scene_buffer->buffer);
 		pixman_region32_fini(&scene_buffer->opaque_region);
+		for (size_t i = 0; i < WLR_SCENE_BUFFER_DAMAGE_LEN; i++) {
+			pixman_region32_fini(&scene_buffer->texture_damage[i]);
+		}
 	} else if (node->type == WLR_SCENE_NODE_TREE) {
 		struct wlr_scene_tree *scene_tree = scene_tree_from_node(node);
 
@@ -133,6 +155,7 @@ void wlr_scene_node_destroy(struct wlr_scene_node *node) {
 
 	wl_list_remove(&node->link);
 	pixman_region32_fini(&node->visible);
+	pixman_region32_fini(&node->opaque);
 	free(node);
 }
 
@@ -164,6 +187,17 @@ struct wlr_scene *wlr_scene_create(void) {
 	scene->debug_damage_option = env_parse_switch("WLR_SCENE_DEBUG_DAMAGE", debug_damage_options);
 	scene->direct_scanout = !env_parse_bool("WLR_SCENE_DISABLE_DIRECT_SCANOUT");
 	scene->calculate_visibility = !env_parse_bool("WLR_SCENE_DISABLE_VISIBILITY");
+	scene->cull_occluded = !env_parse_bool("WLR_SCENE_DISABLE_CULLING");
+
+	long stats_interval = env_parse_int("WLR_SCENE_STATS", 0);
+	if (stats_interval > 0 && stats_interval <= INT_MAX) {
+		scene->stats_interval = stats_interval;
+	}
+
+	long hidden_frame_rate = env_parse_int("WLR_SCENE_HIDDEN_FRAME_RATE", 0);
+	if (hidden_frame_rate > 0 && hidden_frame_rate <= INT_MAX) {
+		scene->hidden_frame_rate = hidden_frame_rate;
+	}
 
 	return scene;
 }
@@ -224,9 +258,13 @@ static bool scene_nodes_in_box(struct wlr_scene_node *node, struct wlr_box *box,
 	return _scene_nodes_in_box(node, box, iterator, user_data, x, y);
 }
 
-static void scene_node_opaque_region(struct wlr_scene_node *node, int x, int y,
-		pixman_region32_t *opaque) {
-	if (node->type == WLR_SCENE_NODE_RECT) {
+static void scene_node_update_opaque(struct wlr_scene_node *node) {
+	pixman_region32_clear(&node->opaque);
+	node->opaque_dirty = false;
+
+	if (node->type == WLR_SCENE_NODE_TREE) {
+		return;
+	} else if (node->type == WLR_SCENE_NODE_RECT) {
 		struct wlr_scene_rect *scene_rect = scene_rect_from_node(node);
 		if (scene_rect->color[3] != 1) {
 			return;
@@ -239,16 +277,25 @@ static void scene_node_opaque_region(struct wlr_scene_node *node, int x, int y,
 		}
 
 		if (!buffer_is_opaque(scene_buffer->buffer)) {
-			pixman_region32_copy(opaque, &scene_buffer->opaque_region);
-			pixman_region32_translate(opaque, x, y);
+			pixman_region32_copy(&node->opaque, &scene_buffer->opaque_region);
 			return;
 		}
 	}
 
 	int width, height;
 	scene_node_get_size(node, &width, &height);
-	pixman_region32_fini(opaque);
-	pixman_region32_init_rect(opaque, x, y, width, height);
+	pixman_region32_union_rect(&node->opaque, &node->opaque,
+		0, 0, width, height);
+}
+
+static void scene_node_opaque_region(struct wlr_scene_node *node, int x, int y,
+		pixman_region32_t *opaque) {
+	if (node->opaque_dirty) {
+		scene_node_update_opaque(node);
+	}
+
+	pixman_region32_copy(opaque, &node->opaque);
+	pixman_region32_translate(opaque, x, y);
 }
 
 struct scene_update_data {
@@ -278,24 +325,121 @@ static void scale_output_damage(pixman_region32_t *damage, float scale) {
 	}
 }
 
+static void scene_output_handle_render_ahead(void *data);
+
+static void scene_output_schedule_frame(struct wlr_scene_output *scene_output) {
+	struct wlr_output *output = scene_output->output;
+	wlr_output_schedule_frame(output);
+
+	if (scene_output->render_ahead_depth == 0 || !output->frame_pending ||
+			scene_output->render_ahead_idle != NULL) {
+		return;
+	}
+
+	struct wl_event_loop *ev = wl_display_get_event_loop(output->display);
+	scene_output->render_ahead_idle = wl_event_loop_add_idle(ev,
+		scene_output_handle_render_ahead, scene_output);
+}
+
+static bool scene_output_intersects(struct wlr_scene_output *scene_output,
+		const pixman_box32_t *extents) {
+	const struct wlr_box *box = &scene_output->layout_box;
+	return extents->x1 < box->x + box->width && extents->x2 > box->x &&
+		extents->y1 < box->y + box->height && extents->y2 > box->y;
+}
+
+#define SCALED_DAMAGE_CACHE_LEN 4
+
+/**
+ * Damage converted for a given output scale, reused by all outputs sharing
+ * that scale.
+ */
+struct scaled_damage_cache {
+	struct {
+		float scale;
+		pixman_region32_t region;
+	} entries[SCALED_DAMAGE_CACHE_LEN];
+	int len;
+};
+
+/**
+ * Get the cached damage for a scale. When there is none, a new empty entry is
+ * returned and *created is set so that the caller fills it in. Returns NULL
+ * if the cache is full.
+ */
+static pixman_region32_t *scaled_damage_cache_get(
+		struct scaled_damage_cache *cache, float scale, bool *created) {
+	*created = false;
+	for (int i = 0; i < cache->len; i++) {
+		if (cache->entries[i].scale == scale) {
+			return &cache->entries[i].region;
+		}
+	}
+
+	if (cache->len == SCALED_DAMAGE_CACHE_LEN) {
+		return NULL;
+	}
+
+	*created = true;
+	cache->entries[cache->len].scale = scale;
+	pixman_region32_init(&cache->entries[cache->len].region);
+	return &cache->entries[cache->len++].region;
+}
+
+static void scaled_damage_cache_finish(struct scaled_damage_cache *cache) {
+	for (int i = 0; i < cache->len; i++) {
+		pixman_region32_fini(&cache->entries[i].region);
+	}
+}
+
 static void scene_damage_outputs(struct wlr_scene *scene, pixman_region32_t *damage) {
 	if (!pixman_region32_not_empty(damage)) {
 		return;
 	}
 
+	pixman_box32_t *extents = pixman_region32_extents(damage);
+	struct scaled_damage_cache cache = {0};
+
 	struct wlr_scene_output *scene_output;
 	wl_list_for_each(scene_output, &scene->outputs, link) {
+		if (!scene_output_intersects(scene_output, extents)) {
+			continue;
+		}
+
+		float scale = scene_output->output->scale;
 		pixman_region32_t output_damage;
 		pixman_region32_init(&output_damage);
-		pixman_region32_copy(&output_damage, damage);
-		pixman_region32_translate(&output_damage,
-			-scene_output->x, -scene_output->y);
-		scale_output_damage(&output_damage, scene_output->output->scale);
+
+		// Scaling and translating only commute when the output position
+		// lands on whole output pixels
+		float offset_x = scene_output->x * scale;
+		float offset_y = scene_output->y * scale;
+		bool created;
+		pixman_region32_t *scaled = NULL;
+		if (floor(offset_x) == offset_x && floor(offset_y) == offset_y) {
+			scaled = scaled_damage_cache_get(&cache, scale, &created);
+		}
+		if (scaled != NULL) {
+			if (created) {
+				pixman_region32_copy(scaled, damage);
+				scale_output_damage(scaled, scale);
+			}
+			pixman_region32_copy(&output_damage, scaled);
+			pixman_region32_translate(&output_damage, -offset_x, -offset_y);
+		} else {
+			pixman_region32_copy(&output_damage, damage);
+			pixman_region32_translate(&output_damage,
+				-scene_output->x, -scene_output->y);
+			scale_output_damage(&output_damage, scale);
+		}
+
 		if (wlr_damage_ring_add(&scene_output->damage_ring, &output_damage)) {
-			wlr_output_schedule_frame(scene_output->output);
+			scene_output_schedule_frame(scene_output);
 		}
 		pixman_region32_fini(&output_damage);
 	}
+
+	scaled_damage_cache_finish(&cache);
 }
 
 static void update_node_update_outputs(struct wlr_scene_node *node,
@@ -327,17 +471,12 @@ static void update_node_update_outputs(struct wlr_scene_node *node,
 			continue;
 		}
 
-		struct wlr_box output_box = {
-			.x = scene_output->x,
-			.y = scene_output->y,
-		};
-		wlr_output_effective_resolution(scene_output->output,
-			&output_box.width, &output_box.height);
+		const struct wlr_box *output_box = &scene_output->layout_box;
 
 		pixman_region32_t intersection;
 		pixman_region32_init(&intersection);
 		pixman_region32_intersect_rect(&intersection, &node->visible,
-			output_box.x, output_box.y, output_box.width, output_box.height);
+			output_box->x, output_box->y, output_box->width, output_box->height);
 
 		if (pixman_region32_not_empty(&intersection)) {
 			uint32_t overlap = region_area(&intersection);
@@ -523,6 +662,7 @@ void wlr_scene_rect_set_size(struct wlr_scene_rect *rect, int width, int height)
 
 	rect->width = width;
 	rect->height = height;
+	rect->node.opaque_dirty = true;
 	scene_node_update(&rect->node, NULL);
 }
 
@@ -532,6 +672,7 @@ void wlr_scene_rect_set_color(struct wlr_scene_rect *rect, const float color[sta
 	}
 
 	memcpy(rect->color, color, sizeof(rect->color));
+	rect->node.opaque_dirty = true;
 	scene_node_update(&rect->node, NULL);
 }
 
@@ -554,11 +695,37 @@ struct wlr_scene_buffer *wlr_scene_buffer_create(struct wlr_scene_tree *parent,
 	wl_signal_init(&scene_buffer->events.frame_done);
 	pixman_region32_init(&scene_buffer->opaque_region);
 
+	scene_buffer->texture_source = next_texture_source++;
+	for (size_t i = 0; i < WLR_SCENE_BUFFER_DAMAGE_LEN; i++) {
+		pixman_region32_init(&scene_buffer->texture_damage[i]);
+	}
+
 	scene_node_update(&scene_buffer->node, NULL);
 
 	return scene_buffer;
 }
 
+static void scene_buffer_add_texture_damage(struct wlr_scene_buffer *scene_buffer,
+		struct wlr_buffer *buffer, pixman_region32_t *damage) {
+	if (buffer == NULL) {
+		// The damage of the next buffer won't be relative to anything we
+		// uploaded, so invalidate all cached textures for this node
+		scene_buffer->texture_source = next_texture_source++;
+		return;
+	}
+
+	scene_buffer->texture_commit++;
+	pixman_region32_t *slot = &scene_buffer->texture_damage[
+		scene_buffer->texture_commit % WLR_SCENE_BUFFER_DAMAGE_LEN];
+	if (damage != NULL) {
+		pixman_region32_intersect_rect(slot, damage,
+			0, 0, buffer->width, buffer->height);
+	} else {
+		pixman_region32_fini(slot);
+		pixman_region32_init_rect(slot, 0, 0, buffer->width, buffer->height);
+	}
+}
+
 void wlr_scene_buffer_set_buffer_with_damage(struct wlr_scene_buffer *scene_buffer,
 		struct wlr_buffer *buffer, pixman_region32_t *damage) {
 	// specifying a region for a NULL buffer doesn't make sense. We need to know
@@ -567,6 +734,13 @@ void wlr_scene_buffer_set_buffer_with_damage(struct wlr_scene_buffer *scene_buff
 	assert(buffer || !damage);
 
 	bool update = false;
+	scene_buffer_add_texture_damage(scene_buffer, buffer, damage);
+	if (buffer == NULL || scene_buffer->buffer == NULL ||
+			buffer_is_opaque(buffer) != buffer_is_opaque(scene_buffer->buffer) ||
+			buffer->width != scene_buffer->buffer->width ||
+			buffer->height != scene_buffer->buffer->height) {
+		scene_buffer->node.opaque_dirty = true;
+	}
 	wlr_buffer_unlock(scene_buffer->buffer);
 
 	wlr_texture_destroy(scene_buffer->texture);
@@ -633,53 +807,89 @@ void wlr_scene_buffer_set_buffer_with_damage(struct wlr_scene_buffer *scene_buff
 		box.x, box.y, box.width, box.height);
 	pixman_region32_translate(&trans_damage, -box.x, -box.y);
 
+	// Bounds of the damage in layout coordinates, with room for the filtering
+	// bleed
+	pixman_box32_t *trans_extents = pixman_region32_extents(&trans_damage);
+	int bleed = (int)ceilf(fmaxf(scale_x, scale_y)) + 1;
+	pixman_box32_t extents = {
+		.x1 = lx + (int)floorf(trans_extents->x1 * scale_x) - bleed,
+		.y1 = ly + (int)floorf(trans_extents->y1 * scale_y) - bleed,
+		.x2 = lx + (int)ceilf(trans_extents->x2 * scale_x) + bleed,
+		.y2 = ly + (int)ceilf(trans_extents->y2 * scale_y) + bleed,
+	};
+
+	struct scaled_damage_cache cache = {0};
 	struct wlr_scene *scene = scene_node_get_root(&scene_buffer->node);
 	struct wlr_scene_output *scene_output;
 	wl_list_for_each(scene_output, &scene->outputs, link) {
+		if (!scene_output_intersects(scene_output, &extents)) {
+			continue;
+		}
+
 		float output_scale = scene_output->output->scale;
-		float output_scale_x = output_scale * scale_x;
-		float output_scale_y = output_scale * scale_y;
+		bool created;
+		pixman_region32_t uncached;
+		pixman_region32_t *scaled =
+			scaled_damage_cache_get(&cache, output_scale, &created);
+		if (scaled == NULL) {
+			pixman_region32_init(&uncached);
+			scaled = &uncached;
+			created = true;
+		}
+
+		// The damage only depends on the output scale until it is moved to
+		// the output's position
+		if (created) {
+			float output_scale_x = output_scale * scale_x;
+			float output_scale_y = output_scale * scale_y;
+			wlr_region_scale_xy(scaled, &trans_damage,
+				output_scale_x, output_scale_y);
+
+			// One output pixel will match (buffer_scale_x)x(buffer_scale_y) buffer pixels.
+			// If the buffer is upscaled on the given axis (output_scale_* > 1.0,
+			// buffer_scale_* < 1.0), its contents will bleed into adjacent
+			// (ceil(output_scale_* / 2)) output pixels because of linear filtering.
+			// Additionally, if the buffer is downscaled (output_scale_* < 1.0,
+			// buffer_scale_* > 1.0), and one output pixel matches a non-integer number of
+			// buffer pixels, its contents will bleed into neighboring output pixels.
+			// Handle both cases by computing buffer_scale_{x,y} and checking if they are
+			// integer numbers; ceilf() is used to ensure that the distance is at least 1.
+			float buffer_scale_x = 1.0f / output_scale_x;
+			float buffer_scale_y = 1.0f / output_scale_y;
+			int dist_x = floor(buffer_scale_x) != buffer_scale_x ?
+				(int)ceilf(output_scale_x / 2.0f) : 0;
+			int dist_y = floor(buffer_scale_y) != buffer_scale_y ?
+				(int)ceilf(output_scale_y / 2.0f) : 0;
+			// TODO: expand with per-axis distances
+			wlr_region_expand(scaled, scaled,
+				dist_x >= dist_y ? dist_x : dist_y);
+
+			pixman_region32_t cull_region;
+			pixman_region32_init(&cull_region);
+			pixman_region32_copy(&cull_region, &scene_buffer->node.visible);
+			scale_output_damage(&cull_region, output_scale);
+			pixman_region32_translate(&cull_region, -lx * output_scale, -ly * output_scale);
+			pixman_region32_intersect(scaled, scaled, &cull_region);
+			pixman_region32_fini(&cull_region);
+		}
+
 		pixman_region32_t output_damage;
 		pixman_region32_init(&output_damage);
-		wlr_region_scale_xy(&output_damage, &trans_damage,
-			output_scale_x, output_scale_y);
-
-		// One output pixel will match (buffer_scale_x)x(buffer_scale_y) buffer pixels.
-		// If the buffer is upscaled on the given axis (output_scale_* > 1.0,
-		// buffer_scale_* < 1.0), its contents will bleed into adjacent
-		// (ceil(output_scale_* / 2)) output pixels because of linear filtering.
-		// Additionally, if the buffer is downscaled (output_scale_* < 1.0,
-		// buffer_scale_* > 1.0), and one output pixel matches a non-integer number of
-		// buffer pixels, its contents will bleed into neighboring output pixels.
-		// Handle both cases by computing buffer_scale_{x,y} and checking if they are
-		// integer numbers; ceilf() is used to ensure that the distance is at least 1.
-		float buffer_scale_x = 1.0f / output_scale_x;
-		float buffer_scale_y = 1.0f / output_scale_y;
-		int dist_x = floor(buffer_scale_x) != buffer_scale_x ?
-			(int)ceilf(output_scale_x / 2.0f) : 0;
-		int dist_y = floor(buffer_scale_y) != buffer_scale_y ?
-			(int)ceilf(output_scale_y / 2.0f) : 0;
-		// TODO: expand with per-axis distances
-		wlr_region_expand(&output_damage, &output_damage,
-			dist_x >= dist_y ? dist_x : dist_y);
-
-		pixman_region32_t cull_region;
-		pixman_region32_init(&cull_region);
-		pixman_region32_copy(&cull_region, &scene_buffer->node.visible);
-		scale_output_damage(&cull_region, output_scale);
-		pixman_region32_translate(&cull_region, -lx * output_scale, -ly * output_scale);
-		pixman_region32_intersect(&output_damage, &output_damage, &cull_region);
-		pixman_region32_fini(&cull_region);
+		pixman_region32_copy(&output_damage, scaled);
+		if (scaled == &uncached) {
+			pixman_region32_fini(&uncached);
+		}
 
 		pixman_region32_translate(&output_damage,
 			(lx - scene_output->x) * output_scale,
 			(ly - scene_output->y) * output_scale);
 		if (wlr_damage_ring_add(&scene_output->damage_ring, &output_damage)) {
-			wlr_output_schedule_frame(scene_output->output);
+			scene_output_schedule_frame(scene_output);
 		}
 		pixman_region32_fini(&output_damage);
 	}
 
+	scaled_damage_cache_finish(&cache);
 	pixman_region32_fini(&trans_damage);
 	pixman_region32_fini(&fallback_damage);
 }
@@ -696,6 +906,7 @@ void wlr_scene_buffer_set_opaque_region(struct wlr_scene_buffer *scene_buffer,
 	}
 
 	pixman_region32_copy(&scene_buffer->opaque_region, region);
+	scene_buffer->node.opaque_dirty = true;
 	scene_node_update(&scene_buffer->node, NULL);
 }
 
@@ -724,6 +935,7 @@ void wlr_scene_buffer_set_dest_size(struct wlr_scene_buffer *scene_buffer,
 
 	scene_buffer->dst_width = width;
 	scene_buffer->dst_height = height;
+	scene_buffer->node.opaque_dirty = true;
 	scene_node_update(&scene_buffer->node, NULL);
 }
 
@@ -734,6 +946,7 @@ void wlr_scene_buffer_set_transform(struct wlr_scene_buffer *scene_buffer,
 	}
 
 	scene_buffer->transform = transform;
+	scene_buffer->node.opaque_dirty = true;
 	scene_node_update(&scene_buffer->node, NULL);
 }
 
@@ -744,21 +957,135 @@ void wlr_scene_buffer_send_frame_done(struct wlr_scene_buffer *scene_buffer,
 	}
 }
 
+/**
+ * A texture imported from a compositor-owned buffer, attached to the buffer
+ * and owned by the renderer. It survives wlr_scene_buffer_set_buffer() so that
+ * buffers cycling through a scene buffer are only re-uploaded where damaged.
+ */
+struct scene_texture_cache {
+	struct wlr_addon addon; // wlr_buffer.addons
+	struct wlr_buffer *buffer;
+	struct wlr_texture *texture;
+
+	// wlr_scene_buffer.texture_{source,commit} the texture is up to date with
+	uint64_t source, commit;
+
+	struct wl_listener renderer_destroy;
+};
+
+static void scene_texture_cache_destroy(struct scene_texture_cache *cache) {
+	wlr_texture_destroy(cache->texture);
+	wlr_addon_finish(&cache->addon);
+	wl_list_remove(&cache->renderer_destroy.link);
+	free(cache);
+}
+
+static void scene_texture_cache_handle_addon_destroy(struct wlr_addon *addon) {
+	struct scene_texture_cache *cache = wl_container_of(addon, cache, addon);
+	scene_texture_cache_destroy(cache);
+}
+
+static const struct wlr_addon_interface texture_cache_addon_impl = {
+	.name = "wlr_scene_texture_cache",
+	.destroy = scene_texture_cache_handle_addon_destroy,
+};
+
+static void scene_texture_cache_handle_renderer_destroy(
+		struct wl_listener *listener, void *data) {
+	struct scene_texture_cache *cache =
+		wl_container_of(listener, cache, renderer_destroy);
+	scene_texture_cache_destroy(cache);
+}
+
+static bool scene_texture_cache_update(struct scene_texture_cache *cache,
+		struct wlr_scene_buffer *scene_buffer) {
+	if (cache->source == scene_buffer->texture_source &&
+			cache->commit == scene_buffer->texture_commit) {
+		return true;
+	}
+
+	struct wlr_buffer *buffer = cache->buffer;
+	pixman_region32_t damage;
+	pixman_region32_init(&damage);
+	if (cache->source == scene_buffer->texture_source &&
+			scene_buffer->texture_commit - cache->commit <=
+			WLR_SCENE_BUFFER_DAMAGE_LEN) {
+		// The buffer may have been redrawn while other buffers were
+		// displayed: accumulate everything committed since our last upload
+		for (uint64_t i = cache->commit + 1;
+				i <= scene_buffer->texture_commit; i++) {
+			pixman_region32_union(&damage, &damage, &scene_buffer->texture_damage[
+				i % WLR_SCENE_BUFFER_DAMAGE_LEN]);
+		}
+	} else {
+		pixman_region32_union_rect(&damage, &damage,
+			0, 0, buffer->width, buffer->height);
+	}
+
+	bool ok = !pixman_region32_not_empty(&damage) ||
+		wlr_texture_update_from_buffer(cache->texture, buffer, &damage);
+	pixman_region32_fini(&damage);
+	if (!ok) {
+		return false;
+	}
+
+	cache->source = scene_buffer->texture_source;
+	cache->commit = scene_buffer->texture_commit;
+	return true;
+}
+
 static struct wlr_texture *scene_buffer_get_texture(
 		struct wlr_scene_buffer *scene_buffer, struct wlr_renderer *renderer) {
-	struct wlr_client_buffer *client_buffer =
-		wlr_client_buffer_get(scene_buffer->buffer);
+	struct wlr_buffer *buffer = scene_buffer->buffer;
+	struct wlr_client_buffer *client_buffer = wlr_client_buffer_get(buffer);
 	if (client_buffer != NULL) {
-		return client_buffer->texture;
+		return wlr_client_buffer_get_texture(client_buffer, renderer);
 	}
 
 	if (scene_buffer->texture != NULL) {
 		return scene_buffer->texture;
 	}
 
-	scene_buffer->texture =
-		wlr_texture_from_buffer(renderer, scene_buffer->buffer);
-	return scene_buffer->texture;
+	struct wlr_addon *addon = wlr_addon_find(&buffer->addons, renderer,
+		&texture_cache_addon_impl);
+	if (addon != NULL) {
+		struct scene_texture_cache *cache = wl_container_of(addon, cache, addon);
+		if (scene_texture_cache_update(cache, scene_buffer)) {
+			return cache->texture;
+		}
+		scene_texture_cache_destroy(cache);
+	}
+
+	struct wlr_texture *texture = wlr_texture_from_buffer(renderer, buffer);
+	if (texture == NULL) {
+		return NULL;
+	}
+
+	// DMA-BUFs are imported rather than uploaded, and the pixman renderer
+	// wraps the buffer's memory: these textures keep a reference to the
+	// buffer and renderers already keep them attached to it until it's
+	// destroyed. Keep the old per-node texture for them.
+	struct wlr_dmabuf_attributes dmabuf;
+	struct scene_texture_cache *cache = NULL;
+	if (!wlr_buffer_get_dmabuf(buffer, &dmabuf) &&
+			!wlr_renderer_is_pixman(renderer)) {
+		cache = calloc(1, sizeof(*cache));
+	}
+	if (cache == NULL) {
+		scene_buffer->texture = texture;
+		return texture;
+	}
+
+	cache->buffer = buffer;
+	cache->texture = texture;
+	cache->source = scene_buffer->texture_source;
+	cache->commit = scene_buffer->texture_commit;
+	wlr_addon_init(&cache->addon, &buffer->addons, renderer,
+		&texture_cache_addon_impl);
+	cache->renderer_destroy.notify = scene_texture_cache_handle_renderer_destroy;
+	wl_signal_add(&renderer->events.destroy, &cache->renderer_destroy);
+
+	return texture;
 }
 
 static void scene_node_get_size(struct wlr_scene_node *node,
@@ -1007,46 +1334,83 @@ struct wlr_scene_node *wlr_scene_node_at(struct wlr_scene_node *node,
 	return NULL;
 }
 
-static void scissor_output(struct wlr_output *output, pixman_box32_t *rect) {
-	struct wlr_renderer *renderer = output->renderer;
+/**
+ * The buffer nodes are rendered to: either the whole output buffer, or an
+ * overlay buffer covering part of the output.
+ */
+struct render_data {
+	struct wlr_scene_output *scene_output;
+	// Area covered by the target, in output-local coordinates
+	struct wlr_box box;
+	enum wl_output_transform transform;
+	float projection[9];
+	// The frame may be dropped, output_present is sent once it's committed
+	bool defer_present;
+};
+
+static void render_data_init_output(struct render_data *data,
+		struct wlr_scene_output *scene_output) {
+	struct wlr_output *output = scene_output->output;
+	data->scene_output = scene_output;
+	data->box = (struct wlr_box){0};
+	wlr_output_transformed_resolution(output,
+		&data->box.width, &data->box.height);
+	data->transform = output->transform;
+	memcpy(data->projection, output->transform_matrix,
+		sizeof(data->projection));
+	data->defer_present = false;
+}
+
+static void scissor_output(struct render_data *data, pixman_box32_t *rect) {
+	struct wlr_renderer *renderer = data->scene_output->output->renderer;
 	assert(renderer);
 
 	struct wlr_box box = {
-		.x = rect->x1,
-		.y = rect->y1,
+		.x = rect->x1 - data->box.x,
+		.y = rect->y1 - data->box.y,
 		.width = rect->x2 - rect->x1,
 		.height = rect->y2 - rect->y1,
 	};
 
-	int ow, oh;
-	wlr_output_transformed_resolution(output, &ow, &oh);
-
 	enum wl_output_transform transform =
-		wlr_output_transform_invert(output->transform);
-	wlr_box_transform(&box, &box, transform, ow, oh);
+		wlr_output_transform_invert(data->transform);
+	wlr_box_transform(&box, &box, transform,
+		data->box.width, data->box.height);
 
 	wlr_renderer_scissor(renderer, &box);
 }
 
-static void render_rect(struct wlr_output *output,
+static struct wlr_scene_output_stats *scene_output_stats(
+		struct wlr_scene_output *scene_output) {
+	return scene_output->stats_enabled ? &scene_output->stats : NULL;
+}
+
+static void render_rect(struct render_data *data,
 		pixman_region32_t *damage, const float color[static 4],
 		const struct wlr_box *box, const float matrix[static 9]) {
-	struct wlr_renderer *renderer = output->renderer;
+	struct wlr_renderer *renderer = data->scene_output->output->renderer;
 	assert(renderer);
 
 	int nrects;
 	pixman_box32_t *rects = pixman_region32_rectangles(damage, &nrects);
 	for (int i = 0; i < nrects; ++i) {
-		scissor_output(output, &rects[i]);
+		scissor_output(data, &rects[i]);
 		wlr_render_rect(renderer, box, color, matrix);
 	}
+
+	struct wlr_scene_output_stats *stats = scene_output_stats(data->scene_output);
+	if (stats != NULL) {
+		stats->scissor_rects += nrects;
+		stats->draw_calls += nrects;
+		stats->rect_pixels += region_area(damage);
+	}
 }
 
-static void render_texture(struct wlr_output *output,
+static void render_texture(struct render_data *data,
 		pixman_region32_t *damage, struct wlr_texture *texture,
 		const struct wlr_fbox *src_box, const struct wlr_box *dst_box,
 		const float matrix[static 9]) {
-	struct wlr_renderer *renderer = output->renderer;
+	struct wlr_renderer *renderer = data->scene_output->output->renderer;
 	assert(renderer);
 
 	struct wlr_fbox default_src_box = {0};
@@ -1059,13 +1423,28 @@ static void render_texture(struct wlr_output *output,
 	int nrects;
 	pixman_box32_t *rects = pixman_region32_rectangles(damage, &nrects);
 	for (int i = 0; i < nrects; ++i) {
-		scissor_output(output, &rects[i]);
+		scissor_output(data, &rects[i]);
 		wlr_render_subtexture_with_matrix(renderer, texture, src_box, matrix, 1.0);
 	}
+
+	struct wlr_scene_output_stats *stats = scene_output_stats(data->scene_output);
+	if (stats != NULL) {
+		stats->scissor_rects += nrects;
+		stats->draw_calls += nrects;
+		stats->buffer_pixels += region_area(damage);
+	}
 }
 
+/**
+ * Render a node, restricted to render_region in output-local coordinates.
+ */
 static void scene_node_render(struct wlr_scene_node *node,
-		struct wlr_scene_output *scene_output, pixman_region32_t *damage) {
+		struct render_data *data, pixman_region32_t *render_region) {
+	if (!pixman_region32_not_empty(render_region)) {
+		return;
+	}
+
+	struct wlr_scene_output *scene_output = data->scene_output;
 	int x, y;
 	wlr_scene_node_coords(node, &x, &y);
 	x -= scene_output->x;
@@ -1073,23 +1452,14 @@ static void scene_node_render(struct wlr_scene_node *node,
 
 	struct wlr_output *output = scene_output->output;
 
-	pixman_region32_t render_region;
-	pixman_region32_init(&render_region);
-	pixman_region32_copy(&render_region, &node->visible);
-	pixman_region32_translate(&render_region, -scene_output->x, -scene_output->y);
-	scale_output_damage(&render_region, output->scale);
-	pixman_region32_intersect(&render_region, &render_region, damage);
-	if (!pixman_region32_not_empty(&render_region)) {
-		pixman_region32_fini(&render_region);
-		return;
-	}
-
 	struct wlr_box dst_box = {
 		.x = x,
 		.y = y,
 	};
 	scene_node_get_size(node, &dst_box.width, &dst_box.height);
 	scale_box(&dst_box, output->scale);
+	dst_box.x -= data->box.x;
+	dst_box.y -= data->box.y;
 
 	struct wlr_texture *texture;
 	float matrix[9];
@@ -1101,8 +1471,8 @@ static void scene_node_render(struct wlr_scene_node *node,
 	case WLR_SCENE_NODE_RECT:;
 		struct wlr_scene_rect *scene_rect = scene_rect_from_node(node);
 
-		render_rect(output, &render_region, scene_rect->color, &dst_box,
-			output->transform_matrix);
+		render_rect(data, render_region, scene_rect->color, &dst_box,
+			data->projection);
 		break;
 	case WLR_SCENE_NODE_BUFFER:;
 		struct wlr_scene_buffer *scene_buffer = wlr_scene_buffer_from_node(node);
@@ -1116,16 +1486,17 @@ static void scene_node_render(struct wlr_scene_node *node,
 
 		transform = wlr_output_transform_invert(scene_buffer->transform);
 		wlr_matrix_project_box(matrix, &dst_box, transform, 0.0,
-			output->transform_matrix);
+			data->projection);
 
-		render_texture(output, &render_region, texture, &scene_buffer->src_box,
+		render_texture(data, render_region, texture, &scene_buffer->src_box,
 			&dst_box, matrix);
 
-		wl_signal_emit_mutable(&scene_buffer->events.output_present, scene_output);
+		if (!data->defer_present) {
+			wl_signal_emit_mutable(&scene_buffer->events.output_present,
+				scene_output);
+		}
 		break;
 	}
-
-	pixman_region32_fini(&render_region);
 }
 
 static void scene_handle_presentation_destroy(struct wl_listener *listener,
@@ -1145,6 +1516,11 @@ void wlr_scene_set_presentation(struct wlr_scene *scene,
 	wl_signal_add(&presentation->events.destroy, &scene->presentation_destroy);
 }
 
+void wlr_scene_set_hidden_frame_rate(struct wlr_scene *scene, int rate) {
+	assert(rate >= 0);
+	scene->hidden_frame_rate = rate;
+}
+
 static void scene_output_handle_destroy(struct wlr_addon *addon) {
 	struct wlr_scene_output *scene_output =
 		wl_container_of(addon, scene_output, addon);
@@ -1170,7 +1546,16 @@ static void scene_node_output_update(struct wlr_scene_node *node,
 	update_node_update_outputs(node, outputs, ignore);
 }
 
+static void scene_output_drop_render_ahead(struct wlr_scene_output *scene_output);
+
 static void scene_output_update_geometry(struct wlr_scene_output *scene_output) {
+	scene_output_drop_render_ahead(scene_output);
+
+	scene_output->layout_box.x = scene_output->x;
+	scene_output->layout_box.y = scene_output->y;
+	wlr_output_effective_resolution(scene_output->output,
+		&scene_output->layout_box.width, &scene_output->layout_box.height);
+
 	int width, height;
 	wlr_output_transformed_resolution(scene_output->output, &width, &height);
 	wlr_damage_ring_set_bounds(&scene_output->damage_ring, width, height);
@@ -1204,7 +1589,7 @@ static void scene_output_handle_damage(struct wl_listener *listener, void *data)
 		scene_output, output_damage);
 	struct wlr_output_event_damage *event = data;
 	if (wlr_damage_ring_add(&scene_output->damage_ring, event->damage)) {
-		wlr_output_schedule_frame(scene_output->output);
+		scene_output_schedule_frame(scene_output);
 	}
 }
 
@@ -1227,6 +1612,8 @@ struct wlr_scene_output *wlr_scene_output_create(struct wlr_scene *scene,
 
 	wlr_damage_ring_init(&scene_output->damage_ring);
 	wl_list_init(&scene_output->damage_highlight_regions);
+	pixman_region32_init(&scene_output->render_ahead_damage);
+	scene_output->epoch = next_output_epoch++;
 
 	int prev_output_index = -1;
 	struct wl_list *prev_output_link = &scene->outputs;
@@ -1259,6 +1646,10 @@ struct wlr_scene_output *wlr_scene_output_create(struct wlr_scene *scene,
 	scene_output->output_needs_frame.notify = scene_output_handle_needs_frame;
 	wl_signal_add(&output->events.needs_frame, &scene_output->output_needs_frame);
 
+	if (scene->stats_interval > 0) {
+		wlr_scene_output_set_stats_enabled(scene_output, true);
+	}
+
 	scene_output_update_geometry(scene_output);
 
 	return scene_output;
@@ -1285,6 +1676,12 @@ void wlr_scene_output_destroy(struct wlr_scene_output *scene_output) {
 		highlight_region_destroy(damage);
 	}
 
+	scene_output_drop_render_ahead(scene_output);
+	if (scene_output->render_ahead_idle != NULL) {
+		wl_event_source_remove(scene_output->render_ahead_idle);
+	}
+	pixman_region32_fini(&scene_output->render_ahead_damage);
+
 	wlr_addon_finish(&scene_output->addon);
 	wlr_damage_ring_finish(&scene_output->damage_ring);
 	wl_list_remove(&scene_output->link);
@@ -1294,6 +1691,8 @@ void wlr_scene_output_destroy(struct wlr_scene_output *scene_output) {
 	wl_list_remove(&scene_output->output_needs_frame.link);
 
 	wl_array_release(&scene_output->render_list);
+	wl_array_release(&scene_output->render_regions);
+	wlr_swapchain_destroy(scene_output->overlay_swapchain);
 	free(scene_output);
 }
 
@@ -1383,7 +1782,7 @@ static bool construct_render_list_iterator(struct wlr_scene_node *node,
 	return false;
 }
 
-static bool scene_node_try_direct_scanout(struct wlr_scene_node *node,
+static bool scene_node_can_scanout(struct wlr_scene_node *node,
 		struct wlr_scene_output *scene_output, struct wlr_box *box) {
 	if (!scene_output->scene->direct_scanout) {
 		return false;
@@ -1425,115 +1824,404 @@ static bool scene_node_try_direct_scanout(struct wlr_scene_node *node,
 	wlr_scene_node_coords(node, &node_box.x, &node_box.y);
 	scene_node_get_size(node, &node_box.width, &node_box.height);
 
-	if (!wlr_box_equal(box, &node_box)) {
+	return wlr_box_equal(box, &node_box);
+}
+
+static bool scene_node_try_direct_scanout(struct wlr_scene_node *node,
+		struct wlr_scene_output *scene_output, struct wlr_box *box) {
+	if (!scene_node_can_scanout(node, scene_output, box)) {
 		return false;
 	}
 
+	struct wlr_scene_buffer *buffer = wlr_scene_buffer_from_node(node);
+	struct wlr_output *output = scene_output->output;
+
 	wlr_output_attach_buffer(output, buffer->buffer);
+	if (scene_output->overlay_active) {
+		wlr_output_attach_overlay(output, NULL, 0, 0);
+	}
 	if (!wlr_output_test(output)) {
 		wlr_output_rollback(output);
 		return false;
 	}
 
-	return wlr_output_commit(output);
+	if (!wlr_output_commit(output)) {
+		return false;
+	}
+
+	scene_output->overlay_active = false;
+	return true;
 }
 
-bool wlr_scene_output_commit(struct wlr_scene_output *scene_output) {
+static struct wlr_buffer *scene_output_acquire_overlay(
+		struct wlr_scene_output *scene_output, int width, int height) {
 	struct wlr_output *output = scene_output->output;
-	enum wlr_scene_debug_damage_option debug_damage =
-		scene_output->scene->debug_damage_option;
+	struct wlr_allocator *allocator = output->allocator;
+	if (allocator == NULL) {
+		return NULL;
+	}
+
+	struct wlr_swapchain *swapchain = scene_output->overlay_swapchain;
+	if (swapchain == NULL || swapchain->width != width ||
+			swapchain->height != height) {
+		const struct wlr_drm_format_set *display_formats =
+			wlr_output_get_primary_formats(output, allocator->buffer_caps);
+		struct wlr_drm_format *format = output_pick_format(output,
+			display_formats, DRM_FORMAT_ARGB8888);
+		if (format == NULL) {
+			wlr_log(WLR_DEBUG, "Failed to pick overlay format");
+			return NULL;
+		}
+
+		wlr_swapchain_destroy(swapchain);
+		scene_output->overlay_swapchain =
+			wlr_swapchain_create(allocator, width, height, format);
+		free(format);
+		if (scene_output->overlay_swapchain == NULL) {
+			wlr_log(WLR_ERROR, "Failed to create overlay swapchain");
+			return NULL;
+		}
+	}
 
+	return wlr_swapchain_acquire(scene_output->overlay_swapchain, NULL);
+}
+
+static bool scene_output_render_overlay(struct wlr_scene_output *scene_output,
+		struct wlr_scene_node **nodes, int nodes_len,
+		struct wlr_buffer *buffer, const struct wlr_box *box) {
+	struct wlr_output *output = scene_output->output;
 	struct wlr_renderer *renderer = output->renderer;
-	assert(renderer != NULL);
 
-	struct render_list_constructor_data list_con = {
-		.box = { .x = scene_output->x, .y = scene_output->y },
-		.render_list = &scene_output->render_list,
-		.calculate_visibility = scene_output->scene->calculate_visibility,
+	struct render_data data = {
+		.scene_output = scene_output,
+		.box = *box,
+		.transform = WL_OUTPUT_TRANSFORM_NORMAL,
 	};
-	wlr_output_effective_resolution(output,
-		&list_con.box.width, &list_con.box.height);
+	matrix_projection(data.projection, box->width, box->height,
+		WL_OUTPUT_TRANSFORM_NORMAL);
 
-	list_con.render_list->size = 0;
-	scene_nodes_in_box(&scene_output->scene->tree.node, &list_con.box,
-		construct_render_list_iterator, &list_con);
-	array_realloc(list_con.render_list, list_con.render_list->size);
+	if (!wlr_renderer_begin_with_buffer(renderer, buffer)) {
+		return false;
+	}
 
-	int list_len = list_con.render_list->size / sizeof(struct wlr_scene_node *);
-	struct wlr_scene_node **list_data = list_con.render_list->data;
+	wlr_renderer_scissor(renderer, NULL);
+	wlr_renderer_clear(renderer, (float[4]){ 0.0, 0.0, 0.0, 0.0 });
 
-	// if there is only one thing to render let's see if that thing can be
-	// directly scanned out
-	bool scanout = false;
-	if (list_len == 1) {
-		struct wlr_scene_node *node = list_data[0];
-		scanout = scene_node_try_direct_scanout(node, scene_output, &list_con.box);
+	for (int i = nodes_len - 1; i >= 0; i--) {
+		struct wlr_scene_node *node = nodes[i];
+
+		pixman_region32_t render_region;
+		pixman_region32_init(&render_region);
+		pixman_region32_copy(&render_region, &node->visible);
+		pixman_region32_translate(&render_region,
+			-scene_output->x, -scene_output->y);
+		scale_output_damage(&render_region, output->scale);
+		pixman_region32_intersect_rect(&render_region, &render_region,
+			box->x, box->y, box->width, box->height);
+		scene_node_render(node, &data, &render_region);
+		pixman_region32_fini(&render_region);
 	}
 
-	if (scene_output->prev_scanout != scanout) {
-		scene_output->prev_scanout = scanout;
-		wlr_log(WLR_DEBUG, "Direct scan-out %s",
-			scanout ? "enabled" : "disabled");
-		// When exiting direct scan-out, damage everything
-		wlr_damage_ring_add_whole(&scene_output->damage_ring);
+	wlr_renderer_scissor(renderer, NULL);
+	wlr_renderer_end(renderer);
+	return true;
+}
+
+/**
+ * Try to scan out the bottom-most node of the render list, with everything
+ * above it composited into a buffer displayed on the output's overlay plane.
+ */
+static bool scene_output_try_overlay_scanout(
+		struct wlr_scene_output *scene_output, struct wlr_scene_node **list,
+		int list_len, struct wlr_box *box) {
+	struct wlr_output *output = scene_output->output;
+
+	if (scene_output->overlay_retry_delay > 0) {
+		scene_output->overlay_retry_delay--;
+		return false;
 	}
 
-	if (scanout) {
-		struct wlr_scene_node *node = list_data[0];
+	// The overlay is rendered in output buffer coordinates
+	if (output->transform != WL_OUTPUT_TRANSFORM_NORMAL) {
+		return false;
+	}
 
-		assert(node->type == WLR_SCENE_NODE_BUFFER);
-		struct wlr_scene_buffer *buffer = wlr_scene_buffer_from_node(node);
-		wl_signal_emit_mutable(&buffer->events.output_present, scene_output);
-		return true;
+	struct wlr_scene_node *primary = list[list_len - 1];
+	if (!scene_node_can_scanout(primary, scene_output, box)) {
+		return false;
 	}
 
-	if (debug_damage == WLR_SCENE_DEBUG_DAMAGE_RERENDER) {
-		wlr_damage_ring_add_whole(&scene_output->damage_ring);
+	pixman_region32_t overlay_region;
+	pixman_region32_init(&overlay_region);
+	for (int i = 0; i < list_len - 1; i++) {
+		pixman_region32_union(&overlay_region, &overlay_region,
+			&list[i]->visible);
+	}
+	pixman_region32_translate(&overlay_region,
+		-scene_output->x, -scene_output->y);
+	scale_output_damage(&overlay_region, output->scale);
+	pixman_region32_intersect_rect(&overlay_region, &overlay_region,
+		0, 0, output->width, output->height);
+	pixman_box32_t *extents = pixman_region32_extents(&overlay_region);
+	struct wlr_box overlay_box = {
+		.x = extents->x1,
+		.y = extents->y1,
+		.width = extents->x2 - extents->x1,
+		.height = extents->y2 - extents->y1,
+	};
+	pixman_region32_fini(&overlay_region);
+
+	if (wlr_box_empty(&overlay_box) ||
+			(int64_t)overlay_box.width * overlay_box.height >
+			(int64_t)output->width * output->height / OVERLAY_MAX_FRACTION) {
+		return false;
 	}
 
-	struct timespec now;
-	if (debug_damage == WLR_SCENE_DEBUG_DAMAGE_HIGHLIGHT) {
-		struct wl_list *regions = &scene_output->damage_highlight_regions;
-		clock_gettime(CLOCK_MONOTONIC, &now);
+	struct wlr_buffer *overlay_buffer = scene_output_acquire_overlay(
+		scene_output, overlay_box.width, overlay_box.height);
+	if (overlay_buffer == NULL) {
+		scene_output->overlay_retry_delay = OVERLAY_RETRY_DELAY;
+		return false;
+	}
 
-		// add the current frame's damage if there is damage
-		if (pixman_region32_not_empty(&scene_output->damage_ring.current)) {
-			struct highlight_region *current_damage =
-				calloc(1, sizeof(*current_damage));
-			if (current_damage) {
-				pixman_region32_init(&current_damage->region);
-				pixman_region32_copy(&current_damage->region,
-					&scene_output->damage_ring.current);
-				current_damage->when = now;
-				wl_list_insert(regions, &current_damage->link);
-			}
+	struct wlr_scene_buffer *buffer = wlr_scene_buffer_from_node(primary);
+	wlr_output_attach_buffer(output, buffer->buffer);
+	wlr_output_attach_overlay(output, overlay_buffer,
+		overlay_box.x, overlay_box.y);
+
+	struct wlr_scene_output_stats *stats = scene_output_stats(scene_output);
+	// The backend doesn't look at the overlay contents when testing, only
+	// render them once we know they'll be used
+	if (!wlr_output_test(output) ||
+			!scene_output_render_overlay(scene_output, list, list_len - 1,
+				overlay_buffer, &overlay_box)) {
+		wlr_output_rollback(output);
+		wlr_buffer_unlock(overlay_buffer);
+		scene_output->overlay_retry_delay = OVERLAY_RETRY_DELAY;
+		if (stats != NULL) {
+			stats->overlay_misses++;
 		}
+		return false;
+	}
+	wlr_buffer_unlock(overlay_buffer);
 
-		pixman_region32_t acc_damage;
-		pixman_region32_init(&acc_damage);
-		struct highlight_region *damage, *tmp_damage;
-		wl_list_for_each_safe(damage, tmp_damage, regions, link) {
-			// remove overlaping damage regions
-			pixman_region32_subtract(&damage->region, &damage->region, &acc_damage);
-			pixman_region32_union(&acc_damage, &acc_damage, &damage->region);
-
-			// if this damage is too old or has nothing in it, get rid of it
-			struct timespec time_diff;
-			timespec_sub(&time_diff, &now, &damage->when);
-			if (timespec_to_msec(&time_diff) >= HIGHLIGHT_DAMAGE_FADEOUT_TIME ||
-					!pixman_region32_not_empty(&damage->region)) {
-				highlight_region_destroy(damage);
-			}
+	if (!wlr_output_commit(output)) {
+		if (stats != NULL) {
+			stats->overlay_misses++;
 		}
+		return false;
+	}
 
-		wlr_damage_ring_add(&scene_output->damage_ring, &acc_damage);
-		pixman_region32_fini(&acc_damage);
+	if (!scene_output->overlay_active) {
+		wlr_log(WLR_DEBUG, "Direct scan-out with overlay enabled");
+	}
+	scene_output->overlay_active = true;
+	if (stats != NULL) {
+		stats->overlay_hits++;
 	}
+	return true;
+}
+
+void wlr_scene_output_set_stats_enabled(struct wlr_scene_output *scene_output,
+		bool enabled) {
+	if (scene_output->stats_enabled == enabled) {
+		return;
+	}
+
+	scene_output->stats_enabled = enabled;
+	if (enabled) {
+		memset(&scene_output->stats, 0, sizeof(scene_output->stats));
+		memset(&scene_output->logged_stats, 0, sizeof(scene_output->logged_stats));
+		clock_gettime(CLOCK_MONOTONIC, &scene_output->stats_logged_at);
+	}
+}
+
+bool wlr_scene_output_get_stats(struct wlr_scene_output *scene_output,
+		struct wlr_scene_output_stats *stats) {
+	if (!scene_output->stats_enabled) {
+		return false;
+	}
+
+	*stats = scene_output->stats;
+	return true;
+}
+
+static void scene_output_log_stats(struct wlr_scene_output *scene_output) {
+	int interval = scene_output->scene->stats_interval;
+	if (interval <= 0 || !scene_output->stats_enabled) {
+		return;
+	}
+
+	struct timespec now, elapsed;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	timespec_sub(&elapsed, &now, &scene_output->stats_logged_at);
+	if (timespec_to_msec(&elapsed) < (int64_t)interval * 1000) {
+		return;
+	}
+
+	const struct wlr_scene_output_stats *cur = &scene_output->stats;
+	const struct wlr_scene_output_stats *prev = &scene_output->logged_stats;
+	uint64_t damage = cur->damage_pixels - prev->damage_pixels;
+	uint64_t drawn = (cur->background_pixels - prev->background_pixels) +
+		(cur->rect_pixels - prev->rect_pixels) +
+		(cur->buffer_pixels - prev->buffer_pixels);
+	wlr_log(WLR_INFO, "Scene output %s: %"PRIu64" frames, "
+		"%"PRIu64" damaged px, %"PRIu64" drawn px (overdraw %.2f), "
+		"%"PRIu64" background px, %"PRIu64" rect px, %"PRIu64" buffer px, "
+		"%"PRIu64" draw calls, %"PRIu64" nodes drawn, %"PRIu64" culled, "
+		"scan-out %"PRIu64" hits %"PRIu64" misses, "
+		"overlay %"PRIu64" hits %"PRIu64" misses, "
+		"render-ahead %"PRIu64" hits %"PRIu64" drops",
+		scene_output->output->name, cur->frames - prev->frames,
+		damage, drawn, damage > 0 ? (double)drawn / damage : 0.0,
+		cur->background_pixels - prev->background_pixels,
+		cur->rect_pixels - prev->rect_pixels,
+		cur->buffer_pixels - prev->buffer_pixels,
+		cur->draw_calls - prev->draw_calls,
+		cur->nodes_drawn - prev->nodes_drawn,
+		cur->nodes_culled - prev->nodes_culled,
+		cur->scanout_hits - prev->scanout_hits,
+		cur->scanout_misses - prev->scanout_misses,
+		cur->overlay_hits - prev->overlay_hits,
+		cur->overlay_misses - prev->overlay_misses,
+		cur->render_ahead_hits - prev->render_ahead_hits,
+		cur->render_ahead_drops - prev->render_ahead_drops);
+
+	scene_output->logged_stats = *cur;
+	scene_output->stats_logged_at = now;
+}
+
+struct scene_buffer_seq {
+	struct wlr_addon addon; // wlr_buffer.addons, owned by the scene output
+	uint64_t epoch, seq;
+};
+
+static void scene_buffer_seq_handle_destroy(struct wlr_addon *addon) {
+	struct scene_buffer_seq *buffer_seq =
+		wl_container_of(addon, buffer_seq, addon);
+	wlr_addon_finish(&buffer_seq->addon);
+	free(buffer_seq);
+}
+
+static const struct wlr_addon_interface buffer_seq_addon_impl = {
+	.name = "wlr_scene_output_buffer_seq",
+	.destroy = scene_buffer_seq_handle_destroy,
+};
+
+/**
+ * Get the age of a back buffer from the frames rendered by the scene output.
+ *
+ * Frames rendered ahead may be dropped without ever being submitted, so the
+ * swapchain's own buffer age can't be trusted in that mode.
+ */
+static int scene_output_buffer_age(struct wlr_scene_output *scene_output,
+		struct wlr_buffer *buffer) {
+	struct wlr_addon *addon = wlr_addon_find(&buffer->addons, scene_output,
+		&buffer_seq_addon_impl);
+	if (addon == NULL) {
+		return 0;
+	}
+
+	struct scene_buffer_seq *buffer_seq =
+		wl_container_of(addon, buffer_seq, addon);
+	if (buffer_seq->epoch != scene_output->epoch) {
+		// Left over by a destroyed scene output at the same address
+		return 0;
+	}
+
+	uint64_t age = scene_output->render_seq - buffer_seq->seq + 1;
+	return age > INT_MAX ? 0 : (int)age;
+}
+
+/**
+ * Account for a frame rendered into a back buffer, once its damage won't be
+ * needed anymore.
+ */
+static void scene_output_frame_rendered(struct wlr_scene_output *scene_output,
+		struct wlr_buffer *buffer) {
+	wlr_damage_ring_rotate(&scene_output->damage_ring);
+	scene_output->render_seq++;
+
+	if (scene_output->render_ahead_depth == 0) {
+		return;
+	}
+
+	struct scene_buffer_seq *buffer_seq;
+	struct wlr_addon *addon = wlr_addon_find(&buffer->addons, scene_output,
+		&buffer_seq_addon_impl);
+	if (addon != NULL) {
+		buffer_seq = wl_container_of(addon, buffer_seq, addon);
+	} else {
+		buffer_seq = calloc(1, sizeof(*buffer_seq));
+		if (buffer_seq == NULL) {
+			return;
+		}
+		wlr_addon_init(&buffer_seq->addon, &buffer->addons, scene_output,
+			&buffer_seq_addon_impl);
+	}
+	buffer_seq->epoch = scene_output->epoch;
+	buffer_seq->seq = scene_output->render_seq;
+}
+
+static void scene_output_set_frame_damage(struct wlr_scene_output *scene_output,
+		pixman_region32_t *damage) {
+	struct wlr_output *output = scene_output->output;
+
+	int tr_width, tr_height;
+	wlr_output_transformed_resolution(output, &tr_width, &tr_height);
+
+	enum wl_output_transform transform =
+		wlr_output_transform_invert(output->transform);
+
+	pixman_region32_t frame_damage;
+	pixman_region32_init(&frame_damage);
+	wlr_region_transform(&frame_damage, damage, transform, tr_width, tr_height);
+	wlr_output_set_damage(output, &frame_damage);
+	pixman_region32_fini(&frame_damage);
+}
+
+static int scene_output_build_render_list(struct wlr_scene_output *scene_output,
+		struct wlr_box *box) {
+	struct render_list_constructor_data list_con = {
+		.box = { .x = scene_output->x, .y = scene_output->y },
+		.render_list = &scene_output->render_list,
+		.calculate_visibility = scene_output->scene->calculate_visibility,
+	};
+	wlr_output_effective_resolution(scene_output->output,
+		&list_con.box.width, &list_con.box.height);
+
+	list_con.render_list->size = 0;
+	scene_nodes_in_box(&scene_output->scene->tree.node, &list_con.box,
+		construct_render_list_iterator, &list_con);
+	array_realloc(list_con.render_list, list_con.render_list->size);
+
+	*box = list_con.box;
+	return list_con.render_list->size / sizeof(struct wlr_scene_node *);
+}
+
+/**
+ * Render the scene into a back buffer attached to the output, and set the
+ * frame damage. *rendered is set to false if there was nothing to render, in
+ * which case the output state is rolled back. Frames rendered ahead don't send
+ * output_present, see scene_output_commit_render_ahead().
+ */
+static bool scene_output_render_frame(struct wlr_scene_output *scene_output,
+		struct wlr_scene_node **list_data, int list_len,
+		const struct timespec *now, bool ahead, bool *rendered) {
+	struct wlr_output *output = scene_output->output;
+	struct wlr_renderer *renderer = output->renderer;
+	enum wlr_scene_debug_damage_option debug_damage =
+		scene_output->scene->debug_damage_option;
+
+	*rendered = false;
 
 	int buffer_age;
 	if (!wlr_output_attach_render(output, &buffer_age)) {
 		return false;
 	}
+	if (scene_output->render_ahead_depth > 0) {
+		buffer_age = scene_output_buffer_age(scene_output, output->back_buffer);
+	}
 
 	pixman_region32_t damage;
 	pixman_region32_init(&damage);
@@ -1546,59 +2234,117 @@ bool wlr_scene_output_commit(struct wlr_scene_output *scene_output) {
 		return true;
 	}
 
-	wlr_renderer_begin(renderer, output->width, output->height);
-
 	pixman_region32_t background;
 	pixman_region32_init(&background);
 	pixman_region32_copy(&background, &damage);
 
-	// Cull areas of the background that are occluded by opaque regions of
-	// scene nodes above. Those scene nodes will just render atop having us
-	// never see the background.
-	if (scene_output->scene->calculate_visibility) {
-		float output_scale = scene_output->output->scale;
+	scene_output->render_regions.size = 0;
+	pixman_region32_t *render_regions = wl_array_add(
+		&scene_output->render_regions, list_len * sizeof(pixman_region32_t));
+	if (render_regions == NULL && list_len > 0) {
+		wlr_log(WLR_ERROR, "Allocation failed");
+		pixman_region32_fini(&background);
+		pixman_region32_fini(&damage);
+		wlr_output_rollback(output);
+		return false;
+	}
+
+	struct timespec render_start;
+	clock_gettime(CLOCK_MONOTONIC, &render_start);
 
-		for (int i = list_len - 1; i >= 0; i--) {
-			struct wlr_scene_node *node = list_data[i];
-			int x, y;
-			wlr_scene_node_coords(node, &x, &y);
-
-			// We must only cull opaque regions that are visible by the node.
-			// The node's visibility will have the knowledge of a black rect
-			// that may have been omitted from the render list via the black
-			// rect optimization. In order to ensure we don't cull background
-			// rendering in that black rect region, consider the node's visibility.
-			pixman_region32_t opaque;
-			pixman_region32_init(&opaque);
-			scene_node_opaque_region(node, x, y, &opaque);
-			pixman_region32_intersect(&opaque, &opaque, &node->visible);
-
-			pixman_region32_translate(&opaque, -scene_output->x, -scene_output->y);
-			wlr_region_scale(&opaque, &opaque, output_scale);
-			pixman_region32_subtract(&background, &background, &opaque);
-			pixman_region32_fini(&opaque);
+	// Walk the render list front to back, so that nodes are never drawn where
+	// they are covered by opaque nodes above them. The same occlusion is used
+	// to cull the background.
+	struct wlr_scene_output_stats *stats = scene_output_stats(scene_output);
+	float output_scale = output->scale;
+	bool fractional_scale = floor(output_scale) != output_scale;
+	bool cull_occluded = scene_output->scene->cull_occluded;
+	pixman_region32_t occluded;
+	pixman_region32_init(&occluded);
+	for (int i = 0; i < list_len; i++) {
+		struct wlr_scene_node *node = list_data[i];
+		int x, y;
+		wlr_scene_node_coords(node, &x, &y);
+
+		pixman_region32_t *render_region = &render_regions[i];
+		pixman_region32_init(render_region);
+		pixman_region32_copy(render_region, &node->visible);
+		pixman_region32_translate(render_region, -scene_output->x, -scene_output->y);
+		scale_output_damage(render_region, output_scale);
+		pixman_region32_intersect(render_region, render_region, &damage);
+
+		if (cull_occluded && pixman_region32_not_empty(render_region) &&
+				pixman_region32_not_empty(&occluded)) {
+			pixman_region32_t unoccluded;
+			pixman_region32_init(&unoccluded);
+			pixman_region32_subtract(&unoccluded, render_region, &occluded);
+			if (fractional_scale && pixman_region32_not_empty(&unoccluded)) {
+				// edges of the nodes above may not cover whole pixels
+				wlr_region_expand(&unoccluded, &unoccluded, 1);
+				pixman_region32_intersect(&unoccluded, &unoccluded, render_region);
+			}
+			if (stats != NULL && !pixman_region32_not_empty(&unoccluded)) {
+				stats->nodes_culled++;
+			}
+			pixman_region32_copy(render_region, &unoccluded);
+			pixman_region32_fini(&unoccluded);
+		}
+		if (stats != NULL && pixman_region32_not_empty(render_region)) {
+			stats->nodes_drawn++;
 		}
 
-		if (floor(output_scale) != output_scale) {
-			wlr_region_expand(&background, &background, 1);
+		// We must only cull opaque regions that are visible by the node.
+		// The node's visibility will have the knowledge of a black rect
+		// that may have been omitted from the render list via the black
+		// rect optimization. In order to ensure we don't cull background
+		// rendering in that black rect region, consider the node's visibility.
+		pixman_region32_t opaque;
+		pixman_region32_init(&opaque);
+		scene_node_opaque_region(node, x, y, &opaque);
+		pixman_region32_intersect(&opaque, &opaque, &node->visible);
 
-			// reintersect with the damage because we never want to render
-			// outside of the damage region
-			pixman_region32_intersect(&background, &background, &damage);
-		}
+		pixman_region32_translate(&opaque, -scene_output->x, -scene_output->y);
+		wlr_region_scale(&opaque, &opaque, output_scale);
+		pixman_region32_union(&occluded, &occluded, &opaque);
+		pixman_region32_fini(&opaque);
+	}
+
+	pixman_region32_subtract(&background, &background, &occluded);
+	pixman_region32_fini(&occluded);
+
+	if (fractional_scale) {
+		wlr_region_expand(&background, &background, 1);
+
+		// reintersect with the damage because we never want to render
+		// outside of the damage region
+		pixman_region32_intersect(&background, &background, &damage);
 	}
 
+	wlr_renderer_begin(renderer, output->width, output->height);
+
+	struct render_data render_data;
+	render_data_init_output(&render_data, scene_output);
+	render_data.defer_present = ahead;
+
 	int nrects;
 	pixman_box32_t *rects = pixman_region32_rectangles(&background, &nrects);
 	for (int i = 0; i < nrects; ++i) {
-		scissor_output(output, &rects[i]);
+		scissor_output(&render_data, &rects[i]);
 		wlr_renderer_clear(renderer, (float[4]){ 0.0, 0.0, 0.0, 1.0 });
 	}
+	if (stats != NULL) {
+		stats->frames++;
+		stats->damage_pixels += region_area(&damage);
+		stats->background_pixels += region_area(&background);
+		stats->scissor_rects += nrects;
+		stats->draw_calls += nrects;
+	}
 	pixman_region32_fini(&background);
 
 	for (int i = list_len - 1; i >= 0; i--) {
 		struct wlr_scene_node *node = list_data[i];
-		scene_node_render(node, scene_output, &damage);
+		scene_node_render(node, &render_data, &render_regions[i]);
+		pixman_region32_fini(&render_regions[i]);
 	}
 
 	wlr_renderer_scissor(renderer, NULL);
@@ -1607,7 +2353,7 @@ bool wlr_scene_output_commit(struct wlr_scene_output *scene_output) {
 		struct highlight_region *damage;
 		wl_list_for_each(damage, &scene_output->damage_highlight_regions, link) {
 			struct timespec time_diff;
-			timespec_sub(&time_diff, &now, &damage->when);
+			timespec_sub(&time_diff, now, &damage->when);
 			int64_t time_diff_ms = timespec_to_msec(&time_diff);
 			float alpha = 1.0 - (double)time_diff_ms / HIGHLIGHT_DAMAGE_FADEOUT_TIME;
 
@@ -1632,26 +2378,329 @@ bool wlr_scene_output_commit(struct wlr_scene_output *scene_output) {
 	wlr_renderer_end(renderer);
 	pixman_region32_fini(&damage);
 
-	int tr_width, tr_height;
-	wlr_output_transformed_resolution(output, &tr_width, &tr_height);
+	struct timespec render_end, render_time;
+	clock_gettime(CLOCK_MONOTONIC, &render_end);
+	timespec_sub(&render_time, &render_end, &render_start);
+	int64_t render_nsec = timespec_to_nsec(&render_time);
+	if (scene_output->render_time == 0) {
+		scene_output->render_time = render_nsec;
+	} else {
+		scene_output->render_time =
+			(scene_output->render_time * 7 + render_nsec) / 8;
+	}
 
-	enum wl_output_transform transform =
-		wlr_output_transform_invert(output->transform);
+	scene_output_set_frame_damage(scene_output,
+		&scene_output->damage_ring.current);
 
-	pixman_region32_t frame_damage;
-	pixman_region32_init(&frame_damage);
-	wlr_region_transform(&frame_damage,
-		&scene_output->damage_ring.current,
-		transform, tr_width, tr_height);
-	wlr_output_set_damage(output, &frame_damage);
-	pixman_region32_fini(&frame_damage);
+	*rendered = true;
+	return true;
+}
+
+static void scene_output_drop_render_ahead(struct wlr_scene_output *scene_output) {
+	if (scene_output->render_ahead_len == 0) {
+		return;
+	}
+
+	struct wlr_scene_output_stats *stats = scene_output_stats(scene_output);
+	for (int i = 0; i < scene_output->render_ahead_len; i++) {
+		wlr_buffer_unlock(scene_output->render_ahead[i]);
+		scene_output->render_ahead[i] = NULL;
+		if (stats != NULL) {
+			stats->render_ahead_drops++;
+		}
+	}
+	scene_output->render_ahead_len = 0;
+
+	// The next frame also needs to tell the backend about the damage of the
+	// frames that have been rendered but never committed
+	wlr_damage_ring_add(&scene_output->damage_ring,
+		&scene_output->render_ahead_damage);
+	pixman_region32_clear(&scene_output->render_ahead_damage);
+}
+
+/**
+ * Send output_present to the buffers drawn in the frames rendered ahead, now
+ * that the last of them has been committed. The scene didn't change since, so
+ * the render list is the one these frames have been rendered from.
+ */
+static void scene_output_send_render_ahead_present(
+		struct wlr_scene_output *scene_output) {
+	struct wlr_box box;
+	int list_len = scene_output_build_render_list(scene_output, &box);
+	struct wlr_scene_node **list_data = scene_output->render_list.data;
+
+	for (int i = 0; i < list_len; i++) {
+		struct wlr_scene_node *node = list_data[i];
+		if (node->type != WLR_SCENE_NODE_BUFFER) {
+			continue;
+		}
+
+		pixman_region32_t render_region;
+		pixman_region32_init(&render_region);
+		pixman_region32_copy(&render_region, &node->visible);
+		pixman_region32_translate(&render_region,
+			-scene_output->x, -scene_output->y);
+		scale_output_damage(&render_region, scene_output->output->scale);
+		pixman_region32_intersect(&render_region, &render_region,
+			&scene_output->render_ahead_damage);
+		bool drawn = pixman_region32_not_empty(&render_region);
+		pixman_region32_fini(&render_region);
+
+		if (drawn) {
+			struct wlr_scene_buffer *scene_buffer =
+				wlr_scene_buffer_from_node(node);
+			wl_signal_emit_mutable(&scene_buffer->events.output_present,
+				scene_output);
+		}
+	}
+}
+
+static bool scene_output_commit_render_ahead(
+		struct wlr_scene_output *scene_output) {
+	struct wlr_output *output = scene_output->output;
+	int last = scene_output->render_ahead_len - 1;
+	struct wlr_buffer *buffer = scene_output->render_ahead[last];
+
+	wlr_output_attach_buffer(output, buffer);
+	scene_output_set_frame_damage(scene_output,
+		&scene_output->render_ahead_damage);
+	if (scene_output->overlay_active) {
+		wlr_output_attach_overlay(output, NULL, 0, 0);
+	}
+
+	if (!wlr_output_commit(output)) {
+		scene_output_drop_render_ahead(scene_output);
+		return false;
+	}
+
+	scene_output_send_render_ahead_present(scene_output);
+
+	// Older frames are superseded by the committed one
+	struct wlr_scene_output_stats *stats = scene_output_stats(scene_output);
+	for (int i = 0; i < scene_output->render_ahead_len; i++) {
+		wlr_buffer_unlock(scene_output->render_ahead[i]);
+		scene_output->render_ahead[i] = NULL;
+		if (stats != NULL) {
+			if (i == last) {
+				stats->render_ahead_hits++;
+			} else {
+				stats->render_ahead_drops++;
+			}
+		}
+	}
+	scene_output->render_ahead_len = 0;
+	pixman_region32_clear(&scene_output->render_ahead_damage);
+	scene_output->overlay_active = false;
+
+	scene_output_log_stats(scene_output);
+	return true;
+}
+
+/**
+ * Check whether a frame rendered now can be ready before the frame event of
+ * the pending frame, which is expected one refresh after the last present.
+ */
+static bool scene_output_render_ahead_in_time(
+		struct wlr_scene_output *scene_output) {
+	struct wlr_output *output = scene_output->output;
+	int64_t refresh = output_get_refresh_nsec(output);
+	int64_t since_present = output_get_time_since_present(output);
+	if (refresh <= 0 || since_present < 0) {
+		return true;
+	}
+
+	return since_present + scene_output->render_time <= refresh;
+}
+
+static void scene_output_handle_render_ahead(void *data) {
+	struct wlr_scene_output *scene_output = data;
+	struct wlr_output *output = scene_output->output;
+	scene_output->render_ahead_idle = NULL;
+
+	// Don't clobber state staged by the compositor, and let the frame event
+	// take care of outputs which aren't waiting for a present or are being
+	// scanned out directly
+	if (!output->enabled || !output->frame_pending ||
+			output->pending.committed != 0 || scene_output->prev_scanout ||
+			scene_output->scene->debug_damage_option ==
+				WLR_SCENE_DEBUG_DAMAGE_HIGHLIGHT ||
+			scene_output->render_ahead_len >= scene_output->render_ahead_depth ||
+			!pixman_region32_not_empty(&scene_output->damage_ring.current) ||
+			!scene_output_render_ahead_in_time(scene_output)) {
+		return;
+	}
+
+	struct wlr_box box;
+	int list_len = scene_output_build_render_list(scene_output, &box);
+	struct wlr_scene_node **list_data = scene_output->render_list.data;
+
+	bool rendered;
+	if (!scene_output_render_frame(scene_output, list_data, list_len,
+			NULL, true, &rendered) || !rendered) {
+		return;
+	}
+
+	struct wlr_buffer *buffer = wlr_buffer_lock(output->back_buffer);
+	pixman_region32_union(&scene_output->render_ahead_damage,
+		&scene_output->render_ahead_damage,
+		&scene_output->damage_ring.current);
+	wlr_output_rollback(output);
+
+	scene_output->render_ahead[scene_output->render_ahead_len++] = buffer;
+	scene_output_frame_rendered(scene_output, buffer);
+}
+
+void wlr_scene_output_set_render_ahead(struct wlr_scene_output *scene_output,
+		int depth) {
+	assert(depth >= 0);
+	if (depth > WLR_SCENE_RENDER_AHEAD_MAX) {
+		depth = WLR_SCENE_RENDER_AHEAD_MAX;
+	}
+
+	if (depth == scene_output->render_ahead_depth) {
+		return;
+	}
+
+	// Buffer ages are tracked differently with and without render-ahead, and
+	// the damage ring has been rotated for frames which were never committed
+	wlr_damage_ring_add_whole(&scene_output->damage_ring);
+	wlr_output_schedule_frame(scene_output->output);
+
+	scene_output->render_ahead_depth = depth;
+	if (depth == 0) {
+		scene_output_drop_render_ahead(scene_output);
+		if (scene_output->render_ahead_idle != NULL) {
+			wl_event_source_remove(scene_output->render_ahead_idle);
+			scene_output->render_ahead_idle = NULL;
+		}
+	}
+}
+
+bool wlr_scene_output_commit(struct wlr_scene_output *scene_output) {
+	struct wlr_output *output = scene_output->output;
+	enum wlr_scene_debug_damage_option debug_damage =
+		scene_output->scene->debug_damage_option;
+
+	assert(output->renderer != NULL);
+
+	if (scene_output->render_ahead_len > 0) {
+		if (!pixman_region32_not_empty(&scene_output->damage_ring.current)) {
+			return scene_output_commit_render_ahead(scene_output);
+		}
+		// The scene changed since, render a fresh frame
+		scene_output_drop_render_ahead(scene_output);
+	}
+
+	struct wlr_box box;
+	int list_len = scene_output_build_render_list(scene_output, &box);
+	struct wlr_scene_node **list_data = scene_output->render_list.data;
+
+	// if there is only one thing to render let's see if that thing can be
+	// directly scanned out
+	bool scanout = false;
+	if (list_len == 1) {
+		struct wlr_scene_node *node = list_data[0];
+		scanout = scene_node_try_direct_scanout(node, scene_output, &box);
+
+		struct wlr_scene_output_stats *stats = scene_output_stats(scene_output);
+		if (stats != NULL) {
+			if (scanout) {
+				stats->scanout_hits++;
+			} else {
+				stats->scanout_misses++;
+			}
+		}
+	} else if (list_len > 1) {
+		scanout = scene_output_try_overlay_scanout(scene_output,
+			list_data, list_len, &box);
+	}
+
+	if (scene_output->prev_scanout != scanout) {
+		scene_output->prev_scanout = scanout;
+		wlr_log(WLR_DEBUG, "Direct scan-out %s",
+			scanout ? "enabled" : "disabled");
+		// When exiting direct scan-out, damage everything
+		wlr_damage_ring_add_whole(&scene_output->damage_ring);
+	}
+
+	if (scanout) {
+		// the scanned out buffer is always at the bottom of the list
+		struct wlr_scene_node *node = list_data[list_len - 1];
+
+		assert(node->type == WLR_SCENE_NODE_BUFFER);
+		struct wlr_scene_buffer *buffer = wlr_scene_buffer_from_node(node);
+		wl_signal_emit_mutable(&buffer->events.output_present, scene_output);
+		scene_output_log_stats(scene_output);
+		return true;
+	}
+
+	if (debug_damage == WLR_SCENE_DEBUG_DAMAGE_RERENDER) {
+		wlr_damage_ring_add_whole(&scene_output->damage_ring);
+	}
+
+	struct timespec now;
+	if (debug_damage == WLR_SCENE_DEBUG_DAMAGE_HIGHLIGHT) {
+		struct wl_list *regions = &scene_output->damage_highlight_regions;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+
+		// add the current frame's damage if there is damage
+		if (pixman_region32_not_empty(&scene_output->damage_ring.current)) {
+			struct highlight_region *current_damage =
+				calloc(1, sizeof(*current_damage));
+			if (current_damage) {
+				pixman_region32_init(&current_damage->region);
+				pixman_region32_copy(&current_damage->region,
+					&scene_output->damage_ring.current);
+				current_damage->when = now;
+				wl_list_insert(regions, &current_damage->link);
+			}
+		}
+
+		pixman_region32_t acc_damage;
+		pixman_region32_init(&acc_damage);
+		struct highlight_region *damage, *tmp_damage;
+		wl_list_for_each_safe(damage, tmp_damage, regions, link) {
+			// remove overlaping damage regions
+			pixman_region32_subtract(&damage->region, &damage->region, &acc_damage);
+			pixman_region32_union(&acc_damage, &acc_damage, &damage->region);
+
+			// if this damage is too old or has nothing in it, get rid of it
+			struct timespec time_diff;
+			timespec_sub(&time_diff, &now, &damage->when);
+			if (timespec_to_msec(&time_diff) >= HIGHLIGHT_DAMAGE_FADEOUT_TIME ||
+					!pixman_region32_not_empty(&damage->region)) {
+				highlight_region_destroy(damage);
+			}
+		}
+
+		wlr_damage_ring_add(&scene_output->damage_ring, &acc_damage);
+		pixman_region32_fini(&acc_damage);
+	}
+
+	bool rendered;
+	if (!scene_output_render_frame(scene_output, list_data, list_len,
+			&now, false, &rendered)) {
+		return false;
+	}
+	if (!rendered) {
+		return true;
+	}
+
+	struct wlr_buffer *buffer = output->back_buffer;
+
+	if (scene_output->overlay_active) {
+		wlr_output_attach_overlay(output, NULL, 0, 0);
+	}
 
 	bool success = wlr_output_commit(output);
 
 	if (success) {
-		wlr_damage_ring_rotate(&scene_output->damage_ring);
+		scene_output_frame_rendered(scene_output, buffer);
+		scene_output->overlay_active = false;
 	}
 
+	scene_output_log_stats(scene_output);
+
 	if (debug_damage == WLR_SCENE_DEBUG_DAMAGE_HIGHLIGHT &&
 			!wl_list_empty(&scene_output->damage_highlight_regions)) {
 		wlr_output_schedule_frame(scene_output->output);
@@ -7,6 +7,7 @@
 #include <wlr/types/wlr_data_device.h>
 #include <wlr/util/log.h>
 #include "types/wlr_data_device.h"
+#include "types/wlr_keyboard.h"
 #include "types/wlr_seat.h"
 
 static void default_keyboard_enter(struct wlr_seat_keyboard_grab *grab,
@@ -345,9 +346,16 @@ void wlr_seat_keyboard_notify_key(struct wlr_seat *seat, uint32_t time,
 
 static void seat_client_send_keymap(struct wlr_seat_client *client,
 		struct wlr_keyboard *keyboard) {
-	if (!keyboard) {
+	if (!keyboard || !keyboard->keymap_shm) {
+		return;
+	}
+
+	// Keyboards with identical keymaps share the same keymap file, so there
+	// is no need to resend it when switching between them
+	if (client->keymap_id == keyboard->keymap_shm->id) {
 		return;
 	}
+	client->keymap_id = keyboard->keymap_shm->id;
 
 	// TODO: We should probably lift all of the keys set by the other
 	// keyboard
@@ -403,7 +411,13 @@ void seat_client_create_keyboard(struct wlr_seat_client *seat_client,
 	if (keyboard == NULL) {
 		return;
 	}
-	seat_client_send_keymap(seat_client, keyboard);
+	if (keyboard->keymap_fd >= 0) {
+		wl_keyboard_send_keymap(resource, WL_KEYBOARD_KEYMAP_FORMAT_XKB_V1,
+			keyboard->keymap_fd, keyboard->keymap_size);
+		if (keyboard->keymap_shm != NULL) {
+			seat_client->keymap_id = keyboard->keymap_shm->id;
+		}
+	}
 	seat_client_send_repeat_info(seat_client, keyboard);
 
 	struct wlr_seat_client *focused_client =
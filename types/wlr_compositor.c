@@ -1,4 +1,5 @@
 #include <assert.h>
+#include <drm_fourcc.h>
 #include <stdlib.h>
 #include <wayland-server-core.h>
 #include <wlr/render/interface.h>
@@ -13,6 +14,8 @@
 #include "types/wlr_buffer.h"
 #include "types/wlr_region.h"
 #include "types/wlr_subcompositor.h"
+#include "util/alpha.h"
+#include "util/env.h"
 #include "util/time.h"
 
 #define COMPOSITOR_VERSION 5
@@ -340,6 +343,93 @@ static void surface_state_move(struct wlr_surface_state *state,
 	next->cached_state_locks = 0;
 }
 
+static void alpha_opaque_add_rows(pixman_region32_t *region,
+		const pixman_box32_t *rect, int y1, int y2) {
+	if (y1 < y2) {
+		pixman_region32_union_rect(region, region, rect->x1, y1,
+			rect->x2 - rect->x1, y2 - y1);
+	}
+}
+
+/**
+ * Update the opaque pixels of the buffer by scanning the alpha channel of the
+ * damaged region only. Clients often use formats with an alpha channel for
+ * fully opaque content, which would otherwise defeat occlusion culling.
+ */
+static void surface_scan_alpha(struct wlr_surface *surface,
+		struct wlr_buffer *buffer) {
+	if (surface->current.buffer_width != surface->previous.buffer_width ||
+			surface->current.buffer_height != surface->previous.buffer_height) {
+		pixman_region32_clear(&surface->alpha_opaque);
+	}
+
+	void *data;
+	uint32_t format;
+	size_t stride;
+	if (!wlr_buffer_begin_data_ptr_access(buffer,
+			WLR_BUFFER_DATA_PTR_ACCESS_READ, &data, &format, &stride)) {
+		pixman_region32_clear(&surface->alpha_opaque);
+		return;
+	}
+	if (format != DRM_FORMAT_ARGB8888 && format != DRM_FORMAT_ABGR8888) {
+		wlr_buffer_end_data_ptr_access(buffer);
+		pixman_region32_clear(&surface->alpha_opaque);
+		surface->alpha_format = DRM_FORMAT_INVALID;
+		return;
+	}
+	if (format != surface->alpha_format) {
+		// Pixels outside of the damage were scanned in another format
+		pixman_region32_clear(&surface->alpha_opaque);
+		surface->alpha_format = format;
+	}
+
+	pixman_region32_t damage;
+	pixman_region32_init(&damage);
+	pixman_region32_intersect_rect(&damage, &surface->buffer_damage,
+		0, 0, buffer->width, buffer->height);
+	pixman_region32_intersect_rect(&surface->alpha_opaque,
+		&surface->alpha_opaque, 0, 0, buffer->width, buffer->height);
+	pixman_region32_subtract(&surface->alpha_opaque,
+		&surface->alpha_opaque, &damage);
+
+	int rects_len;
+	const pixman_box32_t *rects = pixman_region32_rectangles(&damage, &rects_len);
+	for (int i = 0; i < rects_len; i++) {
+		const pixman_box32_t *rect = &rects[i];
+		size_t len = rect->x2 - rect->x1;
+		int run_start = rect->y1;
+		for (int y = rect->y1; y < rect->y2; y++) {
+			const uint32_t *row = (const uint32_t *)((const char *)data +
+				(size_t)y * stride) + rect->x1;
+			if (!alpha_row_is_opaque(row, len)) {
+				alpha_opaque_add_rows(&surface->alpha_opaque, rect,
+					run_start, y);
+				run_start = y + 1;
+			}
+		}
+		alpha_opaque_add_rows(&surface->alpha_opaque, rect,
+			run_start, rect->y2);
+	}
+
+	pixman_region32_fini(&damage);
+	wlr_buffer_end_data_ptr_access(buffer);
+}
+
+/**
+ * Import the buffer into the renderers of the outputs the surface is on,
+ * while the client still can't reuse it.
+ */
+static void surface_import_textures(struct wlr_surface *surface,
+		struct wlr_client_buffer *buffer, struct wlr_buffer *source) {
+	struct wlr_surface_output *surface_output;
+	wl_list_for_each(surface_output, &surface->current_outputs, link) {
+		struct wlr_renderer *renderer = surface_output->output->renderer;
+		if (renderer != NULL) {
+			client_buffer_import_texture(buffer, renderer, source);
+		}
+	}
+}
+
 static void surface_apply_damage(struct wlr_surface *surface) {
 	if (surface->current.buffer == NULL) {
 		// NULL commit
@@ -348,14 +438,25 @@ static void surface_apply_damage(struct wlr_surface *surface) {
 		}
 		surface->buffer = NULL;
 		surface->opaque = false;
+		pixman_region32_clear(&surface->alpha_opaque);
+		surface->alpha_format = DRM_FORMAT_INVALID;
 		return;
 	}
 
 	surface->opaque = buffer_is_opaque(surface->current.buffer);
+	if (!surface->opaque && surface->alpha_scan) {
+		surface_scan_alpha(surface, surface->current.buffer);
+	} else {
+		// The scan only covers damage, start over when it's resumed
+		pixman_region32_clear(&surface->alpha_opaque);
+		surface->alpha_format = DRM_FORMAT_INVALID;
+	}
 
 	if (surface->buffer != NULL) {
 		if (wlr_client_buffer_apply_damage(surface->buffer,
 				surface->current.buffer, &surface->buffer_damage)) {
+			surface_import_textures(surface, surface->buffer,
+				surface->current.buffer);
 			wlr_buffer_unlock(surface->current.buffer);
 			surface->current.buffer = NULL;
 			return;
@@ -364,6 +465,13 @@ static void surface_apply_damage(struct wlr_surface *surface) {
 
 	struct wlr_client_buffer *buffer = wlr_client_buffer_create(
 			surface->current.buffer, surface->renderer);
+	if (buffer != NULL) {
+		if (surface->buffer != NULL) {
+			client_buffer_inherit_textures(buffer, surface->buffer,
+				surface->current.buffer);
+		}
+		surface_import_textures(surface, buffer, surface->current.buffer);
+	}
 
 	wlr_buffer_unlock(surface->current.buffer);
 	surface->current.buffer = NULL;
@@ -396,6 +504,39 @@ static void surface_update_opaque_region(struct wlr_surface *surface) {
 	pixman_region32_intersect_rect(&surface->opaque_region,
 		&surface->current.opaque,
 		0, 0, surface->current.width, surface->current.height);
+
+	struct wlr_surface_state *state = &surface->current;
+	if (!pixman_region32_not_empty(&surface->alpha_opaque) ||
+			state->viewport.has_src || state->viewport.has_dst) {
+		return;
+	}
+
+	// Convert to surface-local coordinates, rounding inwards so that
+	// partially covered surface pixels are never reported as opaque
+	pixman_region32_t alpha_opaque;
+	pixman_region32_init(&alpha_opaque);
+	wlr_region_transform(&alpha_opaque, &surface->alpha_opaque,
+		state->transform, state->buffer_width, state->buffer_height);
+
+	int scale = state->scale;
+	int rects_len;
+	const pixman_box32_t *rects =
+		pixman_region32_rectangles(&alpha_opaque, &rects_len);
+	for (int i = 0; i < rects_len; i++) {
+		int x1 = (rects[i].x1 + scale - 1) / scale;
+		int y1 = (rects[i].y1 + scale - 1) / scale;
+		int x2 = rects[i].x2 / scale;
+		int y2 = rects[i].y2 / scale;
+		if (x1 < x2 && y1 < y2) {
+			pixman_region32_union_rect(&surface->opaque_region,
+				&surface->opaque_region, x1, y1, x2 - x1, y2 - y1);
+		}
+	}
+	pixman_region32_fini(&alpha_opaque);
+
+	pixman_region32_intersect_rect(&surface->opaque_region,
+		&surface->opaque_region,
+		0, 0, surface->current.width, surface->current.height);
 }
 
 static void surface_update_input_region(struct wlr_surface *surface) {
@@ -640,6 +781,7 @@ static void surface_handle_resource_destroy(struct wl_resource *resource) {
 	pixman_region32_fini(&surface->external_damage);
 	pixman_region32_fini(&surface->opaque_region);
 	pixman_region32_fini(&surface->input_region);
+	pixman_region32_fini(&surface->alpha_opaque);
 	if (surface->buffer != NULL) {
 		wlr_buffer_unlock(&surface->buffer->base);
 	}
@@ -654,7 +796,8 @@ static void surface_handle_renderer_destroy(struct wl_listener *listener,
 }
 
 static struct wlr_surface *surface_create(struct wl_client *client,
-		uint32_t version, uint32_t id, struct wlr_renderer *renderer) {
+		uint32_t version, uint32_t id, struct wlr_compositor *compositor) {
+	struct wlr_renderer *renderer = compositor->renderer;
 	struct wlr_surface *surface = calloc(1, sizeof(struct wlr_surface));
 	if (!surface) {
 		wl_client_post_no_memory(client);
@@ -673,6 +816,7 @@ static struct wlr_surface *surface_create(struct wl_client *client,
 	wlr_log(WLR_DEBUG, "New wlr_surface %p (res %p)", surface, surface->resource);
 
 	surface->renderer = renderer;
+	surface->alpha_scan = compositor->alpha_scan;
 
 	surface_state_init(&surface->current);
 	surface_state_init(&surface->pending);
@@ -688,6 +832,7 @@ static struct wlr_surface *surface_create(struct wl_client *client,
 	pixman_region32_init(&surface->external_damage);
 	pixman_region32_init(&surface->opaque_region);
 	pixman_region32_init(&surface->input_region);
+	pixman_region32_init(&surface->alpha_opaque);
 	wlr_addon_set_init(&surface->addons);
 
 	wl_signal_add(&renderer->events.destroy, &surface->renderer_destroy);
@@ -1088,7 +1233,7 @@ static void compositor_create_surface(struct wl_client *client,
 	struct wlr_compositor *compositor = compositor_from_resource(resource);
 
 	struct wlr_surface *surface = surface_create(client,
-		wl_resource_get_version(resource), id, compositor->renderer);
+		wl_resource_get_version(resource), id, compositor);
 	if (surface == NULL) {
 		wl_client_post_no_memory(client);
 		return;
@@ -1144,6 +1289,7 @@ struct wlr_compositor *wlr_compositor_create(struct wl_display *display,
 		return NULL;
 	}
 	compositor->renderer = renderer;
+	compositor->alpha_scan = env_parse_bool("WLR_SURFACE_ALPHA_SCAN");
 
 	wl_signal_init(&compositor->events.new_surface);
 	wl_signal_init(&compositor->events.destroy);
@@ -5,13 +5,15 @@
 #include <wlr/types/wlr_damage_ring.h>
 #include <wlr/util/box.h>
 
-#define WLR_DAMAGE_RING_MAX_RECTS 20
+// Upper bound on the size of the tile grid, beyond which tiling is skipped
+#define MAX_TILES 4096
 
 void wlr_damage_ring_init(struct wlr_damage_ring *ring) {
 	memset(ring, 0, sizeof(*ring));
 
 	ring->width = INT_MAX;
 	ring->height = INT_MAX;
+	ring->max_rects = WLR_DAMAGE_RING_MAX_RECTS;
 
 	pixman_region32_init(&ring->current);
 	for (size_t i = 0; i < WLR_DAMAGE_RING_PREVIOUS_LEN; ++i) {
@@ -38,6 +40,102 @@ void wlr_damage_ring_set_bounds(struct wlr_damage_ring *ring,
 	wlr_damage_ring_add_whole(ring);
 }
 
+void wlr_damage_ring_set_rect_budget(struct wlr_damage_ring *ring,
+		int max_rects, int tile_size) {
+	ring->max_rects = max_rects > 0 ? max_rects : 1;
+	ring->tile_size = tile_size > 0 ? tile_size : 0;
+}
+
+static int floor_div(int a, int b) {
+	return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+/**
+ * Round the region out to a grid of tile_size tiles. Returns false if the
+ * grid would be too large.
+ */
+static bool region_snap_to_tiles(pixman_region32_t *region, int tile_size) {
+	pixman_box32_t *extents = pixman_region32_extents(region);
+	int tx1 = floor_div(extents->x1, tile_size);
+	int ty1 = floor_div(extents->y1, tile_size);
+	int tx2 = floor_div(extents->x2 + tile_size - 1, tile_size);
+	int ty2 = floor_div(extents->y2 + tile_size - 1, tile_size);
+	int cols = tx2 - tx1, rows = ty2 - ty1;
+	if ((int64_t)cols * rows > MAX_TILES) {
+		return false;
+	}
+
+	bool *grid = calloc((size_t)cols * rows, sizeof(*grid));
+	pixman_box32_t *boxes = calloc((size_t)cols * rows, sizeof(*boxes));
+	if (grid == NULL || boxes == NULL) {
+		free(grid);
+		free(boxes);
+		return false;
+	}
+
+	int n_rects;
+	pixman_box32_t *rects = pixman_region32_rectangles(region, &n_rects);
+	for (int i = 0; i < n_rects; i++) {
+		int x1 = floor_div(rects[i].x1, tile_size) - tx1;
+		int y1 = floor_div(rects[i].y1, tile_size) - ty1;
+		int x2 = floor_div(rects[i].x2 + tile_size - 1, tile_size) - tx1;
+		int y2 = floor_div(rects[i].y2 + tile_size - 1, tile_size) - ty1;
+		for (int y = y1; y < y2; y++) {
+			memset(&grid[y * cols + x1], true, (x2 - x1) * sizeof(*grid));
+		}
+	}
+
+	// Emit one box per horizontal run of damaged tiles, pixman coalesces
+	// identical runs on consecutive rows
+	int n_boxes = 0;
+	for (int y = 0; y < rows; y++) {
+		int x = 0;
+		while (x < cols) {
+			if (!grid[y * cols + x]) {
+				x++;
+				continue;
+			}
+			int start = x;
+			while (x < cols && grid[y * cols + x]) {
+				x++;
+			}
+			boxes[n_boxes++] = (pixman_box32_t){
+				.x1 = (tx1 + start) * tile_size,
+				.y1 = (ty1 + y) * tile_size,
+				.x2 = (tx1 + x) * tile_size,
+				.y2 = (ty1 + y + 1) * tile_size,
+			};
+		}
+	}
+
+	pixman_region32_fini(region);
+	pixman_region32_init_rects(region, boxes, n_boxes);
+	free(boxes);
+	free(grid);
+	return true;
+}
+
+static void ring_simplify(struct wlr_damage_ring *ring,
+		pixman_region32_t *region) {
+	if (pixman_region32_n_rects(region) <= ring->max_rects) {
+		return;
+	}
+
+	if (ring->tile_size > 0 && region_snap_to_tiles(region, ring->tile_size)) {
+		pixman_region32_intersect_rect(region, region,
+			0, 0, ring->width, ring->height);
+		if (pixman_region32_n_rects(region) <= ring->max_rects) {
+			return;
+		}
+	}
+
+	pixman_box32_t *extents = pixman_region32_extents(region);
+	pixman_region32_union_rect(region, region,
+		extents->x1, extents->y1,
+		extents->x2 - extents->x1,
+		extents->y2 - extents->y1);
+}
+
 bool wlr_damage_ring_add(struct wlr_damage_ring *ring,
 		pixman_region32_t *damage) {
 	pixman_region32_t clipped;
@@ -47,6 +145,7 @@ bool wlr_damage_ring_add(struct wlr_damage_ring *ring,
 	bool intersects = pixman_region32_not_empty(&clipped);
 	if (intersects) {
 		pixman_region32_union(&ring->current, &ring->current, &clipped);
+		ring_simplify(ring, &ring->current);
 	}
 	pixman_region32_fini(&clipped);
 	return intersects;
@@ -64,6 +163,7 @@ bool wlr_damage_ring_add_box(struct wlr_damage_ring *ring,
 		pixman_region32_union_rect(&ring->current,
 			&ring->current, clipped.x, clipped.y,
 			clipped.width, clipped.height);
+		ring_simplify(ring, &ring->current);
 		return true;
 	}
 	return false;
@@ -99,14 +199,6 @@ void wlr_damage_ring_get_buffer_damage(struct wlr_damage_ring *ring,
 			pixman_region32_union(damage, damage, &ring->previous[j]);
 		}
 
-		// Check the number of rectangles
-		int n_rects = pixman_region32_n_rects(damage);
-		if (n_rects > WLR_DAMAGE_RING_MAX_RECTS) {
-			pixman_box32_t *extents = pixman_region32_extents(damage);
-			pixman_region32_union_rect(damage, damage,
-				extents->x1, extents->y1,
-				extents->x2 - extents->x1,
-				extents->y2 - extents->y1);
-		}
+		ring_simplify(ring, damage);
 	}
 }
@@ -3,7 +3,6 @@
 #endif
 #include <assert.h>
 #include <string.h>
-#include <sys/mman.h>
 #include <unistd.h>
 #include <wayland-util.h>
 #include <wlr/types/wlr_compositor.h>
@@ -11,7 +10,6 @@
 #include <wlr/util/log.h>
 #include <xkbcommon/xkbcommon.h>
 #include "input-method-unstable-v2-protocol.h"
-#include "util/shm.h"
 
 // Note: zwp_input_popup_surface_v2 and zwp_input_method_keyboard_grab_v2 objects
 // become inert when the corresponding zwp_input_method_v2 is destroyed
@@ -304,30 +302,15 @@ void wlr_input_method_keyboard_grab_v2_send_modifiers(
 static bool keyboard_grab_send_keymap(
 		struct wlr_input_method_keyboard_grab_v2 *keyboard_grab,
 		struct wlr_keyboard *keyboard) {
-	int keymap_fd = allocate_shm_file(keyboard->keymap_size);
-	if (keymap_fd < 0) {
-		wlr_log(WLR_ERROR, "creating a keymap file for %zu bytes failed",
-			keyboard->keymap_size);
+	// The keyboard's keymap file is read-only and shared with wl_keyboard
+	if (keyboard->keymap_fd < 0) {
+		wlr_log(WLR_ERROR, "Keyboard has no keymap file");
 		return false;
 	}
 
-	void *ptr = mmap(NULL, keyboard->keymap_size, PROT_READ | PROT_WRITE,
-		MAP_SHARED, keymap_fd, 0);
-	if (ptr == MAP_FAILED) {
-		wlr_log(WLR_ERROR, "failed to mmap() %zu bytes",
-			keyboard->keymap_size);
-		close(keymap_fd);
-		return false;
-	}
-
-	memcpy(ptr, keyboard->keymap_string, keyboard->keymap_size);
-	munmap(ptr, keyboard->keymap_size);
-
 	zwp_input_method_keyboard_grab_v2_send_keymap(keyboard_grab->resource,
-		WL_KEYBOARD_KEYMAP_FORMAT_XKB_V1, keymap_fd,
+		WL_KEYBOARD_KEYMAP_FORMAT_XKB_V1, keyboard->keymap_fd,
 		keyboard->keymap_size);
-
-	close(keymap_fd);
 	return true;
 }
 
@@ -374,8 +357,7 @@ void wlr_input_method_keyboard_grab_v2_set_keyboard(
 
 	if (keyboard) {
 		if (keyboard_grab->keyboard == NULL ||
-				strcmp(keyboard_grab->keyboard->keymap_string,
-				keyboard->keymap_string) != 0) {
+				keyboard_grab->keyboard->keymap_shm != keyboard->keymap_shm) {
 			// send keymap only if it is changed, or if input method is not
 			// aware that it did not change and blindly send it back with
 			// virtual keyboard, it may cause an infinite recursion.
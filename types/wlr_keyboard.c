@@ -1,4 +1,7 @@
+#define _GNU_SOURCE // for memfd_create
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
@@ -12,6 +15,138 @@
 #include "util/shm.h"
 #include "util/time.h"
 
+#if defined(MFD_ALLOW_SEALING) && \
+		(!defined(__ANDROID__) || __ANDROID_API__ >= 30)
+#define HAVE_SEALED_MEMFD 1
+#else
+#define HAVE_SEALED_MEMFD 0
+#endif
+
+// Keymap files currently in use, see keymap_shm_get()
+static struct wl_list keymap_shms = { &keymap_shms, &keymap_shms };
+static uint64_t last_keymap_shm_id = 0;
+
+static uint64_t hash_keymap(const char *data, size_t size) {
+	// FNV-1a
+	uint64_t hash = 0xcbf29ce484222325;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= (unsigned char)data[i];
+		hash *= 0x100000001b3;
+	}
+	return hash;
+}
+
+#if HAVE_SEALED_MEMFD
+static int create_sealed_keymap_file(const char *data, size_t size) {
+	int fd = memfd_create("wlroots-keymap", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (fd < 0) {
+		return -1;
+	}
+
+	size_t written = 0;
+	while (written < size) {
+		ssize_t ret = write(fd, data + written, size - written);
+		if (ret < 0 && errno == EINTR) {
+			continue;
+		} else if (ret <= 0) {
+			close(fd);
+			return -1;
+		}
+		written += ret;
+	}
+
+	if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW |
+			F_SEAL_WRITE | F_SEAL_SEAL) != 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+#endif
+
+static int create_keymap_file(const char *data, size_t size) {
+#if HAVE_SEALED_MEMFD
+	int sealed_fd = create_sealed_keymap_file(data, size);
+	if (sealed_fd >= 0) {
+		return sealed_fd;
+	}
+#endif
+
+	int rw_fd = -1, ro_fd = -1;
+	if (!allocate_shm_file_pair(size, &rw_fd, &ro_fd)) {
+		wlr_log(WLR_ERROR, "Failed to allocate shm file for keymap");
+		return -1;
+	}
+
+	void *dst = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, rw_fd, 0);
+	if (dst == MAP_FAILED) {
+		wlr_log_errno(WLR_ERROR, "mmap failed");
+		close(rw_fd);
+		close(ro_fd);
+		return -1;
+	}
+
+	memcpy(dst, data, size);
+	munmap(dst, size);
+	close(rw_fd);
+	return ro_fd;
+}
+
+struct wlr_keymap_shm *keymap_shm_get(const char *keymap_string,
+		size_t size) {
+	uint64_t hash = hash_keymap(keymap_string, size);
+
+	struct wlr_keymap_shm *keymap_shm;
+	wl_list_for_each(keymap_shm, &keymap_shms, link) {
+		if (keymap_shm->hash == hash && keymap_shm->size == size &&
+				memcmp(keymap_shm->data, keymap_string, size) == 0) {
+			keymap_shm->n_refs++;
+			return keymap_shm;
+		}
+	}
+
+	keymap_shm = calloc(1, sizeof(*keymap_shm));
+	if (keymap_shm == NULL) {
+		return NULL;
+	}
+
+	keymap_shm->fd = create_keymap_file(keymap_string, size);
+	if (keymap_shm->fd < 0) {
+		free(keymap_shm);
+		return NULL;
+	}
+
+	void *data = mmap(NULL, size, PROT_READ, MAP_SHARED, keymap_shm->fd, 0);
+	if (data == MAP_FAILED) {
+		wlr_log_errno(WLR_ERROR, "mmap failed");
+		close(keymap_shm->fd);
+		free(keymap_shm);
+		return NULL;
+	}
+
+	keymap_shm->id = ++last_keymap_shm_id;
+	keymap_shm->hash = hash;
+	keymap_shm->size = size;
+	keymap_shm->data = data;
+	keymap_shm->n_refs = 1;
+	wl_list_insert(&keymap_shms, &keymap_shm->link);
+	return keymap_shm;
+}
+
+void keymap_shm_unref(struct wlr_keymap_shm *keymap_shm) {
+	if (keymap_shm == NULL) {
+		return;
+	}
+	assert(keymap_shm->n_refs > 0);
+	if (--keymap_shm->n_refs > 0) {
+		return;
+	}
+	wl_list_remove(&keymap_shm->link);
+	munmap((void *)keymap_shm->data, keymap_shm->size);
+	close(keymap_shm->fd);
+	free(keymap_shm);
+}
+
 struct wlr_keyboard *wlr_keyboard_from_input_device(
 		struct wlr_input_device *input_device) {
 	assert(input_device->type == WLR_INPUT_DEVICE_KEYBOARD);
@@ -157,9 +292,7 @@ void wlr_keyboard_finish(struct wlr_keyboard *kb) {
 	xkb_state_unref(kb->xkb_state);
 	xkb_keymap_unref(kb->keymap);
 	free(kb->keymap_string);
-	if (kb->keymap_fd >= 0) {
-		close(kb->keymap_fd);
-	}
+	keymap_shm_unref(kb->keymap_shm);
 }
 
 void wlr_keyboard_led_update(struct wlr_keyboard *kb, uint32_t leds) {
@@ -214,29 +347,15 @@ bool wlr_keyboard_set_keymap(struct wlr_keyboard *kb,
 	kb->keymap_string = tmp_keymap_string;
 	kb->keymap_size = strlen(kb->keymap_string) + 1;
 
-	int rw_fd = -1, ro_fd = -1;
-	if (!allocate_shm_file_pair(kb->keymap_size, &rw_fd, &ro_fd)) {
-		wlr_log(WLR_ERROR, "Failed to allocate shm file for keymap");
-		goto err;
-	}
-
-	void *dst = mmap(NULL, kb->keymap_size, PROT_READ | PROT_WRITE,
-		MAP_SHARED, rw_fd, 0);
-	if (dst == MAP_FAILED) {
-		wlr_log_errno(WLR_ERROR, "mmap failed");
-		close(rw_fd);
-		close(ro_fd);
+	struct wlr_keymap_shm *keymap_shm =
+		keymap_shm_get(kb->keymap_string, kb->keymap_size);
+	if (keymap_shm == NULL) {
+		wlr_log(WLR_ERROR, "Failed to create shm file for keymap");
 		goto err;
 	}
-
-	memcpy(dst, kb->keymap_string, kb->keymap_size);
-	munmap(dst, kb->keymap_size);
-	close(rw_fd);
-
-	if (kb->keymap_fd >= 0) {
-		close(kb->keymap_fd);
-	}
-	kb->keymap_fd = ro_fd;
+	keymap_shm_unref(kb->keymap_shm);
+	kb->keymap_shm = keymap_shm;
+	kb->keymap_fd = keymap_shm->fd;
 
 	for (size_t i = 0; i < kb->num_keycodes; ++i) {
 		xkb_keycode_t keycode = kb->keycodes[i] + 8;
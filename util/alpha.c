@@ -0,0 +1,59 @@
+#include "util/alpha.h"
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#define ALPHA_MASK 0xFF000000u
+
+bool alpha_row_is_opaque(const uint32_t *row, size_t len) {
+	size_t i = 0;
+
+	// AND all pixels together, the alpha byte stays at 0xFF only if every
+	// pixel is opaque. Bail out early once per vector block.
+#if defined(__AVX2__)
+	const __m256i mask256 = _mm256_set1_epi32((int)ALPHA_MASK);
+	for (; i + 32 <= len; i += 32) {
+		const __m256i *p = (const __m256i *)&row[i];
+		__m256i acc = _mm256_and_si256(
+			_mm256_and_si256(_mm256_loadu_si256(p), _mm256_loadu_si256(p + 1)),
+			_mm256_and_si256(_mm256_loadu_si256(p + 2), _mm256_loadu_si256(p + 3)));
+		acc = _mm256_and_si256(acc, mask256);
+		if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(acc, mask256)) != -1) {
+			return false;
+		}
+	}
+#endif
+#if defined(__SSE2__)
+	const __m128i mask128 = _mm_set1_epi32((int)ALPHA_MASK);
+	for (; i + 16 <= len; i += 16) {
+		const __m128i *p = (const __m128i *)&row[i];
+		__m128i acc = _mm_and_si128(
+			_mm_and_si128(_mm_loadu_si128(p), _mm_loadu_si128(p + 1)),
+			_mm_and_si128(_mm_loadu_si128(p + 2), _mm_loadu_si128(p + 3)));
+		acc = _mm_and_si128(acc, mask128);
+		if (_mm_movemask_epi8(_mm_cmpeq_epi32(acc, mask128)) != 0xFFFF) {
+			return false;
+		}
+	}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+	const uint32x4_t color_mask = vdupq_n_u32(~ALPHA_MASK);
+	for (; i + 16 <= len; i += 16) {
+		uint32x4_t acc = vandq_u32(
+			vandq_u32(vld1q_u32(&row[i]), vld1q_u32(&row[i + 4])),
+			vandq_u32(vld1q_u32(&row[i + 8]), vld1q_u32(&row[i + 12])));
+		acc = vorrq_u32(acc, color_mask);
+		if (vminvq_u32(acc) != UINT32_MAX) {
+			return false;
+		}
+	}
+#endif
+
+	uint32_t acc = ALPHA_MASK;
+	for (; i < len; i++) {
+		acc &= row[i];
+	}
+	return (acc & ALPHA_MASK) == ALPHA_MASK;
+}
@@ -36,3 +36,20 @@ ssize_t env_parse_switch(const char *option, const char **switches) {
 	wlr_log(WLR_ERROR, "Unknown %s option: %s", option, env);
 	return 0;
 }
+
+long env_parse_int(const char *option, long fallback) {
+	const char *env = getenv(option);
+	if (env) {
+		wlr_log(WLR_INFO, "Loading %s option: %s", option, env);
+	} else {
+		return fallback;
+	}
+
+	char *end;
+	long value = strtol(env, &end, 10);
+	if (*env == '\0' || *end != '\0') {
+		wlr_log(WLR_ERROR, "Unknown %s option: %s", option, env);
+		return fallback;
+	}
+	return value;
+}
@@ -1,6 +1,12 @@
 #define _XOPEN_SOURCE 700 // for snprintf
 #include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
 #include <stdarg.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -8,9 +14,16 @@
 #include <unistd.h>
 #include <wayland-server-core.h>
 #include <wlr/util/log.h>
+#include "util/env.h"
 #include "util/time.h"
 
+// Must be a power of two
+#define ASYNC_LOG_SLOTS 256
+#define ASYNC_LOG_MSG_SIZE 512
+
 static bool colored = true;
+static bool stderr_is_tty = false;
+static pthread_once_t stderr_is_tty_once = PTHREAD_ONCE_INIT;
 static enum wlr_log_importance log_importance = WLR_ERROR;
 static struct timespec start_time = {-1};
 
@@ -35,6 +48,30 @@ static void init_start_time(void) {
 	clock_gettime(CLOCK_MONOTONIC, &start_time);
 }
 
+static void init_stderr_is_tty(void) {
+	stderr_is_tty = isatty(STDERR_FILENO);
+}
+
+static bool use_colors(void) {
+	pthread_once(&stderr_is_tty_once, init_stderr_is_tty);
+	return colored && stderr_is_tty;
+}
+
+static unsigned verbosity_index(enum wlr_log_importance verbosity) {
+	return (verbosity < WLR_LOG_IMPORTANCE_LAST) ?
+		verbosity : WLR_LOG_IMPORTANCE_LAST - 1;
+}
+
+static int format_prefix(char *buf, size_t size, const struct timespec *ts,
+		enum wlr_log_importance verbosity) {
+	unsigned c = verbosity_index(verbosity);
+	return snprintf(buf, size, "%02d:%02d:%02d.%03ld %s%s",
+		(int)(ts->tv_sec / 60 / 60), (int)(ts->tv_sec / 60 % 60),
+		(int)(ts->tv_sec % 60), ts->tv_nsec / 1000000,
+		use_colors() ? verbosity_colors[c] : verbosity_headers[c],
+		use_colors() ? "" : " ");
+}
+
 static void log_stderr(enum wlr_log_importance verbosity, const char *fmt,
 		va_list args) {
 	init_start_time();
@@ -47,24 +84,216 @@ static void log_stderr(enum wlr_log_importance verbosity, const char *fmt,
 	clock_gettime(CLOCK_MONOTONIC, &ts);
 	timespec_sub(&ts, &ts, &start_time);
 
-	fprintf(stderr, "%02d:%02d:%02d.%03ld ", (int)(ts.tv_sec / 60 / 60),
-		(int)(ts.tv_sec / 60 % 60), (int)(ts.tv_sec % 60),
-		ts.tv_nsec / 1000000);
+	char prefix[64];
+	format_prefix(prefix, sizeof(prefix), &ts, verbosity);
+
+	flockfile(stderr);
+	fputs(prefix, stderr);
+	vfprintf(stderr, fmt, args);
+	fputs(use_colors() ? "\x1B[0m\n" : "\n", stderr);
+	funlockfile(stderr);
+}
+
+/*
+ * Asynchronous logger: messages are formatted on the calling thread into a
+ * bounded multi-producer ring and written to stderr by a background thread.
+ * Producers never block on stderr; when the ring is full the message is
+ * dropped and counted, except for errors which are written synchronously.
+ */
+struct async_log_slot {
+	atomic_size_t seq;
+	enum wlr_log_importance verbosity;
+	struct timespec ts;
+	char msg[ASYNC_LOG_MSG_SIZE];
+};
+
+static struct {
+	struct async_log_slot *slots;
+	atomic_size_t tail; // next slot to be claimed by a producer
+	size_t head; // next slot to be consumed, protected by consumer_mutex
+	pthread_mutex_t consumer_mutex;
+	sem_t pending;
+	pthread_t thread;
+	atomic_uint_fast64_t dropped;
+	uint64_t dropped_reported;
+	bool ready;
+} async_log = {
+	.consumer_mutex = PTHREAD_MUTEX_INITIALIZER,
+};
 
-	unsigned c = (verbosity < WLR_LOG_IMPORTANCE_LAST) ? verbosity : WLR_LOG_IMPORTANCE_LAST - 1;
+static pthread_once_t async_log_once = PTHREAD_ONCE_INIT;
 
-	if (colored && isatty(STDERR_FILENO)) {
-		fprintf(stderr, "%s", verbosity_colors[c]);
-	} else {
-		fprintf(stderr, "%s ", verbosity_headers[c]);
+static void async_log_write_slot(struct async_log_slot *slot) {
+	// The suffix is always written in full, even if the message is cut, so
+	// that colors don't leak into the following lines
+	const char *suffix = use_colors() ? "\x1B[0m\n" : "\n";
+	size_t suffix_len = strlen(suffix);
+
+	char line[ASYNC_LOG_MSG_SIZE + 96];
+	size_t max = sizeof(line) - suffix_len;
+	int ret = format_prefix(line, max, &slot->ts, slot->verbosity);
+	if (ret < 0) {
+		return;
 	}
+	size_t n = (size_t)ret < max ? (size_t)ret : max - 1;
+	ret = snprintf(line + n, max - n, "%s", slot->msg);
+	if (ret > 0) {
+		n += (size_t)ret < max - n ? (size_t)ret : max - n - 1;
+	}
+	memcpy(line + n, suffix, suffix_len);
+	n += suffix_len;
 
-	vfprintf(stderr, fmt, args);
+	size_t written = 0;
+	while (written < n) {
+		ssize_t w = write(STDERR_FILENO, line + written, n - written);
+		if (w < 0 && errno == EINTR) {
+			continue;
+		} else if (w <= 0) {
+			break;
+		}
+		written += w;
+	}
+}
+
+// Must be called with consumer_mutex held
+static bool async_log_consume_one(void) {
+	struct async_log_slot *slot =
+		&async_log.slots[async_log.head & (ASYNC_LOG_SLOTS - 1)];
+	size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+	if (seq != async_log.head + 1) {
+		return false;
+	}
+
+	async_log_write_slot(slot);
+
+	atomic_store_explicit(&slot->seq, async_log.head + ASYNC_LOG_SLOTS,
+		memory_order_release);
+	async_log.head++;
+
+	uint64_t dropped = atomic_load_explicit(&async_log.dropped,
+		memory_order_relaxed);
+	if (dropped != async_log.dropped_reported) {
+		char note[128];
+		int n = snprintf(note, sizeof(note),
+			"[wlr log] %" PRIu64 " message(s) dropped, ring full\n",
+			dropped - async_log.dropped_reported);
+		if (n > 0 && write(STDERR_FILENO, note, n) < 0) {
+			// Nothing sensible to do
+		}
+		async_log.dropped_reported = dropped;
+	}
+	return true;
+}
+
+static void async_log_flush(void) {
+	pthread_mutex_lock(&async_log.consumer_mutex);
+	while (async_log_consume_one()) {
+		// Drain
+	}
+	pthread_mutex_unlock(&async_log.consumer_mutex);
+}
+
+static void *async_log_thread(void *data) {
+	while (true) {
+		while (sem_wait(&async_log.pending) != 0 && errno == EINTR) {
+			// Retry
+		}
+		async_log_flush();
+	}
+	return NULL;
+}
+
+static void async_log_init(void) {
+	// Detect the terminal before the logging thread exists
+	use_colors();
+
+	async_log.slots = calloc(ASYNC_LOG_SLOTS, sizeof(*async_log.slots));
+	if (async_log.slots == NULL) {
+		return;
+	}
+	for (size_t i = 0; i < ASYNC_LOG_SLOTS; i++) {
+		atomic_init(&async_log.slots[i].seq, i);
+	}
+	atomic_init(&async_log.tail, 0);
+	atomic_init(&async_log.dropped, 0);
+
+	if (sem_init(&async_log.pending, 0, 0) != 0) {
+		free(async_log.slots);
+		async_log.slots = NULL;
+		return;
+	}
 
-	if (colored && isatty(STDERR_FILENO)) {
-		fprintf(stderr, "\x1B[0m");
+	// Block all signals in the logging thread so that they keep being
+	// delivered to the compositor's threads
+	sigset_t mask, old_mask;
+	sigfillset(&mask);
+	pthread_sigmask(SIG_SETMASK, &mask, &old_mask);
+	int ret = pthread_create(&async_log.thread, NULL, async_log_thread, NULL);
+	pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+	if (ret != 0) {
+		sem_destroy(&async_log.pending);
+		free(async_log.slots);
+		async_log.slots = NULL;
+		return;
 	}
-	fprintf(stderr, "\n");
+	pthread_detach(async_log.thread);
+
+	atexit(async_log_flush);
+	async_log.ready = true;
+}
+
+void wlr_log_stderr_async(enum wlr_log_importance verbosity, const char *fmt,
+		va_list args) {
+	init_start_time();
+
+	if (verbosity > log_importance) {
+		return;
+	}
+
+	pthread_once(&async_log_once, async_log_init);
+	if (!async_log.ready) {
+		log_stderr(verbosity, fmt, args);
+		return;
+	}
+
+	struct async_log_slot *slot;
+	size_t pos = atomic_load_explicit(&async_log.tail, memory_order_relaxed);
+	while (true) {
+		slot = &async_log.slots[pos & (ASYNC_LOG_SLOTS - 1)];
+		size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+		intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+		if (diff == 0) {
+			if (atomic_compare_exchange_weak_explicit(&async_log.tail, &pos,
+					pos + 1, memory_order_relaxed, memory_order_relaxed)) {
+				break;
+			}
+		} else if (diff < 0) {
+			// Ring is full: errors are still worth blocking for, after the
+			// queued messages so that the output stays in order
+			if (verbosity <= WLR_ERROR) {
+				async_log_flush();
+				log_stderr(verbosity, fmt, args);
+				return;
+			}
+			atomic_fetch_add_explicit(&async_log.dropped, 1,
+				memory_order_relaxed);
+			return;
+		} else {
+			pos = atomic_load_explicit(&async_log.tail, memory_order_relaxed);
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &slot->ts);
+	timespec_sub(&slot->ts, &slot->ts, &start_time);
+	slot->verbosity = verbosity;
+	vsnprintf(slot->msg, sizeof(slot->msg), fmt, args);
+
+	atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+	sem_post(&async_log.pending);
+}
+
+uint64_t wlr_log_get_dropped(void) {
+	return atomic_load_explicit(&async_log.dropped, memory_order_relaxed);
 }
 
 static wlr_log_func_t log_callback = log_stderr;
@@ -86,6 +315,8 @@ void wlr_log_init(enum wlr_log_importance verbosity, wlr_log_func_t callback) {
 	}
 	if (callback) {
 		log_callback = callback;
+	} else if (env_parse_bool("WLR_LOG_ASYNC")) {
+		log_callback = wlr_log_stderr_async;
 	}
 
 	wl_log_set_handler_server(log_wl);